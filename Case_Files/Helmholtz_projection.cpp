@@ -64,7 +64,11 @@ int main(int argc, char *argv[]) {
                         &seed_fname       = input.getCmdOption("--seed_file",       
                                                                "zero",                  
                                                                asked_help,
-                                                               "netCDF file containing initial guesses for Helmholtz scalars.\nUse 'zero' (the default) for no seed.");
+                                                               "netCDF file containing initial guesses for Helmholtz scalars.\nUse 'zero' (the default) for no seed."),
+                        &time_seed        = input.getCmdOption("--time_seed",
+                                                               "none",
+                                                               asked_help,
+                                                               "How to seed each time from the earlier times (at the same depth) on this processor.\n'none' (the default) uses seed_file, 'previous' uses the previous solution,\nand 'extrapolate' linearly extrapolates from the previous two solutions.");
 
     const std::string   &time_dim_name      = input.getCmdOption("--time",        
                                                                  "time",       
@@ -145,6 +149,12 @@ int main(int argc, char *argv[]) {
 
     if (asked_help) { return 0; }
 
+    if ( not( (time_seed == "none") or (time_seed == "previous") or (time_seed == "extrapolate") ) ) {
+        if (wRank == 0) { fprintf( stderr, "--time_seed must be one of none, previous, or extrapolate (got '%s').\n", time_seed.c_str() ); }
+        MPI_Finalize();
+        return -1;
+    }
+
     // Print processor assignments
     const int max_threads = omp_get_max_threads();
     omp_set_num_threads( max_threads );
@@ -248,7 +258,7 @@ int main(int argc, char *argv[]) {
 
     // Apply to projection routine
     Apply_Helmholtz_Projection( output_fname, source_data, Psi_seed, Phi_seed, single_seed, 
-            tolerance, max_iterations, use_area_weight, use_mask, Tikhov_Laplace );
+            tolerance, max_iterations, use_area_weight, use_mask, Tikhov_Laplace, time_seed );
 
     // Done!
     #if DEBUG >= 0
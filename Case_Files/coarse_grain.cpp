@@ -31,6 +31,7 @@
  * @param   --region_definitions_file
  * @param   --region_definitions_dim
  * @param   --region_definitions_var
+ * @param   --max_time_window
  *
  */
 int main(int argc, char *argv[]) {
@@ -127,6 +128,12 @@ int main(int argc, char *argv[]) {
     const int   Nprocs_in_time_input  = stoi(Nprocs_in_time_string),
                 Nprocs_in_depth_input = stoi(Nprocs_in_depth_string);
 
+    const std::string   &max_time_window_string = input.getCmdOption("--max_time_window",
+                                                                     "0",
+                                                                     asked_help,
+                                                                     "The most times that each processor holds in memory at once (0 means all of them).\nIf positive, the times are filtered in windows, reading the next window while filtering the current one.");
+    const int   max_time_window = stoi(max_time_window_string);
+
     const std::string   &zonal_vel_name    = input.getCmdOption("--zonal_vel",   "uo", asked_help,
                                                                 "Name of zonal (eastward) velocity in input file"),
                         &merid_vel_name    = input.getCmdOption("--merid_vel",   "vo", asked_help,
@@ -183,6 +190,9 @@ int main(int argc, char *argv[]) {
 
     // Apply some cleaning to the processor allotments if necessary. 
     source_data.check_processor_divisions( Nprocs_in_time_input, Nprocs_in_depth_input );
+
+    // Optionally, choose the time / depth divisions so that each processor has a similar amount of water to filter
+    if (constants::BALANCE_BY_WATER) { source_data.balance_processor_divisions( zonal_vel_name, input_fname ); }
      
     // Convert to radians, if appropriate
     if ( (latlon_in_degrees == "true") and (not(constants::CARTESIAN)) ) {
@@ -192,38 +202,45 @@ int main(int argc, char *argv[]) {
     // Compute the area of each 'cell' which will be necessary for integration
     source_data.compute_cell_areas();
 
-    // Read in the velocity fields
-    source_data.load_variable( "u_lon", zonal_vel_name, input_fname, true, true );
-    source_data.load_variable( "u_lat", merid_vel_name, input_fname, true, true );
+    // Optionally, only hold a window of the times at once
+    source_data.set_time_windows( max_time_window );
 
-    // Get the MPI-local dimension sizes
-    source_data.Ntime  = source_data.myCounts[0];
-    source_data.Ndepth = source_data.myCounts[1];
+    // Read in the fields for the current time window. With more than one window, 
+    //   this is also used to read the later windows (from the IO thread).
+    auto load_window = [&]( dataset & data ) {
 
-    // No u_r in inputs, so initialize as zero
-    source_data.variables.insert( std::pair< std::string, std::vector<double> >
-                                           ( "u_r",       std::vector<double>(source_data.variables.at("u_lon").size(), 0.) ) 
-                                );
+        // Read in the velocity fields
+        data.load_variable( "u_lon", zonal_vel_name, input_fname, true, true );
+        data.load_variable( "u_lat", merid_vel_name, input_fname, true, true );
 
-    if (constants::COMP_BC_TRANSFERS) {
-        // If desired, read in rho and p
-        source_data.load_variable( "rho", density_var_name,  input_fname, false, false );
-        source_data.load_variable( "p",   pressure_var_name, input_fname, false, false );
-    }
+        // Get the MPI-local dimension sizes
+        data.Ntime  = data.myCounts[0];
+        data.Ndepth = data.myCounts[1];
 
+        // No u_r in inputs, so initialize as zero
+        data.variables["u_r"].assign( data.variables.at("u_lon").size(), 0. );
 
+        if (constants::COMP_BC_TRANSFERS) {
+            // If desired, read in rho and p
+            data.load_variable( "rho", density_var_name,  input_fname, false, false );
+            data.load_variable( "p",   pressure_var_name, input_fname, false, false );
+        }
 
-    if ( not(constants::EXTEND_DOMAIN_TO_POLES) ) {
-        // Mask out the pole, if necessary (i.e. set lat = 90 to land)
-        mask_out_pole( source_data.latitude, source_data.mask, source_data.Ntime, source_data.Ndepth, source_data.Nlat, source_data.Nlon );
-    }
+        if ( not(constants::EXTEND_DOMAIN_TO_POLES) ) {
+            // Mask out the pole, if necessary (i.e. set lat = 90 to land)
+            mask_out_pole( data.latitude, data.mask, data.Ntime, data.Ndepth, data.Nlat, data.Nlon );
+        }
 
-    // If we're using FILTER_OVER_LAND, then the mask has been wiped out. Load in a mask that still includes land references
-    //      so that we have both. Will be used to get 'water-only' region areas.
-    if (constants::FILTER_OVER_LAND) { 
-        read_mask_from_file( source_data.reference_mask, zonal_vel_name, input_fname,
-               source_data.Nprocs_in_time, source_data.Nprocs_in_depth );
-    }
+        // If we're using FILTER_OVER_LAND, then the mask has been wiped out. Load in a mask that still includes land references
+        //      so that we have both. Will be used to get 'water-only' region areas.
+        if (constants::FILTER_OVER_LAND) { 
+            read_mask_from_file( data.reference_mask, zonal_vel_name, input_fname,
+                   data.Nprocs_in_time, data.Nprocs_in_depth, true, -1, 0., data.MPI_Comm_Global,
+                   &data.time_split_starts, &data.depth_split_starts,
+                   data.Itime_window, data.Ntime_windows );
+        }
+    };
+    load_window( source_data );
 
     // Read in the region definitions and compute region areas
     if ( check_file_existence( region_defs_fname ) ) {
@@ -299,7 +316,11 @@ int main(int argc, char *argv[]) {
     //// Now pass the arrays along to the filtering routines
     //
     const double pre_filter_time = MPI_Wtime();
-    filtering( source_data, filter_scales );
+    if (source_data.Ntime_windows > 1) {
+        filtering_streamed( source_data, filter_scales, load_window );
+    } else {
+        filtering( source_data, filter_scales );
+    }
     const double post_filter_time = MPI_Wtime();
 
     // Done!
@@ -13,6 +13,22 @@
 #include "../constants.hpp"
 #include "../fft_based.hpp"
 
+/*
+ * \brief Case file to coarse-grain velocity fields on periodic Cartesian grids using FFTs
+ *
+ * @param   --input_file            Filename for the primary input. (default is input.nc)
+ * @param   --time                  Name of the time dimension (default is time)
+ * @param   --depth                 Name of the depth dimension (default is depth)
+ * @param   --latitude
+ * @param   --longitude
+ * @param   --Nprocs_in_time
+ * @param   --Nprocs_in_depth
+ * @param   --zonal_vel
+ * @param   --merid_vel
+ * @param   --fftw_wisdom
+ * @param   --filter_scales
+ *
+ */
 int main(int argc, char *argv[]) {
 
     // Enable all floating point exceptions but FE_INEXACT
@@ -22,7 +38,6 @@ int main(int argc, char *argv[]) {
     //   and initialize the MPI world
     int thread_safety_provided;
     MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &thread_safety_provided);
-    MPI_Comm_set_errhandler(MPI_COMM_WORLD, MPI::ERRORS_THROW_EXCEPTIONS);
     //MPI_Status status;
     const double start_time = MPI_Wtime();
 
@@ -30,23 +45,6 @@ int main(int argc, char *argv[]) {
     MPI_Comm_rank( MPI_COMM_WORLD, &wRank );
     MPI_Comm_size( MPI_COMM_WORLD, &wSize );
 
-    // For the time being, hard-code the filter scales
-    //   include scales as a comma-separated list
-    //   scales are given in metres
-    // A zero scale will cause everything to nan out
-    std::vector<double> filter_scales {
-        //2, 3, 4, 5, 6, 7, 8, 9, 10, 15, 20, 25, 30, 35, 40, 45, 
-        //50, 55, 60, 65, 70, 75, 80, 85, 90, 95, 100, 128, 180
-        //150, 160, 170, 180, 190, 200, 210, 220, 230, 240, 250, 300, 400, 500
-
-        // 2d full-output
-        //10, 20, 45, 65
-
-        // Artifical Dataset
-        0.1, 0.5, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 12, 15, 17, 20
-
-    };
-
     //
     //// Parse command-line arguments
     //
@@ -55,17 +53,45 @@ int main(int argc, char *argv[]) {
         if (wRank == 0) { print_compile_info(NULL); } 
         return 0;
     }
+    const bool asked_help = input.cmdOptionExists("--help");
+    if (asked_help) {
+        fprintf( stdout, "\033[1;4mThe command-line input arguments [and default values] are:\033[0m\n" );
+    }
 
     // first argument is the flag, second argument is default value (for when flag is not present)
-    const std::string &input_fname       = input.getCmdOption("--input_file",  "input.nc");
-
-    const std::string &time_dim_name      = input.getCmdOption("--time",        "time");
-    const std::string &depth_dim_name     = input.getCmdOption("--depth",       "depth");
-    const std::string &latitude_dim_name  = input.getCmdOption("--latitude",    "latitude");
-    const std::string &longitude_dim_name = input.getCmdOption("--longitude",   "longitude");
-
-    const std::string &zonal_vel_name    = input.getCmdOption("--zonal_vel",   "uo");
-    const std::string &merid_vel_name    = input.getCmdOption("--merid_vel",   "vo");
+    const std::string &input_fname       = input.getCmdOption("--input_file",  "input.nc", asked_help,
+                                                              "netCDF file containing the input variables and grid.");
+
+    const std::string &time_dim_name      = input.getCmdOption("--time",        "time",      asked_help,
+                                                               "Name of 'time' dimension in netCDF input file.");
+    const std::string &depth_dim_name     = input.getCmdOption("--depth",       "depth",     asked_help,
+                                                               "Name of 'depth' dimension in netCDF input file.");
+    const std::string &latitude_dim_name  = input.getCmdOption("--latitude",    "latitude",  asked_help,
+                                                               "Name of 'latitude' (y) dimension in netCDF input file.");
+    const std::string &longitude_dim_name = input.getCmdOption("--longitude",   "longitude", asked_help,
+                                                               "Name of 'longitude' (x) dimension in netCDF input file.");
+
+    const std::string   &Nprocs_in_time_string  = input.getCmdOption("--Nprocs_in_time",  "1", asked_help,
+                                                                     "The number of MPI divisions in time."),
+                        &Nprocs_in_depth_string = input.getCmdOption("--Nprocs_in_depth", "1", asked_help,
+                                                                     "The number of MPI divisions in depth.");
+    const int   Nprocs_in_time_input  = stoi(Nprocs_in_time_string),
+                Nprocs_in_depth_input = stoi(Nprocs_in_depth_string);
+
+    const std::string &zonal_vel_name    = input.getCmdOption("--zonal_vel",   "uo", asked_help,
+                                                              "Name of x velocity in input file");
+    const std::string &merid_vel_name    = input.getCmdOption("--merid_vel",   "vo", asked_help,
+                                                              "Name of y velocity in input file");
+
+    const std::string &wisdom_fname      = input.getCmdOption("--fftw_wisdom", "fftw_wisdom.dat", asked_help,
+                                                              "File in which to keep the FFTW planning wisdom (\"none\" to not use one).");
+
+    // Also read in the filter scales from the commandline
+    //   e.g. --filter_scales "10.e3 150.76e3 1000e3" (units are in metres)
+    std::vector<double> filter_scales;
+    input.getFilterScales( filter_scales, "--filter_scales", asked_help );
+
+    if (asked_help) { return 0; }
 
     // Set OpenMP thread number
     const int max_threads = omp_get_max_threads();
@@ -74,11 +100,8 @@ int main(int argc, char *argv[]) {
     // Print some header info, depending on debug level
     print_header_info();
 
-    std::vector<double> longitude, latitude, time, depth;
-    std::vector<double> u_r, u_lon, u_lat, rho, p;
-    std::vector<bool> mask;
-    std::vector<int> myCounts, myStarts;
-    size_t II;
+    // Initialize dataset class instance
+    dataset source_data;
 
     // Read in source data / get size information
     #if DEBUG >= 1
@@ -86,62 +109,40 @@ int main(int argc, char *argv[]) {
     #endif
 
     // Read in the grid coordinates
-    read_var_from_file(time,      time_dim_name,      input_fname);
-    read_var_from_file(depth,     depth_dim_name,     input_fname);
-    read_var_from_file(latitude,  latitude_dim_name,  input_fname);
-    read_var_from_file(longitude, longitude_dim_name, input_fname);
-     
-    convert_coordinates(longitude, latitude);
+    source_data.load_time(      time_dim_name,      input_fname );
+    source_data.load_depth(     depth_dim_name,     input_fname );
+    source_data.load_latitude(  latitude_dim_name,  input_fname );
+    source_data.load_longitude( longitude_dim_name, input_fname );
 
-    // Read in the velocity fields
-    read_var_from_file(u_lon, zonal_vel_name, input_fname, &mask, &myCounts, &myStarts);
-    read_var_from_file(u_lat, merid_vel_name, input_fname, &mask, &myCounts, &myStarts);
+    // Apply some cleaning to the processor allotments if necessary. 
+    source_data.check_processor_divisions( Nprocs_in_time_input, Nprocs_in_depth_input );
 
-    // No u_r in inputs, so initialize as zero
-    u_r.resize(u_lon.size());
-    #pragma omp parallel default(none) private(II) shared(u_r)
-    { 
-        #pragma omp for collapse(1) schedule(static)
-        for (II = 0; II < u_r.size(); II++) {
-            u_r.at(II) = 0.;
-        }
-    }
+    // Compute the area of each 'cell' which will be necessary for integration
+    source_data.compute_cell_areas();
 
-    #if DEBUG >= 1
-    const int Ntime  = time.size();
-    const int Ndepth = depth.size();
-    #endif
-    const int Nlon   = longitude.size();
-    const int Nlat   = latitude.size();
+    // Read in the velocity fields
+    source_data.load_variable( "u_lon", zonal_vel_name, input_fname, true, true );
+    source_data.load_variable( "u_lat", merid_vel_name, input_fname, true, true );
 
-    #if DEBUG >= 1
-    fprintf(stdout, "Processor %d has (%d, %d, %d, %d) from (%d, %d, %d, %d)\n", 
-            wRank, 
-            myCounts[0], myCounts[1], myCounts[2], myCounts[3],
-            Ntime, Ndepth, Nlat, Nlon);
-    fflush(stdout);
-    MPI_Barrier(MPI_COMM_WORLD);
-    #endif
+    // Get the MPI-local dimension sizes
+    source_data.Ntime  = source_data.myCounts[0];
+    source_data.Ndepth = source_data.myCounts[1];
 
-    // Compute the area of each 'cell'
-    //   which will be necessary for integration
-    #if DEBUG >= 1
-    if (wRank == 0) { fprintf(stdout, "Computing the cell areas.\n\n"); }
-    #endif
+    // No u_r in inputs, so initialize as zero
+    source_data.variables.insert( std::pair< std::string, std::vector<double> >
+                                           ( "u_r", std::vector<double>(source_data.variables.at("u_lon").size(), 0.) ) 
+                                );
 
-    std::vector<double> areas(Nlon * Nlat);
-    compute_areas(areas, longitude, latitude);
+    // Post-processing uses a single region, which is the entire domain
+    source_data.region_names.push_back("full_domain");
+    source_data.regions.insert( std::pair< std::string, std::vector<bool> >( 
+                                "full_domain", std::vector<bool>( source_data.Nlat * source_data.Nlon, true) ) 
+            );
+    source_data.compute_region_areas();
 
     // Now pass the arrays along to the filtering routines
     const double pre_filter_time = MPI_Wtime();
-    filtering_fftw(
-            u_r, u_lon, u_lat,
-            rho, p,
-            filter_scales,
-            areas, 
-            time, depth,
-            longitude, latitude,
-            mask, myCounts, myStarts);
+    filtering_fftw( source_data, filter_scales, (wisdom_fname == "none") ? "" : wisdom_fname );
     const double post_filter_time = MPI_Wtime();
 
     // Done!
@@ -157,7 +158,9 @@ int main(int argc, char *argv[]) {
     }
     #endif
 
+    #if DEBUG >= 1
     fprintf(stdout, "Processor %d / %d waiting to finalize.\n", wRank + 1, wSize);
+    #endif
     MPI_Finalize();
     return 0;
 }
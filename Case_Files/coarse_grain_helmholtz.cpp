@@ -195,6 +195,9 @@ int main(int argc, char *argv[]) {
     // Apply some cleaning to the processor allotments if necessary. 
     source_data.check_processor_divisions( Nprocs_in_time_input, Nprocs_in_depth_input );
 
+    // Optionally, choose the time / depth divisions so that each processor has a similar amount of water to filter
+    if (constants::BALANCE_BY_WATER) { source_data.balance_processor_divisions( vel_field_var_name, vel_input_fname ); }
+
     // Load in the coarsened grid, if applicable
     if ( not( coarse_map_grid_fname == "none" ) ) {
         source_data.prepare_for_coarsened_grids( coarse_map_grid_fname );
@@ -262,7 +265,8 @@ int main(int argc, char *argv[]) {
     //      so that we have both. Will be used to get 'water-only' region areas.
     if (constants::FILTER_OVER_LAND) { 
         read_mask_from_file( source_data.reference_mask, vel_field_var_name, vel_input_fname,
-               source_data.Nprocs_in_time, source_data.Nprocs_in_depth );
+               source_data.Nprocs_in_time, source_data.Nprocs_in_depth, true, -1, 0., MPI_COMM_WORLD,
+               &source_data.time_split_starts, &source_data.depth_split_starts );
     }
 
     if ( constants::EXTEND_DOMAIN_TO_POLES ) {
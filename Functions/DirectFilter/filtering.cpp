@@ -1,6 +1,7 @@
 #include <math.h>
 #include <algorithm>
 #include <vector>
+#include <memory>
 #include <omp.h>
 #include <mpi.h>
 #include "../../functions.hpp"
@@ -15,15 +16,25 @@
  * loop sequences, calls the other funcations (velocity conversions), and
  * calls the IO functionality.
  *
- * @param[in]   source_data     dataset class instance containing data (velocities, etc)
+ * If source_data only holds one window of the times (see dataset::set_time_windows), then
+ * the output files are only created for the first window, and the other windows write into them.
+ *
+ * With FLOAT_FIELD_STORAGE (and COMP_BC_TRANSFERS), rho and p are moved out of source_data
+ * into single precision, and so are empty in source_data on return.
+ *
+ * @param[in,out]   source_data     dataset class instance containing data (velocities, etc)
  * @param[in]   scales          scales at which to filter the data
  * @param[in]   comm            MPI communicator (default MPI_COMM_WORLD)
+ * @param[in]   shared_writer   output queue to use (NULL to create one here), e.g. to share with the prefetching in filtering_streamed
+ * @param[in,out]   shared_workspace    working arrays to use (NULL to create them here), e.g. to re-use them for every window in filtering_streamed
  *
  */
 void filtering(
-        const dataset & source_data,
+        dataset & source_data,
         const std::vector<double> & scales,
-        const MPI_Comm comm
+        const MPI_Comm comm,
+        output_writer * shared_writer,
+        filtering_workspace * shared_workspace
         ) {
 
     // Create some tidy names for variables
@@ -36,9 +47,7 @@ void filtering(
 
     const std::vector<double>   &full_u_r   = source_data.variables.at("u_r"),
                                 &full_u_lon = source_data.variables.at("u_lon"),
-                                &full_u_lat = source_data.variables.at("u_lat"),
-                                &full_rho   = constants::COMP_BC_TRANSFERS ? source_data.variables.at("rho") : std::vector<double>(),
-                                &full_p     = constants::COMP_BC_TRANSFERS ? source_data.variables.at("p")   : std::vector<double>();
+                                &full_u_lat = source_data.variables.at("u_lat");
 
     // Get some MPI info
     int wRank, wSize;
@@ -68,12 +77,37 @@ void filtering(
     std::vector<const std::vector<double>*> postprocess_fields;
     std::vector<std::string> postprocess_names;
 
-    int LAT_lb, LAT_ub;
+    // Compressed kernel stencil (only the cells inside of the kernel support)
+    kernel_stencil local_stencil;
+
+    // Runs of water cells along each row, so that the filter loops don't need to check the mask
+    water_runs water;
+
+    // Latitude band (of target points) handled by this processor
+    latitude_bands bands;
+
+    // Output files are written through a queue (in the background if ASYNC_OUTPUT)
+    std::unique_ptr<output_writer> own_writer;
+    if (shared_writer == NULL) { own_writer.reset( new output_writer() ); }
+    output_writer & writer = (shared_writer == NULL) ? *own_writer : *shared_writer;
 
-    std::vector<double> local_kernel(Nlat * Nlon);
+    // Working arrays (which keep their storage between calls, if shared)
+    filtering_workspace own_workspace;
+    filtering_workspace & workspace = (shared_workspace == NULL) ? own_workspace : *shared_workspace;
 
-    std::vector<double> u_x(num_pts), u_y(num_pts), u_z(num_pts);
-    std::vector<double> coarse_u_r(num_pts), coarse_u_lon(num_pts), coarse_u_lat(num_pts);
+    // When streaming through time, the output files already exist after the first window
+    const bool create_outputs = (source_data.Itime_window == 0) and not(constants::NO_FULL_OUTPUTS);
+
+    // Subsampled grid for decimated outputs (see DECIMATE_OUTPUT_PTS_PER_SCALE), and its water runs
+    dataset decimated_data;
+    water_runs decimated_water;
+
+    // Block-averaged grids for filtering at large scales (see PYRAMID_MAX_SPACING_FRACTION)
+    resolution_pyramid pyramid;
+
+    std::vector<double> &coarse_u_r   = workspace.array( "coarse_u_r",   num_pts ),
+                        &coarse_u_lon = workspace.array( "coarse_u_lon", num_pts ),
+                        &coarse_u_lat = workspace.array( "coarse_u_lat", num_pts );
 
     if ( (constants::EXTEND_DOMAIN_TO_POLES) or (constants::FILTER_OVER_LAND) ) {
             vars_to_write.push_back("mask");
@@ -96,16 +130,27 @@ void filtering(
     postprocess_names.push_back( "coarse_u_lat");
     postprocess_fields.push_back(&coarse_u_lat);
 
-    int index, Itime, Idepth, Ilat, Ilon, tid;
-    // Now convert the Spherical velocities to Cartesian
-    //   (although we will still be on a spherical
-    //     coordinate system)
-    vel_Spher_to_Cart( u_x, u_y, u_z, full_u_r, full_u_lon, full_u_lat, source_data );
+    int index, out_index, Itime, Idepth, Ilat, Ilon, Jlat, Jlon, tid;
 
-    std::vector<double> full_KE(num_pts, 0.), KE_from_coarse_vel(num_pts, 0.);
+    std::vector<double> &KE_from_coarse_vel = workspace.array( "KE_from_coarse_vel", num_pts );
     postprocess_names.push_back( "coarse_KE");
     postprocess_fields.push_back(&KE_from_coarse_vel);
-    KE_from_vels(full_KE, &u_x, &u_y, &u_z, mask);
+
+    // Now convert the Spherical velocities to Cartesian
+    //   (although we will still be on a spherical
+    //     coordinate system), and then move them (and the KE)
+    //     into the storage used by the filters (see FLOAT_FIELD_STORAGE)
+    std::vector<filter_real> u_x, u_y, u_z, full_KE;
+    {
+        std::vector<double> full_u_x(num_pts), full_u_y(num_pts), full_u_z(num_pts), full_KE_vals(num_pts, 0.);
+        vel_Spher_to_Cart( full_u_x, full_u_y, full_u_z, full_u_r, full_u_lon, full_u_lat, source_data );
+        KE_from_vels(full_KE_vals, &full_u_x, &full_u_y, &full_u_z, mask);
+
+        move_to_filter_storage( u_x,     full_u_x     );
+        move_to_filter_storage( u_y,     full_u_y     );
+        move_to_filter_storage( u_z,     full_u_z     );
+        move_to_filter_storage( full_KE, full_KE_vals );
+    }
 
     // Compute the kernal alpha value (for baroclinic transfers)
     const double kern_alpha = kernel_alpha();
@@ -116,8 +161,12 @@ void filtering(
            u_r_tmp,     u_lon_tmp, u_lat_tmp,
            u_x_tilde,   u_y_tilde, u_z_tilde;
 
-    std::vector<double> fine_u_r, fine_u_lon, fine_u_lat,
-        div_J, fine_KE, filtered_KE;
+    std::vector<double> &fine_u_r    = workspace.array( "fine_u_r" ),
+                        &fine_u_lon  = workspace.array( "fine_u_lon" ),
+                        &fine_u_lat  = workspace.array( "fine_u_lat" ),
+                        &div_J       = workspace.array( "div_J" ),
+                        &fine_KE     = workspace.array( "fine_KE" ),
+                        &filtered_KE = workspace.array( "filtered_KE" );
 
     div_J.resize(num_pts);
     postprocess_names.push_back( "div_Jtransport");
@@ -149,17 +198,20 @@ void filtering(
 
     std::vector<double> null_vector(0);
 
-    std::vector<double> fine_vort_r, fine_vort_lat, fine_vort_lon,
-        coarse_vort_r, coarse_vort_lon, coarse_vort_lat,
-        full_vort_r,
-        div, OkuboWeiss;
+    std::vector<double> &fine_vort_r     = workspace.array( "fine_vort_r" ),
+                        &fine_vort_lat   = workspace.array( "fine_vort_lat" ),
+                        &fine_vort_lon   = workspace.array( "fine_vort_lon" ),
+                        &coarse_vort_r   = workspace.array( "coarse_vort_r" ),
+                        &coarse_vort_lon = workspace.array( "coarse_vort_lon" ),
+                        &coarse_vort_lat = workspace.array( "coarse_vort_lat" ),
+                        &div             = workspace.array( "div" ),
+                        &OkuboWeiss      = workspace.array( "OkuboWeiss" );
+    std::vector<filter_real> full_vort_r;
     if (constants::COMP_VORT) {
         #if DEBUG >= 1
         if (wRank == 0) { fprintf(stdout, "Initializing COMP_VORT fields.\n"); }
         #endif
 
-        full_vort_r.resize(num_pts);
-
         coarse_vort_r.resize(  num_pts);
         coarse_vort_lon.resize(num_pts);
         coarse_vort_lat.resize(num_pts);
@@ -197,11 +249,20 @@ void filtering(
 
     double uxux_tmp, uxuy_tmp, uxuz_tmp, uyuy_tmp, uyuz_tmp, uzuz_tmp, vort_ux_tmp, vort_uy_tmp, vort_uz_tmp;
     double KE_tmp;
-    std::vector<double> coarse_uxux, coarse_uxuy, coarse_uxuz,
-        coarse_uyuy, coarse_uyuz, coarse_uzuz, 
-        coarse_vort_ux, coarse_vort_uy, coarse_vort_uz,
-        coarse_u_x, coarse_u_y, coarse_u_z, 
-        energy_transfer, enstrophy_transfer;
+    std::vector<double> &coarse_uxux        = workspace.array( "coarse_uxux" ),
+                        &coarse_uxuy        = workspace.array( "coarse_uxuy" ),
+                        &coarse_uxuz        = workspace.array( "coarse_uxuz" ),
+                        &coarse_uyuy        = workspace.array( "coarse_uyuy" ),
+                        &coarse_uyuz        = workspace.array( "coarse_uyuz" ),
+                        &coarse_uzuz        = workspace.array( "coarse_uzuz" ),
+                        &coarse_vort_ux     = workspace.array( "coarse_vort_ux" ),
+                        &coarse_vort_uy     = workspace.array( "coarse_vort_uy" ),
+                        &coarse_vort_uz     = workspace.array( "coarse_vort_uz" ),
+                        &coarse_u_x         = workspace.array( "coarse_u_x" ),
+                        &coarse_u_y         = workspace.array( "coarse_u_y" ),
+                        &coarse_u_z         = workspace.array( "coarse_u_z" ),
+                        &energy_transfer    = workspace.array( "energy_transfer" ),
+                        &enstrophy_transfer = workspace.array( "enstrophy_transfer" );
     if (constants::COMP_TRANSFERS) {
         #if DEBUG >= 1
         if (wRank == 0) { fprintf(stdout, "Initializing COMP_TRANSFERS fields.\n"); }
@@ -251,9 +312,17 @@ void filtering(
 
 
     double rho_tmp, p_tmp;
-    std::vector<double> coarse_rho, coarse_p, fine_rho, fine_p, PEtoKE, 
-        tilde_u_r,    tilde_u_lon,    tilde_u_lat,
-        tilde_vort_r, tilde_vort_lon, tilde_vort_lat;
+    std::vector<double> &coarse_rho     = workspace.array( "coarse_rho" ),
+                        &coarse_p       = workspace.array( "coarse_p" ),
+                        &fine_rho       = workspace.array( "fine_rho" ),
+                        &fine_p         = workspace.array( "fine_p" ),
+                        &PEtoKE         = workspace.array( "PEtoKE" ),
+                        &tilde_u_r      = workspace.array( "tilde_u_r" ),
+                        &tilde_u_lon    = workspace.array( "tilde_u_lon" ),
+                        &tilde_u_lat    = workspace.array( "tilde_u_lat" ),
+                        &tilde_vort_r   = workspace.array( "tilde_vort_r" ),
+                        &tilde_vort_lon = workspace.array( "tilde_vort_lon" ),
+                        &tilde_vort_lat = workspace.array( "tilde_vort_lat" );
     if (constants::COMP_BC_TRANSFERS) {
         #if DEBUG >= 1
         if (wRank == 0) { fprintf(stdout, "Initializing COMP_BC_TRANSFERS fields.\n"); }
@@ -308,17 +377,27 @@ void filtering(
                 null_vector, null_vector, null_vector,
                 source_data, full_u_r, full_u_lon, full_u_lat );
 
-        compute_vorticity( full_vort_r, null_vector, null_vector, null_vector, null_vector,
+        std::vector<double> full_vort_r_tmp( constants::COMP_VORT ? num_pts : 0 );
+        compute_vorticity( full_vort_r_tmp, null_vector, null_vector, null_vector, null_vector,
                 null_vector, null_vector, null_vector,
                 source_data, full_u_r, full_u_lon, full_u_lat );
+        move_to_filter_storage( full_vort_r, full_vort_r_tmp );
 
     int perc_base = 5;
     int perc, perc_count=0;
 
     // Set up filtering vectors
     std::vector<double*> filtered_vals, tilde_vals;
+    std::vector<double> level_vals, level_tilde_vals, level_quad_vals;
     std::vector<bool> filt_use_mask;
-    std::vector<const std::vector<double>*> filter_fields;
+    std::vector<const std::vector<filter_real>*> filter_fields;
+
+    // rho and p are only read from the filter storage (by the filters, and for the fine rho and p),
+    //   so with FLOAT_FIELD_STORAGE the double-precision copies in source_data are released
+    std::vector<filter_real> rho_storage, p_storage;
+    const std::vector<filter_real>
+        &filter_rho = constants::COMP_BC_TRANSFERS ? release_to_filter_storage( rho_storage, source_data.variables.at("rho") ) : rho_storage,
+        &filter_p   = constants::COMP_BC_TRANSFERS ? release_to_filter_storage( p_storage,   source_data.variables.at("p")   ) : p_storage;
 
     filter_fields.push_back(&u_x);
     filt_use_mask.push_back(true);
@@ -333,13 +412,179 @@ void filtering(
     filt_use_mask.push_back(true);
 
     if (constants::COMP_BC_TRANSFERS) {
-        filter_fields.push_back(&full_rho);
+        filter_fields.push_back(&filter_rho);
         filt_use_mask.push_back(false);
 
-        filter_fields.push_back(&full_p);
+        filter_fields.push_back(&filter_p);
         filt_use_mask.push_back(false);
     }
 
+    // If the kernel can be rolled in longitude, then we can (optionally) filter
+    //   whole latitude rows at once using FFTs in longitude
+    //   (unless decimating the outputs, which only filters at a subset of points)
+    const bool decimate = ( constants::DECIMATE_OUTPUT_PTS_PER_SCALE > 0 );
+
+    // On Cartesian grids, Gaussian kernels can (optionally) be applied as two one-dimensional passes
+    const bool use_separable = (constants::SEPARABLE_CARTESIAN_FILTER) and not(decimate);
+
+    // With the TopHat kernel, each row of the disc can (optionally) be summed from prefix sums
+    const bool use_tophat_sums = (constants::TOPHAT_PREFIX_SUM_FILTER) and not(decimate) and not(use_separable);
+
+    // Gaussian kernels can (optionally) be approximated with recursive filters, at a cost that doesn't depend on scale
+    const bool use_iir = (constants::IIR_GAUSSIAN_FILTER) and not(decimate) and not(use_separable) and not(use_tophat_sums);
+
+    const bool use_lon_fft = (constants::USE_LON_FFT_FILTER) and (constants::PERIODIC_X) 
+                             and (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN) and not(decimate) 
+                             and not(use_separable) and not(use_tophat_sums) and not(use_iir);
+    std::vector<const std::vector<filter_real>*> null_factors, quad_fields, quad_factors,
+                                                 vel_fields = { &u_x, &u_y, &u_z };
+    std::vector<std::vector<double>*> null_outputs, precomputed_coarse, precomputed_tilde, quad_outputs;
+    std::vector<std::vector<double>> &precomputed_storage = workspace.array_sets[ "precomputed_storage" ],
+                                     &multiscale_storage  = workspace.array_sets[ "multiscale_storage"  ];
+
+    // Alternatively, we can (optionally) filter at every scale in a single sweep
+    const bool use_multiscale = (constants::MULTISCALE_SINGLE_PASS) and not(use_lon_fft) and not(decimate) 
+                                and not(use_separable) and not(use_tophat_sums) and not(use_iir);
+
+    // In any of these cases, the main loop only needs to collect the pre-computed filtered values
+    const bool precompute_every_scale = use_lon_fft or use_multiscale or use_separable or use_tophat_sums or use_iir;
+
+    // Large scales can (optionally) be filtered on a coarsened grid, and then interpolated back
+    //   (which also fills the pre-computed values, for the scales that use it)
+    const bool use_pyramid = (constants::PYRAMID_MAX_SPACING_FRACTION > 0) and not(use_multiscale) and not(decimate) 
+                             and not(use_separable) and not(use_tophat_sums) and not(use_iir);
+
+    // The quadratic terms are filtered as products formed on the fly: quad_fields[II] * quad_factors[II]
+    if (constants::COMP_TRANSFERS) {
+        quad_fields  = { &u_x, &u_x, &u_x, &u_y, &u_y, &u_z, &full_vort_r, &full_vort_r, &full_vort_r };
+        quad_factors = { &u_x, &u_y, &u_z, &u_y, &u_z, &u_z, &u_x,         &u_y,         &u_z         };
+        quad_outputs = { &coarse_uxux, &coarse_uxuy, &coarse_uxuz, &coarse_uyuy, &coarse_uyuz, &coarse_uzuz,
+                         &coarse_vort_ux, &coarse_vort_uy, &coarse_vort_uz };
+    }
+
+    // The mask doesn't change between scales, so compress it into water runs once
+    water.build( mask, Ntime, Ndepth, Nlat, Nlon );
+    #if DEBUG >= 1
+    if (wRank == 0) { fprintf(stdout, "Water fraction (rank 0): %g\n", water.water_fraction()); }
+    #endif
+
+    // Processors that share the same times and depths balance the filtering work by splitting the
+    //   target latitudes between them (the source fields are not split, so this doesn't reduce memory).
+    //   Each one only computes (and writes) the rows in its own band, with a halo of filtered rows
+    //   from its neighbours so that derivatives are correct within the band.
+    bands.build( source_data, &water, source_data.MPI_subcomm_sametimedepths );
+    const int   Ilat_start  = bands.first_row(),
+                Ilat_end    = bands.end_row(),
+                Nlevels     = Ntime * Ndepth;
+    #if DEBUG >= 1
+    if ( (wRank == 0) and (bands.Nbands > 1) ) {
+        fprintf(stdout, "Balancing the filtering over %d latitude bands (rank 0 has [%d, %d)).\n", bands.Nbands, Ilat_start, Ilat_end);
+    }
+    #endif
+
+    if (use_lon_fft or use_pyramid or use_separable or use_tophat_sums or use_iir) {
+        workspace.array_set( "precomputed_storage", filter_fields.size() + ( constants::COMP_BC_TRANSFERS ? 3 : 0 ), num_pts );
+        for (size_t II = 0; II < filter_fields.size(); II++) { precomputed_coarse.push_back( &precomputed_storage.at(II) ); }
+        if (constants::COMP_BC_TRANSFERS) {
+            for (size_t II = 0; II < 3; II++) { precomputed_tilde.push_back( &precomputed_storage.at(filter_fields.size() + II) ); }
+        }
+    }
+
+    if (use_pyramid) {
+        if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
+        pyramid.build( source_data, *std::max_element( scales.begin(), scales.end() ) );
+        if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "build_pyramid"); }
+        #if DEBUG >= 1
+        if (wRank == 0) {
+            for (int Igrid = 1; Igrid < pyramid.Ngrids; Igrid++) {
+                fprintf(stdout, "Pyramid grid %d: %d x %d blocks (%d x %d points, spacing %.4g km)\n", Igrid,
+                        pyramid.block_sizes.at(Igrid), pyramid.block_sizes.at(Igrid), 
+                        pyramid.grids.at(Igrid).Nlat, pyramid.grids.at(Igrid).Nlon, pyramid.spacings.at(Igrid) / 1e3);
+            }
+        }
+        #endif
+    }
+
+    if (use_multiscale) {
+        //
+        //// Walk the stencil for the largest scale once per point, and filter at every scale at the same time.
+        ////   multiscale_storage[ Iscale * Nout + Iout ] holds the filtered fields (linear, then quadratics, then tilde)
+        //
+        const int   Nlinear = filter_fields.size(),
+                    Nquad   = quad_fields.size(),
+                    Ntilde  = constants::COMP_BC_TRANSFERS ? vel_fields.size() : 0,
+                    Nout    = Nlinear + Nquad + Ntilde;
+        workspace.array_set( "multiscale_storage", Nscales * Nout, num_pts );
+
+        #if DEBUG >= 1
+        if (wRank == 0) { fprintf(stdout, "Filtering all %d scales in a single sweep.\n", Nscales); }
+        #endif
+
+        const double sweep_clock = MPI_Wtime();
+        if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
+        #pragma omp parallel \
+        default(none) \
+        shared( source_data, scales, filter_fields, null_factors, quad_fields, quad_factors, vel_fields, \
+                filter_rho, multiscale_storage, water ) \
+        private( Ilat, Ilon, Itime, Idepth, index, local_stencil, level_vals, level_quad_vals, level_tilde_vals ) \
+        firstprivate( Nlon, Nlat, Ndepth, Ntime, Nscales, Nlinear, Nquad, Ntilde, Nout, Nlevels, \
+                      Ilat_start, Ilat_end )
+        {
+            #pragma omp for collapse(1) schedule(dynamic)
+            for (Ilat = Ilat_start; Ilat < Ilat_end; Ilat++) {
+
+                // Rolling in longitude lets us build the (multi-scale) stencil once per latitude
+                if ( (constants::PERIODIC_X) and (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN) ) {
+                    local_stencil.build( source_data, scales, Ilat, 0 );
+                }
+
+                for (Ilon = 0; Ilon < Nlon; Ilon++) {
+                    if ( not( (constants::PERIODIC_X) and (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN) ) ) {
+                        local_stencil.build( source_data, scales, Ilat, Ilon );
+                    }
+
+                    apply_filter_at_point_multiscale( level_vals, filter_fields, null_factors, 
+                            source_data, Ilat, Ilon, local_stencil, NULL, true, &water );
+                    if (constants::COMP_TRANSFERS) {
+                        apply_filter_at_point_multiscale( level_quad_vals, quad_fields, quad_factors, 
+                                source_data, Ilat, Ilon, local_stencil, NULL, true, &water );
+                    }
+                    if (constants::COMP_BC_TRANSFERS) {
+                        apply_filter_at_point_multiscale( level_tilde_vals, vel_fields, null_factors, 
+                                source_data, Ilat, Ilon, local_stencil, &filter_rho, true, &water );
+                    }
+
+                    for (Itime = 0; Itime < Ntime; Itime++) {
+                        for (Idepth = 0; Idepth < Ndepth; Idepth++) {
+                            index = Index(Itime, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon);
+                            if ( not(source_data.mask.at(index)) ) { continue; }
+
+                            const int Ilev = Itime * Ndepth + Idepth;
+                            for (int Iscale = 0; Iscale < Nscales; Iscale++) {
+                                for (int II = 0; II < Nlinear; II++) {
+                                    multiscale_storage.at( Iscale * Nout + II ).at(index) 
+                                        = level_vals.at( ( Iscale * Nlevels + Ilev ) * Nlinear + II );
+                                }
+                                for (int II = 0; II < Nquad; II++) {
+                                    multiscale_storage.at( Iscale * Nout + Nlinear + II ).at(index) 
+                                        = level_quad_vals.at( ( Iscale * Nlevels + Ilev ) * Nquad + II );
+                                }
+                                for (int II = 0; II < Ntilde; II++) {
+                                    multiscale_storage.at( Iscale * Nout + Nlinear + Nquad + II ).at(index) 
+                                        = level_tilde_vals.at( ( Iscale * Nlevels + Ilev ) * Ntilde + II );
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "filter_multiscale_sweep"); }
+        #if DEBUG >= 0
+        print_load_imbalance( MPI_Wtime() - sweep_clock, "multiscale sweep", comm );
+        #endif
+    }
+
     //
     //// Begin the main filtering loop
     //
@@ -348,13 +593,59 @@ void filtering(
     #endif
     for (int Iscale = 0; Iscale < Nscales; Iscale++) {
 
+        // Output grid for this scale. If decimating, the filter is only applied at
+        //   source point (Jlat * lat_stride, Jlon * lon_stride) for output point (Jlat, Jlon)
+        int lat_stride, lon_stride;
+        get_decimation_strides( lat_stride, lon_stride, source_data, scales.at(Iscale) );
+        const bool is_decimated = (lat_stride > 1) or (lon_stride > 1);
+        if (is_decimated) {
+            // Queued output operations might still refer to the previous output grid
+            writer.flush();
+            decimated_data.subsample_from( source_data, lat_stride, lon_stride );
+            decimated_water.build( decimated_data.mask, Ntime, Ndepth, decimated_data.Nlat, decimated_data.Nlon );
+        }
+        const dataset & output_data = is_decimated ? decimated_data : source_data;
+        const std::vector<bool> & out_mask = output_data.mask;
+        const int   Nlat_out    = output_data.Nlat,
+                    Nlon_out    = output_data.Nlon;
+        counts[2] = Nlat_out;
+        counts[3] = Nlon_out;
+
+        if (decimate) {
+            #if DEBUG >= 0
+            if (wRank == 0) { 
+                fprintf(stdout, "\nOutput grid strides (lat, lon) = (%d, %d), giving %d x %d points\n", 
+                        lat_stride, lon_stride, Nlat_out, Nlon_out); 
+            }
+            #endif
+            for ( std::vector<double> * field : { &coarse_u_r, &coarse_u_lon, &coarse_u_lat, &KE_from_coarse_vel,
+                                                  &fine_u_r, &fine_u_lon, &fine_u_lat, &div_J, &filtered_KE, &fine_KE,
+                                                  &coarse_vort_r, &coarse_vort_lon, &coarse_vort_lat, &div, &OkuboWeiss,
+                                                  &fine_vort_r, &fine_vort_lon, &fine_vort_lat,
+                                                  &coarse_uxux, &coarse_uxuy, &coarse_uxuz, &coarse_uyuy, &coarse_uyuz, &coarse_uzuz,
+                                                  &coarse_vort_ux, &coarse_vort_uy, &coarse_vort_uz,
+                                                  &coarse_u_x, &coarse_u_y, &coarse_u_z, &energy_transfer, &enstrophy_transfer,
+                                                  &coarse_rho, &coarse_p, &fine_rho, &fine_p, &PEtoKE,
+                                                  &tilde_u_r, &tilde_u_lon, &tilde_u_lat, 
+                                                  &tilde_vort_r, &tilde_vort_lon, &tilde_vort_lat } ) {
+                if (field->size() > 0) { field->assign( Nlevels * Nlat_out * Nlon_out, 0. ); }
+            }
+        }
+
+        // Split the output latitudes between the processors that share the same times and depths
+        bands.build( output_data, is_decimated ? &decimated_water : &water, source_data.MPI_subcomm_sametimedepths );
+        const int   Jlat_start  = bands.first_row(),
+                    Jlat_end    = bands.end_row();
+        writer.set_latitude_band( Jlat_start, Jlat_end, Nlat_out );
+
         // Create the output file
         snprintf(fname, 50, "filter_%.6gkm.nc", scales.at(Iscale)/1e3);
-        if (not(constants::NO_FULL_OUTPUTS)) {
-            initialize_output_file( source_data, vars_to_write, fname, scales.at(Iscale));
+        if (create_outputs) {
+            writer.initialize_file( output_data, vars_to_write, fname, scales.at(Iscale));
 
             // Add some attributes to the file
-            add_attr_to_file("kernel_alpha", kern_alpha, fname);
+            writer.add_attr("kernel_alpha", kern_alpha, fname);
+            writer.add_attr("kernel_radius", kernel_pad() * scales.at(Iscale) / 2., fname);
         }
 
         #if DEBUG >= 0
@@ -367,6 +658,124 @@ void filtering(
         scale = scales.at(Iscale);
         perc  = perc_base;
 
+        // Which grid of the pyramid to filter on (zero is the source grid)
+        const int Igrid = use_pyramid ? pyramid.grid_for_scale( scale ) : 0;
+        const bool use_precomputed = precompute_every_scale or (Igrid > 0);
+
+        // Wall time for the filtering on this processor, to compare across processors
+        const double filter_clock = MPI_Wtime();
+
+        if (Igrid > 0) {
+            // Filter on the coarsened grid, and interpolate back onto this processor's latitude band.
+            //   The main loop below then only needs to collect the results (as for the FFT filter).
+            if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
+            apply_filter_via_pyramid( precomputed_coarse, filter_fields, null_factors, source_data, 
+                    pyramid, Igrid, scale, Jlat_start, Jlat_end );
+            if (constants::COMP_TRANSFERS) {
+                apply_filter_via_pyramid( quad_outputs, quad_fields, quad_factors, source_data, 
+                        pyramid, Igrid, scale, Jlat_start, Jlat_end );
+            }
+            if (constants::COMP_BC_TRANSFERS) {
+                apply_filter_via_pyramid( precomputed_tilde, vel_fields, null_factors, source_data, 
+                        pyramid, Igrid, scale, Jlat_start, Jlat_end, &filter_rho );
+            }
+            if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "filter_via_pyramid"); }
+
+            #if DEBUG >= 1
+            const double pyramid_error = pyramid_filter_error( precomputed_coarse, filter_fields, source_data, 
+                    scale, Jlat_start, Jlat_end, 64, &water );
+            if (wRank == 0) { 
+                fprintf(stdout, "  filtering on pyramid grid %d (spacing %.4g km), sampled relative error %.3g\n", 
+                        Igrid, pyramid.spacings.at(Igrid) / 1e3, pyramid_error); 
+            }
+            if (create_outputs) { writer.add_attr("pyramid_relative_error", pyramid_error, fname); }
+            #endif
+            if (create_outputs) { writer.add_attr("pyramid_spacing", pyramid.spacings.at(Igrid), fname); }
+        } else if (use_separable) {
+            // Sum along rows, and then along columns, for this processor's latitude band.
+            //   The main loop below then only needs to collect the results.
+            if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
+            apply_filter_separable( precomputed_coarse, filter_fields, null_factors, source_data, 
+                    scale, Jlat_start, Jlat_end );
+            if (constants::COMP_TRANSFERS) {
+                apply_filter_separable( quad_outputs, quad_fields, quad_factors, source_data, 
+                        scale, Jlat_start, Jlat_end );
+            }
+            if (constants::COMP_BC_TRANSFERS) {
+                apply_filter_separable( precomputed_tilde, vel_fields, null_factors, source_data, 
+                        scale, Jlat_start, Jlat_end, &filter_rho );
+            }
+            if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "filter_separable"); }
+        } else if (use_tophat_sums) {
+            // Sum each row of the disc from prefix sums, for this processor's latitude band.
+            //   The main loop below then only needs to collect the results.
+            if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
+            apply_filter_tophat( precomputed_coarse, filter_fields, null_factors, source_data, 
+                    scale, Jlat_start, Jlat_end );
+            if (constants::COMP_TRANSFERS) {
+                apply_filter_tophat( quad_outputs, quad_fields, quad_factors, source_data, 
+                        scale, Jlat_start, Jlat_end );
+            }
+            if (constants::COMP_BC_TRANSFERS) {
+                apply_filter_tophat( precomputed_tilde, vel_fields, null_factors, source_data, 
+                        scale, Jlat_start, Jlat_end, &filter_rho );
+            }
+            if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "filter_tophat_sums"); }
+        } else if (use_iir) {
+            // Recursive filters along longitude and then latitude, for this processor's latitude band.
+            //   The main loop below then only needs to collect the results.
+            if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
+            apply_filter_iir( precomputed_coarse, filter_fields, null_factors, source_data, 
+                    scale, Jlat_start, Jlat_end );
+            if (constants::COMP_TRANSFERS) {
+                apply_filter_iir( quad_outputs, quad_fields, quad_factors, source_data, 
+                        scale, Jlat_start, Jlat_end );
+            }
+            if (constants::COMP_BC_TRANSFERS) {
+                apply_filter_iir( precomputed_tilde, vel_fields, null_factors, source_data, 
+                        scale, Jlat_start, Jlat_end, &filter_rho );
+            }
+            if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "filter_iir"); }
+
+            #if DEBUG >= 1
+            const double iir_error = pyramid_filter_error( precomputed_coarse, filter_fields, source_data, 
+                    scale, Jlat_start, Jlat_end, 64, &water );
+            if (wRank == 0) { fprintf(stdout, "  recursive filter, sampled relative error %.3g\n", iir_error); }
+            if (create_outputs) { writer.add_attr("iir_relative_error", iir_error, fname); }
+            #endif
+        } else if (use_lon_fft) {
+            // Filter whole latitude rows of this processor's band at once. The main loop below then only
+            //   needs to collect the results and convert them back to spherical coordinates.
+            if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
+            apply_filter_via_lon_fft( precomputed_coarse, null_outputs, null_outputs, NULL, NULL,
+                    filter_fields, null_factors, source_data, scale, Jlat_start, Jlat_end );
+            if (constants::COMP_TRANSFERS) {
+                apply_filter_via_lon_fft( quad_outputs, null_outputs, null_outputs, NULL, NULL,
+                        quad_fields, quad_factors, source_data, scale, Jlat_start, Jlat_end );
+            }
+            if (constants::COMP_BC_TRANSFERS) {
+                apply_filter_via_lon_fft( precomputed_tilde, null_outputs, null_outputs, NULL, NULL,
+                        vel_fields, null_factors, source_data, scale, Jlat_start, Jlat_end, &filter_rho );
+            }
+            if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "filter_via_lon_fft"); }
+        } else if (use_multiscale) {
+            // Everything was already filtered in the single sweep, so just point to this scale's outputs
+            const int   Nlinear = filter_fields.size(),
+                        Nquad   = quad_fields.size(),
+                        Nout    = multiscale_storage.size() / Nscales;
+            precomputed_coarse.clear();
+            precomputed_tilde.clear();
+            for (int II = 0; II < Nlinear; II++) { 
+                precomputed_coarse.push_back( &multiscale_storage.at( Iscale * Nout + II ) ); 
+            }
+            for (int II = 0; II < Nquad; II++) { 
+                *(quad_outputs.at(II)) = multiscale_storage.at( Iscale * Nout + Nlinear + II ); 
+            }
+            for (int II = Nlinear + Nquad; II < Nout; II++) { 
+                precomputed_tilde.push_back( &multiscale_storage.at( Iscale * Nout + II ) ); 
+            }
+        }
+
         #if DEBUG >= 1
         if (wRank == 0) { fprintf(stdout, "  filtering: "); }
         fflush(stdout);
@@ -375,7 +784,9 @@ void filtering(
         #pragma omp parallel \
         default(none) \
         shared( source_data, mask, u_x, u_y, u_z, stdout, \
-                filter_fields, filt_use_mask, \
+                filter_fields, filt_use_mask, null_vector, null_factors, \
+                vel_fields, quad_fields, quad_factors, \
+                precomputed_coarse, precomputed_tilde, water, \
                 timing_records, clock_on, \
                 longitude, latitude, scale,\
                 full_KE, filtered_KE, fine_KE, \
@@ -386,10 +797,10 @@ void filtering(
                 coarse_uxux, coarse_uxuy, coarse_uxuz,\
                 coarse_uyuy, coarse_uyuz, coarse_uzuz,\
                 coarse_vort_ux, coarse_vort_uy, coarse_vort_uz,\
-                full_rho, full_p, coarse_rho, coarse_p,\
+                filter_rho, filter_p, coarse_rho, coarse_p,\
                 fine_rho, fine_p, PEtoKE,\
                 fine_u_r, fine_u_lon, fine_u_lat, perc_base)\
-        private(Itime, Idepth, Ilat, Ilon, index, \
+        private(Itime, Idepth, Ilat, Ilon, Jlat, Jlon, index, out_index, \
                 u_x_tmp, u_y_tmp, u_z_tmp,\
                 u_x_tilde, u_y_tilde, u_z_tilde,\
                 u_r_tmp, u_lat_tmp, u_lon_tmp,\
@@ -397,9 +808,10 @@ void filtering(
                 uyuy_tmp, uyuz_tmp, uzuz_tmp,\
                 vort_ux_tmp, vort_uy_tmp, vort_uz_tmp,\
                 KE_tmp, rho_tmp, p_tmp,\
-                LAT_lb, LAT_ub, tid, filtered_vals, tilde_vals ) \
-        firstprivate(perc, wRank, local_kernel, perc_count,\
-                     Nlon, Nlat, Ndepth, Ntime )
+                tid, filtered_vals, tilde_vals ) \
+        firstprivate(perc, wRank, local_stencil, perc_count, level_vals, level_tilde_vals, level_quad_vals, \
+                     Nlon, Nlat, Ndepth, Ntime, use_precomputed, Jlat_start, Jlat_end, \
+                     lat_stride, lon_stride, Nlat_out, Nlon_out )
         {
 
             tid = omp_get_thread_num();
@@ -431,29 +843,24 @@ void filtering(
             }
 
             #pragma omp for collapse(1) schedule(dynamic)
-            for (Ilat = 0; Ilat < Nlat; Ilat++) {
+            for (Jlat = Jlat_start; Jlat < Jlat_end; Jlat++) {
 
-                get_lat_bounds(LAT_lb, LAT_ub, latitude,  Ilat, scale); 
-                #if DEBUG >= 3
-                if (wRank == 0) { fprintf(stdout, "Ilat (%d) has loop bounds %d and %d.\n", Ilat, LAT_lb, LAT_ub); }
-                #endif
+                Ilat = Jlat * lat_stride;
 
                 // If our longitude grid is uniform, and spans the full periodic domain,
-                // then we can just compute it once and translate it at each lon index
-                if ( (constants::PERIODIC_X) and (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN) ) {
-                    //#if DEBUG >= 3
-                    //if (wRank == 0) { fprintf(stdout, "  computing local kernel ... "); }
-                    //#endif
+                // then we can just compute the stencil once and translate it at each lon index
+                if ( (constants::PERIODIC_X) and (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN) and not(use_precomputed) ) {
                     if ( (constants::DO_TIMING) and (tid == 0) ) { clock_on = MPI_Wtime(); }
-                    std::fill(local_kernel.begin(), local_kernel.end(), 0);
-                    compute_local_kernel( local_kernel, scale, source_data, Ilat, 0, LAT_lb, LAT_ub );
+                    local_stencil.build( source_data, scale, Ilat, 0 );
                     if ( (constants::DO_TIMING) and (tid == 0) ) { timing_records.add_to_record(MPI_Wtime() - clock_on, "kernel_precomputation_outer"); }
-                    //#if DEBUG >= 3
-                    //if (wRank == 0) { fprintf(stdout, "  done\n"); }
-                    //#endif
+                    #if DEBUG >= 3
+                    if (wRank == 0) { fprintf(stdout, "Ilat (%d) has a stencil with %zu rows and %zu cells.\n", Ilat, local_stencil.Nrows(), local_stencil.size()); }
+                    #endif
                 }
 
-                for (Ilon = 0; Ilon < Nlon; Ilon++) {
+                for (Jlon = 0; Jlon < Nlon_out; Jlon++) {
+
+                    Ilon = Jlon * lon_stride;
 
                     //#if DEBUG >= 3
                     //if (wRank == 0) { fprintf(stdout, "    Ilon (%d)\n", Ilon); }
@@ -463,7 +870,7 @@ void filtering(
                     tid = omp_get_thread_num();
                     if ( (tid == 0) and (wRank == 0) ) {
                         // Every perc_base percent, print a dot, but only the first thread
-                        if ( ((double)(Ilat*Nlon + Ilon + 1) / (Nlon*Nlat)) * 100 >= perc ) {
+                        if ( ((double)((Jlat - Jlat_start)*Nlon_out + Jlon + 1) / (Nlon_out*(Jlat_end - Jlat_start))) * 100 >= perc ) {
                             perc_count++;
                             if (perc_count % 5 == 0) { fprintf(stdout, "|"); }
                             else                     { fprintf(stdout, "."); }
@@ -475,26 +882,41 @@ void filtering(
 
 
                     if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
-                    if ( not( (constants::PERIODIC_X) and (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN) ) ) {
-                        // If we couldn't precompute the kernel earlier, then do it now
-                        std::fill(local_kernel.begin(), local_kernel.end(), 0);
-                        compute_local_kernel( local_kernel, scale, source_data, Ilat, Ilon, LAT_lb, LAT_ub );
+                    if ( not( (constants::PERIODIC_X) and (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN) ) and not(use_precomputed) ) {
+                        // If we couldn't precompute the stencil earlier, then do it now
+                        local_stencil.build( source_data, scale, Ilat, Ilon );
                         if ( (constants::DO_TIMING) and (tid == 0) ) { timing_records.add_to_record(MPI_Wtime() - clock_on, "kernel_precomputation_inner"); }
                     }
 
+                    // Walk the stencil once for all of the local times and depths, computing the
+                    //   linear, quadratic, and rho-weighted filters together (each cell is read once).
+                    if (not(use_precomputed)) {
+                        if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
+                        apply_filter_at_point_fused( level_vals, level_quad_vals, level_tilde_vals,
+                                u_x, u_y, u_z, full_KE,
+                                constants::COMP_TRANSFERS    ? &full_vort_r : NULL,
+                                constants::COMP_BC_TRANSFERS ? &filter_rho  : NULL,
+                                constants::COMP_BC_TRANSFERS ? &filter_p    : NULL,
+                                source_data, Ilat, Ilon, local_stencil, &water );
+                        if ( (constants::DO_TIMING) and (tid == 0) ) { timing_records.add_to_record(MPI_Wtime() - clock_on, "filter_main"); }
+                    }
+
                     for (Itime = 0; Itime < Ntime; Itime++) {
                         for (Idepth = 0; Idepth < Ndepth; Idepth++) {
 
                             // Convert our four-index to a one-index
-                            index = Index(Itime, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon);
+                            index     = Index(Itime, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat,     Nlon);
+                            out_index = Index(Itime, Idepth, Jlat, Jlon, Ntime, Ndepth, Nlat_out, Nlon_out);
 
                             if ( mask.at(index) ) { // Skip land areas
 
                                 // Apply the filter at the point
                                 if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
 
-                                apply_filter_at_point(  filtered_vals, filter_fields, source_data, Itime, Idepth, Ilat, Ilon,
-                                                        LAT_lb, LAT_ub, scale, filt_use_mask, local_kernel );
+                                for (size_t II = 0; II < filtered_vals.size(); II++) {
+                                    *(filtered_vals.at(II)) = use_precomputed ? precomputed_coarse.at(II)->at(index)
+                                                                          : level_vals.at( (Itime * Ndepth + Idepth) * filter_fields.size() + II );
+                                }
 
                                 // Convert the filtered fields back to spherical
                                 vel_Cart_to_Spher_at_point(
@@ -502,18 +924,18 @@ void filtering(
                                         u_x_tmp, u_y_tmp,   u_z_tmp,
                                         longitude.at(Ilon), latitude.at(Ilat));
 
-                                coarse_u_r.at(  index) = u_r_tmp;
-                                coarse_u_lon.at(index) = u_lon_tmp;
-                                coarse_u_lat.at(index) = u_lat_tmp;
+                                coarse_u_r.at(  out_index) = u_r_tmp;
+                                coarse_u_lon.at(out_index) = u_lon_tmp;
+                                coarse_u_lat.at(out_index) = u_lat_tmp;
 
                                 if (not(constants::MINIMAL_OUTPUT)) {
-                                    fine_u_r.at(  index) = full_u_r.at(  index) - coarse_u_r.at(  index);
+                                    fine_u_r.at(  out_index) = full_u_r.at(  index) - coarse_u_r.at(  out_index);
                                 }
-                                fine_u_lon.at(index) = full_u_lon.at(index) - coarse_u_lon.at(index);
-                                fine_u_lat.at(index) = full_u_lat.at(index) - coarse_u_lat.at(index);
+                                fine_u_lon.at(out_index) = full_u_lon.at(index) - coarse_u_lon.at(out_index);
+                                fine_u_lat.at(out_index) = full_u_lat.at(index) - coarse_u_lat.at(out_index);
 
                                 // Also filter KE
-                                filtered_KE.at(index) = KE_tmp;
+                                filtered_KE.at(out_index) = KE_tmp;
                                 if ( (constants::DO_TIMING) and (tid == 0) ) { timing_records.add_to_record(MPI_Wtime() - clock_on, "filter_main"); }
 
                                 // If we want energy transfers (Pi), 
@@ -521,34 +943,55 @@ void filtering(
                                 if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
                                 if (constants::COMP_TRANSFERS) {
 
-                                    apply_filter_at_point_for_quadratics(
-                                            uxux_tmp, uxuy_tmp, uxuz_tmp, uyuy_tmp, uyuz_tmp, uzuz_tmp, vort_ux_tmp, vort_uy_tmp, vort_uz_tmp,
-                                            u_x, u_y, u_z, full_vort_r, source_data, Itime, Idepth, Ilat, Ilon, LAT_lb, LAT_ub, scale, local_kernel);
+                                    if (use_precomputed) {
+                                        uxux_tmp = coarse_uxux.at(out_index);
+                                        uxuy_tmp = coarse_uxuy.at(out_index);
+                                        uxuz_tmp = coarse_uxuz.at(out_index);
+                                        uyuy_tmp = coarse_uyuy.at(out_index);
+                                        uyuz_tmp = coarse_uyuz.at(out_index);
+                                        uzuz_tmp = coarse_uzuz.at(out_index);
+
+                                        vort_ux_tmp = coarse_vort_ux.at(out_index);
+                                        vort_uy_tmp = coarse_vort_uy.at(out_index);
+                                        vort_uz_tmp = coarse_vort_uz.at(out_index);
+                                    } else {
+                                        const size_t quad_offset = (Itime * Ndepth + Idepth) * quad_fields.size();
+                                        uxux_tmp = level_quad_vals.at( quad_offset + 0 );
+                                        uxuy_tmp = level_quad_vals.at( quad_offset + 1 );
+                                        uxuz_tmp = level_quad_vals.at( quad_offset + 2 );
+                                        uyuy_tmp = level_quad_vals.at( quad_offset + 3 );
+                                        uyuz_tmp = level_quad_vals.at( quad_offset + 4 );
+                                        uzuz_tmp = level_quad_vals.at( quad_offset + 5 );
+
+                                        vort_ux_tmp = level_quad_vals.at( quad_offset + 6 );
+                                        vort_uy_tmp = level_quad_vals.at( quad_offset + 7 );
+                                        vort_uz_tmp = level_quad_vals.at( quad_offset + 8 );
+                                    }
 
                                     vel_Spher_to_Cart_at_point(
                                             u_x_tmp, u_y_tmp, u_z_tmp,
-                                            coarse_u_r.at(index), 
-                                            coarse_u_lon.at(index),  
-                                            coarse_u_lat.at(index),
+                                            coarse_u_r.at(out_index), 
+                                            coarse_u_lon.at(out_index),  
+                                            coarse_u_lat.at(out_index),
                                             longitude.at(Ilon), latitude.at(Ilat));
 
-                                    coarse_uxux.at(index) = uxux_tmp;
-                                    coarse_uxuy.at(index) = uxuy_tmp;
-                                    coarse_uxuz.at(index) = uxuz_tmp;
-                                    coarse_uyuy.at(index) = uyuy_tmp;
-                                    coarse_uyuz.at(index) = uyuz_tmp;
-                                    coarse_uzuz.at(index) = uzuz_tmp;
+                                    coarse_uxux.at(out_index) = uxux_tmp;
+                                    coarse_uxuy.at(out_index) = uxuy_tmp;
+                                    coarse_uxuz.at(out_index) = uxuz_tmp;
+                                    coarse_uyuy.at(out_index) = uyuy_tmp;
+                                    coarse_uyuz.at(out_index) = uyuz_tmp;
+                                    coarse_uzuz.at(out_index) = uzuz_tmp;
 
-                                    coarse_vort_ux.at(index) = vort_ux_tmp;
-                                    coarse_vort_uy.at(index) = vort_uy_tmp;
-                                    coarse_vort_uz.at(index) = vort_uz_tmp;
+                                    coarse_vort_ux.at(out_index) = vort_ux_tmp;
+                                    coarse_vort_uy.at(out_index) = vort_uy_tmp;
+                                    coarse_vort_uz.at(out_index) = vort_uz_tmp;
 
-                                    coarse_u_x.at(index) = u_x_tmp;
-                                    coarse_u_y.at(index) = u_y_tmp;
-                                    coarse_u_z.at(index) = u_z_tmp;
+                                    coarse_u_x.at(out_index) = u_x_tmp;
+                                    coarse_u_y.at(out_index) = u_y_tmp;
+                                    coarse_u_z.at(out_index) = u_z_tmp;
 
                                     // tau(u,u)
-                                    fine_KE.at(index) = 
+                                    fine_KE.at(out_index) = 
                                         0.5 * constants::rho0 * (
                                                 uxux_tmp - u_x_tmp * u_x_tmp
                                             +   uyuy_tmp - u_y_tmp * u_y_tmp
@@ -561,35 +1004,37 @@ void filtering(
                                 //    then do those calculations now
                                 if (constants::COMP_BC_TRANSFERS) {
                                     if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
-                                    coarse_rho.at(index) = rho_tmp;
-                                    coarse_p.at(  index) = p_tmp;
+                                    coarse_rho.at(out_index) = rho_tmp;
+                                    coarse_p.at(  out_index) = p_tmp;
 
                                     if (not(constants::MINIMAL_OUTPUT)) {
-                                        fine_rho.at(index) = 
-                                            full_rho.at(index) - coarse_rho.at(index);
-                                        fine_p.at(index)   = 
-                                            full_p.at(  index) - coarse_p.at(  index);
+                                        fine_rho.at(out_index) = 
+                                            filter_rho.at(index) - coarse_rho.at(out_index);
+                                        fine_p.at(out_index)   = 
+                                            filter_p.at(  index) - coarse_p.at(  out_index);
                                     }
 
-                                    PEtoKE.at(index) = 
-                                        (coarse_rho.at(index) - constants::rho0)
+                                    PEtoKE.at(out_index) = 
+                                        (coarse_rho.at(out_index) - constants::rho0)
                                         * (-constants::g)
-                                        * coarse_u_r.at(index);
+                                        * coarse_u_r.at(out_index);
 
                                     //
                                     // If we have rho, then also compute tilde fields
                                     //
-                                    apply_filter_at_point(  tilde_vals, filter_fields, source_data, Itime, Idepth, Ilat, Ilon,
-                                                            LAT_lb, LAT_ub, scale, filt_use_mask, local_kernel, &full_rho );
+                                    for (size_t II = 0; II < 3; II++) {
+                                        *(tilde_vals.at(II)) = use_precomputed ? precomputed_tilde.at(II)->at(index)
+                                                                           : level_tilde_vals.at( (Itime * Ndepth + Idepth) * vel_fields.size() + II );
+                                    }
 
                                     vel_Cart_to_Spher_at_point(
                                             u_r_tmp,    u_lon_tmp, u_lat_tmp,
                                             u_x_tilde,  u_y_tilde, u_z_tilde,
                                             longitude.at(Ilon), latitude.at(Ilat));
 
-                                    tilde_u_r.at(  index) = u_r_tmp   / rho_tmp;
-                                    tilde_u_lon.at(index) = u_lon_tmp / rho_tmp;
-                                    tilde_u_lat.at(index) = u_lat_tmp / rho_tmp;
+                                    tilde_u_r.at(  out_index) = u_r_tmp   / rho_tmp;
+                                    tilde_u_lon.at(out_index) = u_lon_tmp / rho_tmp;
+                                    tilde_u_lat.at(out_index) = u_lat_tmp / rho_tmp;
                                     if ( (constants::DO_TIMING) and (tid == 0) ) { timing_records.add_to_record(MPI_Wtime() - clock_on, "filter_for_Lambda"); }
                                 }
 
@@ -601,37 +1046,54 @@ void filtering(
         }  // end pragma parallel block
         #if DEBUG >= 0
         if (wRank == 0) { fprintf(stdout, "\n"); }
+        print_load_imbalance( MPI_Wtime() - filter_clock, "filtering", comm );
         #endif
 
+        // Fill in the rows just outside of this band, so that the derivatives (vorticity, and then
+        //   the gradients of vorticity in Z) are correct within the band. Other fields are only
+        //   ever used point-wise, so stay band-only.
+        if (bands.Nbands > 1) {
+            if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
+            const int Nhalo = 2 * ( constants::DiffOrd + 1 );
+            for ( std::vector<double> * field : { &coarse_u_r, &coarse_u_lon, &coarse_u_lat, &fine_u_r, &fine_u_lon, &fine_u_lat,
+                                                  &coarse_u_x, &coarse_u_y, &coarse_u_z,
+                                                  &coarse_uxux, &coarse_uxuy, &coarse_uxuz, &coarse_uyuy, &coarse_uyuz, &coarse_uzuz,
+                                                  &coarse_vort_ux, &coarse_vort_uy, &coarse_vort_uz, &coarse_p,
+                                                  &tilde_u_r, &tilde_u_lon, &tilde_u_lat } ) {
+                bands.exchange_halo( *field, Nlevels, Nlon_out, Nhalo );
+            }
+            if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "exchange_band_halos"); }
+        }
+
         #if DEBUG >= 2
         fprintf(stdout, "  = Rank %d finished filtering loop =\n", wRank);
         fflush(stdout);
         #endif
 
         if ( (constants::EXTEND_DOMAIN_TO_POLES) or (constants::FILTER_OVER_LAND) ) {
-                std::vector<double> mask_double( source_data.reference_mask.begin(), 
-                                                 source_data.reference_mask.end() );
-                write_field_to_output( mask_double, "mask", starts, counts, fname, NULL );
+                std::vector<double> mask_double( output_data.reference_mask.begin(), 
+                                                 output_data.reference_mask.end() );
+                writer.write( mask_double, "mask", starts, counts, fname, NULL );
                 mask_double.clear();
         }
 
         // Get KE from coarse velocities
-        KE_from_vels(KE_from_coarse_vel, &coarse_u_r, &coarse_u_lon, &coarse_u_lat, mask);
+        KE_from_vels(KE_from_coarse_vel, &coarse_u_r, &coarse_u_lon, &coarse_u_lat, out_mask);
 
         // Write to file
         if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
         if (not(constants::MINIMAL_OUTPUT)) {
-            write_field_to_output(coarse_u_r,   "coarse_u_r",   starts, counts, fname, &mask);
-            write_field_to_output(fine_u_r,     "fine_u_r",     starts, counts, fname, &mask);
-            write_field_to_output(filtered_KE,  "filtered_KE",  starts, counts, fname, &mask);
+            writer.write(coarse_u_r,   "coarse_u_r",   starts, counts, fname, &out_mask);
+            writer.write(fine_u_r,     "fine_u_r",     starts, counts, fname, &out_mask);
+            writer.write(filtered_KE,  "filtered_KE",  starts, counts, fname, &out_mask);
         }
         if (not(constants::NO_FULL_OUTPUTS)) {
-            write_field_to_output(coarse_u_lon,       "coarse_u_lon", starts, counts, fname, &mask);
-            write_field_to_output(coarse_u_lat,       "coarse_u_lat", starts, counts, fname, &mask);
-            write_field_to_output(KE_from_coarse_vel, "coarse_KE",    starts, counts, fname, &mask);
+            writer.write(coarse_u_lon,       "coarse_u_lon", starts, counts, fname, &out_mask);
+            writer.write(coarse_u_lat,       "coarse_u_lat", starts, counts, fname, &out_mask);
+            writer.write(KE_from_coarse_vel, "coarse_KE",    starts, counts, fname, &out_mask);
 
-            write_field_to_output(fine_u_lon,   "fine_u_lon",   starts, counts, fname, &mask);
-            write_field_to_output(fine_u_lat,   "fine_u_lat",   starts, counts, fname, &mask);
+            writer.write(fine_u_lon,   "fine_u_lon",   starts, counts, fname, &out_mask);
+            writer.write(fine_u_lat,   "fine_u_lat",   starts, counts, fname, &out_mask);
         }
         if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "writing"); }
 
@@ -646,23 +1108,23 @@ void filtering(
             if (not(constants::MINIMAL_OUTPUT)) {
                 compute_vorticity(fine_vort_r, fine_vort_lon, fine_vort_lat, div, OkuboWeiss,
                         null_vector, null_vector, null_vector,
-                        source_data, fine_u_r, fine_u_lon, fine_u_lat );
+                        output_data, fine_u_r, fine_u_lon, fine_u_lat );
             }
 
             compute_vorticity(coarse_vort_r, coarse_vort_lon, coarse_vort_lat, div, OkuboWeiss,
                     null_vector, null_vector, null_vector,
-                    source_data, coarse_u_r, coarse_u_lon, coarse_u_lat );
+                    output_data, coarse_u_r, coarse_u_lon, coarse_u_lat );
 
             if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "compute_vorticity"); }
 
             if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
             if (not(constants::MINIMAL_OUTPUT)) {
-                write_field_to_output(fine_vort_r, "fine_vort_r", starts, counts, fname, &mask);
-                write_field_to_output(div, "coarse_vel_div", starts, counts, fname, &mask);
+                writer.write(fine_vort_r, "fine_vort_r", starts, counts, fname, &out_mask);
+                writer.write(div, "coarse_vel_div", starts, counts, fname, &out_mask);
             }
             if (not(constants::NO_FULL_OUTPUTS)) {
-                write_field_to_output(coarse_vort_r, "coarse_vort_r", starts, counts, fname, &mask);
-                write_field_to_output(OkuboWeiss, "OkuboWeiss", starts, counts, fname, &mask);
+                writer.write(coarse_vort_r, "coarse_vort_r", starts, counts, fname, &out_mask);
+                writer.write(OkuboWeiss, "OkuboWeiss", starts, counts, fname, &out_mask);
             }
             if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "writing"); }
         }
@@ -674,17 +1136,17 @@ void filtering(
             if (wRank == 0) { fprintf(stdout, "Starting compute_Pi\n"); }
             fflush(stdout);
             #endif
-            compute_Pi( energy_transfer, source_data, coarse_u_x,  coarse_u_y,  coarse_u_z, 
+            compute_Pi( energy_transfer, output_data, coarse_u_x,  coarse_u_y,  coarse_u_z, 
                         coarse_uxux, coarse_uxuy, coarse_uxuz, coarse_uyuy, coarse_uyuz, coarse_uzuz );
-            compute_Z(  enstrophy_transfer, source_data, coarse_u_x,  coarse_u_y,  coarse_u_z, coarse_vort_r, 
+            compute_Z(  enstrophy_transfer, output_data, coarse_u_x,  coarse_u_y,  coarse_u_z, coarse_vort_r, 
                         coarse_vort_ux, coarse_vort_uy, coarse_vort_uz );
             if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "compute_Pi_and_Z"); }
 
             if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
             if (not(constants::NO_FULL_OUTPUTS)) {
-                write_field_to_output(energy_transfer, "Pi", starts, counts, fname, &mask);
-                write_field_to_output(enstrophy_transfer, "Z", starts, counts, fname, &mask);
-                write_field_to_output(fine_KE, "fine_KE", starts, counts, fname, &mask);
+                writer.write(energy_transfer, "Pi", starts, counts, fname, &out_mask);
+                writer.write(enstrophy_transfer, "Z", starts, counts, fname, &out_mask);
+                writer.write(fine_KE, "fine_KE", starts, counts, fname, &out_mask);
             }
             if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "writing"); }
         }
@@ -698,20 +1160,20 @@ void filtering(
 
             compute_vorticity(tilde_vort_r, tilde_vort_lon, tilde_vort_lat, div, OkuboWeiss,
                     null_vector, null_vector, null_vector,
-                    source_data, tilde_u_r, tilde_u_lon, tilde_u_lat );
+                    output_data, tilde_u_r, tilde_u_lon, tilde_u_lat );
 
             if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "compute_Lambda"); }
 
             if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
             if (not(constants::NO_FULL_OUTPUTS)) {
-                write_field_to_output(PEtoKE,        "PEtoKE",            starts, counts, fname, &mask);
-                write_field_to_output(coarse_rho,    "coarse_rho",        starts, counts, fname, &mask);
-                write_field_to_output(coarse_p,      "coarse_p",          starts, counts, fname, &mask);
-                write_field_to_output(tilde_vort_r,  "tilde_vort_p",      starts, counts, fname, &mask);
+                writer.write(PEtoKE,        "PEtoKE",            starts, counts, fname, &out_mask);
+                writer.write(coarse_rho,    "coarse_rho",        starts, counts, fname, &out_mask);
+                writer.write(coarse_p,      "coarse_p",          starts, counts, fname, &out_mask);
+                writer.write(tilde_vort_r,  "tilde_vort_p",      starts, counts, fname, &out_mask);
             }
             if (not(constants::MINIMAL_OUTPUT)) {
-                write_field_to_output(fine_rho, "fine_rho", starts, counts, fname, &mask);
-                write_field_to_output(fine_p,   "fine_p",   starts, counts, fname, &mask);
+                writer.write(fine_rho, "fine_rho", starts, counts, fname, &out_mask);
+                writer.write(fine_p,   "fine_p",   starts, counts, fname, &out_mask);
             }
             if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "writing"); }
         }
@@ -722,7 +1184,7 @@ void filtering(
         #endif
         if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
         compute_div_transport(
-                div_J, source_data,
+                div_J, output_data,
                 coarse_u_x,  coarse_u_y,  coarse_u_z,
                 coarse_uxux, coarse_uxuy, coarse_uxuz,
                 coarse_uyuy, coarse_uyuz, coarse_uzuz,
@@ -731,7 +1193,7 @@ void filtering(
 
         if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
         if (not(constants::MINIMAL_OUTPUT)) {
-            write_field_to_output(div_J, "div_Jtransport", starts, counts, fname, &mask);
+            writer.write(div_J, "div_Jtransport", starts, counts, fname, &out_mask);
         }
         if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "writing"); }
 
@@ -740,13 +1202,19 @@ void filtering(
         //
 
         if (constants::APPLY_POSTPROCESS) {
+            // Post-processing also uses netcdf, so the queued writes need to finish first
+            if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
+            writer.flush();
+            if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "waiting_for_output"); }
+
             MPI_Barrier(MPI_COMM_WORLD);
 
             if (wRank == 0) { fprintf(stdout, "Beginning post-process routines\n"); }
             fflush(stdout);
 
             if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
-            Apply_Postprocess_Routines( source_data, postprocess_fields, postprocess_names, OkuboWeiss, scales.at(Iscale), timing_records, "postprocess");
+            Apply_Postprocess_Routines( output_data, postprocess_fields, postprocess_names, OkuboWeiss, scales.at(Iscale), timing_records, "postprocess",
+                                        MPI_COMM_WORLD, &bands );
             if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "postprocess"); }
         }
 
@@ -763,4 +1231,8 @@ void filtering(
         }
 
     }  // end for(scale) block
+
+    // The queued operations may refer to the (local) output grid, so they need to finish before returning
+    writer.flush();
+    writer.set_latitude_band( 0, Nlat, Nlat );
 } // end filtering
@@ -0,0 +1,128 @@
+#include <algorithm>
+#include <vector>
+#include <cassert>
+#include <mpi.h>
+#include "../../functions.hpp"
+#include "../../netcdf_io.hpp"
+#include "../../constants.hpp"
+
+/*!
+ * \brief Filtering driver that streams through time, one window of times at a time
+ *
+ * source_data must already hold the first window (Itime_window = 0, see dataset::set_time_windows),
+ * including the region definitions. Each window is passed through filtering (all scales,
+ * outputs and post-processing), while the next window is read in the background by
+ * load_window on the output queue, into a second set of buffers. The two sets of
+ * buffers are then swapped, so that only two windows are ever held in memory. The
+ * working arrays of filtering are also kept between windows (see filtering_workspace),
+ * so after the first two windows nothing needs to be allocated.
+ *
+ * load_window must read every variable that filtering needs (as well as the mask, and
+ * the reference_mask if FILTER_OVER_LAND) for data.Itime_window, and set data.Ntime and data.Ndepth.
+ * It is called from the IO thread, so any collective calls must use data.MPI_Comm_Global.
+ *
+ * Time-averaged post-processing (POSTPROCESS_DO_TIME_MEANS) and EXTEND_DOMAIN_TO_POLES are not
+ *    supported with more than one window.
+ *
+ * @param[in,out]   source_data     dataset class instance holding the first window
+ * @param[in]       scales          scales at which to filter the data
+ * @param[in]       load_window     function to read window data.Itime_window into data
+ * @param[in]       comm            MPI communicator (default MPI_COMM_WORLD)
+ *
+ */
+void filtering_streamed(
+        dataset & source_data,
+        const std::vector<double> & scales,
+        const std::function< void( dataset & data ) > & load_window,
+        const MPI_Comm comm
+        ) {
+
+    const int Ntime_windows = source_data.Ntime_windows;
+    assert( source_data.Itime_window == 0 );
+
+    if (Ntime_windows == 1) {
+        filtering( source_data, scales, comm );
+        return;
+    }
+
+    assert( not(constants::POSTPROCESS_DO_TIME_MEANS) ); // time means would only cover the last window
+    assert( not(constants::EXTEND_DOMAIN_TO_POLES) );
+    assert( source_data.Nprocs_in_quadrature == 1 );
+
+    int wRank=-1;
+    MPI_Comm_rank( comm, &wRank );
+
+    // Second set of buffers, for the window being read in. It only needs the dimensions and
+    //   processor divisions (load_window fills in the rest), and has its own communicator,
+    //   since it is only used from the IO thread.
+    dataset next_data;
+    next_data.Nprocs_in_time        = source_data.Nprocs_in_time;
+    next_data.Nprocs_in_depth       = source_data.Nprocs_in_depth;
+    next_data.Nprocs_in_quadrature  = source_data.Nprocs_in_quadrature;
+
+    next_data.time      = source_data.time;
+    next_data.depth     = source_data.depth;
+    next_data.latitude  = source_data.latitude;
+    next_data.longitude = source_data.longitude;
+    next_data.Ntime     = source_data.Ntime;
+    next_data.Ndepth    = source_data.Ndepth;
+    next_data.Nlat      = source_data.Nlat;
+    next_data.Nlon      = source_data.Nlon;
+    next_data.full_Ntime  = source_data.full_Ntime;
+    next_data.full_Ndepth = source_data.full_Ndepth;
+
+    next_data.MPI_subcomm_sametimes         = source_data.MPI_subcomm_sametimes;
+    next_data.MPI_subcomm_samedepths        = source_data.MPI_subcomm_samedepths;
+    next_data.MPI_subcomm_sametimedepths    = source_data.MPI_subcomm_sametimedepths;
+    next_data.MPI_subcomm_samequadrature    = source_data.MPI_subcomm_samequadrature;
+    MPI_Comm_dup( MPI_COMM_WORLD, &next_data.MPI_Comm_Global );
+
+    next_data.compute_radial_vel    = source_data.compute_radial_vel;
+    next_data.use_depth_derivatives = source_data.use_depth_derivatives;
+    next_data.depth_is_elevation    = source_data.depth_is_elevation;
+    next_data.depth_is_increasing   = source_data.depth_is_increasing;
+
+    next_data.time_split_starts  = source_data.time_split_starts;
+    next_data.depth_split_starts = source_data.depth_split_starts;
+    next_data.Ntime_windows      = Ntime_windows;
+
+    // The working arrays of filtering, shared between the windows
+    filtering_workspace workspace;
+
+    // Always use the IO thread, since that is what overlaps the reading with the filtering
+    output_writer writer( comm, true );
+
+    for (int Iwindow = 0; Iwindow < Ntime_windows; Iwindow++) {
+
+        #if DEBUG >= 0
+        if (wRank == 0) { fprintf(stdout, "\nFiltering time window %'d of %'d\n", Iwindow + 1, Ntime_windows); }
+        #endif
+
+        // Start reading the next window. This is queued ahead of this window's outputs,
+        //   and is done by the time filtering flushes the queue for the post-processing.
+        if (Iwindow + 1 < Ntime_windows) {
+            next_data.Itime_window = Iwindow + 1;
+            writer.enqueue( [&next_data, &load_window](){ load_window( next_data ); } );
+        }
+
+        filtering( source_data, scales, comm, &writer, &workspace );
+
+        if (Iwindow + 1 < Ntime_windows) {
+            writer.flush();
+
+            // Swap in the next window, keeping this window's buffers to read into next
+            source_data.variables.swap(      next_data.variables      );
+            source_data.mask.swap(           next_data.mask           );
+            source_data.reference_mask.swap( next_data.reference_mask );
+            source_data.myCounts.swap(       next_data.myCounts       );
+            source_data.myStarts.swap(       next_data.myStarts       );
+
+            source_data.Itime_window = Iwindow + 1;
+            source_data.Ntime        = source_data.myCounts[0];
+            source_data.Ndepth       = source_data.myCounts[1];
+            source_data.compute_region_areas();
+        }
+    }
+
+    MPI_Comm_free( &next_data.MPI_Comm_Global );
+}
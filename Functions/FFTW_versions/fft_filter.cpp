@@ -2,100 +2,57 @@
 #include <algorithm>
 #include <vector>
 #include <omp.h>
-#include <mpi.h>
 #include <fftw3.h>
 #include "../../constants.hpp"
 #include "../../functions.hpp"
 #include "../../fft_based.hpp"
 
+/*!
+ * \brief Filter a pre-computed spectrum (see fft_forward) at one scale, and transform back
+ *
+ * The spectrum is left untouched (it is multiplied by the transfer function into fft_out),
+ * so the same spectrum can be filtered at every scale.
+ *
+ * @param[in,out]   coarse_field    where to store the filtered field (resized if needed)
+ * @param[in]       spectrum        spectrum of the field, for every level
+ * @param[in]       transfer        transfer function of the filter (see fft_transfer_function)
+ * @param[in]       ifft            backward plan (from fft_out to fft_inp)
+ * @param[in]       fft_inp,fft_out work arrays for the plan
+ * @param[in]       Nlevels         number of times * depths
+ * @param[in]       Ny,Nx           number of latitudes / longitudes
+ *
+ */
 void fft_filter(
         std::vector<double> & coarse_field,
-        const std::vector<double> & full_field,
-        const fftw_plan  fft,
+        const fftw_complex * spectrum,
+        const std::vector<double> & transfer,
         const fftw_plan ifft,
         double * fft_inp,
         fftw_complex * fft_out,
-        const double scale,
-        const int Ntime,
-        const int Ndepth,
+        const int Nlevels,
         const int Ny,
-        const int Nx,
-        const double Ly,
-        const double Lx
+        const int Nx
         ) {
 
-    int wRank, wSize;
-    MPI_Comm_rank( MPI_COMM_WORLD, &wRank );
-    MPI_Comm_size( MPI_COMM_WORLD, &wSize );
+    const size_t    Nk_level    = (size_t) Ny * (Nx/2 + 1),
+                    Nk          = Nlevels * Nk_level,
+                    Npts        = (size_t) Nlevels * Ny * Nx;
+    const double    norm        = 1. / ( (double) Nx * Ny );
 
-    size_t index;
-    int Itime, Idepth, Iky, Ikx;
-    double ky, kx, kk;
-    const double dky = 2. * M_PI / Ly;
-    const double dkx = 2. * M_PI / Lx;
-    const int Nky = Ny;
-    const int Nkx = Nx/2 + 1;
-
-    #if DEBUG >= 1
-    if (wRank == 0) { fprintf(stdout, "  Copying full field into fft input.\n"); }
-    #endif
-    // Copy full_field into fft_inp
-    for (index = 0; index < full_field.size(); index++) {
-        fft_inp[index] = full_field.at(index);
-    }
-
-    #if DEBUG >= 1
-    if (wRank == 0) { fprintf(stdout, "  Forward transforming.\n"); }
-    #endif
-    // Forward transform
-    fftw_execute(fft);
-
-    #if DEBUG >= 1
-    if (wRank == 0) { fprintf(stdout, "  Applying filter.\n"); }
-    #endif
     // Apply filter
-    for (Iky = 0; Iky < Nky; Iky++) {
-
-        // y wavenumber
-        if (Iky < Nky/2) { ky = dky * Iky; }
-        else {             ky = dky * (Nky - Iky); }
-
-        for (Ikx = 0; Ikx < Nkx; Ikx++) {
-
-            // x wavenumber ( this one is halved, so no if/else )
-            kx = dkx * Ikx;
-
-            // Compute full
-            kk = sqrt(kx*kx + ky*ky);
-
-            // Remove anything higher frequency than filter scale
-            if (kk >= 2. * M_PI / scale) {
-                for (Itime = 0; Itime < Ntime; Itime++) {
-                    for (Idepth = 0; Idepth < Ndepth; Idepth++) {
-                        index = ( ( Itime * Ndepth + Idepth) * Nky + Iky ) * Nkx + Ikx;
-                        fft_out[index][0] = 0.;
-                        fft_out[index][1] = 0.;
-                    }
-                }
-            }
-        }
+    #pragma omp parallel for default(none) shared( spectrum, transfer, fft_out ) firstprivate( Nk, Nk_level )
+    for (size_t index = 0; index < Nk; index++) {
+        const double T = transfer[ index % Nk_level ];
+        fft_out[index][0] = T * spectrum[index][0];
+        fft_out[index][1] = T * spectrum[index][1];
     }
 
-    #if DEBUG >= 1
-    if (wRank == 0) { fprintf(stdout, "  Back transforming.\n"); }
-    #endif
     // Transform back
     fftw_execute(ifft);
 
-    #if DEBUG >= 1
-    if (wRank == 0) { fprintf(stdout, "  Copying fft output into coarse field.\n"); }
-    #endif
-    // Copy fft_inp into coarse_field
-    for (index = 0; index < full_field.size(); index++) {
-        coarse_field.at(index) = fft_inp[index] / (Nx * Ny);
+    coarse_field.resize( Npts );
+    #pragma omp parallel for default(none) shared( coarse_field, fft_inp ) firstprivate( Npts, norm )
+    for (size_t index = 0; index < Npts; index++) {
+        coarse_field[index] = fft_inp[index] * norm;
     }
-
-    #if DEBUG >= 1
-    if (wRank == 0) { fprintf(stdout, "  \n"); }
-    #endif
 }
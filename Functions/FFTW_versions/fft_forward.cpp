@@ -0,0 +1,44 @@
+#include <math.h>
+#include <vector>
+#include <omp.h>
+#include <fftw3.h>
+#include "../../constants.hpp"
+#include "../../functions.hpp"
+#include "../../fft_based.hpp"
+
+/*!
+ * \brief Forward transform a field (or the product of two fields) for every local time and depth
+ *
+ * Land cells are treated as zero. The spectrum is written straight into spectrum (which
+ * must come from fftw_alloc_complex, with the same size as the plan output), so that it can
+ * be filtered at every scale (see fft_filter) without transforming again.
+ *
+ * @param[in,out]   spectrum        where to store the spectrum
+ * @param[in]       full_field      field to transform
+ * @param[in]       full_factor     optional second factor (NULL indicates not provided)
+ * @param[in]       mask            land / water mask (true = water)
+ * @param[in]       fft             forward plan (from fft_inp)
+ * @param[in]       fft_inp         real work array for the plan
+ *
+ */
+void fft_forward(
+        fftw_complex * spectrum,
+        const std::vector<double> & full_field,
+        const std::vector<double> * full_factor,
+        const std::vector<bool> & mask,
+        const fftw_plan fft,
+        double * fft_inp
+        ) {
+
+    const size_t Npts = full_field.size();
+
+    #pragma omp parallel for default(none) shared( full_field, full_factor, mask, fft_inp ) firstprivate( Npts )
+    for (size_t index = 0; index < Npts; index++) {
+        if ( not(mask[index]) ) { fft_inp[index] = 0.; }
+        else if (full_factor == NULL) { fft_inp[index] = full_field[index]; }
+        else { fft_inp[index] = full_field[index] * (*full_factor)[index]; }
+    }
+
+    // New-array execute, so that each field keeps its own spectrum
+    fftw_execute_dft_r2c( fft, fft_inp, spectrum );
+}
@@ -0,0 +1,87 @@
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include <fftw3.h>
+#include "../../constants.hpp"
+#include "../../functions.hpp"
+#include "../../fft_based.hpp"
+
+/*!
+ * \brief Compute the spectral transfer function of the filter at a given scale
+ *
+ * The transfer function is stored as transfer[ Iky * Nkx + Ikx ], with Nkx = Nlon/2 + 1
+ * (i.e. the layout of a single level of an r2c transform).
+ *
+ * If FFT_TRANSFER_FROM_KERNEL, the kernel (KERNEL_OPT) is sampled on the (periodic) grid around
+ * the first grid point and transformed, and then normalized by its sum. Filtering with it is then
+ * the same as direct filtering on the same grid (without land), which Tests/fftw_filter_test.cpp
+ * checks. Otherwise, it is a sharp cutoff
+ * that removes every wavenumber at or above 2 pi / scale.
+ *
+ * @param[in,out]   transfer        where to store the transfer function (resized if needed)
+ * @param[in]       scale           filter scale
+ * @param[in]       source_data     dataset class instance containing the grid
+ *
+ */
+void fft_transfer_function(
+        std::vector<double> & transfer,
+        const double scale,
+        const dataset & source_data
+        ) {
+
+    const std::vector<double>   &latitude   = source_data.latitude,
+                                &longitude  = source_data.longitude;
+
+    const int   Ny  = source_data.Nlat,
+                Nx  = source_data.Nlon,
+                Nky = Ny,
+                Nkx = Nx/2 + 1;
+
+    const double    Ly  = Ny * (latitude.at( 1) - latitude.at( 0)),
+                    Lx  = Nx * (longitude.at(1) - longitude.at(0)),
+                    dky = 2. * M_PI / Ly,
+                    dkx = 2. * M_PI / Lx;
+
+    transfer.resize( Nky * Nkx );
+
+    if (not(constants::FFT_TRANSFER_FROM_KERNEL)) {
+        double ky, kx;
+        for (int Iky = 0; Iky < Nky; Iky++) {
+            // y wavenumber
+            if (Iky < Nky/2) { ky = dky * Iky; }
+            else {             ky = dky * (Nky - Iky); }
+
+            for (int Ikx = 0; Ikx < Nkx; Ikx++) {
+                // x wavenumber ( this one is halved, so no if/else )
+                kx = dkx * Ikx;
+
+                transfer[ Iky * Nkx + Ikx ] = ( sqrt(kx*kx + ky*ky) >= 2. * M_PI / scale ) ? 0. : 1.;
+            }
+        }
+        return;
+    }
+
+    // Sample the kernel around the first grid point. The kernel is symmetric, and
+    //   distance accounts for the periodicity, so the transform is real.
+    double * kern = fftw_alloc_real( Ny * Nx );
+    fftw_complex * kern_hat = fftw_alloc_complex( Nky * Nkx );
+    fftw_plan plan = fftw_plan_dft_r2c_2d( Ny, Nx, kern, kern_hat, FFTW_ESTIMATE );
+
+    double kern_sum = 0.;
+    for (int Iy = 0; Iy < Ny; Iy++) {
+        for (int Ix = 0; Ix < Nx; Ix++) {
+            kern[ Iy * Nx + Ix ] = kernel( distance( longitude[0], latitude[0], longitude[Ix], latitude[Iy], Lx, Ly ), scale );
+            kern_sum += kern[ Iy * Nx + Ix ];
+        }
+    }
+
+    fftw_execute( plan );
+
+    for (int II = 0; II < Nky * Nkx; II++) {
+        transfer[II] = (kern_sum == 0) ? 0. : kern_hat[II][0] / kern_sum;
+    }
+
+    fftw_destroy_plan( plan );
+    fftw_free( kern );
+    fftw_free( kern_hat );
+}
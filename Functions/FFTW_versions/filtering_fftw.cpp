@@ -1,6 +1,9 @@
 #include <math.h>
+#include <string.h>
+#include <stdlib.h>
 #include <algorithm>
 #include <vector>
+#include <string>
 #include <omp.h>
 #include <mpi.h>
 #include "../../functions.hpp"
@@ -11,63 +14,73 @@
 #include <fftw3.h>
 #include <assert.h>
 
+/*!
+ * \brief Filtering driver for periodic Cartesian grids, using FFTs
+ *
+ * Each velocity component (and each quadratic product, if COMP_TRANSFERS) is transformed
+ * once, and then every scale only needs to apply its transfer function (see fft_transfer_function)
+ * and transform back. This needs one spectrum (about half of a full-sized array of complex values)
+ * per transformed field.
+ *
+ * The FFTW plans are threaded (using the OpenMP threads), and the planning wisdom is
+ * read from / saved to wisdom_filename (if given), so that later runs on the same grid
+ * don't need to re-plan.
+ *
+ * In the velocity variables, u_lon / u_lat / u_r are the x / y / z components.
+ *
+ * @param[in]   source_data         dataset class instance containing data (velocities, etc)
+ * @param[in]   scales              scales at which to filter the data
+ * @param[in]   wisdom_filename     file for FFTW wisdom ("" to not use wisdom)
+ * @param[in]   comm                MPI communicator (default MPI_COMM_WORLD)
+ *
+ */
 void filtering_fftw(
-        const std::vector<double> & full_u_z,       /**< [in] Full u_r velocity array */
-        const std::vector<double> & full_u_x,       /**< [in] Full u_lon velocity array */
-        const std::vector<double> & full_u_y,       /**< [in] Full u_lat velocity array */
-        const std::vector<double> & full_rho,       /**< [in] Full density array */
-        const std::vector<double> & full_p,         /**< [in] Full pressure array */
-        const std::vector<double> & scales,         /**< [in] Array of filtering scales */
-        const std::vector<double> & dAreas,         /**< [in] Array of cell areas (2D) (compute_areas()) */
-        const std::vector<double> & time,           /**< [in] Time dimension (1D) */
-        const std::vector<double> & depth,          /**< [in] Depth dimension (1D) */
-        const std::vector<double> & longitude,      /**< [in] Longitude dimension (1D) */
-        const std::vector<double> & latitude,       /**< [in] Latitude dimension (1D) */
-        const std::vector<bool> & mask,             /**< [in] Array to distinguish between land and water cells (2D) */
-        const std::vector<int>    & myCounts,       /**< [in] Array of dimension sizes */
-        const std::vector<int>    & myStarts,       /**< [in] Array of dimension sizes */
-        const MPI_Comm comm                         /**< [in] MPI Communicator */
+        const dataset & source_data,
+        const std::vector<double> & scales,
+        const std::string & wisdom_filename,
+        const MPI_Comm comm
         ) {
 
-    static_assert( constants::CARTESIAN  );
-    static_assert( constants::PERIODIC_X );
-    static_assert( constants::PERIODIC_Y );
+    static_assert( constants::CARTESIAN,        "filtering_fftw requires a Cartesian grid" );
+    static_assert( constants::PERIODIC_X,       "filtering_fftw requires a periodic grid" );
+    static_assert( constants::PERIODIC_Y,       "filtering_fftw requires a periodic grid" );
+    static_assert( constants::UNIFORM_LON_GRID, "filtering_fftw requires a uniform grid" );
+    static_assert( constants::UNIFORM_LAT_GRID, "filtering_fftw requires a uniform grid" );
 
     int wRank, wSize;
     MPI_Comm_rank( comm, &wRank );
     MPI_Comm_size( comm, &wSize );
 
-    size_t index;
-    double scale;
+    // If we've passed the DO_TIMING flag, then create some timing vars
+    Timing_Records timing_records;
+    double clock_on;
 
-    // Get dimension sizes
-    const int Nscales = scales.size();
-    const int Ntime   = myCounts.at(0);
-    const int Ndepth  = myCounts.at(1);
-    const int Nlat    = myCounts.at(2);
-    const int Nlon    = myCounts.at(3);
+    const std::vector<bool> &mask = source_data.mask;
 
-    const double Llat = Nlat * (latitude.at( 1) - latitude.at( 0));
-    const double Llon = Nlon * (longitude.at(1) - longitude.at(0));
+    const std::vector<double>   &full_u_x = source_data.variables.at("u_lon"),
+                                &full_u_y = source_data.variables.at("u_lat"),
+                                &full_u_z = source_data.variables.at("u_r");
 
-    const unsigned int num_pts = Ntime * Ndepth * Nlat * Nlon;
+    // Get dimension sizes
+    const int   Nscales = scales.size(),
+                Ntime   = source_data.Ntime,
+                Ndepth  = source_data.Ndepth,
+                Nlat    = source_data.Nlat,
+                Nlon    = source_data.Nlon,
+                Nlevels = Ntime * Ndepth;
+
+    const size_t num_pts = (size_t) Nlevels * Nlat * Nlon;
     char filename [50];
-    
+
     const int ndims = 4;
     size_t starts[ndims] = {
-        size_t(myStarts.at(0)), size_t(myStarts.at(1)), 
-        size_t(myStarts.at(2)), size_t(myStarts.at(3))};
+        size_t(source_data.myStarts.at(0)), size_t(source_data.myStarts.at(1)),
+        size_t(source_data.myStarts.at(2)), size_t(source_data.myStarts.at(3))};
     size_t counts[ndims] = {
-        size_t(Ntime), size_t(Ndepth), 
+        size_t(Ntime), size_t(Ndepth),
         size_t(Nlat), size_t(Nlon)};
     std::vector<std::string> vars_to_write;
 
-    #if DEBUG >= 1
-    if (wRank == 0) { fprintf(stdout, "Converting to Cartesian velocities.\n"); }
-    #endif
-
-    std::vector<double> local_kernel(Nlat * Nlon);
-
     std::vector<double> coarse_u_x(num_pts), coarse_u_y(num_pts), coarse_u_z(num_pts);
     vars_to_write.push_back("coarse_u_x");
     vars_to_write.push_back("coarse_u_y");
@@ -81,8 +94,8 @@ void filtering_fftw(
 
     // If computing energy transfers, we'll need some more arrays
         std::vector<double> coarse_uxux, coarse_uxuy, coarse_uxuz,
-                                         coarse_uyuy, coarse_uyuz, 
-                                                      coarse_uzuz;   
+                                         coarse_uyuy, coarse_uyuz,
+                                                      coarse_uzuz;
         std::vector<double> energy_transfer, fine_KE;
     if (constants::COMP_TRANSFERS) {
         coarse_uxux.resize(num_pts);
@@ -96,7 +109,7 @@ void filtering_fftw(
 
         // Also an array for the transfer itself
         energy_transfer.resize(num_pts);
-        vars_to_write.push_back("energy_transfer");
+        vars_to_write.push_back("Pi");
 
         fine_KE.resize(num_pts);
         vars_to_write.push_back("fine_KE");
@@ -106,88 +119,146 @@ void filtering_fftw(
     std::vector<const std::vector<double>*> postprocess_fields;
     std::vector<std::string> postprocess_names;
 
-
     postprocess_names.push_back("coarse_KE");
     postprocess_fields.push_back(&coarse_KE);
 
-    postprocess_names.push_back("fine_KE");
-    postprocess_fields.push_back(&fine_KE);
+    if (constants::COMP_TRANSFERS) {
+        postprocess_names.push_back("fine_KE");
+        postprocess_fields.push_back(&fine_KE);
 
-    postprocess_names.push_back("Pi");
-    postprocess_fields.push_back(&energy_transfer);
+        postprocess_names.push_back("Pi");
+        postprocess_fields.push_back(&energy_transfer);
+    }
 
     // Initialize fftw plans
-    const int rank = 2; 
-    const int howmany = Ntime;
-    const int idist = Nlat * Nlon; 
+    const int rank = 2;
+    const int howmany = Nlevels;
+    const int idist = Nlat * Nlon;
     const int odist = Nlat * (Nlon/2 + 1);
-    const int istride = 1; 
+    const int istride = 1;
     const int ostride = 1;
     int n[] = {Nlat, Nlon};
     int *inembed = NULL, *onembed = NULL;
-    const int Nk = Ntime * Ndepth * Nlat * (Nlon/2 + 1);
+    const size_t Nk = (size_t) Nlevels * Nlat * (Nlon/2 + 1);
 
     #if DEBUG >= 1
     if (wRank == 0) { fprintf(stdout, "Preparing FFTW plans.\n"); }
     #endif
-    double *fft_inp = fftw_alloc_real(Ntime * Ndepth * Nlat * Nlon);
+    if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
+
+    // Use the OpenMP threads in the transforms
+    fftw_init_threads();
+    fftw_plan_with_nthreads( omp_get_max_threads() );
+
+    // Re-use the planning from previous runs, if we have it
+    //   Only rank 0 reads the wisdom file (and it is also the only one that writes it, below),
+    //   and the wisdom is passed on to the other ranks as a string
+    if (wisdom_filename != "") {
+        int have_wisdom = 0;
+        if (wRank == 0) { have_wisdom = fftw_import_wisdom_from_filename( wisdom_filename.c_str() ); }
+        MPI_Bcast( &have_wisdom, 1, MPI_INT, 0, comm );
+
+        if (have_wisdom) {
+            char * wisdom = (wRank == 0) ? fftw_export_wisdom_to_string() : NULL;
+            int wisdom_length = (wRank == 0) ? strlen( wisdom ) + 1 : 0;
+            MPI_Bcast( &wisdom_length, 1, MPI_INT, 0, comm );
+
+            std::vector<char> wisdom_buffer( wisdom_length );
+            if (wRank == 0) {
+                std::copy( wisdom, wisdom + wisdom_length, wisdom_buffer.begin() );
+                free( wisdom );
+            }
+            MPI_Bcast( wisdom_buffer.data(), wisdom_length, MPI_CHAR, 0, comm );
+            if (wRank != 0) { fftw_import_wisdom_from_string( wisdom_buffer.data() ); }
+        }
 
-    #if DEBUG >= 1
-    if (wRank == 0) { fprintf(stdout, "   ... complex storage\n"); }
-    #endif
+        #if DEBUG >= 1
+        if ( (wRank == 0) and not(have_wisdom) ) { 
+            fprintf(stdout, "   ... no saved wisdom in %s, so planning from scratch\n", wisdom_filename.c_str()); 
+        }
+        #endif
+    }
+
+    double *fft_inp = fftw_alloc_real(num_pts);
     fftw_complex *fft_out = fftw_alloc_complex(Nk);
 
-    #if DEBUG >= 1
-    if (wRank == 0) { fprintf(stdout, "   ... forward plan\n"); }
-    #endif
     fftw_plan fft = fftw_plan_many_dft_r2c(
             rank, n, howmany,
             fft_inp, inembed, istride, idist,
             fft_out, onembed, ostride, odist,
             FFTW_PATIENT);
 
-    #if DEBUG >= 1
-    if (wRank == 0) { fprintf(stdout, "   ... backward plan\n"); }
-    #endif
     fftw_plan ifft = fftw_plan_many_dft_c2r(
             rank, n, howmany,
             fft_out, onembed, ostride, odist,
             fft_inp, inembed, istride, idist,
             FFTW_PATIENT);
 
+    // Every rank with the same grid gets the same plans, so only one needs to save them
+    //   (no other rank reads the file, so this can't race with the imports above)
+    if ( (wisdom_filename != "") and (wRank == 0) ) {
+        fftw_export_wisdom_to_filename( wisdom_filename.c_str() );
+    }
+    if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "fft_planning"); }
+
+    //
+    //// Transform each field (and product) once
+    //
+    #if DEBUG >= 1
+    if (wRank == 0) { fprintf(stdout, "Forward transforming the fields.\n"); }
+    #endif
+    if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
+
+    std::vector<const std::vector<double>*> spectral_fields  = { &full_u_x, &full_u_y, &full_u_z },
+                                            spectral_factors = { NULL,      NULL,      NULL      };
+    std::vector<std::vector<double>*>       coarse_fields    = { &coarse_u_x, &coarse_u_y, &coarse_u_z };
+    if (constants::COMP_TRANSFERS) {
+        spectral_fields.insert(  spectral_fields.end(),  { &full_u_x,    &full_u_x,    &full_u_x,    &full_u_y,    &full_u_y,    &full_u_z    } );
+        spectral_factors.insert( spectral_factors.end(), { &full_u_x,    &full_u_y,    &full_u_z,    &full_u_y,    &full_u_z,    &full_u_z    } );
+        coarse_fields.insert(    coarse_fields.end(),    { &coarse_uxux, &coarse_uxuy, &coarse_uxuz, &coarse_uyuy, &coarse_uyuz, &coarse_uzuz } );
+    }
+    const int Nspectra = spectral_fields.size();
+
+    std::vector<fftw_complex*> spectra( Nspectra );
+    for (int Ifield = 0; Ifield < Nspectra; Ifield++) {
+        spectra[Ifield] = fftw_alloc_complex(Nk);
+        fft_forward( spectra[Ifield], *spectral_fields[Ifield], spectral_factors[Ifield], mask, fft, fft_inp );
+    }
+    if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "fft_forward"); }
+
     //
     //// Begin the main filtering loop
     //
     #if DEBUG>=1
     if (wRank == 0) { fprintf(stdout, "Beginning main filtering loop.\n\n"); }
     #endif
+    std::vector<double> transfer;
     for (int Iscale = 0; Iscale < Nscales; Iscale++) {
 
+        const double scale = scales.at(Iscale);
+
         // Create the output file
+        snprintf(filename, 50, "filter_%.6gkm.nc", scale/1e3);
         if (not(constants::NO_FULL_OUTPUTS)) {
-            snprintf(filename, 50, "filter_%.6gkm.nc", scales.at(Iscale)/1e3);
-            initialize_output_file(time, depth, longitude, latitude, 
-                    dAreas, vars_to_write, filename, scales.at(Iscale));
+            initialize_output_file( source_data, vars_to_write, filename, scale );
         }
 
         #if DEBUG >= 0
-        if (wRank == 0) { 
-            fprintf(stdout, "Scale %d of %d (%.5g km)\n", 
-                Iscale+1, Nscales, scales.at(Iscale)/1e3); 
+        if (wRank == 0) {
+            fprintf(stdout, "Scale %d of %d (%.5g km)\n",
+                Iscale+1, Nscales, scale/1e3);
         }
         #endif
 
-        scale = scales.at(Iscale);
-
-        // Filter velocity fields
-        fft_filter(coarse_u_x, full_u_x, fft, ifft, fft_inp, fft_out, scale,
-                Ntime, Ndepth, Nlat, Nlon, Llat, Llon);
-        fft_filter(coarse_u_y, full_u_y, fft, ifft, fft_inp, fft_out, scale,
-                Ntime, Ndepth, Nlat, Nlon, Llat, Llon);
-        fft_filter(coarse_u_z, full_u_z, fft, ifft, fft_inp, fft_out, scale,
-                Ntime, Ndepth, Nlat, Nlon, Llat, Llon);
+        // Filter every spectrum at this scale
+        if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
+        fft_transfer_function( transfer, scale, source_data );
+        for (int Ifield = 0; Ifield < Nspectra; Ifield++) {
+            fft_filter( *coarse_fields[Ifield], spectra[Ifield], transfer, ifft, fft_inp, fft_out, Nlevels, Nlat, Nlon );
+        }
+        if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "fft_filter"); }
 
-        for (index = 0; index < num_pts; ++index) {
+        for (size_t index = 0; index < num_pts; ++index) {
             coarse_KE.at(index) = 0.5 * constants::rho0 * (
                                     pow(coarse_u_x.at(index), 2.0)
                                   + pow(coarse_u_y.at(index), 2.0)
@@ -196,25 +267,17 @@ void filtering_fftw(
         }
 
         if (constants::COMP_TRANSFERS) {
-            // Filter Quadratics (for tau)
-            fft_filter_product(coarse_uxux, full_u_x, full_u_x, fft, ifft, fft_inp, fft_out,
-                    scale, Ntime, Ndepth, Nlat, Nlon, Llat, Llon);
-            fft_filter_product(coarse_uxuy, full_u_x, full_u_y, fft, ifft, fft_inp, fft_out,
-                    scale, Ntime, Ndepth, Nlat, Nlon, Llat, Llon);
-            fft_filter_product(coarse_uxuz, full_u_x, full_u_z, fft, ifft, fft_inp, fft_out,
-                    scale, Ntime, Ndepth, Nlat, Nlon, Llat, Llon);
-            fft_filter_product(coarse_uyuy, full_u_y, full_u_y, fft, ifft, fft_inp, fft_out,
-                    scale, Ntime, Ndepth, Nlat, Nlon, Llat, Llon);
-            fft_filter_product(coarse_uyuz, full_u_y, full_u_z, fft, ifft, fft_inp, fft_out,
-                    scale, Ntime, Ndepth, Nlat, Nlon, Llat, Llon);
-            fft_filter_product(coarse_uzuz, full_u_z, full_u_z, fft, ifft, fft_inp, fft_out,
-                    scale, Ntime, Ndepth, Nlat, Nlon, Llat, Llon);
-
-            for (index = 0; index < num_pts; ++index) {
-                fine_KE.at(index) = 
+            for (size_t index = 0; index < num_pts; ++index) {
+                fine_KE.at(index) =
                     0.5 * constants::rho0 * ( coarse_uxux.at(index) + coarse_uyuy.at(index) + coarse_uzuz.at(index) )
                     - coarse_KE.at(index);
             }
+
+            // Compute the energy transfer through the filter scale
+            if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
+            compute_Pi( energy_transfer, source_data, coarse_u_x, coarse_u_y, coarse_u_z,
+                        coarse_uxux, coarse_uxuy, coarse_uxuz, coarse_uyuy, coarse_uyuz, coarse_uzuz, comm );
+            if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "compute_Pi"); }
         }
 
         #if DEBUG >= 1
@@ -223,52 +286,47 @@ void filtering_fftw(
         #endif
 
         // Write to file
+        if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
         if (not(constants::NO_FULL_OUTPUTS)) {
-            write_field_to_output(coarse_u_x, "coarse_u_x", starts, counts, filename);
-            write_field_to_output(coarse_u_y, "coarse_u_y", starts, counts, filename);
-            write_field_to_output(coarse_u_z, "coarse_u_z",   starts, counts, filename);
+            write_field_to_output(coarse_u_x, "coarse_u_x", starts, counts, filename, &mask);
+            write_field_to_output(coarse_u_y, "coarse_u_y", starts, counts, filename, &mask);
+            write_field_to_output(coarse_u_z, "coarse_u_z", starts, counts, filename, &mask);
 
-            write_field_to_output(coarse_KE, "coarse_KE", starts, counts, filename);
-            write_field_to_output(fine_KE,   "fine_KE", starts, counts, filename);
-        }
+            write_field_to_output(coarse_KE, "coarse_KE", starts, counts, filename, &mask);
 
-        if (constants::COMP_TRANSFERS) {
-            // Compute the energy transfer through the filter scale
-            compute_Pi(
-                    energy_transfer, 
-                    coarse_u_x,  coarse_u_y,  coarse_u_z,
-                    coarse_uxux, coarse_uxuy, coarse_uxuz,
-                    coarse_uyuy, coarse_uyuz, coarse_uzuz,
-                    Ntime, Ndepth, Nlat, Nlon,
-                    longitude, latitude, mask);
-
-            if (not(constants::NO_FULL_OUTPUTS)) {
-                write_field_to_output(energy_transfer, "energy_transfer", starts, counts, filename);
+            if (constants::COMP_TRANSFERS) {
+                write_field_to_output(fine_KE,         "fine_KE", starts, counts, filename, &mask);
+                write_field_to_output(energy_transfer, "Pi",      starts, counts, filename, &mask);
             }
         }
+        if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "writing"); }
 
         if (constants::APPLY_POSTPROCESS) {
-            MPI_Barrier(MPI_COMM_WORLD);
+            MPI_Barrier(comm);
 
             if (wRank == 0) { fprintf(stdout, "Beginning post-process routines\n"); }
             fflush(stdout);
 
-            Apply_Postprocess_Routines(
-                    postprocess_fields, postprocess_names,
-                    OkuboWeiss, time, depth, latitude, longitude,
-                    mask, dAreas,
-                    myCounts, myStarts,
-                    scales.at(Iscale));
+            if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
+            Apply_Postprocess_Routines( source_data, postprocess_fields, postprocess_names, OkuboWeiss, scale, timing_records, "postprocess", comm );
+            if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "postprocess"); }
         }
 
+        // If we're doing timings, then print out and reset values now
+        if (constants::DO_TIMING) {
+            timing_records.print();
+            timing_records.reset();
+            fflush(stdout);
+        }
 
     }  // end for(scale) block
 
     // Cleanup some fftw stuff
-    fftw_cleanup();
+    for (int Ifield = 0; Ifield < Nspectra; Ifield++) { fftw_free( spectra[Ifield] ); }
     fftw_destroy_plan(fft);
     fftw_destroy_plan(ifft);
     fftw_free(fft_inp);
     fftw_free(fft_out);
+    fftw_cleanup_threads();
 
 } // end filtering
@@ -1,6 +1,7 @@
 #include <math.h>
 #include <algorithm>
 #include <vector>
+#include <deque>
 #include <omp.h>
 #include <mpi.h>
 #include "../../functions.hpp"
@@ -81,11 +82,23 @@ void filtering_helmholtz(
     size_t index;
     std::vector<std::string> vars_to_write;
 
-    int LAT_lb, LAT_ub;
+    // Compressed kernel stencil (only the cells inside of the kernel support)
+    //   If the kernel can be rolled in longitude, the threads instead share one stencil per latitude
+    kernel_stencil local_stencil;
+    stencil_cache shared_stencils;
+    shared_stencils.capacity = 2 * omp_get_max_threads();
 
-    std::vector<double> local_kernel( Nlat * Nlon, 0.), 
-                        local_dl_kernel( Nlat*Nlon, 0. ),
-                        local_dll_kernel( Nlat*Nlon, 0. );
+    // (latitude, longitude-block) tasks for the threads
+    latitude_task_queue task_queue;
+
+    // Runs of water cells along each row, so that the filter loops don't need to check the mask
+    water_runs water;
+
+    // Latitude band (of target points) handled by this processor
+    latitude_bands bands;
+
+    // Output files are written through a queue (in the background if ASYNC_OUTPUT)
+    output_writer writer;
 
     std::vector<double> null_vector(0);
 
@@ -533,7 +546,7 @@ void filtering_helmholtz(
 
     // Now prepare to filter
     double scale;
-    int Itime, Idepth, Ilat, Ilon, Ilatlon, thread_id, num_threads, prev_Ilat = -1;
+    int Itime, Idepth, Ilat, Ilon, Ilon_start, Ilon_end, thread_id;
     const bool can_roll_in_longitude = ( (constants::PERIODIC_X) and (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN) );
 
     int perc_base = 5;
@@ -545,46 +558,53 @@ void filtering_helmholtz(
     std::vector<double*> filtered_vals, dl_filter_vals, dll_filter_vals, 
         dl_kernel_vals, dll_kernel_vals;
     std::vector<bool> filt_use_mask;
-    std::vector<const std::vector<double>*> filter_fields;
+    std::vector<const std::vector<filter_real>*> filter_fields;
+
+    // These are also needed (in double) elsewhere, so the filters get a copy (if needed, see FLOAT_FIELD_STORAGE)
+    std::deque< std::vector<filter_real> > filter_field_copies;
+    auto filter_view = [&filter_field_copies]( const std::vector<double> & field ) {
+        filter_field_copies.emplace_back();
+        return &filter_storage_view( filter_field_copies.back(), field );
+    };
 
     double F_pot_tmp;
-    filter_fields.push_back(&F_potential);
+    filter_fields.push_back( filter_view( F_potential ) );
     filt_use_mask.push_back(false);
 
     double F_tor_tmp;
-    filter_fields.push_back(&F_toroidal);
+    filter_fields.push_back( filter_view( F_toroidal ) );
     filt_use_mask.push_back(false);
 
     double u_r_tmp;
     if ( source_data.compute_radial_vel ) {
-        filter_fields.push_back(&u_r);
+        filter_fields.push_back( filter_view( u_r ) );
         filt_use_mask.push_back(false);
     }
 
     double uiuj_F_r_tmp, uiuj_F_Phi_tmp, uiuj_F_Psi_tmp;
     if ( constants::COMP_PI_HELMHOLTZ ) {
-        filter_fields.push_back(&uiuj_F_r);
+        filter_fields.push_back( filter_view( uiuj_F_r ) );
         filt_use_mask.push_back(false);
 
-        filter_fields.push_back(&uiuj_F_Psi);
+        filter_fields.push_back( filter_view( uiuj_F_Psi ) );
         filt_use_mask.push_back(false);
 
-        filter_fields.push_back(&uiuj_F_Phi);
+        filter_fields.push_back( filter_view( uiuj_F_Phi ) );
         filt_use_mask.push_back(false);
     }
 
     double wind_tau_Psi_tmp, wind_tau_Phi_tmp, tau_wind_dot_u_tor_tmp, tau_wind_dot_u_pot_tmp; 
     if ( constants::COMP_WIND_FORCE ) {
-        filter_fields.push_back( &wind_tau_Psi );
+        filter_fields.push_back( filter_view( wind_tau_Psi ) );
         filt_use_mask.push_back(false);
 
-        filter_fields.push_back( &wind_tau_Phi );
+        filter_fields.push_back( filter_view( wind_tau_Phi ) );
         filt_use_mask.push_back(false);
 
-        filter_fields.push_back( &tau_wind_dot_u_tor );
+        filter_fields.push_back( filter_view( tau_wind_dot_u_tor ) );
         filt_use_mask.push_back(false);
 
-        filter_fields.push_back( &tau_wind_dot_u_pot );
+        filter_fields.push_back( filter_view( tau_wind_dot_u_pot ) );
         filt_use_mask.push_back(false);
     }
 
@@ -595,6 +615,79 @@ void filtering_helmholtz(
 
     double uxux_tmp, uxuy_tmp, uxuz_tmp, uyuy_tmp, uyuz_tmp, uzuz_tmp, vort_ux_tmp, vort_uy_tmp, vort_uz_tmp;
 
+    // Filtered values for all local times / depths at a single (lat,lon) point
+    //   (the dl / dll vectors need to be non-empty to flag that they are wanted)
+    std::vector<double> level_vals, level_dl_vals(1), level_dll_vals(1), level_dl_kernel, level_dll_kernel,
+                        level_quad_vals;
+    int Ilev;
+    size_t quad_offset;
+
+    //
+    //// If the kernel can be rolled in longitude, then we can (optionally) filter
+    ////   whole latitude rows at once using FFTs in longitude
+    //
+    const bool use_lon_fft = (constants::USE_LON_FFT_FILTER) and can_roll_in_longitude;
+    std::vector<const std::vector<filter_real>*> null_factors;
+    std::vector<std::vector<double>*> lon_fft_coarse, lon_fft_dl, lon_fft_dll, null_outputs;
+    std::vector<double> lon_fft_dl_kernel, lon_fft_dll_kernel;
+
+    // The Cartesian velocities and vorticities are only needed by the filters, so move them
+    //   into the storage used by the filters (see FLOAT_FIELD_STORAGE)
+    //   quad_inputs[ 4 * Iquad + II ] is u_x, u_y, u_z, vort_r (II = 0, 1, 2, 3) for tor, pot, tot (Iquad = 0, 1, 2)
+    std::vector<std::vector<double>*> quad_sources = {
+        &u_x_tor, &u_y_tor, &u_z_tor, &full_vort_tor_r,
+        &u_x_pot, &u_y_pot, &u_z_pot, &full_vort_pot_r,
+        &u_x_tot, &u_y_tot, &u_z_tot, &full_vort_tot_r
+    };
+    std::vector<std::vector<filter_real>> quad_inputs( quad_sources.size() );
+    for (size_t II = 0; II < quad_sources.size(); II++) { move_to_filter_storage( quad_inputs.at(II), *quad_sources.at(II) ); }
+
+    // Quadratic terms (tor, pot, tot), each ordered as uxux, uxuy, uxuz, uyuy, uyuz, uzuz, vort_ux, vort_uy, vort_uz
+    std::vector<std::vector<const std::vector<filter_real>*>> quad_fields, quad_factors;
+    std::vector<std::vector<std::vector<double>*>> quad_outputs;
+    for (int Iquad = 0; Iquad < 3; Iquad++) {
+        const std::vector<filter_real>  *ux     = &quad_inputs.at( 4 * Iquad     ),
+                                        *uy     = &quad_inputs.at( 4 * Iquad + 1 ),
+                                        *uz     = &quad_inputs.at( 4 * Iquad + 2 ),
+                                        *vort   = &quad_inputs.at( 4 * Iquad + 3 );
+        quad_fields.push_back(  { ux, ux, ux, uy, uy, uz, vort, vort, vort } );
+        quad_factors.push_back( { ux, uy, uz, uy, uz, uz, ux,   uy,   uz   } );
+    }
+
+    // The point-wise loop filters all of the quadratics (tor, pot, tot) in one stencil walk,
+    //   reading only the tor and pot inputs (see apply_filter_at_point_helmholtz_quadratics)
+
+    if (use_lon_fft) {
+        lon_fft_dl_kernel.resize(  num_pts );
+        lon_fft_dll_kernel.resize( num_pts );
+
+        lon_fft_coarse = { &coarse_F_pot,  &coarse_F_tor  };
+        lon_fft_dl     = { &dl_coarse_Phi, &dl_coarse_Psi };
+        lon_fft_dll    = { &dll_coarse_Phi, &dll_coarse_Psi };
+        if ( source_data.compute_radial_vel ) {
+            lon_fft_coarse.push_back( &u_r_coarse );
+            lon_fft_dl.push_back(  &dl_coarse_u_r );
+            lon_fft_dll.push_back( &dll_coarse_u_r );
+        }
+        if ( constants::COMP_PI_HELMHOLTZ ) {
+            lon_fft_coarse.insert( lon_fft_coarse.end(), { &coarse_uiuj_F_r, &coarse_uiuj_F_Psi, &coarse_uiuj_F_Phi } );
+            lon_fft_dl.insert(  lon_fft_dl.end(),  3, NULL );
+            lon_fft_dll.insert( lon_fft_dll.end(), 3, NULL );
+        }
+        if ( constants::COMP_WIND_FORCE ) {
+            lon_fft_coarse.insert( lon_fft_coarse.end(), { &coarse_wind_tau_Psi, &coarse_wind_tau_Phi, 
+                                                           &coarse_tau_wind_dot_u_tor, &coarse_tau_wind_dot_u_pot } );
+            lon_fft_dl.insert(  lon_fft_dl.end(),  4, NULL );
+            lon_fft_dll.insert( lon_fft_dll.end(), 4, NULL );
+        }
+
+        quad_outputs = {
+            { &ux_ux_tor, &ux_uy_tor, &ux_uz_tor, &uy_uy_tor, &uy_uz_tor, &uz_uz_tor, &vort_ux_tor, &vort_uy_tor, &vort_uz_tor },
+            { &ux_ux_pot, &ux_uy_pot, &ux_uz_pot, &uy_uy_pot, &uy_uz_pot, &uz_uz_pot, &vort_ux_pot, &vort_uy_pot, &vort_uz_pot },
+            { &ux_ux_tot, &ux_uy_tot, &ux_uz_tot, &uy_uy_tot, &uy_uz_tot, &uz_uz_tot, &vort_ux_tot, &vort_uy_tot, &vort_uz_tot }
+        };
+    }
+
     //
     //// Set up post-processing variables
     //
@@ -721,7 +814,24 @@ void filtering_helmholtz(
     postprocess_fields_pot.push_back( &KE_pot_strain );
     postprocess_fields_tot.push_back( &KE_tot_strain );
 
-    
+    // The mask doesn't change between scales, so compress it into water runs once
+    water.build( mask, Ntime, Ndepth, Nlat, Nlon );
+
+    // Processors that share the same times and depths balance the filtering work by splitting the
+    //   target latitudes between them (the source fields are not split, so this doesn't reduce memory).
+    //   Each one only computes (and writes) the rows in its own band, with a halo of filtered rows
+    //   from its neighbours so that derivatives are correct within the band.
+    //   The Helmholtz scalars are filtered over land as well, so every point counts towards the cost.
+    bands.build( source_data, NULL, source_data.MPI_subcomm_sametimedepths );
+    const int   Ilat_start  = bands.first_row(),
+                Ilat_end    = bands.end_row(),
+                Nlevels     = Ntime * Ndepth;
+    #if DEBUG >= 1
+    if ( (wRank == 0) and (bands.Nbands > 1) ) {
+        fprintf(stdout, "Balancing the filtering over %d latitude bands (rank 0 has [%d, %d)).\n", bands.Nbands, Ilat_start, Ilat_end);
+    }
+    #endif
+    writer.set_latitude_band( Ilat_start, Ilat_end, Nlat );
 
     //
     //// Begin the main filtering loop
@@ -737,10 +847,11 @@ void filtering_helmholtz(
         // Create the output file
         snprintf(fname, 50, "filter_%.6gkm.nc", scales.at(Iscale)/1e3);
         if (not(constants::NO_FULL_OUTPUTS)) {
-            initialize_output_file( source_data, vars_to_write, fname, scales.at(Iscale));
+            writer.initialize_file( source_data, vars_to_write, fname, scales.at(Iscale));
 
             // Add some attributes to the file
-            add_attr_to_file("kernel_alpha", kern_alpha, fname);
+            writer.add_attr("kernel_alpha", kern_alpha, fname);
+            writer.add_attr("kernel_radius", kernel_pad() * scales.at(Iscale) / 2., fname);
         }
 
         #if DEBUG >= 0
@@ -753,22 +864,97 @@ void filtering_helmholtz(
         scale = scales.at(Iscale);
         perc  = perc_base;
 
+        // Wall time for the filtering on this processor, to compare across processors
+        const double filter_clock = MPI_Wtime();
+
         #if DEBUG >= 1
         if (wRank == 0) { fprintf(stdout, "  filtering: "); }
         fflush(stdout);
         #endif
 
+        if (use_lon_fft) {
+            // Filter whole latitude rows of this processor's band at once, then convert the 
+            //   ell-derivatives and quadratic terms into the same form as the point-wise loop below
+            if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
+            apply_filter_via_lon_fft( lon_fft_coarse, lon_fft_dl, lon_fft_dll, 
+                    &lon_fft_dl_kernel, &lon_fft_dll_kernel,
+                    filter_fields, null_factors, source_data, scale, Ilat_start, Ilat_end );
+            if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "filter_via_lon_fft"); }
+
+            if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
+            for (size_t Iquad = 0; Iquad < quad_fields.size(); Iquad++) {
+                apply_filter_via_lon_fft( quad_outputs.at(Iquad), null_outputs, null_outputs, NULL, NULL,
+                        quad_fields.at(Iquad), quad_factors.at(Iquad), source_data, scale, Ilat_start, Ilat_end );
+            }
+            if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "filter_via_lon_fft_for_quadratics"); }
+
+            #pragma omp parallel \
+            default(none) \
+            shared( mask, lon_fft_coarse, lon_fft_dl, lon_fft_dll, lon_fft_dl_kernel, lon_fft_dll_kernel, \
+                    quad_outputs, KE_tor_filt, KE_pot_filt, KE_tot_filt, ux_ux_tor, uy_uy_tor, uz_uz_tor, \
+                    ux_ux_pot, uy_uy_pot, uz_uz_pot, ux_ux_tot, uy_uy_tot, uz_uz_tot, \
+                    coarse_tau_wind_dot_u_tor, coarse_tau_wind_dot_u_pot, coarse_tau_wind_dot_u_tot ) \
+            private( index ) \
+            firstprivate( num_pts, Nlat, Nlon, Ilat_start, Ilat_end )
+            {
+                double coarse_val, dl_val, dll_val, dl_kern, dll_kern;
+                int Ilat;
+
+                #pragma omp for collapse(1) schedule(static)
+                for (index = 0; index < num_pts; ++index) {
+
+                    // Only this processor's latitude band was filtered
+                    Ilat = ( index / Nlon ) % Nlat;
+                    if ( (Ilat < Ilat_start) or (Ilat >= Ilat_end) ) { continue; }
+
+                    // Convert filtered-with-derivative-kernel values to ell-derivatives of the coarse field
+                    dl_kern  = lon_fft_dl_kernel.at(index);
+                    dll_kern = lon_fft_dll_kernel.at(index);
+                    for (size_t II = 0; II < lon_fft_coarse.size(); II++) {
+                        if (lon_fft_dl.at(II) == NULL) { continue; }
+                        coarse_val = lon_fft_coarse.at(II)->at(index);
+                        dl_val     = lon_fft_dl.at(II)->at(index);
+                        dll_val    = lon_fft_dll.at(II)->at(index);
+
+                        lon_fft_dl.at(II)->at(index)  = (dl_val - coarse_val) * dl_kern;
+                        lon_fft_dll.at(II)->at(index) = 
+                            ( dll_val - coarse_val ) * dll_kern
+                            - 2 * (dl_val - coarse_val) * pow( dl_kern, 2 );
+                    }
+
+                    if ( constants::COMP_WIND_FORCE ) {
+                        coarse_tau_wind_dot_u_tot.at( index ) =   coarse_tau_wind_dot_u_tor.at( index ) 
+                                                                + coarse_tau_wind_dot_u_pot.at( index );
+                    }
+
+                    // The quadratic terms are only kept on water cells
+                    if ( mask.at(index) ) {
+                        KE_tor_filt.at(index) = 0.5 * constants::rho0 * (ux_ux_tor.at(index) + uy_uy_tor.at(index) + uz_uz_tor.at(index));
+                        KE_pot_filt.at(index) = 0.5 * constants::rho0 * (ux_ux_pot.at(index) + uy_uy_pot.at(index) + uz_uz_pot.at(index));
+                        KE_tot_filt.at(index) = 0.5 * constants::rho0 * (ux_ux_tot.at(index) + uy_uy_tot.at(index) + uz_uz_tot.at(index));
+                    } else {
+                        for (size_t Iquad = 0; Iquad < quad_outputs.size(); Iquad++) {
+                            for (size_t II = 0; II < quad_outputs.at(Iquad).size(); II++) {
+                                quad_outputs.at(Iquad).at(II)->at(index) = 0.;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        // Otherwise, apply the filter point-by-point
+        task_queue.build( Ilat_start, Ilat_end, Nlon, omp_get_max_threads() );
+        if (not(use_lon_fft))
         #pragma omp parallel \
         default(none) \
-        shared( source_data, mask, stdout, perc_base, \
-                filter_fields, filt_use_mask, \
+        shared( source_data, mask, stdout, perc_base, task_queue, shared_stencils, \
+                filter_fields, filt_use_mask, null_factors, quad_inputs, water, \
                 timing_records, clock_on, \
                 longitude, latitude, scale, \
                 F_potential, F_toroidal, coarse_F_tor, coarse_F_pot, u_r, u_r_coarse, \
                 dl_coarse_Phi, dll_coarse_Phi, dl_coarse_Psi, dll_coarse_Psi, \
                 dl_coarse_u_r, dll_coarse_u_r, \
-                full_vort_tor_r, full_vort_pot_r, full_vort_tot_r, \
-                u_x_tor, u_y_tor, u_z_tor, u_x_pot, u_y_pot, u_z_pot, u_x_tot, u_y_tot, u_z_tot, \
                 ux_ux_tor, ux_uy_tor, ux_uz_tor, uy_uy_tor, uy_uz_tor, uz_uz_tor,\
                 ux_ux_pot, ux_uy_pot, ux_uz_pot, uy_uy_pot, uy_uz_pot, uz_uz_pot,\
                 ux_ux_tot, ux_uy_tot, ux_uz_tot, uy_uy_tot, uy_uz_tot, uz_uz_tot,\
@@ -781,15 +967,16 @@ void filtering_helmholtz(
                 coarse_wind_tau_Psi, coarse_wind_tau_Phi, \
                 coarse_tau_wind_dot_u_tor, coarse_tau_wind_dot_u_pot, coarse_tau_wind_dot_u_tot \
                 ) \
-        private(Itime, Idepth, Ilat, Ilon, index, prev_Ilat, Ilatlon, \
+        private(Itime, Idepth, Ilat, Ilon, Ilon_start, Ilon_end, index, \
                 F_tor_tmp, F_pot_tmp, u_r_tmp, uxux_tmp, uxuy_tmp, uxuz_tmp, uyuy_tmp, uyuz_tmp, uzuz_tmp, \
-                vort_ux_tmp, vort_uy_tmp, vort_uz_tmp, LAT_lb, LAT_ub, thread_id, num_threads, \
-                filtered_vals, dl_filter_vals, dll_filter_vals, dl_kernel_val, dll_kernel_val, \
+                vort_ux_tmp, vort_uy_tmp, vort_uz_tmp, thread_id, \
+                filtered_vals, dl_filter_vals, dll_filter_vals, dl_kernel_val, dll_kernel_val, Ilev, quad_offset, \
                 uiuj_F_r_tmp, uiuj_F_Phi_tmp, uiuj_F_Psi_tmp, \
                 dl_Psi_tmp, dll_Psi_tmp, dl_Phi_tmp, dll_Phi_tmp, dl_ur_tmp, dll_ur_tmp, \
                 wind_tau_Psi_tmp, wind_tau_Phi_tmp, tau_wind_dot_u_tor_tmp, tau_wind_dot_u_pot_tmp ) \
-        firstprivate(perc, wRank, local_kernel, local_dl_kernel, local_dll_kernel, \
-                perc_count, Nlon, Nlat, Ndepth, Ntime )
+        firstprivate(perc, wRank, local_stencil, \
+                level_vals, level_dl_vals, level_dll_vals, level_dl_kernel, level_dll_kernel, level_quad_vals, \
+                perc_count, Nlon, Nlat, Ndepth, Ntime, Ilat_start, Ilat_end )
         {
 
             filtered_vals.clear();
@@ -849,54 +1036,33 @@ void filtering_helmholtz(
             }
 
             thread_id = omp_get_thread_num();  // thread ID
-            num_threads = omp_get_num_threads(); // number of threads
-
-            prev_Ilat = -1; // forces kernel computation on first iteration
-
-            // Melt latitude and longitude into one loop
-            //   This is done manually (instead of simply using a 'collapse(2)'
-            //   for optimization purposes. If threads jump between latitudes, 
-            //   they need to keep recomputing the kernel, which is costly.
-            //   Here we force them to iterate through one latitude at a time, 
-            //   splitting the longitudes evenly between the group
-            // If cost per point varies heavily, this could have load balancing issues,
-            //   but in the case of filtering over land (the typical Helmholtz case)
-            //   there is no land/water distinction, and so filtering cost should be
-            //   similar at all longitudes.
-            for (Ilatlon = thread_id; Ilatlon < Nlat * Nlon; Ilatlon = Ilatlon + num_threads) {
-                Ilon = Ilatlon % Nlon;
-                Ilat = Ilatlon / Nlon;
-
-                get_lat_bounds(LAT_lb, LAT_ub, latitude,  Ilat, scale); 
-
-                // If our longitude grid is uniform, and spans the full periodic domain,
-                // AND we're at the same latitude as the last iteration of the loop,
-                // then we can just re-use the kernel.
-                // Otherwise, we need to compute the kernel.
-                if ( can_roll_in_longitude and (Ilat == prev_Ilat) ) {
-                    // just re-use the kernel from last time
-                } else if ( can_roll_in_longitude ) {
-                    // At a new latitude, so compute kernel at reference longitude (index 0)
-                    if ( (constants::DO_TIMING) and (thread_id == 0) ) { clock_on = MPI_Wtime(); }
-                    compute_local_kernel( local_kernel, local_dl_kernel, local_dll_kernel,
-                            scale, source_data, Ilat, 0, LAT_lb, LAT_ub );
-                    if ( (constants::DO_TIMING) and (thread_id == 0) ) { timing_records.add_to_record(MPI_Wtime() - clock_on, "kernel_computation"); }
-                } else {
-                    // Otherwise, we need to compute the whole kernel every time. Boo.
+
+            // The stencil for the current point. When the kernel can be rolled in longitude,
+            //   this is the shared stencil for the latitude, otherwise it is built at every point.
+            std::shared_ptr<const kernel_stencil> latitude_stencil;
+            const kernel_stencil * stencil = &local_stencil;
+            bool was_built;
+
+            // Work through (latitude, longitude-block) tasks
+            //   Each thread starts on its own contiguous set of latitudes, and steals
+            //   from the others once it runs out, so that expensive rows (near the poles, 
+            //   or with more water) don't leave the other threads idle. Since the threads
+            //   mostly stay on their own latitudes, and share the stencils that they build,
+            //   each stencil is only built about once.
+            while ( task_queue.next_task( thread_id, Ilat, Ilon_start, Ilon_end ) ) {
+
+                if ( can_roll_in_longitude ) {
+                    // Get the stencil at the reference longitude (index 0), built by whichever thread got here first
                     if ( (constants::DO_TIMING) and (thread_id == 0) ) { clock_on = MPI_Wtime(); }
-                    compute_local_kernel( local_kernel, local_dl_kernel, local_dll_kernel,
-                            scale, source_data, Ilat, Ilon, LAT_lb, LAT_ub );
-                    if ( (constants::DO_TIMING) and (thread_id == 0) ) { timing_records.add_to_record(MPI_Wtime() - clock_on, "kernel_computation_all"); }
+                    latitude_stencil = shared_stencils.get( source_data, scale, Ilat, true, true, was_built );
+                    stencil = latitude_stencil.get();
+                    if ( (constants::DO_TIMING) and (thread_id == 0) and was_built ) { timing_records.add_to_record(MPI_Wtime() - clock_on, "kernel_computation"); }
                 }
-                // And set prev_Ilat before we forget
-                prev_Ilat = Ilat;
-
-                //fprintf( stdout, "Finished computing local kernel (tid %d of %d).\n", thread_id, num_threads );
 
                 #if DEBUG >= 0
                 if ( (thread_id == 0) and (wRank == 0) ) {
                     // Every perc_base percent, print a dot, but only the first thread
-                    if ( ((double)(Ilat*Nlon + Ilon + 1) / (Nlon*Nlat)) * 100 >= perc ) {
+                    if ( task_queue.fraction_issued() * 100 >= perc ) {
                         perc_count++;
                         if (perc_count % 5 == 0) { fprintf(stdout, "|"); }
                         else                     { fprintf(stdout, "."); }
@@ -906,145 +1072,207 @@ void filtering_helmholtz(
                 }
                 #endif
 
-                for (Itime = 0; Itime < Ntime; Itime++) {
-                    for (Idepth = 0; Idepth < Ndepth; Idepth++) {
-
-                        // Convert our four-index to a one-index
-                        index = Index(Itime, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon);
-
-                        // The F_tor and F_pot fields exist over land from the projection
-                        //     procedure, so do those filtering operations on land as well.
-                        // The other stuff (KE, etc), will only be done on water cells
+                for (Ilon = Ilon_start; Ilon < Ilon_end; Ilon++) {
 
-                        // Apply the filter at the point
+                    if ( not(can_roll_in_longitude) ) {
+                        // Without rolling, we need to compute the whole kernel at every point. Boo.
                         if ( (constants::DO_TIMING) and (thread_id == 0) ) { clock_on = MPI_Wtime(); }
-                        apply_filter_at_point(  
-                                filtered_vals, dl_filter_vals, dll_filter_vals,
-                                dl_kernel_val, dll_kernel_val,
-                                filter_fields, source_data, Itime, Idepth, Ilat, Ilon, 
-                                LAT_lb, LAT_ub, scale, filt_use_mask, 
-                                local_kernel, local_dl_kernel, local_dll_kernel );
-                        if ( (constants::DO_TIMING) and (thread_id == 0) ) { timing_records.add_to_record(MPI_Wtime() - clock_on, "filter_at_point"); }
-
-                        // Store the filtered values in the appropriate arrays
-
-                        // Phi
-                        coarse_F_pot.at(index) = F_pot_tmp;
-                        dl_coarse_Phi.at(index) = (dl_Phi_tmp - F_pot_tmp) * dl_kernel_val;
-                        dll_coarse_Phi.at(index) = 
-                            ( dll_Phi_tmp - F_pot_tmp ) * dll_kernel_val
-                            - 2 * (dl_Phi_tmp - F_pot_tmp) * pow( dl_kernel_val, 2 );
-
-                        // Psi
-                        coarse_F_tor.at(index) = F_tor_tmp;
-                        dl_coarse_Psi.at(index) = (dl_Psi_tmp - F_tor_tmp) * dl_kernel_val;
-                        dll_coarse_Psi.at(index) = 
-                            ( dll_Psi_tmp - F_tor_tmp ) * dll_kernel_val
-                            - 2 * (dl_Psi_tmp - F_tor_tmp) * pow( dl_kernel_val, 2 );
-
-                        // u_r
-                        if ( source_data.compute_radial_vel ) {
-                            u_r_coarse.at(index) = u_r_tmp;
-                            dl_coarse_u_r.at(index) = (dl_ur_tmp - u_r_tmp) * dl_kernel_val;
-                            dll_coarse_u_r.at(index) = 
-                                ( dll_ur_tmp - u_r_tmp ) * dll_kernel_val
-                                - 2 * (dl_ur_tmp - u_r_tmp) * pow( dl_kernel_val, 2 );
-                        }
+                        local_stencil.build( source_data, scale, Ilat, Ilon, true, true );
+                        if ( (constants::DO_TIMING) and (thread_id == 0) ) { timing_records.add_to_record(MPI_Wtime() - clock_on, "kernel_computation_all"); }
+                    }
+
+                    // Apply the filter at the point, walking the stencil once for all local times / depths
+                    //   The F_tor and F_pot fields exist over land from the projection
+                    //   procedure, so do those filtering operations on land as well.
+                    if ( (constants::DO_TIMING) and (thread_id == 0) ) { clock_on = MPI_Wtime(); }
+                    apply_filter_at_point_all_levels(
+                            level_vals, level_dl_vals, level_dll_vals,
+                            level_dl_kernel, level_dll_kernel,
+                            filter_fields, null_factors, source_data, Ilat, Ilon, *stencil, NULL, false, &water );
+                    if ( (constants::DO_TIMING) and (thread_id == 0) ) { timing_records.add_to_record(MPI_Wtime() - clock_on, "filter_at_point"); }
 
-                        if ( constants::COMP_PI_HELMHOLTZ ) {
-                            coarse_uiuj_F_r.at(  index) = uiuj_F_r_tmp;
-                            coarse_uiuj_F_Phi.at(index) = uiuj_F_Phi_tmp;
-                            if ( ( uiuj_F_Phi_tmp == 0 ) and ( wRank == 0 ) ) {
-                                fprintf( stdout, " bar(F_phi[%'d,%'d]) = 0 (loc val is %'.4g)\n", Ilat, Ilon, uiuj_F_Phi.at(index) );
+                    // The quadratics (tor, pot, tot) are only needed on water cells, and share the same stencil
+                    if ( (constants::DO_TIMING) and (thread_id == 0) ) { clock_on = MPI_Wtime(); }
+                    apply_filter_at_point_helmholtz_quadratics(
+                            level_quad_vals,
+                            quad_inputs[0], quad_inputs[1], quad_inputs[2], quad_inputs[3],
+                            quad_inputs[4], quad_inputs[5], quad_inputs[6], quad_inputs[7],
+                            source_data, Ilat, Ilon, *stencil, &water );
+                    if ( (constants::DO_TIMING) and (thread_id == 0) ) { timing_records.add_to_record(MPI_Wtime() - clock_on, "filter_at_point_for_quadratics"); }
+
+                    for (Itime = 0; Itime < Ntime; Itime++) {
+                        for (Idepth = 0; Idepth < Ndepth; Idepth++) {
+
+                            // Convert our four-index to a one-index
+                            index = Index(Itime, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon);
+
+                            // The other stuff (KE, etc), will only be done on water cells
+
+                            // Unpack the filtered values for this level
+                            Ilev = Itime * Ndepth + Idepth;
+                            for (size_t II = 0; II < filtered_vals.size(); II++) {
+                                *(filtered_vals.at(II)) = level_vals.at( Ilev * filter_fields.size() + II );
+                                if (dl_filter_vals.at(II)  != NULL) { *(dl_filter_vals.at(II))  = level_dl_vals.at(  Ilev * filter_fields.size() + II ); }
+                                if (dll_filter_vals.at(II) != NULL) { *(dll_filter_vals.at(II)) = level_dll_vals.at( Ilev * filter_fields.size() + II ); }
+                            }
+                            dl_kernel_val  = level_dl_kernel.at(Ilev);
+                            dll_kernel_val = level_dll_kernel.at(Ilev);
+
+                            // Store the filtered values in the appropriate arrays
+
+                            // Phi
+                            coarse_F_pot.at(index) = F_pot_tmp;
+                            dl_coarse_Phi.at(index) = (dl_Phi_tmp - F_pot_tmp) * dl_kernel_val;
+                            dll_coarse_Phi.at(index) = 
+                                ( dll_Phi_tmp - F_pot_tmp ) * dll_kernel_val
+                                - 2 * (dl_Phi_tmp - F_pot_tmp) * pow( dl_kernel_val, 2 );
+
+                            // Psi
+                            coarse_F_tor.at(index) = F_tor_tmp;
+                            dl_coarse_Psi.at(index) = (dl_Psi_tmp - F_tor_tmp) * dl_kernel_val;
+                            dll_coarse_Psi.at(index) = 
+                                ( dll_Psi_tmp - F_tor_tmp ) * dll_kernel_val
+                                - 2 * (dl_Psi_tmp - F_tor_tmp) * pow( dl_kernel_val, 2 );
+
+                            // u_r
+                            if ( source_data.compute_radial_vel ) {
+                                u_r_coarse.at(index) = u_r_tmp;
+                                dl_coarse_u_r.at(index) = (dl_ur_tmp - u_r_tmp) * dl_kernel_val;
+                                dll_coarse_u_r.at(index) = 
+                                    ( dll_ur_tmp - u_r_tmp ) * dll_kernel_val
+                                    - 2 * (dl_ur_tmp - u_r_tmp) * pow( dl_kernel_val, 2 );
                             }
-                            coarse_uiuj_F_Psi.at(index) = uiuj_F_Psi_tmp;
-                        }
 
-                        if ( constants::COMP_WIND_FORCE ) {
-                            coarse_wind_tau_Psi.at( index ) = wind_tau_Psi_tmp;
-                            coarse_wind_tau_Phi.at( index ) = wind_tau_Phi_tmp;
-                            coarse_tau_wind_dot_u_tor.at( index ) = tau_wind_dot_u_tor_tmp;
-                            coarse_tau_wind_dot_u_pot.at( index ) = tau_wind_dot_u_pot_tmp;
-                            coarse_tau_wind_dot_u_tot.at( index ) = tau_wind_dot_u_tor_tmp + tau_wind_dot_u_pot_tmp;
-                        }
+                            if ( constants::COMP_PI_HELMHOLTZ ) {
+                                coarse_uiuj_F_r.at(  index) = uiuj_F_r_tmp;
+                                coarse_uiuj_F_Phi.at(index) = uiuj_F_Phi_tmp;
+                                if ( ( uiuj_F_Phi_tmp == 0 ) and ( wRank == 0 ) ) {
+                                    fprintf( stdout, " bar(F_phi[%'d,%'d]) = 0 (loc val is %'.4g)\n", Ilat, Ilon, uiuj_F_Phi.at(index) );
+                                }
+                                coarse_uiuj_F_Psi.at(index) = uiuj_F_Psi_tmp;
+                            }
 
-                        if ( mask.at(index) ) {
-                            if ( (constants::DO_TIMING) and (thread_id == 0) ) { clock_on = MPI_Wtime(); }
-
-                            //
-                            //// Also get (uiuj)_bar from Cartesian velocities
-                            //
-
-                            // tor
-                            apply_filter_at_point_for_quadratics(
-                                    uxux_tmp, uxuy_tmp, uxuz_tmp, uyuy_tmp, uyuz_tmp, uzuz_tmp, vort_ux_tmp, vort_uy_tmp, vort_uz_tmp,
-                                    u_x_tor,  u_y_tor,  u_z_tor, full_vort_tor_r, source_data, Itime, Idepth, Ilat, Ilon,
-                                    LAT_lb, LAT_ub, scale, local_kernel);
-
-                            ux_ux_tor.at(index) = uxux_tmp;
-                            ux_uy_tor.at(index) = uxuy_tmp;
-                            ux_uz_tor.at(index) = uxuz_tmp;
-                            uy_uy_tor.at(index) = uyuy_tmp;
-                            uy_uz_tor.at(index) = uyuz_tmp;
-                            uz_uz_tor.at(index) = uzuz_tmp;
-
-                            vort_ux_tor.at(index) = vort_ux_tmp;
-                            vort_uy_tor.at(index) = vort_uy_tmp;
-                            vort_uz_tor.at(index) = vort_uz_tmp;
-
-                            KE_tor_filt.at(index) = 0.5 * constants::rho0 * (uxux_tmp + uyuy_tmp + uzuz_tmp);
-
-                            // pot
-                            apply_filter_at_point_for_quadratics(
-                                    uxux_tmp, uxuy_tmp, uxuz_tmp, uyuy_tmp, uyuz_tmp, uzuz_tmp, vort_ux_tmp, vort_uy_tmp, vort_uz_tmp,
-                                    u_x_pot,  u_y_pot,  u_z_pot, full_vort_pot_r, source_data, Itime, Idepth, Ilat, Ilon,
-                                    LAT_lb, LAT_ub, scale, local_kernel);
-
-                            ux_ux_pot.at(index) = uxux_tmp;
-                            ux_uy_pot.at(index) = uxuy_tmp;
-                            ux_uz_pot.at(index) = uxuz_tmp;
-                            uy_uy_pot.at(index) = uyuy_tmp;
-                            uy_uz_pot.at(index) = uyuz_tmp;
-                            uz_uz_pot.at(index) = uzuz_tmp;
-
-                            vort_ux_pot.at(index) = vort_ux_tmp;
-                            vort_uy_pot.at(index) = vort_uy_tmp;
-                            vort_uz_pot.at(index) = vort_uz_tmp;
-
-                            KE_pot_filt.at(index) = 0.5 * constants::rho0 * (uxux_tmp + uyuy_tmp + uzuz_tmp);
-
-                            // tot
-                            apply_filter_at_point_for_quadratics(
-                                    uxux_tmp, uxuy_tmp, uxuz_tmp, uyuy_tmp, uyuz_tmp, uzuz_tmp, vort_ux_tmp, vort_uy_tmp, vort_uz_tmp,
-                                    u_x_tot,  u_y_tot,  u_z_tot, full_vort_tot_r, source_data, Itime, Idepth, Ilat, Ilon,
-                                    LAT_lb, LAT_ub, scale, local_kernel);
-
-                            ux_ux_tot.at(index) = uxux_tmp;
-                            ux_uy_tot.at(index) = uxuy_tmp;
-                            ux_uz_tot.at(index) = uxuz_tmp;
-                            uy_uy_tot.at(index) = uyuy_tmp;
-                            uy_uz_tot.at(index) = uyuz_tmp;
-                            uz_uz_tot.at(index) = uzuz_tmp;
-
-                            vort_ux_tot.at(index) = vort_ux_tmp;
-                            vort_uy_tot.at(index) = vort_uy_tmp;
-                            vort_uz_tot.at(index) = vort_uz_tmp;
-
-                            KE_tot_filt.at(index) = 0.5 * constants::rho0 * (uxux_tmp + uyuy_tmp + uzuz_tmp);
-
-                            if ( (constants::DO_TIMING) and (thread_id == 0) ) { 
-                                timing_records.add_to_record(MPI_Wtime() - clock_on, "filter_at_point_for_quadratics"); 
+                            if ( constants::COMP_WIND_FORCE ) {
+                                coarse_wind_tau_Psi.at( index ) = wind_tau_Psi_tmp;
+                                coarse_wind_tau_Phi.at( index ) = wind_tau_Phi_tmp;
+                                coarse_tau_wind_dot_u_tor.at( index ) = tau_wind_dot_u_tor_tmp;
+                                coarse_tau_wind_dot_u_pot.at( index ) = tau_wind_dot_u_pot_tmp;
+                                coarse_tau_wind_dot_u_tot.at( index ) = tau_wind_dot_u_tor_tmp + tau_wind_dot_u_pot_tmp;
                             }
 
-                        }  // end if(masked) block
-                    }  // end for(depth) block
-                }  // end for(time) block
-            }  // end for(latitude-longitude) block
+                            if ( mask.at(index) ) {
+
+                                //
+                                //// Also get (uiuj)_bar from Cartesian velocities
+                                //
+
+                                // tor
+                                quad_offset = ( Ilev * 3 + 0 ) * 9;
+                                uxux_tmp = level_quad_vals.at( quad_offset + 0 );
+                                uxuy_tmp = level_quad_vals.at( quad_offset + 1 );
+                                uxuz_tmp = level_quad_vals.at( quad_offset + 2 );
+                                uyuy_tmp = level_quad_vals.at( quad_offset + 3 );
+                                uyuz_tmp = level_quad_vals.at( quad_offset + 4 );
+                                uzuz_tmp = level_quad_vals.at( quad_offset + 5 );
+                                vort_ux_tmp = level_quad_vals.at( quad_offset + 6 );
+                                vort_uy_tmp = level_quad_vals.at( quad_offset + 7 );
+                                vort_uz_tmp = level_quad_vals.at( quad_offset + 8 );
+
+                                ux_ux_tor.at(index) = uxux_tmp;
+                                ux_uy_tor.at(index) = uxuy_tmp;
+                                ux_uz_tor.at(index) = uxuz_tmp;
+                                uy_uy_tor.at(index) = uyuy_tmp;
+                                uy_uz_tor.at(index) = uyuz_tmp;
+                                uz_uz_tor.at(index) = uzuz_tmp;
+
+                                vort_ux_tor.at(index) = vort_ux_tmp;
+                                vort_uy_tor.at(index) = vort_uy_tmp;
+                                vort_uz_tor.at(index) = vort_uz_tmp;
+
+                                KE_tor_filt.at(index) = 0.5 * constants::rho0 * (uxux_tmp + uyuy_tmp + uzuz_tmp);
+
+                                // pot
+                                quad_offset = ( Ilev * 3 + 1 ) * 9;
+                                uxux_tmp = level_quad_vals.at( quad_offset + 0 );
+                                uxuy_tmp = level_quad_vals.at( quad_offset + 1 );
+                                uxuz_tmp = level_quad_vals.at( quad_offset + 2 );
+                                uyuy_tmp = level_quad_vals.at( quad_offset + 3 );
+                                uyuz_tmp = level_quad_vals.at( quad_offset + 4 );
+                                uzuz_tmp = level_quad_vals.at( quad_offset + 5 );
+                                vort_ux_tmp = level_quad_vals.at( quad_offset + 6 );
+                                vort_uy_tmp = level_quad_vals.at( quad_offset + 7 );
+                                vort_uz_tmp = level_quad_vals.at( quad_offset + 8 );
+
+                                ux_ux_pot.at(index) = uxux_tmp;
+                                ux_uy_pot.at(index) = uxuy_tmp;
+                                ux_uz_pot.at(index) = uxuz_tmp;
+                                uy_uy_pot.at(index) = uyuy_tmp;
+                                uy_uz_pot.at(index) = uyuz_tmp;
+                                uz_uz_pot.at(index) = uzuz_tmp;
+
+                                vort_ux_pot.at(index) = vort_ux_tmp;
+                                vort_uy_pot.at(index) = vort_uy_tmp;
+                                vort_uz_pot.at(index) = vort_uz_tmp;
+
+                                KE_pot_filt.at(index) = 0.5 * constants::rho0 * (uxux_tmp + uyuy_tmp + uzuz_tmp);
+
+                                // tot
+                                quad_offset = ( Ilev * 3 + 2 ) * 9;
+                                uxux_tmp = level_quad_vals.at( quad_offset + 0 );
+                                uxuy_tmp = level_quad_vals.at( quad_offset + 1 );
+                                uxuz_tmp = level_quad_vals.at( quad_offset + 2 );
+                                uyuy_tmp = level_quad_vals.at( quad_offset + 3 );
+                                uyuz_tmp = level_quad_vals.at( quad_offset + 4 );
+                                uzuz_tmp = level_quad_vals.at( quad_offset + 5 );
+                                vort_ux_tmp = level_quad_vals.at( quad_offset + 6 );
+                                vort_uy_tmp = level_quad_vals.at( quad_offset + 7 );
+                                vort_uz_tmp = level_quad_vals.at( quad_offset + 8 );
+
+                                ux_ux_tot.at(index) = uxux_tmp;
+                                ux_uy_tot.at(index) = uxuy_tmp;
+                                ux_uz_tot.at(index) = uxuz_tmp;
+                                uy_uy_tot.at(index) = uyuy_tmp;
+                                uy_uz_tot.at(index) = uyuz_tmp;
+                                uz_uz_tot.at(index) = uzuz_tmp;
+
+                                vort_ux_tot.at(index) = vort_ux_tmp;
+                                vort_uy_tot.at(index) = vort_uy_tmp;
+                                vort_uz_tot.at(index) = vort_uz_tmp;
+
+                                KE_tot_filt.at(index) = 0.5 * constants::rho0 * (uxux_tmp + uyuy_tmp + uzuz_tmp);
+
+                            }  // end if(masked) block
+                        }  // end for(depth) block
+                    }  // end for(time) block
+                }  // end for(longitude) block
+            }  // end while(tasks) block
         }  // end pragma parallel block
         #if DEBUG >= 0
         if (wRank == 0) { fprintf(stdout, "\n"); }
+        print_load_imbalance( MPI_Wtime() - filter_clock, "filtering", comm );
         #endif
 
+        // Fill in the rows just outside of this band, so that the derivatives are correct within the band.
+        //   The longest chain is Psi / Phi -> velocity -> vorticity -> gradients of vorticity (in Z),
+        //   the rest of the filtered fields are only ever used point-wise, and so stay band-only.
+        if (bands.Nbands > 1) {
+            if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
+            const int Nhalo = 3 * ( constants::DiffOrd + 1 );
+            for ( std::vector<double> * field : { &coarse_F_tor, &coarse_F_pot, &u_r_coarse,
+                                                  &dl_coarse_Phi, &dl_coarse_Psi, &dll_coarse_Phi, &dll_coarse_Psi,
+                                                  &ux_ux_tor, &ux_uy_tor, &ux_uz_tor, &uy_uy_tor, &uy_uz_tor, &uz_uz_tor,
+                                                  &ux_ux_pot, &ux_uy_pot, &ux_uz_pot, &uy_uy_pot, &uy_uz_pot, &uz_uz_pot,
+                                                  &ux_ux_tot, &ux_uy_tot, &ux_uz_tot, &uy_uy_tot, &uy_uz_tot, &uz_uz_tot,
+                                                  &vort_ux_tor, &vort_uy_tor, &vort_uz_tor,
+                                                  &vort_ux_pot, &vort_uy_pot, &vort_uz_pot,
+                                                  &vort_ux_tot, &vort_uy_tot, &vort_uz_tot,
+                                                  &coarse_uiuj_F_r, &coarse_uiuj_F_Phi, &coarse_uiuj_F_Psi,
+                                                  &coarse_wind_tau_Psi, &coarse_wind_tau_Phi } ) {
+                bands.exchange_halo( *field, Nlevels, Nlon, Nhalo );
+            }
+            if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "exchange_band_halos"); }
+        }
+
         #if DEBUG >= 2
         fprintf(stdout, "  = Rank %d finished filtering loop =\n", wRank);
         fflush(stdout);
@@ -1054,13 +1282,13 @@ void filtering_helmholtz(
         if (not(constants::NO_FULL_OUTPUTS)) {
             if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
             // Don't mask these fields, since they are filled over land from the projection
-            write_field_to_output(coarse_F_tor, "coarse_F_tor", starts, counts, fname, NULL);
-            write_field_to_output(coarse_F_pot, "coarse_F_pot", starts, counts, fname, NULL);
+            writer.write(coarse_F_tor, "coarse_F_tor", starts, counts, fname, NULL);
+            writer.write(coarse_F_pot, "coarse_F_pot", starts, counts, fname, NULL);
 
             if ( constants::COMP_PI_HELMHOLTZ ) {
-                write_field_to_output(coarse_uiuj_F_r,   "coarse_uiuj_F_r",   starts, counts, fname, NULL);
-                write_field_to_output(coarse_uiuj_F_Phi, "coarse_uiuj_F_Phi", starts, counts, fname, NULL);
-                write_field_to_output(coarse_uiuj_F_Psi, "coarse_uiuj_F_Psi", starts, counts, fname, NULL);
+                writer.write(coarse_uiuj_F_r,   "coarse_uiuj_F_r",   starts, counts, fname, NULL);
+                writer.write(coarse_uiuj_F_Phi, "coarse_uiuj_F_Phi", starts, counts, fname, NULL);
+                writer.write(coarse_uiuj_F_Psi, "coarse_uiuj_F_Psi", starts, counts, fname, NULL);
             }
             if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "writing");  }
         }
@@ -1087,14 +1315,14 @@ void filtering_helmholtz(
 
         if (not(constants::NO_FULL_OUTPUTS)) {
             if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
-            write_field_to_output(u_lon_tor, "u_lon_tor", starts, counts, fname, &mask);
-            write_field_to_output(u_lat_tor, "u_lat_tor", starts, counts, fname, &mask);
+            writer.write(u_lon_tor, "u_lon_tor", starts, counts, fname, &mask);
+            writer.write(u_lat_tor, "u_lat_tor", starts, counts, fname, &mask);
 
-            write_field_to_output(u_lon_pot, "u_lon_pot", starts, counts, fname, &mask);
-            write_field_to_output(u_lat_pot, "u_lat_pot", starts, counts, fname, &mask);
+            writer.write(u_lon_pot, "u_lon_pot", starts, counts, fname, &mask);
+            writer.write(u_lat_pot, "u_lat_pot", starts, counts, fname, &mask);
 
             if ( source_data.compute_radial_vel ) {
-                write_field_to_output(u_r_coarse, "u_r", starts, counts, fname, NULL);
+                writer.write(u_r_coarse, "u_r", starts, counts, fname, NULL);
             }
             if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "writing");  }
         }
@@ -1113,18 +1341,18 @@ void filtering_helmholtz(
         if (not(constants::NO_FULL_OUTPUTS)) {
             if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
 
-            write_field_to_output( u_spectrum_tot, "u_spectrum_tot", starts, counts, fname, &mask);
-            write_field_to_output( v_spectrum_tot, "v_spectrum_tot", starts, counts, fname, &mask);
+            writer.write( u_spectrum_tot, "u_spectrum_tot", starts, counts, fname, &mask);
+            writer.write( v_spectrum_tot, "v_spectrum_tot", starts, counts, fname, &mask);
 
-            write_field_to_output( u_spectrum_tor, "u_spectrum_tor", starts, counts, fname, &mask);
-            write_field_to_output( v_spectrum_tor, "v_spectrum_tor", starts, counts, fname, &mask);
+            writer.write( u_spectrum_tor, "u_spectrum_tor", starts, counts, fname, &mask);
+            writer.write( v_spectrum_tor, "v_spectrum_tor", starts, counts, fname, &mask);
 
-            write_field_to_output( u_spectrum_pot, "u_spectrum_pot", starts, counts, fname, &mask);
-            write_field_to_output( v_spectrum_pot, "v_spectrum_pot", starts, counts, fname, &mask);
+            writer.write( u_spectrum_pot, "u_spectrum_pot", starts, counts, fname, &mask);
+            writer.write( v_spectrum_pot, "v_spectrum_pot", starts, counts, fname, &mask);
 
-            write_field_to_output( spec_slope_tot, "KE_spectral_slope_tot", starts, counts, fname, &mask);
-            write_field_to_output( spec_slope_tor, "KE_spectral_slope_tor", starts, counts, fname, &mask);
-            write_field_to_output( spec_slope_pot, "KE_spectral_slope_pot", starts, counts, fname, &mask);
+            writer.write( spec_slope_tot, "KE_spectral_slope_tot", starts, counts, fname, &mask);
+            writer.write( spec_slope_tor, "KE_spectral_slope_tor", starts, counts, fname, &mask);
+            writer.write( spec_slope_pot, "KE_spectral_slope_pot", starts, counts, fname, &mask);
 
             if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "writing");  }
         }
@@ -1135,9 +1363,9 @@ void filtering_helmholtz(
 
             if (not(constants::MINIMAL_OUTPUT)) {
                 if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
-                write_field_to_output( ulon_ulon, "coarse_uu", starts, counts, fname, &mask );
-                write_field_to_output( ulon_ulat, "coarse_uv", starts, counts, fname, &mask );
-                write_field_to_output( ulat_ulat, "coarse_vv", starts, counts, fname, &mask );
+                writer.write( ulon_ulon, "coarse_uu", starts, counts, fname, &mask );
+                writer.write( ulon_ulat, "coarse_uv", starts, counts, fname, &mask );
+                writer.write( ulat_ulat, "coarse_vv", starts, counts, fname, &mask );
                 if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "writing");  }
             }
         }
@@ -1162,21 +1390,21 @@ void filtering_helmholtz(
 
         if (not(constants::MINIMAL_OUTPUT)) {
             if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
-            write_field_to_output(div_tor, "div_tor", starts, counts, fname, &mask);
-            write_field_to_output(div_pot, "div_pot", starts, counts, fname, &mask);
-            write_field_to_output(div_tot, "div_tot", starts, counts, fname, &mask);
+            writer.write(div_tor, "div_tor", starts, counts, fname, &mask);
+            writer.write(div_pot, "div_pot", starts, counts, fname, &mask);
+            writer.write(div_tot, "div_tot", starts, counts, fname, &mask);
 
             if (constants::DO_OKUBOWEISS_ANALYSIS) {
-                write_field_to_output(OkuboWeiss_tor, "OkuboWeiss_tor", starts, counts, fname, &mask);
-                write_field_to_output(OkuboWeiss_pot, "OkuboWeiss_pot", starts, counts, fname, &mask);
-                write_field_to_output(OkuboWeiss_tot, "OkuboWeiss_tot", starts, counts, fname, &mask);
+                writer.write(OkuboWeiss_tor, "OkuboWeiss_tor", starts, counts, fname, &mask);
+                writer.write(OkuboWeiss_pot, "OkuboWeiss_pot", starts, counts, fname, &mask);
+                writer.write(OkuboWeiss_tot, "OkuboWeiss_tot", starts, counts, fname, &mask);
 
-                write_field_to_output(KE_tot_cyclonic, "cyclonic_KE", starts, counts, fname, &mask);
-                write_field_to_output(KE_tot_anticyclonic, "anticyclonic_KE", starts, counts, fname, &mask);
+                writer.write(KE_tot_cyclonic, "cyclonic_KE", starts, counts, fname, &mask);
+                writer.write(KE_tot_anticyclonic, "anticyclonic_KE", starts, counts, fname, &mask);
 
-                write_field_to_output(KE_tor_strain, "strain_KE_tor", starts, counts, fname, &mask);
-                write_field_to_output(KE_pot_strain, "strain_KE_pot", starts, counts, fname, &mask);
-                write_field_to_output(KE_tot_strain, "strain_KE_tot", starts, counts, fname, &mask);
+                writer.write(KE_tor_strain, "strain_KE_tor", starts, counts, fname, &mask);
+                writer.write(KE_pot_strain, "strain_KE_pot", starts, counts, fname, &mask);
+                writer.write(KE_tot_strain, "strain_KE_tot", starts, counts, fname, &mask);
             }
             if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "writing");  }
         }
@@ -1338,17 +1566,17 @@ void filtering_helmholtz(
         // Writing
         if (not(constants::NO_FULL_OUTPUTS)) {
             if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
-            write_field_to_output( Pi_tor, "Pi_tor", starts, counts, fname, &mask);
-            write_field_to_output( Pi_pot, "Pi_pot", starts, counts, fname, &mask);
-            write_field_to_output( Pi_tot, "Pi_tot", starts, counts, fname, &mask);
+            writer.write( Pi_tor, "Pi_tor", starts, counts, fname, &mask);
+            writer.write( Pi_pot, "Pi_pot", starts, counts, fname, &mask);
+            writer.write( Pi_tot, "Pi_tot", starts, counts, fname, &mask);
 
             if ( constants::COMP_PI_HELMHOLTZ ) {
-                write_field_to_output( Pi_Helm, "Pi_Helm", starts, counts, fname, &mask);
+                writer.write( Pi_Helm, "Pi_Helm", starts, counts, fname, &mask);
             }
 
-            write_field_to_output( Z_tor, "Z_tor", starts, counts, fname, &mask);
-            write_field_to_output( Z_pot, "Z_pot", starts, counts, fname, &mask);
-            write_field_to_output( Z_tot, "Z_tot", starts, counts, fname, &mask);
+            writer.write( Z_tor, "Z_tor", starts, counts, fname, &mask);
+            writer.write( Z_pot, "Z_pot", starts, counts, fname, &mask);
+            writer.write( Z_tot, "Z_tot", starts, counts, fname, &mask);
             if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "writing");  }
         }
 
@@ -1388,29 +1616,29 @@ void filtering_helmholtz(
 
         if (not(constants::NO_FULL_OUTPUTS)) {
             if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
-            write_field_to_output( KE_tor_filt, "KE_tor_filt", starts, counts, fname, &mask);
-            write_field_to_output( KE_pot_filt, "KE_pot_filt", starts, counts, fname, &mask);
-            write_field_to_output( KE_tot_filt, "KE_tot_filt", starts, counts, fname, &mask);
+            writer.write( KE_tor_filt, "KE_tor_filt", starts, counts, fname, &mask);
+            writer.write( KE_pot_filt, "KE_pot_filt", starts, counts, fname, &mask);
+            writer.write( KE_tot_filt, "KE_tot_filt", starts, counts, fname, &mask);
 
-            write_field_to_output( KE_tor_fine, "KE_tor_fine", starts, counts, fname, &mask);
-            write_field_to_output( KE_pot_fine, "KE_pot_fine", starts, counts, fname, &mask);
-            write_field_to_output( KE_tot_fine, "KE_tot_fine", starts, counts, fname, &mask);
+            writer.write( KE_tor_fine, "KE_tor_fine", starts, counts, fname, &mask);
+            writer.write( KE_pot_fine, "KE_pot_fine", starts, counts, fname, &mask);
+            writer.write( KE_tot_fine, "KE_tot_fine", starts, counts, fname, &mask);
             if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "writing");  }
         }
 
         if (not(constants::MINIMAL_OUTPUT)) {
             if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
-            write_field_to_output( KE_tor_fine_mod, "KE_tor_fine_mod", starts, counts, fname, &mask);
-            write_field_to_output( KE_pot_fine_mod, "KE_pot_fine_mod", starts, counts, fname, &mask);
-            write_field_to_output( KE_tot_fine_mod, "KE_tot_fine_mod", starts, counts, fname, &mask);
+            writer.write( KE_tor_fine_mod, "KE_tor_fine_mod", starts, counts, fname, &mask);
+            writer.write( KE_pot_fine_mod, "KE_pot_fine_mod", starts, counts, fname, &mask);
+            writer.write( KE_tot_fine_mod, "KE_tot_fine_mod", starts, counts, fname, &mask);
 
-            write_field_to_output( Enst_tor, "Enstrophy_tor", starts, counts, fname, &mask);
-            write_field_to_output( Enst_pot, "Enstrophy_pot", starts, counts, fname, &mask);
-            write_field_to_output( Enst_tot, "Enstrophy_tot", starts, counts, fname, &mask);
+            writer.write( Enst_tor, "Enstrophy_tor", starts, counts, fname, &mask);
+            writer.write( Enst_pot, "Enstrophy_pot", starts, counts, fname, &mask);
+            writer.write( Enst_tot, "Enstrophy_tot", starts, counts, fname, &mask);
 
-            write_field_to_output( vort_tor_r, "vort_r_tor", starts, counts, fname, &mask);
-            write_field_to_output( vort_pot_r, "vort_r_pot", starts, counts, fname, &mask);
-            write_field_to_output( vort_tot_r, "vort_r_tot", starts, counts, fname, &mask);
+            writer.write( vort_tor_r, "vort_r_tor", starts, counts, fname, &mask);
+            writer.write( vort_pot_r, "vort_r_pot", starts, counts, fname, &mask);
+            writer.write( vort_tot_r, "vort_r_tot", starts, counts, fname, &mask);
             if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "writing");  }
         }
         
@@ -1450,11 +1678,11 @@ void filtering_helmholtz(
 
             if (not(constants::NO_FULL_OUTPUTS)) {
                 if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
-                write_field_to_output( local_wind_forcing_tor, "local_wind_forcing_tor", starts, counts, fname, &mask);
-                write_field_to_output( local_wind_forcing_pot, "local_wind_forcing_pot", starts, counts, fname, &mask);
+                writer.write( local_wind_forcing_tor, "local_wind_forcing_tor", starts, counts, fname, &mask);
+                writer.write( local_wind_forcing_pot, "local_wind_forcing_pot", starts, counts, fname, &mask);
 
-                write_field_to_output( coarse_tau_wind_dot_u_tor, "tau_wind_dot_u_tor", starts, counts, fname, &mask );
-                write_field_to_output( coarse_tau_wind_dot_u_pot, "tau_wind_dot_u_pot", starts, counts, fname, &mask );
+                writer.write( coarse_tau_wind_dot_u_tor, "tau_wind_dot_u_tor", starts, counts, fname, &mask );
+                writer.write( coarse_tau_wind_dot_u_pot, "tau_wind_dot_u_pot", starts, counts, fname, &mask );
                 if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "writing");  }
             }
         }
@@ -1464,6 +1692,11 @@ void filtering_helmholtz(
         //
 
         if (constants::APPLY_POSTPROCESS) {
+            // Post-processing also uses netcdf, so the queued writes need to finish first
+            if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
+            writer.flush();
+            if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "waiting_for_output"); }
+
             MPI_Barrier(MPI_COMM_WORLD);
 
             #if DEBUG >= 1
@@ -1473,15 +1706,15 @@ void filtering_helmholtz(
 
             Apply_Postprocess_Routines(
                     source_data, postprocess_fields_tor, postprocess_names, OkuboWeiss_tor,
-                    scales.at(Iscale), timing_records, "postprocess_toroidal");
+                    scales.at(Iscale), timing_records, "postprocess_toroidal", MPI_COMM_WORLD, &bands );
 
             Apply_Postprocess_Routines(
                     source_data, postprocess_fields_pot, postprocess_names, OkuboWeiss_pot,
-                    scales.at(Iscale), timing_records, "postprocess_potential");
+                    scales.at(Iscale), timing_records, "postprocess_potential", MPI_COMM_WORLD, &bands );
 
             Apply_Postprocess_Routines(
                     source_data, postprocess_fields_tot, postprocess_names, OkuboWeiss_tot,
-                    scales.at(Iscale), timing_records, "postprocess_full");
+                    scales.at(Iscale), timing_records, "postprocess_full", MPI_COMM_WORLD, &bands );
 
             #if DEBUG >= 1
             if (wRank == 0) { fprintf(stdout, "Finished post-process routines\n"); }
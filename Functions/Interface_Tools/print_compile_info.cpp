@@ -94,6 +94,9 @@ void print_compile_info(
     fprintf(stdout, "  g       = %g\n", constants::g);
     fprintf(stdout, "  DiffOrd = %d\n", constants::DiffOrd);
     fprintf(stdout, "  KernPad = %g\n", constants::KernPad);
+    if (constants::KERNEL_TRUNCATION_TOLERANCE > 0) {
+        fprintf(stdout, "  KernPad from tolerance %g = %g\n", constants::KERNEL_TRUNCATION_TOLERANCE, kernel_pad());
+    }
     fprintf(stdout, "\n");
 
     if ( scales != NULL ) {
@@ -76,6 +76,9 @@ void apply_filter_at_point(
     const bool do_dl  = ( dl_coarse_vals.size() > 0),
                do_dll = ( dll_coarse_vals.size() > 0);
 
+    // Periodic length in y, so that get_lon_bounds can wrap the latitude separation
+    const double Llat = ( constants::CARTESIAN and constants::PERIODIC_Y ) ? (latitude.at(1) - latitude.at(0)) * Nlat : 0.;
+
     for (int LAT = LAT_lb; LAT < LAT_ub; LAT++) {
 
         // Handle periodicity if necessary
@@ -83,7 +86,7 @@ void apply_filter_at_point(
         else                       { curr_lat = LAT; }
         lat_at_curr = latitude.at(curr_lat);
 
-        get_lon_bounds(LON_lb, LON_ub, longitude, Ilon, lat_at_ilat, lat_at_curr, scale);
+        get_lon_bounds(LON_lb, LON_ub, longitude, Ilon, lat_at_ilat, lat_at_curr, scale, Llat);
         for (int LON = LON_lb; LON < LON_ub; LON++ ) {
 
             // Handle periodicity if necessary
@@ -0,0 +1,196 @@
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include <cassert>
+#include "../functions.hpp"
+#include "../constants.hpp"
+
+/*!
+ * \brief Compute filtered fields at a single (lat,lon) point for every local time and depth
+ *
+ * This is equivalent to calling apply_filter_at_point for each (Itime, Idepth), but the
+ * stencil is only walked once. The kernel * area weights come from a pre-built kernel_stencil
+ * (so they can be shared across longitudes, passes and fields), and the inner loops are
+ * contiguous weighted gathers along each run of source longitudes. If the water runs are
+ * provided, then the numerators only walk over the water intervals (no per-cell mask checks).
+ *
+ * If field_factors is non-empty, then it must be the same length as fields, and the product
+ * (*fields[Ifield]) * (*field_factors[Ifield]) is filtered (NULL entries indicate no factor).
+ * This allows quadratic terms (e.g. u*v) to be filtered without storing the products.
+ *
+ * Outputs are stored as coarse_vals[ Ilev * Nfields + Ifield ], where Ilev = Itime * Ndepth + Idepth.
+ * The dl / dll outputs follow the same convention, and dl_kernel_vals / dll_kernel_vals are per level.
+ *
+ * The fields, factors, and weight can be stored in single or double precision (see FLOAT_FIELD_STORAGE),
+ * but the kernel sums are always accumulated in double precision.
+ *
+ * @param[in,out]   coarse_vals             where to store filtered values (resized if needed)
+ * @param[in,out]   dl_coarse_vals          where to store values filtered with the ell-derivative kernel (size 0 to skip)
+ * @param[in,out]   dll_coarse_vals         where to store values filtered with the 2nd ell-derivative kernel (size 0 to skip)
+ * @param[in,out]   dl_kernel_vals          where to store kpA_sum / kA_sum for each level (only if dl_coarse_vals is used)
+ * @param[in,out]   dll_kernel_vals         where to store kppA_sum / kA_sum for each level (only if dll_coarse_vals is used)
+ * @param[in]       fields                  fields to filter
+ * @param[in]       field_factors           optional factors multiplying each field (size 0 if not used)
+ * @param[in]       source_data             dataset class instance containing data (Psi, Phi, etc)
+ * @param[in]       Ilat,Ilon               current position
+ * @param[in]       stencil                 pre-computed kernel stencil (built at Ilat, and at Ilon unless the kernel can be rolled)
+ * @param[in]       weight                  pointer to spatial weight (i.e. rho) (NULL indicates not provided)
+ * @param[in]       skip_land               if true, levels where (Ilat,Ilon) is land are not computed (left as zero)
+ * @param[in]       water                   pre-computed water runs for the mask (NULL indicates not provided)
+ *
+ */
+template <class real_type>
+void apply_filter_at_point_all_levels(
+        std::vector<double> & coarse_vals,
+        std::vector<double> & dl_coarse_vals,
+        std::vector<double> & dll_coarse_vals,
+        std::vector<double> & dl_kernel_vals,
+        std::vector<double> & dll_kernel_vals,
+        const std::vector<const std::vector<real_type>*> & fields,
+        const std::vector<const std::vector<real_type>*> & field_factors,
+        const dataset & source_data,
+        const int Ilat,
+        const int Ilon,
+        const kernel_stencil & stencil,
+        const typename non_deduced< std::vector<real_type> >::type * weight,
+        const bool skip_land,
+        const water_runs * water
+        ) {
+
+    const int Nfields = fields.size();
+
+    const std::vector<bool> &mask = source_data.mask;
+
+    const int   Ntime   = source_data.Ntime,
+                Ndepth  = source_data.Ndepth,
+                Nlat    = source_data.Nlat,
+                Nlon    = source_data.Nlon,
+                Nlevels = Ntime * Ndepth;
+
+    const bool do_dl  = ( dl_coarse_vals.size()  > 0 ),
+               do_dll = ( dll_coarse_vals.size() > 0 );
+
+    const bool use_factors = ( field_factors.size() > 0 );
+
+    #if DEBUG >= 1
+    const bool can_roll_in_longitude = ( (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN) and (constants::PERIODIC_X) );
+    assert( stencil.ref_Ilat == Ilat );
+    assert( can_roll_in_longitude or (stencil.ref_Ilon == Ilon) );
+    assert( not(do_dl)  or stencil.do_dl  );
+    assert( not(do_dll) or stencil.do_dll );
+    assert( not(use_factors) or ( (int)field_factors.size() == Nfields ) );
+    assert( stencil.Nscales == 1 );
+    assert( (water == NULL) or ( (water->Nrows == Nlevels * Nlat) and (water->Nlon == Nlon) ) );
+    #endif
+
+    coarse_vals.resize( Nlevels * Nfields );
+    std::fill( coarse_vals.begin(), coarse_vals.end(), 0. );
+    if (do_dl)  { dl_coarse_vals.resize(  Nlevels * Nfields ); dl_kernel_vals.resize(  Nlevels ); }
+    if (do_dll) { dll_coarse_vals.resize( Nlevels * Nfields ); dll_kernel_vals.resize( Nlevels ); }
+
+    std::vector<double> kA_sum(Nlevels, 0.), kpA_sum(Nlevels, 0.), kppA_sum(Nlevels, 0.),
+                        tmp_vals(Nlevels * Nfields, 0.), tmp_dl_vals(Nlevels * Nfields, 0.), tmp_dll_vals(Nlevels * Nfields, 0.);
+
+    // Which levels actually need to be computed
+    std::vector<bool> do_level(Nlevels, true);
+    if (skip_land) {
+        for (int Ilev = 0; Ilev < Nlevels; Ilev++) {
+            do_level[Ilev] = mask.at( Index(Ilev / Ndepth, Ilev % Ndepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon) );
+        }
+    }
+
+    // Each stencil row is split into (at most two) contiguous segments of longitude,
+    //   so that wrapping around the periodic boundary doesn't need per-cell arithmetic
+    stencil_segment segs[2];
+    int Nsegs;
+    size_t level_offset;
+    double kA_lev, kpA_lev, kppA_lev, val_sum, dl_sum, dll_sum, loc_val;
+    std::vector<int> wet_lo, wet_hi;
+
+    for (size_t Irow = 0; Irow < stencil.Nrows(); Irow++) {
+
+        Nsegs = stencil.row_segments( segs, Irow, Ilon, Nlon );
+
+        for (int Ilev = 0; Ilev < Nlevels; Ilev++) {
+            if (not(do_level[Ilev])) { continue; }
+
+            level_offset = Index(Ilev / Ndepth, Ilev % Ndepth, stencil.row_lat[Irow], 0, Ntime, Ndepth, Nlat, Nlon);
+
+            for (int Iseg = 0; Iseg < Nsegs; Iseg++) {
+
+                const int       LON0 = segs[Iseg].lon_start,
+                                NN   = segs[Iseg].Ncells;
+                const double    *kA   = &( stencil.kA[  segs[Iseg].cell_offset] ),
+                                *kpA  = do_dl  ? &( stencil.kpA[ segs[Iseg].cell_offset] ) : NULL,
+                                *kppA = do_dll ? &( stencil.kppA[segs[Iseg].cell_offset] ) : NULL;
+
+                // Water intervals within this segment (relative to LON0)
+                segment_water_runs( wet_lo, wet_hi, segs[Iseg], level_offset, mask, water );
+                const size_t Nruns = wet_lo.size();
+
+                // Denominators (only the water cells if we're deforming around land, otherwise every cell)
+                const real_type * wght = (weight == NULL) ? NULL : &( (*weight)[level_offset + LON0] );
+                kA_lev   = 0.;
+                kpA_lev  = 0.;
+                kppA_lev = 0.;
+                //   A masked loop walks the water runs, and an unmasked loop is the single interval [0, NN)
+                for (size_t Irun = 0; Irun < ( constants::DEFORM_AROUND_LAND ? Nruns : 1 ); Irun++) {
+                    const int   II_lo = constants::DEFORM_AROUND_LAND ? wet_lo[Irun] : 0,
+                                II_hi = constants::DEFORM_AROUND_LAND ? wet_hi[Irun] : NN;
+                    for (int II = II_lo; II < II_hi; II++) {
+                        kA_lev += kA[II] * ( (wght == NULL) ? 1. : wght[II] );
+                        if (do_dl)  { kpA_lev  += kpA[II];  }
+                        if (do_dll) { kppA_lev += kppA[II]; }
+                    }
+                }
+                kA_sum[Ilev]   += kA_lev;
+                kpA_sum[Ilev]  += kpA_lev;
+                kppA_sum[Ilev] += kppA_lev;
+
+                // Numerators, one field at a time, walking only over the water runs
+                for (int Ifield = 0; Ifield < Nfields; Ifield++) {
+                    const real_type * field  = &( (*fields[Ifield])[level_offset + LON0] );
+                    const real_type * factor = ( use_factors and (field_factors[Ifield] != NULL) ) ?
+                                                &( (*field_factors[Ifield])[level_offset + LON0] ) : NULL;
+                    val_sum = 0.;
+                    dl_sum  = 0.;
+                    dll_sum = 0.;
+                    for (size_t Irun = 0; Irun < Nruns; Irun++) {
+                        for (int II = wet_lo[Irun]; II < wet_hi[Irun]; II++) {
+                            loc_val = field[II];
+                            if (factor != NULL) { loc_val *= factor[II]; }
+                            val_sum += loc_val * kA[II] * ( (wght == NULL) ? 1. : wght[II] );
+                            if (do_dl)  { dl_sum  += loc_val * kpA[II];  }
+                            if (do_dll) { dll_sum += loc_val * kppA[II]; }
+                        }
+                    }
+                    tmp_vals[ Ilev * Nfields + Ifield ] += val_sum;
+                    if (do_dl)  { tmp_dl_vals[  Ilev * Nfields + Ifield ] += dl_sum;  }
+                    if (do_dll) { tmp_dll_vals[ Ilev * Nfields + Ifield ] += dll_sum; }
+                }
+            }
+        }
+    }
+
+    // On the off chance that the kernel was null (size zero), just return zero
+    for (int Ilev = 0; Ilev < Nlevels; Ilev++) {
+        for (int Ifield = 0; Ifield < Nfields; Ifield++) {
+            const int II = Ilev * Nfields + Ifield;
+            coarse_vals[II] = (kA_sum[Ilev] == 0) ? 0. : tmp_vals[II] / kA_sum[Ilev];
+            if (do_dl)  { dl_coarse_vals[II]  = (kpA_sum[Ilev]  == 0) ? 0. : tmp_dl_vals[II]  / kpA_sum[Ilev];  }
+            if (do_dll) { dll_coarse_vals[II] = (kppA_sum[Ilev] == 0) ? 0. : tmp_dll_vals[II] / kppA_sum[Ilev]; }
+        }
+        if (do_dl)  { dl_kernel_vals[Ilev]  = (kA_sum[Ilev] == 0) ? 0. : kpA_sum[Ilev]  / kA_sum[Ilev]; }
+        if (do_dll) { dll_kernel_vals[Ilev] = (kA_sum[Ilev] == 0) ? 0. : kppA_sum[Ilev] / kA_sum[Ilev]; }
+    }
+}
+
+template void apply_filter_at_point_all_levels<double>(
+        std::vector<double> &, std::vector<double> &, std::vector<double> &, std::vector<double> &, std::vector<double> &,
+        const std::vector<const std::vector<double>*> &, const std::vector<const std::vector<double>*> &,
+        const dataset &, const int, const int, const kernel_stencil &, const std::vector<double> *, const bool, const water_runs * );
+
+template void apply_filter_at_point_all_levels<float>(
+        std::vector<double> &, std::vector<double> &, std::vector<double> &, std::vector<double> &, std::vector<double> &,
+        const std::vector<const std::vector<float>*> &, const std::vector<const std::vector<float>*> &,
+        const dataset &, const int, const int, const kernel_stencil &, const std::vector<float> *, const bool, const water_runs * );
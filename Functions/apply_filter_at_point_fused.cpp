@@ -0,0 +1,234 @@
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include <cassert>
+#include "../functions.hpp"
+#include "../constants.hpp"
+
+/*!
+ * \brief Compute every filtered field needed by the filtering driver at a single (lat,lon) point, in one walk of the stencil
+ *
+ * This is equivalent to three calls to apply_filter_at_point_all_levels (for the linear fields,
+ * the quadratic products, and the rho-weighted velocities), but each stencil cell is only read
+ * once: the velocities (and KE, vorticity, rho, p) are loaded once per cell, and the products
+ * are formed from those values as the sums are accumulated.
+ *
+ * Outputs (with Ilev = Itime * Ndepth + Idepth) are
+ *   - linear_vals[ Ilev * Nlinear + {0..Nlinear-1} ] = u_x, u_y, u_z, KE (and rho, p, if rho is given)
+ *   - quad_vals[   Ilev * 9 + {0..8} ]               = uxux, uxuy, uxuz, uyuy, uyuz, uzuz, vort*ux, vort*uy, vort*uz
+ *   - tilde_vals[  Ilev * 3 + {0..2} ]               = rho-weighted u_x, u_y, u_z
+ *
+ * Levels where (Ilat,Ilon) is land are left as zero.
+ *
+ * @param[in,out]   linear_vals             where to store the filtered linear fields (resized if needed)
+ * @param[in,out]   quad_vals               where to store the filtered products (only if vort_r is given)
+ * @param[in,out]   tilde_vals              where to store the rho-weighted velocities (only if rho is given)
+ * @param[in]       u_x,u_y,u_z             Cartesian velocity components
+ * @param[in]       KE                      kinetic energy
+ * @param[in]       vort_r                  pointer to vorticity (NULL to skip the quadratic products)
+ * @param[in]       rho,p                   pointers to density and pressure (NULL to skip them and the rho-weighted velocities)
+ * @param[in]       source_data             dataset class instance containing data (Psi, Phi, etc)
+ * @param[in]       Ilat,Ilon               current position
+ * @param[in]       stencil                 pre-computed kernel stencil (built at Ilat, and at Ilon unless the kernel can be rolled)
+ * @param[in]       water                   pre-computed water runs for the mask (NULL indicates not provided)
+ *
+ */
+template <class real_type>
+void apply_filter_at_point_fused(
+        std::vector<double> & linear_vals,
+        std::vector<double> & quad_vals,
+        std::vector<double> & tilde_vals,
+        const std::vector<real_type> & u_x,
+        const std::vector<real_type> & u_y,
+        const std::vector<real_type> & u_z,
+        const std::vector<real_type> & KE,
+        const typename non_deduced< std::vector<real_type> >::type * vort_r,
+        const typename non_deduced< std::vector<real_type> >::type * rho,
+        const typename non_deduced< std::vector<real_type> >::type * p,
+        const dataset & source_data,
+        const int Ilat,
+        const int Ilon,
+        const kernel_stencil & stencil,
+        const water_runs * water
+        ) {
+
+    const std::vector<bool> &mask = source_data.mask;
+
+    const int   Ntime   = source_data.Ntime,
+                Ndepth  = source_data.Ndepth,
+                Nlat    = source_data.Nlat,
+                Nlon    = source_data.Nlon,
+                Nlevels = Ntime * Ndepth;
+
+    const bool  do_quad = ( vort_r != NULL ),
+                do_rho  = ( rho    != NULL );
+
+    const int   Nlinear = do_rho ? 6 : 4,
+                Nquad   = 9,
+                Ntilde  = 3;
+
+    #if DEBUG >= 1
+    const bool can_roll_in_longitude = ( (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN) and (constants::PERIODIC_X) );
+    assert( stencil.ref_Ilat == Ilat );
+    assert( can_roll_in_longitude or (stencil.ref_Ilon == Ilon) );
+    assert( stencil.Nscales == 1 );
+    assert( not(do_rho) or (p != NULL) );
+    assert( (water == NULL) or ( (water->Nrows == Nlevels * Nlat) and (water->Nlon == Nlon) ) );
+    #endif
+
+    linear_vals.assign( Nlevels * Nlinear, 0. );
+    if (do_quad) { quad_vals.assign(  Nlevels * Nquad,  0. ); }
+    if (do_rho)  { tilde_vals.assign( Nlevels * Ntilde, 0. ); }
+
+    std::vector<double> kA_sum(Nlevels, 0.), kA_rho_sum(Nlevels, 0.);
+
+    // Which levels actually need to be computed
+    std::vector<bool> do_level(Nlevels);
+    for (int Ilev = 0; Ilev < Nlevels; Ilev++) {
+        do_level[Ilev] = mask.at( Index(Ilev / Ndepth, Ilev % Ndepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon) );
+    }
+
+    // Each stencil row is split into (at most two) contiguous segments of longitude,
+    //   so that wrapping around the periodic boundary doesn't need per-cell arithmetic
+    stencil_segment segs[2];
+    int Nsegs;
+    size_t level_offset;
+    std::vector<int> wet_lo, wet_hi;
+
+    for (size_t Irow = 0; Irow < stencil.Nrows(); Irow++) {
+
+        Nsegs = stencil.row_segments( segs, Irow, Ilon, Nlon );
+
+        for (int Ilev = 0; Ilev < Nlevels; Ilev++) {
+            if (not(do_level[Ilev])) { continue; }
+
+            level_offset = Index(Ilev / Ndepth, Ilev % Ndepth, stencil.row_lat[Irow], 0, Ntime, Ndepth, Nlat, Nlon);
+
+            for (int Iseg = 0; Iseg < Nsegs; Iseg++) {
+
+                const int       LON0 = segs[Iseg].lon_start,
+                                NN   = segs[Iseg].Ncells;
+                const double    *kA  = &( stencil.kA[ segs[Iseg].cell_offset ] );
+                const size_t    off  = level_offset + LON0;
+
+                // Water intervals within this segment (relative to LON0)
+                segment_water_runs( wet_lo, wet_hi, segs[Iseg], level_offset, mask, water );
+                const size_t Nruns = wet_lo.size();
+
+                const real_type *ux  = &u_x[off],
+                                *uy  = &u_y[off],
+                                *uz  = &u_z[off],
+                                *ke  = &KE[off],
+                                *vrt = do_quad ? &( (*vort_r)[off] ) : NULL,
+                                *rh  = do_rho  ? &( (*rho)[off] )    : NULL,
+                                *pr  = do_rho  ? &( (*p)[off] )      : NULL;
+
+                // Denominators (only the water cells if we're deforming around land, otherwise every cell)
+                double kA_lev = 0., kA_rho_lev = 0.;
+                for (size_t Irun = 0; Irun < ( constants::DEFORM_AROUND_LAND ? Nruns : 1 ); Irun++) {
+                    const int   II_lo = constants::DEFORM_AROUND_LAND ? wet_lo[Irun] : 0,
+                                II_hi = constants::DEFORM_AROUND_LAND ? wet_hi[Irun] : NN;
+                    for (int II = II_lo; II < II_hi; II++) {
+                        kA_lev += kA[II];
+                        if (do_rho) { kA_rho_lev += kA[II] * rh[II]; }
+                    }
+                }
+                kA_sum[Ilev]     += kA_lev;
+                kA_rho_sum[Ilev] += kA_rho_lev;
+
+                // Numerators, walking only over the water runs and reading each cell once
+                double  s_ux = 0., s_uy = 0., s_uz = 0., s_ke = 0., s_rho = 0., s_p = 0.,
+                        s_uxux = 0., s_uxuy = 0., s_uxuz = 0., s_uyuy = 0., s_uyuz = 0., s_uzuz = 0.,
+                        s_wux = 0., s_wuy = 0., s_wuz = 0.,
+                        s_rux = 0., s_ruy = 0., s_ruz = 0.;
+                for (size_t Irun = 0; Irun < Nruns; Irun++) {
+                    for (int II = wet_lo[Irun]; II < wet_hi[Irun]; II++) {
+                        const double    w  = kA[II],
+                                        vx = ux[II],
+                                        vy = uy[II],
+                                        vz = uz[II];
+                        s_ux += vx * w;
+                        s_uy += vy * w;
+                        s_uz += vz * w;
+                        s_ke += (double) ke[II] * w;
+                        if (do_quad) {
+                            const double vort = vrt[II];
+                            s_uxux += vx * vx * w;
+                            s_uxuy += vx * vy * w;
+                            s_uxuz += vx * vz * w;
+                            s_uyuy += vy * vy * w;
+                            s_uyuz += vy * vz * w;
+                            s_uzuz += vz * vz * w;
+                            s_wux  += vort * vx * w;
+                            s_wuy  += vort * vy * w;
+                            s_wuz  += vort * vz * w;
+                        }
+                        if (do_rho) {
+                            const double r = rh[II];
+                            s_rho += r * w;
+                            s_p   += (double) pr[II] * w;
+                            s_rux += vx * w * r;
+                            s_ruy += vy * w * r;
+                            s_ruz += vz * w * r;
+                        }
+                    }
+                }
+
+                double * lin = &linear_vals[ Ilev * Nlinear ];
+                lin[0] += s_ux;
+                lin[1] += s_uy;
+                lin[2] += s_uz;
+                lin[3] += s_ke;
+                if (do_rho) {
+                    lin[4] += s_rho;
+                    lin[5] += s_p;
+                    double * tld = &tilde_vals[ Ilev * Ntilde ];
+                    tld[0] += s_rux;
+                    tld[1] += s_ruy;
+                    tld[2] += s_ruz;
+                }
+                if (do_quad) {
+                    double * quad = &quad_vals[ Ilev * Nquad ];
+                    quad[0] += s_uxux;
+                    quad[1] += s_uxuy;
+                    quad[2] += s_uxuz;
+                    quad[3] += s_uyuy;
+                    quad[4] += s_uyuz;
+                    quad[5] += s_uzuz;
+                    quad[6] += s_wux;
+                    quad[7] += s_wuy;
+                    quad[8] += s_wuz;
+                }
+            }
+        }
+    }
+
+    // On the off chance that the kernel was null (size zero), just return zero
+    for (int Ilev = 0; Ilev < Nlevels; Ilev++) {
+        const double kA = kA_sum[Ilev], kA_rho = kA_rho_sum[Ilev];
+        for (int II = 0; II < Nlinear; II++) {
+            double & val = linear_vals[ Ilev * Nlinear + II ];
+            val = (kA == 0) ? 0. : val / kA;
+        }
+        for (int II = 0; II < ( do_quad ? Nquad : 0 ); II++) {
+            double & val = quad_vals[ Ilev * Nquad + II ];
+            val = (kA == 0) ? 0. : val / kA;
+        }
+        for (int II = 0; II < ( do_rho ? Ntilde : 0 ); II++) {
+            double & val = tilde_vals[ Ilev * Ntilde + II ];
+            val = (kA_rho == 0) ? 0. : val / kA_rho;
+        }
+    }
+}
+
+template void apply_filter_at_point_fused<double>(
+        std::vector<double> &, std::vector<double> &, std::vector<double> &,
+        const std::vector<double> &, const std::vector<double> &, const std::vector<double> &, const std::vector<double> &,
+        const std::vector<double> *, const std::vector<double> *, const std::vector<double> *,
+        const dataset &, const int, const int, const kernel_stencil &, const water_runs * );
+
+template void apply_filter_at_point_fused<float>(
+        std::vector<double> &, std::vector<double> &, std::vector<double> &,
+        const std::vector<float> &, const std::vector<float> &, const std::vector<float> &, const std::vector<float> &,
+        const std::vector<float> *, const std::vector<float> *, const std::vector<float> *,
+        const dataset &, const int, const int, const kernel_stencil &, const water_runs * );
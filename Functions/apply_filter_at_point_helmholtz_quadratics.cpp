@@ -0,0 +1,206 @@
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include <cassert>
+#include "../functions.hpp"
+#include "../constants.hpp"
+
+/*!
+ * \brief Compute the filtered toroidal, potential, and total quadratic terms at a single (lat,lon) point, in one walk of the stencil
+ *
+ * This is equivalent to calling apply_filter_at_point_all_levels with the 27 (field, factor) pairs
+ * for the toroidal, potential, and total products, but only the toroidal and potential velocities
+ * and vorticities are read (once per stencil cell). The total velocity and vorticity are formed
+ * as tor + pot (both the vorticity and the Cartesian conversion are linear in the velocity), and
+ * all of the products are accumulated from those values in one traversal.
+ *
+ * Outputs are stored as quad_vals[ ( Ilev * 3 + Iquad ) * 9 + II ], where Ilev = Itime * Ndepth + Idepth,
+ * Iquad = 0, 1, 2 for tor, pot, tot, and II = 0, ..., 8 for uxux, uxuy, uxuz, uyuy, uyuz, uzuz, vort*ux, vort*uy, vort*uz.
+ *
+ * Levels where (Ilat,Ilon) is land are left as zero.
+ *
+ * @param[in,out]   quad_vals                       where to store the filtered products (resized if needed)
+ * @param[in]       u_x_tor,u_y_tor,u_z_tor         Cartesian toroidal velocity components
+ * @param[in]       vort_tor                        toroidal (radial) vorticity
+ * @param[in]       u_x_pot,u_y_pot,u_z_pot         Cartesian potential velocity components
+ * @param[in]       vort_pot                        potential (radial) vorticity
+ * @param[in]       source_data                     dataset class instance containing data (Psi, Phi, etc)
+ * @param[in]       Ilat,Ilon                       current position
+ * @param[in]       stencil                         pre-computed kernel stencil (built at Ilat, and at Ilon unless the kernel can be rolled)
+ * @param[in]       water                           pre-computed water runs for the mask (NULL indicates not provided)
+ *
+ */
+template <class real_type>
+void apply_filter_at_point_helmholtz_quadratics(
+        std::vector<double> & quad_vals,
+        const std::vector<real_type> & u_x_tor,
+        const std::vector<real_type> & u_y_tor,
+        const std::vector<real_type> & u_z_tor,
+        const std::vector<real_type> & vort_tor,
+        const std::vector<real_type> & u_x_pot,
+        const std::vector<real_type> & u_y_pot,
+        const std::vector<real_type> & u_z_pot,
+        const std::vector<real_type> & vort_pot,
+        const dataset & source_data,
+        const int Ilat,
+        const int Ilon,
+        const kernel_stencil & stencil,
+        const water_runs * water
+        ) {
+
+    const std::vector<bool> &mask = source_data.mask;
+
+    const int   Ntime   = source_data.Ntime,
+                Ndepth  = source_data.Ndepth,
+                Nlat    = source_data.Nlat,
+                Nlon    = source_data.Nlon,
+                Nlevels = Ntime * Ndepth,
+                Nquad   = 27;
+
+    #if DEBUG >= 1
+    const bool can_roll_in_longitude = ( (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN) and (constants::PERIODIC_X) );
+    assert( stencil.ref_Ilat == Ilat );
+    assert( can_roll_in_longitude or (stencil.ref_Ilon == Ilon) );
+    assert( stencil.Nscales == 1 );
+    assert( (water == NULL) or ( (water->Nrows == Nlevels * Nlat) and (water->Nlon == Nlon) ) );
+    #endif
+
+    quad_vals.assign( Nlevels * Nquad, 0. );
+
+    std::vector<double> kA_sum(Nlevels, 0.);
+
+    // Which levels actually need to be computed
+    std::vector<bool> do_level(Nlevels);
+    for (int Ilev = 0; Ilev < Nlevels; Ilev++) {
+        do_level[Ilev] = mask.at( Index(Ilev / Ndepth, Ilev % Ndepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon) );
+    }
+
+    // Each stencil row is split into (at most two) contiguous segments of longitude,
+    //   so that wrapping around the periodic boundary doesn't need per-cell arithmetic
+    stencil_segment segs[2];
+    int Nsegs;
+    size_t level_offset;
+    std::vector<int> wet_lo, wet_hi;
+
+    for (size_t Irow = 0; Irow < stencil.Nrows(); Irow++) {
+
+        Nsegs = stencil.row_segments( segs, Irow, Ilon, Nlon );
+
+        for (int Ilev = 0; Ilev < Nlevels; Ilev++) {
+            if (not(do_level[Ilev])) { continue; }
+
+            level_offset = Index(Ilev / Ndepth, Ilev % Ndepth, stencil.row_lat[Irow], 0, Ntime, Ndepth, Nlat, Nlon);
+
+            for (int Iseg = 0; Iseg < Nsegs; Iseg++) {
+
+                const int       LON0 = segs[Iseg].lon_start,
+                                NN   = segs[Iseg].Ncells;
+                const double    *kA  = &( stencil.kA[ segs[Iseg].cell_offset ] );
+                const size_t    off  = level_offset + LON0;
+
+                // Water intervals within this segment (relative to LON0)
+                segment_water_runs( wet_lo, wet_hi, segs[Iseg], level_offset, mask, water );
+                const size_t Nruns = wet_lo.size();
+
+                // Denominator (only the water cells if we're deforming around land, otherwise every cell)
+                double kA_lev = 0.;
+                for (size_t Irun = 0; Irun < ( constants::DEFORM_AROUND_LAND ? Nruns : 1 ); Irun++) {
+                    const int   II_lo = constants::DEFORM_AROUND_LAND ? wet_lo[Irun] : 0,
+                                II_hi = constants::DEFORM_AROUND_LAND ? wet_hi[Irun] : NN;
+                    for (int II = II_lo; II < II_hi; II++) { kA_lev += kA[II]; }
+                }
+                kA_sum[Ilev] += kA_lev;
+
+                const real_type *tx = &u_x_tor[off],
+                                *ty = &u_y_tor[off],
+                                *tz = &u_z_tor[off],
+                                *tw = &vort_tor[off],
+                                *px = &u_x_pot[off],
+                                *py = &u_y_pot[off],
+                                *pz = &u_z_pot[off],
+                                *pw = &vort_pot[off];
+
+                // Numerators, walking only over the water runs and reading each cell once
+                //   s_t*, s_p*, s_a* are the tor, pot, and total (all) sums
+                double  s_txx = 0., s_txy = 0., s_txz = 0., s_tyy = 0., s_tyz = 0., s_tzz = 0., s_twx = 0., s_twy = 0., s_twz = 0.,
+                        s_pxx = 0., s_pxy = 0., s_pxz = 0., s_pyy = 0., s_pyz = 0., s_pzz = 0., s_pwx = 0., s_pwy = 0., s_pwz = 0.,
+                        s_axx = 0., s_axy = 0., s_axz = 0., s_ayy = 0., s_ayz = 0., s_azz = 0., s_awx = 0., s_awy = 0., s_awz = 0.;
+                for (size_t Irun = 0; Irun < Nruns; Irun++) {
+                    for (int II = wet_lo[Irun]; II < wet_hi[Irun]; II++) {
+                        const double    w   = kA[II],
+                                        tvx = tx[II], tvy = ty[II], tvz = tz[II], tvw = tw[II],
+                                        pvx = px[II], pvy = py[II], pvz = pz[II], pvw = pw[II],
+                                        avx = tvx + pvx,
+                                        avy = tvy + pvy,
+                                        avz = tvz + pvz,
+                                        avw = tvw + pvw;
+
+                        s_txx += tvx * tvx * w;
+                        s_txy += tvx * tvy * w;
+                        s_txz += tvx * tvz * w;
+                        s_tyy += tvy * tvy * w;
+                        s_tyz += tvy * tvz * w;
+                        s_tzz += tvz * tvz * w;
+                        s_twx += tvw * tvx * w;
+                        s_twy += tvw * tvy * w;
+                        s_twz += tvw * tvz * w;
+
+                        s_pxx += pvx * pvx * w;
+                        s_pxy += pvx * pvy * w;
+                        s_pxz += pvx * pvz * w;
+                        s_pyy += pvy * pvy * w;
+                        s_pyz += pvy * pvz * w;
+                        s_pzz += pvz * pvz * w;
+                        s_pwx += pvw * pvx * w;
+                        s_pwy += pvw * pvy * w;
+                        s_pwz += pvw * pvz * w;
+
+                        s_axx += avx * avx * w;
+                        s_axy += avx * avy * w;
+                        s_axz += avx * avz * w;
+                        s_ayy += avy * avy * w;
+                        s_ayz += avy * avz * w;
+                        s_azz += avz * avz * w;
+                        s_awx += avw * avx * w;
+                        s_awy += avw * avy * w;
+                        s_awz += avw * avz * w;
+                    }
+                }
+
+                double * quad = &quad_vals[ Ilev * Nquad ];
+                quad[ 0] += s_txx;  quad[ 1] += s_txy;  quad[ 2] += s_txz;
+                quad[ 3] += s_tyy;  quad[ 4] += s_tyz;  quad[ 5] += s_tzz;
+                quad[ 6] += s_twx;  quad[ 7] += s_twy;  quad[ 8] += s_twz;
+
+                quad[ 9] += s_pxx;  quad[10] += s_pxy;  quad[11] += s_pxz;
+                quad[12] += s_pyy;  quad[13] += s_pyz;  quad[14] += s_pzz;
+                quad[15] += s_pwx;  quad[16] += s_pwy;  quad[17] += s_pwz;
+
+                quad[18] += s_axx;  quad[19] += s_axy;  quad[20] += s_axz;
+                quad[21] += s_ayy;  quad[22] += s_ayz;  quad[23] += s_azz;
+                quad[24] += s_awx;  quad[25] += s_awy;  quad[26] += s_awz;
+            }
+        }
+    }
+
+    // On the off chance that the kernel was null (size zero), just return zero
+    for (int Ilev = 0; Ilev < Nlevels; Ilev++) {
+        const double kA = kA_sum[Ilev];
+        for (int II = 0; II < Nquad; II++) {
+            double & val = quad_vals[ Ilev * Nquad + II ];
+            val = (kA == 0) ? 0. : val / kA;
+        }
+    }
+}
+
+template void apply_filter_at_point_helmholtz_quadratics<double>(
+        std::vector<double> &,
+        const std::vector<double> &, const std::vector<double> &, const std::vector<double> &, const std::vector<double> &,
+        const std::vector<double> &, const std::vector<double> &, const std::vector<double> &, const std::vector<double> &,
+        const dataset &, const int, const int, const kernel_stencil &, const water_runs * );
+
+template void apply_filter_at_point_helmholtz_quadratics<float>(
+        std::vector<double> &,
+        const std::vector<float> &, const std::vector<float> &, const std::vector<float> &, const std::vector<float> &,
+        const std::vector<float> &, const std::vector<float> &, const std::vector<float> &, const std::vector<float> &,
+        const dataset &, const int, const int, const kernel_stencil &, const water_runs * );
@@ -0,0 +1,173 @@
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include <cassert>
+#include "../functions.hpp"
+#include "../constants.hpp"
+
+/*!
+ * \brief Compute filtered fields at a single (lat,lon) point for every local time, depth, and filter scale
+ *
+ * This walks a multi-scale kernel_stencil (built for all of the scales at once) a single time,
+ * and accumulates the partial sums for every scale together. Each field value is therefore only
+ * loaded once per point, regardless of the number of scales. If the water runs are provided,
+ * then the numerators only walk over the water intervals (no per-cell mask checks).
+ *
+ * As in apply_filter_at_point_all_levels, if field_factors is non-empty then the products
+ * (*fields[Ifield]) * (*field_factors[Ifield]) are filtered (NULL entries indicate no factor).
+ *
+ * Outputs are stored as coarse_vals[ ( Iscale * Nlevels + Ilev ) * Nfields + Ifield ],
+ *    where Ilev = Itime * Ndepth + Idepth.
+ *
+ * The fields, factors, and weight can be stored in single or double precision (see FLOAT_FIELD_STORAGE),
+ * but the kernel sums are always accumulated in double precision.
+ *
+ * @param[in,out]   coarse_vals             where to store filtered values (resized if needed)
+ * @param[in]       fields                  fields to filter
+ * @param[in]       field_factors           optional factors multiplying each field (size 0 if not used)
+ * @param[in]       source_data             dataset class instance containing data (Psi, Phi, etc)
+ * @param[in]       Ilat,Ilon               current position
+ * @param[in]       stencil                 pre-computed multi-scale kernel stencil
+ * @param[in]       weight                  pointer to spatial weight (i.e. rho) (NULL indicates not provided)
+ * @param[in]       skip_land               if true, levels where (Ilat,Ilon) is land are not computed (left as zero)
+ * @param[in]       water                   pre-computed water runs for the mask (NULL indicates not provided)
+ *
+ */
+template <class real_type>
+void apply_filter_at_point_multiscale(
+        std::vector<double> & coarse_vals,
+        const std::vector<const std::vector<real_type>*> & fields,
+        const std::vector<const std::vector<real_type>*> & field_factors,
+        const dataset & source_data,
+        const int Ilat,
+        const int Ilon,
+        const kernel_stencil & stencil,
+        const typename non_deduced< std::vector<real_type> >::type * weight,
+        const bool skip_land,
+        const water_runs * water
+        ) {
+
+    const int Nfields = fields.size();
+
+    const std::vector<bool> &mask = source_data.mask;
+
+    const int   Ntime   = source_data.Ntime,
+                Ndepth  = source_data.Ndepth,
+                Nlat    = source_data.Nlat,
+                Nlon    = source_data.Nlon,
+                Nlevels = Ntime * Ndepth,
+                Nscales = stencil.Nscales;
+
+    const bool use_factors = ( field_factors.size() > 0 );
+
+    #if DEBUG >= 1
+    const bool can_roll_in_longitude = ( (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN) and (constants::PERIODIC_X) );
+    assert( stencil.ref_Ilat == Ilat );
+    assert( can_roll_in_longitude or (stencil.ref_Ilon == Ilon) );
+    assert( not(use_factors) or ( (int)field_factors.size() == Nfields ) );
+    assert( (water == NULL) or ( (water->Nrows == Nlevels * Nlat) and (water->Nlon == Nlon) ) );
+    #endif
+
+    coarse_vals.resize( Nscales * Nlevels * Nfields );
+    std::fill( coarse_vals.begin(), coarse_vals.end(), 0. );
+
+    std::vector<double> kA_sum(Nscales * Nlevels, 0.), tmp_vals(Nscales * Nlevels * Nfields, 0.),
+                        kA_loc(Nscales), val_loc(Nscales * Nfields);
+
+    // Which levels actually need to be computed
+    std::vector<bool> do_level(Nlevels, true);
+    if (skip_land) {
+        for (int Ilev = 0; Ilev < Nlevels; Ilev++) {
+            do_level[Ilev] = mask.at( Index(Ilev / Ndepth, Ilev % Ndepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon) );
+        }
+    }
+
+    // Each stencil row is split into (at most two) contiguous segments of longitude,
+    //   so that wrapping around the periodic boundary doesn't need per-cell arithmetic
+    stencil_segment segs[2];
+    int Nsegs;
+    size_t level_offset;
+    double loc_val, loc_weight;
+    std::vector<int> wet_lo, wet_hi;
+
+    for (size_t Irow = 0; Irow < stencil.Nrows(); Irow++) {
+
+        Nsegs = stencil.row_segments( segs, Irow, Ilon, Nlon );
+
+        for (int Ilev = 0; Ilev < Nlevels; Ilev++) {
+            if (not(do_level[Ilev])) { continue; }
+
+            level_offset = Index(Ilev / Ndepth, Ilev % Ndepth, stencil.row_lat[Irow], 0, Ntime, Ndepth, Nlat, Nlon);
+
+            std::fill( kA_loc.begin(),  kA_loc.end(),  0. );
+            std::fill( val_loc.begin(), val_loc.end(), 0. );
+
+            for (int Iseg = 0; Iseg < Nsegs; Iseg++) {
+
+                const int       LON0 = segs[Iseg].lon_start,
+                                NN   = segs[Iseg].Ncells;
+                const double    *kA_seg = &( stencil.kA[ segs[Iseg].cell_offset * Nscales ] );
+
+                // Water intervals within this segment (relative to LON0)
+                segment_water_runs( wet_lo, wet_hi, segs[Iseg], level_offset, mask, water );
+                const size_t Nruns = wet_lo.size();
+
+                // Denominators (the cell area counts unless we're deforming around land)
+                //   A masked loop walks the water runs, and an unmasked loop is the single interval [0, NN)
+                for (size_t Irun = 0; Irun < ( constants::DEFORM_AROUND_LAND ? Nruns : 1 ); Irun++) {
+                    const int   II_lo = constants::DEFORM_AROUND_LAND ? wet_lo[Irun] : 0,
+                                II_hi = constants::DEFORM_AROUND_LAND ? wet_hi[Irun] : NN;
+                    for (int II = II_lo; II < II_hi; II++) {
+                        const double * kA = &( kA_seg[ II * Nscales ] );
+                        loc_weight = (weight == NULL) ? 1. : (*weight)[level_offset + LON0 + II];
+                        for (int Is = 0; Is < Nscales; Is++) { kA_loc[Is] += kA[Is] * loc_weight; }
+                    }
+                }
+
+                // Numerators: each field value is loaded once and used for every scale
+                for (int Ifield = 0; Ifield < Nfields; Ifield++) {
+                    const std::vector<real_type> * factor = use_factors ? field_factors[Ifield] : NULL;
+                    double * vals = &( val_loc[Ifield * Nscales] );
+                    for (size_t Irun = 0; Irun < Nruns; Irun++) {
+                        for (int II = wet_lo[Irun]; II < wet_hi[Irun]; II++) {
+                            const size_t    src_index = level_offset + LON0 + II;
+                            const double *  kA        = &( kA_seg[ II * Nscales ] );
+                            loc_val = (*fields[Ifield])[src_index];
+                            if (weight != NULL) { loc_val *= (*weight)[src_index]; }
+                            if (factor != NULL) { loc_val *= (*factor)[src_index]; }
+                            for (int Is = 0; Is < Nscales; Is++) { vals[Is] += loc_val * kA[Is]; }
+                        }
+                    }
+                }
+            }
+
+            for (int Is = 0; Is < Nscales; Is++) {
+                kA_sum[ Is * Nlevels + Ilev ] += kA_loc[Is];
+                for (int Ifield = 0; Ifield < Nfields; Ifield++) {
+                    tmp_vals[ ( Is * Nlevels + Ilev ) * Nfields + Ifield ] += val_loc[ Ifield * Nscales + Is ];
+                }
+            }
+        }
+    }
+
+    // On the off chance that the kernel was null (size zero), just return zero
+    for (int Is = 0; Is < Nscales; Is++) {
+        for (int Ilev = 0; Ilev < Nlevels; Ilev++) {
+            const double denom = kA_sum[ Is * Nlevels + Ilev ];
+            for (int Ifield = 0; Ifield < Nfields; Ifield++) {
+                const size_t II = ( Is * Nlevels + Ilev ) * Nfields + Ifield;
+                coarse_vals[II] = (denom == 0) ? 0. : tmp_vals[II] / denom;
+            }
+        }
+    }
+}
+
+template void apply_filter_at_point_multiscale<double>(
+        std::vector<double> &,
+        const std::vector<const std::vector<double>*> &, const std::vector<const std::vector<double>*> &,
+        const dataset &, const int, const int, const kernel_stencil &, const std::vector<double> *, const bool, const water_runs * );
+
+template void apply_filter_at_point_multiscale<float>(
+        std::vector<double> &,
+        const std::vector<const std::vector<float>*> &, const std::vector<const std::vector<float>*> &,
+        const dataset &, const int, const int, const kernel_stencil &, const std::vector<float> *, const bool, const water_runs * );
@@ -0,0 +1,301 @@
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include <cassert>
+#include <omp.h>
+#include "../functions.hpp"
+#include "../constants.hpp"
+
+// Below this width (in cells) the recursive filter is inaccurate, so the Gaussian
+//   is applied directly instead (which only needs a handful of taps)
+static const double IIR_MIN_SIGMA = 1.;
+
+// Number of longitudes (columns) processed together in the latitude pass
+static const int IIR_LANES = 64;
+
+/*
+ * Apply a unit-sum Gaussian of width sigma (in cells) along the first index of data,
+ *   where element (II, lane) is data[ II * stride + lane ], for II in [0, N) and lane in [0, Nlanes).
+ *   Points outside of [0, N) are zero, unless periodic.
+ *
+ * For sigma >= IIR_MIN_SIGMA, this is the fourth-order recursive filter of Deriche (1993), as
+ *   the sum of a causal and an anti-causal pass, so the cost doesn't depend on sigma. Its impulse 
+ *   response matches the Gaussian to within ~5e-4 of the peak. (The third-order filter of Young and 
+ *   van Vliet is cheaper, but is ~50 times less accurate.) Since each pass only sees one side, zero 
+ *   boundaries are exact, and periodic boundaries are handled by wrapping 5 sigma onto either side.
+ */
+static void gaussian_1d(
+        double * data,
+        const int N,
+        const size_t stride,
+        const int Nlanes,
+        const double sigma,
+        const bool periodic,
+        std::vector<double> & buffer
+        ) {
+
+    if ( (sigma <= 0) or (N <= 0) ) { return; }
+
+    // A periodic Gaussian this wide is flat (to within exp(-2 pi^2) for the first harmonic)
+    if ( periodic and (sigma >= N) ) {
+        for (int lane = 0; lane < Nlanes; lane++) {
+            double mean = 0.;
+            for (int II = 0; II < N; II++) { mean += data[ II * stride + lane ]; }
+            mean /= N;
+            for (int II = 0; II < N; II++) { data[ II * stride + lane ] = mean; }
+        }
+        return;
+    }
+
+    const bool use_iir = (sigma >= IIR_MIN_SIGMA);
+    const int   pad     = use_iir ? ( periodic ? (int) ceil( 5 * sigma ) : 0 ) : (int) ceil( 4 * sigma ),
+                Nbuf    = N + 2 * pad;
+
+    // Copy into the padded buffer (followed by space for the causal and anti-causal passes)
+    buffer.resize( (size_t) 3 * Nbuf * Nlanes );
+    double  *x_buf  = buffer.data(),
+            *yp_buf = x_buf  + (size_t) Nbuf * Nlanes,
+            *ym_buf = yp_buf + (size_t) Nbuf * Nlanes;
+    for (int Ib = 0; Ib < Nbuf; Ib++) {
+        int II = Ib - pad;
+        if (periodic) { II = ( II % N + N ) % N; }
+        double * dst = &x_buf[ (size_t) Ib * Nlanes ];
+        if ( (II < 0) or (II >= N) ) { std::fill( dst, dst + Nlanes, 0. ); }
+        else { std::copy( data + II * stride, data + II * stride + Nlanes, dst ); }
+    }
+
+    if (use_iir) {
+        // Deriche coefficients (for the Gaussian with unit sigma), scaled to this sigma
+        const double    a0 = 1.680, a1 = 3.735, b0 = 1.783, w0 = 0.6318,
+                        c0 = -0.6803, c1 = -0.2598, b1 = 1.723, w1 = 1.997,
+                        e0  = exp( -b0 / sigma ),  e1  = exp( -b1 / sigma ),
+                        cw0 = cos(  w0 / sigma ),  sw0 = sin(  w0 / sigma ),
+                        cw1 = cos(  w1 / sigma ),  sw1 = sin(  w1 / sigma );
+
+        const double    n0 = a0 + c0,
+                        n1 = e1 * ( c1 * sw1 - ( c0 + 2 * a0 ) * cw1 ) + e0 * ( a1 * sw0 - ( 2 * c0 + a0 ) * cw0 ),
+                        n2 = 2 * e0 * e1 * ( ( a0 + c0 ) * cw1 * cw0 - a1 * cw1 * sw0 - c1 * cw0 * sw1 ) 
+                                + c0 * e0 * e0 + a0 * e1 * e1,
+                        n3 = e1 * e0 * e0 * ( c1 * sw1 - c0 * cw1 ) + e0 * e1 * e1 * ( a1 * sw0 - a0 * cw0 ),
+                        d1 = - 2 * e1 * cw1 - 2 * e0 * cw0,
+                        d2 = 4 * cw1 * cw0 * e0 * e1 + e1 * e1 + e0 * e0,
+                        d3 = - 2 * cw0 * e0 * e1 * e1 - 2 * cw1 * e1 * e0 * e0,
+                        d4 = e0 * e0 * e1 * e1,
+                        m1 = n1 - d1 * n0,
+                        m2 = n2 - d2 * n0,
+                        m3 = n3 - d3 * n0,
+                        m4 = - d4 * n0;
+
+        // Normalize to unit sum
+        const double norm = ( 1 + d1 + d2 + d3 + d4 ) / ( n0 + n1 + n2 + n3 + m1 + m2 + m3 + m4 );
+
+        // Causal pass (the state before the start of the buffer is zero)
+        for (int Ib = 0; Ib < Nbuf; Ib++) {
+            const double * x = &x_buf[ (size_t) Ib * Nlanes ];
+            double * y = &yp_buf[ (size_t) Ib * Nlanes ];
+            for (int lane = 0; lane < Nlanes; lane++) {
+                double val = n0 * x[lane];
+                if (Ib >= 1) { val += n1 * x[lane -     Nlanes] - d1 * y[lane -     Nlanes]; }
+                if (Ib >= 2) { val += n2 * x[lane - 2 * Nlanes] - d2 * y[lane - 2 * Nlanes]; }
+                if (Ib >= 3) { val += n3 * x[lane - 3 * Nlanes] - d3 * y[lane - 3 * Nlanes]; }
+                if (Ib >= 4) { val -=                             d4 * y[lane - 4 * Nlanes]; }
+                y[lane] = val;
+            }
+        }
+
+        // Anti-causal pass (likewise after the end)
+        for (int Ib = Nbuf - 1; Ib >= 0; Ib--) {
+            const double * x = &x_buf[ (size_t) Ib * Nlanes ];
+            double * y = &ym_buf[ (size_t) Ib * Nlanes ];
+            for (int lane = 0; lane < Nlanes; lane++) {
+                double val = 0.;
+                if (Ib + 1 < Nbuf) { val += m1 * x[lane +     Nlanes] - d1 * y[lane +     Nlanes]; }
+                if (Ib + 2 < Nbuf) { val += m2 * x[lane + 2 * Nlanes] - d2 * y[lane + 2 * Nlanes]; }
+                if (Ib + 3 < Nbuf) { val += m3 * x[lane + 3 * Nlanes] - d3 * y[lane + 3 * Nlanes]; }
+                if (Ib + 4 < Nbuf) { val += m4 * x[lane + 4 * Nlanes] - d4 * y[lane + 4 * Nlanes]; }
+                y[lane] = val;
+            }
+        }
+
+        for (int II = 0; II < N; II++) {
+            const size_t Ib = (size_t) ( II + pad ) * Nlanes;
+            for (int lane = 0; lane < Nlanes; lane++) {
+                data[ II * stride + lane ] = ( yp_buf[ Ib + lane ] + ym_buf[ Ib + lane ] ) * norm;
+            }
+        }
+    } else {
+        // Narrow kernel, so just apply the sampled Gaussian
+        const int K = pad;
+        std::vector<double> taps( 2 * K + 1 );
+        double tap_sum = 0.;
+        for (int k = -K; k <= K; k++) {
+            taps[ k + K ] = exp( - k * k / ( 2 * sigma * sigma ) );
+            tap_sum += taps[ k + K ];
+        }
+
+        for (int II = 0; II < N; II++) {
+            double * dst = data + II * stride;
+            std::fill( dst, dst + Nlanes, 0. );
+            for (int k = -K; k <= K; k++) {
+                const double * src = &x_buf[ (size_t) ( II + pad + k ) * Nlanes ];
+                for (int lane = 0; lane < Nlanes; lane++) { dst[lane] += taps[ k + K ] * src[lane] / tap_sum; }
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Filter fields with a recursive (IIR) approximation of the Gaussian kernel
+ *
+ * The kernel is approximated as a product of one-dimensional Gaussians, in local distance along
+ * longitude and along latitude, and each is applied with the fourth-order recursive filter of
+ * Deriche, so the cost per cell does not depend on the filter scale. The latitude pass
+ * is done first, so that the longitude pass can use the width (in cells) of the kernel along each
+ * target row (i.e. distances are measured as at the kernel centre). Target rows narrower than the
+ * kernel (near the poles) get the row mean if PERIODIC_X. Each pass has unit sum, and since the
+ * numerators and denominator at a point come from the same passes, the normalization cancels.
+ *
+ * Land is handled with normalized convolution: area * mask * field and the denominator weights
+ * (area * mask if DEFORM_AROUND_LAND, otherwise area) are filtered together, and the filtered
+ * field is their ratio, as in apply_filter_at_point.
+ *
+ * On a Cartesian grid, the Gaussian kernels factor exactly, and the only error is from the recursive
+ * approximation. On the sphere, distances along the two passes are not geodesic distances, so the
+ * error grows with the scale and near the poles. See Tests/iir_filter_accuracy.cpp, and the
+ * sampled error reported when DEBUG >= 1.
+ *
+ * Assumes uniform grids (the average latitude spacing is used for the latitude pass).
+ *
+ * If field_factors is non-empty, then the field that is filtered is fields[II] * field_factors[II]
+ * (NULL entries in field_factors indicate a linear field).
+ *
+ * Only the rows [Ilat_start, Ilat_end) are filtered (land points are set to zero).
+ *
+ * @param[in,out]   coarse_fields           where to store the filtered fields (NULL entries are skipped)
+ * @param[in]       fields                  fields to filter
+ * @param[in]       field_factors           optional second factor for each field (size 0 or same size as fields)
+ * @param[in]       source_data             dataset class instance containing data (Psi, Phi, etc)
+ * @param[in]       scale                   filtering scale
+ * @param[in]       Ilat_start              first latitude to filter
+ * @param[in]       Ilat_end                one past the last latitude to filter
+ * @param[in]       weight                  pointer to spatial weight (i.e. rho) (NULL indicates not provided)
+ *
+ */
+void apply_filter_iir(
+        std::vector< std::vector<double>* > & coarse_fields,
+        const std::vector<const std::vector<filter_real>*> & fields,
+        const std::vector<const std::vector<filter_real>*> & field_factors,
+        const dataset & source_data,
+        const double scale,
+        const int Ilat_start,
+        const int Ilat_end,
+        const std::vector<filter_real> * weight
+        ) {
+
+    static_assert( not(constants::IIR_GAUSSIAN_FILTER) or
+                ( (constants::KERNEL_OPT == constants::KernelType::Gaussian) or
+                  (constants::KERNEL_OPT == constants::KernelType::JohnsonGaussian) ),
+            "The recursive filter requires a Gaussian kernel." );
+    static_assert( constants::UNIFORM_LON_GRID, "The recursive filter requires a uniform lon grid." );
+
+    const int Nfields = fields.size();
+    assert( (int)coarse_fields.size() == Nfields );
+    assert( (field_factors.size() == 0) or ((int)field_factors.size() == Nfields) );
+
+    const std::vector<double>   &dAreas     = source_data.areas,
+                                &latitude   = source_data.latitude,
+                                &longitude  = source_data.longitude;
+    const std::vector<bool> &mask = source_data.mask;
+
+    const int   Ntime   = source_data.Ntime,
+                Ndepth  = source_data.Ndepth,
+                Nlat    = source_data.Nlat,
+                Nlon    = source_data.Nlon,
+                Nlevels = Ntime * Ndepth;
+
+    // Standard deviation of the kernel, in metres:
+    //   exp( -(2 d / scale)^2 ) for Gaussian, and exp( -(2 d / scale)^2 / 8 ) for JohnsonGaussian
+    const double sigma = ( constants::KERNEL_OPT == constants::KernelType::JohnsonGaussian ) ? scale : scale / ( 2 * sqrt(2.) );
+
+    const double    dlon = ( Nlon > 1 ) ? longitude.at(1) - longitude.at(0) : 1.,
+                    dlat = ( Nlat > 1 ) ? ( latitude.at(Nlat - 1) - latitude.at(0) ) / ( Nlat - 1 ) : 1.;
+
+    // Widths (in cells) for the latitude pass, and for the longitude pass along each row
+    const double sigma_lat = constants::CARTESIAN ? sigma / dlat : sigma / ( constants::R_earth * dlat );
+    std::vector<double> sigma_lon( Nlat );
+    for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+        const double dx = constants::CARTESIAN ? dlon : constants::R_earth * fabs( cos( latitude.at(Ilat) ) ) * dlon;
+        sigma_lon[Ilat] = ( dx > 0 ) ? sigma / dx : 1e30;
+        // Beyond this, the kernel is flat across a non-periodic row anyway
+        if (not(constants::PERIODIC_X)) { sigma_lon[Ilat] = std::min( sigma_lon[Ilat], 10. * Nlon ); }
+    }
+
+    // Numerators for each field, then the denominator
+    const int Nsums = Nfields + 1;
+    std::vector< std::vector<double> > sums( Nsums, std::vector<double>( (size_t) Nlat * Nlon ) );
+
+    for (int Ilev = 0; Ilev < Nlevels; Ilev++) {
+        const int   Itime   = Ilev / Ndepth,
+                    Idepth  = Ilev % Ndepth;
+
+        #pragma omp parallel default(none) \
+        shared( sums, fields, field_factors, dAreas, mask, weight, sigma_lon ) \
+        firstprivate( Nfields, Nsums, Ntime, Ndepth, Nlat, Nlon, Itime, Idepth, Ilat_start, Ilat_end, sigma_lat )
+        {
+            std::vector<double> buffer;
+
+            // Weighted fields
+            #pragma omp for schedule(static)
+            for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+                const size_t row_offset = Index(Itime, Idepth, Ilat, 0, Ntime, Ndepth, Nlat, Nlon);
+                for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+                    const size_t index = row_offset + Ilon;
+                    const double Aw = dAreas[ Ilat * Nlon + Ilon ] * ( (weight == NULL) ? 1. : (*weight)[index] );
+                    for (int Ifield = 0; Ifield < Nfields; Ifield++) {
+                        double val = 0.;
+                        if ( mask[index] ) {
+                            val = (*fields[Ifield])[index];
+                            if ( (field_factors.size() > 0) and (field_factors[Ifield] != NULL) ) { val *= (*field_factors[Ifield])[index]; }
+                        }
+                        sums[Ifield][ Ilat * Nlon + Ilon ] = val * Aw;
+                    }
+                    sums[Nfields][ Ilat * Nlon + Ilon ] = ( mask[index] or not(constants::DEFORM_AROUND_LAND) ) ? Aw : 0.;
+                }
+            }
+
+            // Latitude pass, on blocks of columns at a time
+            const int Nblocks = ( Nlon + IIR_LANES - 1 ) / IIR_LANES;
+            #pragma omp for collapse(2) schedule(dynamic)
+            for (int II = 0; II < Nsums; II++) {
+                for (int Iblock = 0; Iblock < Nblocks; Iblock++) {
+                    const int   Ilon0   = Iblock * IIR_LANES,
+                                Nlanes  = std::min( IIR_LANES, Nlon - Ilon0 );
+                    gaussian_1d( &sums[II][Ilon0], Nlat, Nlon, Nlanes, sigma_lat, constants::PERIODIC_Y, buffer );
+                }
+            }
+
+            // Longitude pass along each target row
+            #pragma omp for collapse(2) schedule(dynamic)
+            for (int Ilat = Ilat_start; Ilat < Ilat_end; Ilat++) {
+                for (int II = 0; II < Nsums; II++) {
+                    gaussian_1d( &sums[II][ (size_t) Ilat * Nlon ], Nlon, 1, 1, sigma_lon[Ilat], constants::PERIODIC_X, buffer );
+                }
+            }
+        }
+
+        #pragma omp parallel for default(none) schedule(static) \
+        shared( coarse_fields, sums, mask ) \
+        firstprivate( Nfields, Ntime, Ndepth, Nlat, Nlon, Itime, Idepth, Ilat_start, Ilat_end )
+        for (int Ilat = Ilat_start; Ilat < Ilat_end; Ilat++) {
+            for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+                const size_t    index   = Index(Itime, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon),
+                                II      = (size_t) Ilat * Nlon + Ilon;
+                const double denom = sums[Nfields][II];
+                for (int Ifield = 0; Ifield < Nfields; Ifield++) {
+                    if (coarse_fields[Ifield] == NULL) { continue; }
+                    coarse_fields[Ifield]->at(index) = ( not(mask[index]) or (denom == 0) ) ? 0. : sums[Ifield][II] / denom;
+                }
+            }
+        }
+    }
+}
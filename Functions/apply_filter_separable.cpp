@@ -0,0 +1,190 @@
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include <cassert>
+#include <omp.h>
+#include "../functions.hpp"
+#include "../constants.hpp"
+
+// One-dimensional kernel weights for each target index: the sources are
+//   idx[ offset[II] .. offset[II+1] ), with kernel values kern[ same range ]
+struct separable_weights {
+    std::vector<size_t> offset;
+    std::vector<int>    idx;
+    std::vector<double> kern;
+};
+
+// Kernel weights along one (Cartesian) coordinate. The kernel is cut off at the same radius
+//   as the direct stencil ( kernel_pad() * scale / 2 ), but along each direction separately.
+static void build_separable_weights(
+        separable_weights & weights,
+        const std::vector<double> & coord,
+        const bool periodic,
+        const double scale
+        ) {
+
+    const int N = coord.size();
+    const double    L       = (N > 1) ? ( coord[1] - coord[0] ) * N : 0.,
+                    radius  = kernel_pad() * scale / 2.;
+
+    weights.offset.assign( 1, 0 );
+    weights.idx.clear();
+    weights.kern.clear();
+
+    double dist;
+    int Ncells;
+    for (int II = 0; II < N; II++) {
+        // Walk outwards from II in both directions until leaving the kernel
+        //   (or, if periodic, until every cell has been visited once)
+        Ncells = 0;
+        for (int dir = -1; dir <= 1; dir += 2) {
+            for (int step = (dir < 0) ? 1 : 0; (step < N) and (Ncells < N); step++) {
+                int JJ = II + dir * step;
+                if (periodic) { JJ = ( JJ % N + N ) % N; }
+                else if ( (JJ < 0) or (JJ >= N) ) { break; }
+
+                dist = fabs( coord[JJ] - coord[II] );
+                if (periodic) { dist = std::min( dist, L - dist ); }
+                if (dist > radius) { break; }
+
+                weights.idx.push_back( JJ );
+                weights.kern.push_back( kernel( dist, scale ) );
+                Ncells++;
+            }
+        }
+        weights.offset.push_back( weights.idx.size() );
+    }
+}
+
+/*!
+ * \brief Filter fields with a separable kernel, as one pass in longitude (x) followed by one pass in latitude (y)
+ *
+ * On a Cartesian grid, the Gaussian kernels factor as G(x) G(y), so the double sum over
+ * the stencil can be done as two one-dimensional sums. The first pass sums along each row
+ * (with the cell areas, mask, and weight), and the second sums the row results along each
+ * column. The denominators are computed the same way (from the mask if DEFORM_AROUND_LAND,
+ * otherwise from every cell), so the results match apply_filter_at_point up to the kernel
+ * being cut off on a square instead of a disc (which is negligible for these kernels).
+ *
+ * The cost per point is proportional to the stencil width instead of its area.
+ *
+ * If field_factors is non-empty, then the field that is filtered is fields[II] * field_factors[II]
+ * (NULL entries in field_factors indicate a linear field).
+ *
+ * Only the rows [Ilat_start, Ilat_end) are filtered (land points are set to zero).
+ *
+ * @param[in,out]   coarse_fields           where to store the filtered fields (NULL entries are skipped)
+ * @param[in]       fields                  fields to filter
+ * @param[in]       field_factors           optional second factor for each field (size 0 or same size as fields)
+ * @param[in]       source_data             dataset class instance containing data (Psi, Phi, etc)
+ * @param[in]       scale                   filtering scale
+ * @param[in]       Ilat_start              first latitude to filter
+ * @param[in]       Ilat_end                one past the last latitude to filter
+ * @param[in]       weight                  pointer to spatial weight (i.e. rho) (NULL indicates not provided)
+ *
+ */
+void apply_filter_separable(
+        std::vector< std::vector<double>* > & coarse_fields,
+        const std::vector<const std::vector<filter_real>*> & fields,
+        const std::vector<const std::vector<filter_real>*> & field_factors,
+        const dataset & source_data,
+        const double scale,
+        const int Ilat_start,
+        const int Ilat_end,
+        const std::vector<filter_real> * weight
+        ) {
+
+    static_assert( not(constants::SEPARABLE_CARTESIAN_FILTER) or ( (constants::CARTESIAN) and 
+                ( (constants::KERNEL_OPT == constants::KernelType::Gaussian) or 
+                  (constants::KERNEL_OPT == constants::KernelType::JohnsonGaussian) ) ),
+            "The separable filter requires a Cartesian grid and a Gaussian kernel." );
+
+    const int Nfields = fields.size();
+    assert( (int)coarse_fields.size() == Nfields );
+    assert( (field_factors.size() == 0) or ((int)field_factors.size() == Nfields) );
+
+    const std::vector<double> &dAreas = source_data.areas;
+    const std::vector<bool> &mask = source_data.mask;
+
+    const int   Ntime   = source_data.Ntime,
+                Ndepth  = source_data.Ndepth,
+                Nlat    = source_data.Nlat,
+                Nlon    = source_data.Nlon,
+                Nlevels = Ntime * Ndepth;
+
+    separable_weights x_weights, y_weights;
+    build_separable_weights( x_weights, source_data.longitude, constants::PERIODIC_X, scale );
+    build_separable_weights( y_weights, source_data.latitude,  constants::PERIODIC_Y, scale );
+
+    // Source rows that are needed for the target rows
+    std::vector<bool> row_needed( Nlat, false );
+    for (int Ilat = Ilat_start; Ilat < Ilat_end; Ilat++) {
+        for (size_t JJ = y_weights.offset[Ilat]; JJ < y_weights.offset[Ilat + 1]; JJ++) { row_needed[ y_weights.idx[JJ] ] = true; }
+    }
+
+    // Row sums: Nfields numerators and a denominator for each (row, lon)
+    const int Nsums = Nfields + 1;
+    std::vector<double> row_sums( (size_t) Nlat * Nlon * Nsums, 0. );
+
+    for (int Ilev = 0; Ilev < Nlevels; Ilev++) {
+        const int   Itime   = Ilev / Ndepth,
+                    Idepth  = Ilev % Ndepth;
+
+        // First pass: along each row
+        #pragma omp parallel for default(none) schedule(dynamic) \
+        shared( row_sums, row_needed, x_weights, fields, field_factors, dAreas, mask, weight ) \
+        firstprivate( Nfields, Nsums, Ntime, Ndepth, Nlat, Nlon, Itime, Idepth )
+        for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+            if (not(row_needed[Ilat])) { continue; }
+
+            const size_t row_offset = Index(Itime, Idepth, Ilat, 0, Ntime, Ndepth, Nlat, Nlon);
+            for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+                double * sums = &row_sums[ ( (size_t) Ilat * Nlon + Ilon ) * Nsums ];
+                std::fill( sums, sums + Nsums, 0. );
+
+                for (size_t JJ = x_weights.offset[Ilon]; JJ < x_weights.offset[Ilon + 1]; JJ++) {
+                    const size_t index = row_offset + x_weights.idx[JJ];
+                    const double kAw = x_weights.kern[JJ] * dAreas[ Ilat * Nlon + x_weights.idx[JJ] ]
+                                       * ( (weight == NULL) ? 1. : (*weight)[index] );
+
+                    if ( mask[index] ) {
+                        for (int Ifield = 0; Ifield < Nfields; Ifield++) {
+                            double val = (*fields[Ifield])[index];
+                            if ( (field_factors.size() > 0) and (field_factors[Ifield] != NULL) ) { val *= (*field_factors[Ifield])[index]; }
+                            sums[Ifield] += val * kAw;
+                        }
+                    }
+                    if ( mask[index] or not(constants::DEFORM_AROUND_LAND) ) { sums[Nfields] += kAw; }
+                }
+            }
+        }
+
+        // Second pass: along each column, for the target rows
+        #pragma omp parallel for default(none) schedule(dynamic) \
+        shared( coarse_fields, row_sums, y_weights, mask ) \
+        firstprivate( Nfields, Nsums, Ntime, Ndepth, Nlat, Nlon, Itime, Idepth, Ilat_start, Ilat_end )
+        for (int Ilat = Ilat_start; Ilat < Ilat_end; Ilat++) {
+            std::vector<double> sums( Nsums );
+            for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+                const size_t index = Index(Itime, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon);
+                if ( not(mask[index]) ) {
+                    for (int Ifield = 0; Ifield < Nfields; Ifield++) {
+                        if (coarse_fields[Ifield] != NULL) { coarse_fields[Ifield]->at(index) = 0.; }
+                    }
+                    continue;
+                }
+
+                std::fill( sums.begin(), sums.end(), 0. );
+                for (size_t JJ = y_weights.offset[Ilat]; JJ < y_weights.offset[Ilat + 1]; JJ++) {
+                    const double * src = &row_sums[ ( (size_t) y_weights.idx[JJ] * Nlon + Ilon ) * Nsums ];
+                    for (int II = 0; II < Nsums; II++) { sums[II] += y_weights.kern[JJ] * src[II]; }
+                }
+
+                for (int Ifield = 0; Ifield < Nfields; Ifield++) {
+                    if (coarse_fields[Ifield] == NULL) { continue; }
+                    coarse_fields[Ifield]->at(index) = (sums[Nfields] == 0) ? 0. : sums[Ifield] / sums[Nfields];
+                }
+            }
+        }
+    }
+}
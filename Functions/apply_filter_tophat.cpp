@@ -0,0 +1,208 @@
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include <cassert>
+#include <omp.h>
+#include "../functions.hpp"
+#include "../constants.hpp"
+
+// Append the runs of non-zero weights in the stencil to (lat, lon_start, Ncells)
+//   A stencil row is usually one run, but can have a gap when the disc wraps around the row
+static void append_stencil_runs(
+        std::vector<int> & run_lat,
+        std::vector<int> & run_lon_start,
+        std::vector<int> & run_Ncells,
+        const kernel_stencil & stencil
+        ) {
+    for (size_t Irow = 0; Irow < stencil.Nrows(); Irow++) {
+        const double * kA = &( stencil.kA[ stencil.row_offset[Irow] ] );
+        const int NN = stencil.row_Ncells[Irow];
+        for (int II = 0; II < NN; II++) {
+            if (kA[II] == 0) { continue; }
+            if ( (II > 0) and (kA[II - 1] != 0) ) { 
+                run_Ncells.back()++; 
+            } else {
+                run_lat.push_back( stencil.row_lat[Irow] );
+                run_lon_start.push_back( stencil.row_lon_start[Irow] + II );
+                run_Ncells.push_back( 1 );
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Filter fields with the TopHat kernel, using prefix sums along each row
+ *
+ * With the TopHat kernel, each filtered value is a (masked) area-weighted mean over a disc,
+ * and the disc covers one (or two) contiguous runs of longitudes in each source row. So, for each level,
+ * prefix sums (in longitude) of area * field and of the denominator weights (area * mask if
+ * DEFORM_AROUND_LAND, otherwise area) are built once, and each row of the disc then contributes
+ * the difference of two prefix sums per run (three if the run wraps around a periodic boundary). 
+ * The cost per point is proportional to the number of rows in the disc, instead of the number of cells.
+ *
+ * The runs are the non-zero cells of a kernel_stencil, so the results match apply_filter_at_point
+ * up to round-off. If the kernel can be rolled in longitude, the stencil is only built once per 
+ * target latitude; otherwise it is built at every point, which loses most of the gain.
+ *
+ * If field_factors is non-empty, then the field that is filtered is fields[II] * field_factors[II]
+ * (NULL entries in field_factors indicate a linear field), as for the quadratic terms in compute_Pi.
+ *
+ * Only the rows [Ilat_start, Ilat_end) are filtered (land points are set to zero).
+ *
+ * @param[in,out]   coarse_fields           where to store the filtered fields (NULL entries are skipped)
+ * @param[in]       fields                  fields to filter
+ * @param[in]       field_factors           optional second factor for each field (size 0 or same size as fields)
+ * @param[in]       source_data             dataset class instance containing data (Psi, Phi, etc)
+ * @param[in]       scale                   filtering scale
+ * @param[in]       Ilat_start              first latitude to filter
+ * @param[in]       Ilat_end                one past the last latitude to filter
+ * @param[in]       weight                  pointer to spatial weight (i.e. rho) (NULL indicates not provided)
+ *
+ */
+void apply_filter_tophat(
+        std::vector< std::vector<double>* > & coarse_fields,
+        const std::vector<const std::vector<filter_real>*> & fields,
+        const std::vector<const std::vector<filter_real>*> & field_factors,
+        const dataset & source_data,
+        const double scale,
+        const int Ilat_start,
+        const int Ilat_end,
+        const std::vector<filter_real> * weight
+        ) {
+
+    static_assert( not(constants::TOPHAT_PREFIX_SUM_FILTER) or (constants::KERNEL_OPT == constants::KernelType::TopHat),
+            "The prefix-sum filter requires the TopHat kernel." );
+
+    const int Nfields = fields.size();
+    assert( (int)coarse_fields.size() == Nfields );
+    assert( (field_factors.size() == 0) or ((int)field_factors.size() == Nfields) );
+
+    const std::vector<double> &dAreas = source_data.areas;
+    const std::vector<bool> &mask = source_data.mask;
+
+    const int   Ntime   = source_data.Ntime,
+                Ndepth  = source_data.Ndepth,
+                Nlat    = source_data.Nlat,
+                Nlon    = source_data.Nlon,
+                Nlevels = Ntime * Ndepth;
+
+    const bool can_roll_in_longitude = (constants::PERIODIC_X) and (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN);
+
+    // If the kernel can be rolled, keep the runs of each target latitude (relative to the kernel centre)
+    //   The runs for target Jlat are run_lat/lon_start/Ncells[ run_offset[Jlat - Ilat_start] .. run_offset[Jlat - Ilat_start + 1] )
+    std::vector<size_t> run_offset( 1, 0 );
+    std::vector<int> run_lat, run_lon_start, run_Ncells;
+    if (can_roll_in_longitude) {
+        kernel_stencil stencil;
+        for (int Ilat = Ilat_start; Ilat < Ilat_end; Ilat++) {
+            stencil.build( source_data, scale, Ilat, 0 );
+            append_stencil_runs( run_lat, run_lon_start, run_Ncells, stencil );
+            run_offset.push_back( run_lat.size() );
+        }
+    }
+
+    // Prefix sums: Nfields numerators and a denominator for each (row, lon)
+    //   prefix[ ( Ilat * (Nlon+1) + Ilon ) * Nsums + II ] is the sum over [0, Ilon) of row Ilat
+    const int Nsums = Nfields + 1;
+    std::vector<double> prefix( (size_t) Nlat * (Nlon + 1) * Nsums, 0. );
+
+    for (int Ilev = 0; Ilev < Nlevels; Ilev++) {
+        const int   Itime   = Ilev / Ndepth,
+                    Idepth  = Ilev % Ndepth;
+
+        #pragma omp parallel for default(none) schedule(static) \
+        shared( prefix, fields, field_factors, dAreas, mask, weight ) \
+        firstprivate( Nfields, Nsums, Ntime, Ndepth, Nlat, Nlon, Itime, Idepth )
+        for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+            const size_t row_offset = Index(Itime, Idepth, Ilat, 0, Ntime, Ndepth, Nlat, Nlon);
+            double * sums = &prefix[ (size_t) Ilat * (Nlon + 1) * Nsums ];
+            std::fill( sums, sums + Nsums, 0. );
+
+            for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+                const size_t index = row_offset + Ilon;
+                const double Aw = dAreas[ Ilat * Nlon + Ilon ] * ( (weight == NULL) ? 1. : (*weight)[index] );
+                double * next = sums + Nsums;
+
+                for (int Ifield = 0; Ifield < Nfields; Ifield++) {
+                    double val = 0.;
+                    if ( mask[index] ) {
+                        val = (*fields[Ifield])[index];
+                        if ( (field_factors.size() > 0) and (field_factors[Ifield] != NULL) ) { val *= (*field_factors[Ifield])[index]; }
+                    }
+                    next[Ifield] = sums[Ifield] + val * Aw;
+                }
+                next[Nfields] = sums[Nfields] + ( ( mask[index] or not(constants::DEFORM_AROUND_LAND) ) ? Aw : 0. );
+                sums = next;
+            }
+        }
+
+        #pragma omp parallel default(none) \
+        shared( coarse_fields, prefix, mask, source_data, run_offset, run_lat, run_lon_start, run_Ncells ) \
+        firstprivate( Nfields, Nsums, Ntime, Ndepth, Nlat, Nlon, Itime, Idepth, Ilat_start, Ilat_end, \
+                      scale, can_roll_in_longitude )
+        {
+            kernel_stencil stencil;
+            std::vector<double> sums( Nsums );
+            std::vector<int> local_lat, local_lon_start, local_Ncells;
+            size_t Irun_start, Irun_end;
+            const int *lats, *lon_starts, *Ncells;
+
+            #pragma omp for schedule(dynamic)
+            for (int Ilat = Ilat_start; Ilat < Ilat_end; Ilat++) {
+                for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+                    const size_t index = Index(Itime, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon);
+                    if ( not(mask[index]) ) {
+                        for (int Ifield = 0; Ifield < Nfields; Ifield++) {
+                            if (coarse_fields[Ifield] != NULL) { coarse_fields[Ifield]->at(index) = 0.; }
+                        }
+                        continue;
+                    }
+
+                    if (can_roll_in_longitude) {
+                        Irun_start  = run_offset[ Ilat - Ilat_start ];
+                        Irun_end    = run_offset[ Ilat - Ilat_start + 1 ];
+                        lats        = run_lat.data();
+                        lon_starts  = run_lon_start.data();
+                        Ncells      = run_Ncells.data();
+                    } else {
+                        stencil.build( source_data, scale, Ilat, Ilon );
+                        local_lat.clear();
+                        local_lon_start.clear();
+                        local_Ncells.clear();
+                        append_stencil_runs( local_lat, local_lon_start, local_Ncells, stencil );
+                        Irun_start  = 0;
+                        Irun_end    = local_lat.size();
+                        lats        = local_lat.data();
+                        lon_starts  = local_lon_start.data();
+                        Ncells      = local_Ncells.data();
+                    }
+
+                    std::fill( sums.begin(), sums.end(), 0. );
+                    for (size_t Irun = Irun_start; Irun < Irun_end; Irun++) {
+                        int lon_start = lon_starts[Irun] + Ilon;
+                        if (constants::PERIODIC_X) { lon_start = ( lon_start % Nlon + Nlon ) % Nlon; }
+                        const int lon_end = lon_start + Ncells[Irun];
+
+                        const double * row = &prefix[ (size_t) lats[Irun] * (Nlon + 1) * Nsums ];
+                        if (lon_end <= Nlon) {
+                            for (int II = 0; II < Nsums; II++) {
+                                sums[II] += row[ lon_end * Nsums + II ] - row[ lon_start * Nsums + II ];
+                            }
+                        } else {
+                            // The run wraps around the periodic boundary
+                            for (int II = 0; II < Nsums; II++) {
+                                sums[II] +=   row[ Nlon * Nsums + II ] - row[ lon_start * Nsums + II ]
+                                            + row[ (lon_end - Nlon) * Nsums + II ];
+                            }
+                        }
+                    }
+
+                    for (int Ifield = 0; Ifield < Nfields; Ifield++) {
+                        if (coarse_fields[Ifield] == NULL) { continue; }
+                        coarse_fields[Ifield]->at(index) = (sums[Nfields] == 0) ? 0. : sums[Ifield] / sums[Nfields];
+                    }
+                }
+            }
+        }
+    }
+}
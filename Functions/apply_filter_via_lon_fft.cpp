@@ -0,0 +1,278 @@
+#include <math.h>
+#include <algorithm>
+#include <complex>
+#include <vector>
+#include <cassert>
+#include <omp.h>
+#include "../functions.hpp"
+#include "../constants.hpp"
+
+/*!
+ * \brief Filter whole latitude rows at once using FFTs in longitude
+ *
+ * When the longitude grid is uniform, periodic, and spans the full domain, the kernel
+ * for every point on a latitude row is a shift of the kernel at Ilon = 0. The contribution
+ * of each source latitude to the target row is then a circular correlation in longitude,
+ * which is computed here as a product of the (pre-computed) kernel-row spectra with the
+ * spectra of the area-weighted (and masked) source rows. The products are summed over the
+ * source latitudes before a single inverse transform per target row.
+ *
+ * The denominators (kA_sum etc in apply_filter_at_point) are obtained in the same way by
+ * filtering area (and mask, if DEFORM_AROUND_LAND) with the same kernel rows, so the results
+ * match apply_filter_at_point up to round-off.
+ *
+ * Spectra of all of the fields are computed once for all local times / depths, so this
+ * needs roughly one extra full-sized array per filtered field. Two real fields are packed
+ * into each complex transform.
+ *
+ * If field_factors is non-empty, then the field that is filtered is fields[II] * field_factors[II]
+ * (NULL entries in field_factors indicate a linear field). This allows quadratic terms to be
+ * filtered without storing the products.
+ *
+ * Only the target latitudes [Ilat_start, Ilat_end) are filtered (e.g. this processor's latitude
+ * band), and only the source rows that their kernels reach are transformed. Other rows of the
+ * outputs are left untouched.
+ *
+ * @param[in,out]   coarse_fields           where to store the filtered fields (NULL entries are skipped)
+ * @param[in,out]   dl_coarse_fields        where to store fields filtered with the ell-derivative kernel (size 0 to skip)
+ * @param[in,out]   dll_coarse_fields       where to store fields filtered with the 2nd ell-derivative kernel (size 0 to skip)
+ * @param[in,out]   dl_kernel_vals          where to store kpA_sum / kA_sum (NULL to skip)
+ * @param[in,out]   dll_kernel_vals         where to store kppA_sum / kA_sum (NULL to skip)
+ * @param[in]       fields                  fields to filter
+ * @param[in]       field_factors           optional second factor for each field (size 0 or same size as fields)
+ * @param[in]       source_data             dataset class instance containing data (Psi, Phi, etc)
+ * @param[in]       scale                   filtering scale
+ * @param[in]       Ilat_start,Ilat_end     range of target latitudes to filter
+ * @param[in]       weight                  pointer to spatial weight (i.e. rho) (NULL indicates not provided)
+ *
+ */
+void apply_filter_via_lon_fft(
+        std::vector< std::vector<double>* > & coarse_fields,
+        std::vector< std::vector<double>* > & dl_coarse_fields,
+        std::vector< std::vector<double>* > & dll_coarse_fields,
+        std::vector<double> * dl_kernel_vals,
+        std::vector<double> * dll_kernel_vals,
+        const std::vector<const std::vector<filter_real>*> & fields,
+        const std::vector<const std::vector<filter_real>*> & field_factors,
+        const dataset & source_data,
+        const double scale,
+        const int Ilat_start,
+        const int Ilat_end,
+        const std::vector<filter_real> * weight
+        ) {
+
+    static_assert( (constants::PERIODIC_X) and (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN),
+            "Filtering via FFTs in longitude requires a uniform, periodic, full-span longitude grid." );
+
+    const int Nfields = fields.size();
+    assert( (int)coarse_fields.size() == Nfields );
+    assert( (field_factors.size() == 0) or ((int)field_factors.size() == Nfields) );
+
+    const bool do_dl  = ( dl_coarse_fields.size()  > 0 ) or ( dl_kernel_vals  != NULL ),
+               do_dll = ( dll_coarse_fields.size() > 0 ) or ( dll_kernel_vals != NULL );
+
+    // The ell-derivative sums in apply_filter_at_point are not weighted
+    assert( (weight == NULL) or not(do_dl or do_dll) );
+
+    const std::vector<double>   &latitude   = source_data.latitude,
+                                &dAreas     = source_data.areas;
+
+    const std::vector<bool> &mask = source_data.mask;
+
+    const int   Ntime   = source_data.Ntime,
+                Ndepth  = source_data.Ndepth,
+                Nlat    = source_data.Nlat,
+                Nlon    = source_data.Nlon,
+                Nlevels = Ntime * Ndepth;
+
+    // Channels are the fields, followed by the denominator (area * weight * mask')
+    //   where mask' is the mask if deforming around land, and one otherwise.
+    const int Nchannels = Nfields + 1,
+              Npairs    = ( Nchannels + 1 ) / 2,
+              Iden      = Nfields;
+
+    // Twiddle factors for the longitude transforms
+    std::vector< std::complex<double> > twiddles(Nlon);
+    for (int II = 0; II < Nlon; II++) { twiddles[II] = std::polar( 1., -2. * M_PI * II / Nlon ); }
+
+    // Source rows that the kernels of the target rows reach
+    std::vector<bool> need_row( Nlat, false );
+    int row_lb, row_ub;
+    for (int Ilat = Ilat_start; Ilat < Ilat_end; Ilat++) {
+        get_lat_bounds(row_lb, row_ub, latitude, Ilat, scale);
+        for (int LAT = row_lb; LAT < row_ub; LAT++) {
+            need_row[ constants::PERIODIC_Y ? ( LAT % Nlat + Nlat ) % Nlat : LAT ] = true;
+        }
+    }
+
+    //
+    //// Spectra of each (packed) pair of channels on every needed row, for every time / depth
+    //
+    std::vector< std::complex<double> > spectra( (size_t) Nlevels * Npairs * Nlat * Nlon );
+    #define SPEC_INDEX(LEV, PAIR, LAT) ( ( ( (size_t)(LEV) * Npairs + (PAIR) ) * Nlat + (LAT) ) * Nlon )
+
+    #pragma omp parallel default(none) \
+    shared( spectra, twiddles, fields, field_factors, weight, mask, dAreas, need_row ) \
+    firstprivate( Nlevels, Nlat, Nlon, Ntime, Ndepth, Nfields, Npairs, Iden )
+    {
+        std::vector< std::complex<double> > row(Nlon), work;
+        int Itime, Idepth, Ilat, Ilon, Ichan, Ipair;
+        size_t index, area_index;
+        double vals[2], area, loc_val;
+        bool is_water;
+
+        #pragma omp for collapse(2) schedule(static)
+        for (int Ilev = 0; Ilev < Nlevels; Ilev++) {
+            for (Ilat = 0; Ilat < Nlat; Ilat++) {
+                if (not(need_row[Ilat])) { continue; }
+                Itime  = Ilev / Ndepth;
+                Idepth = Ilev % Ndepth;
+                for (Ipair = 0; Ipair < Npairs; Ipair++) {
+                    for (Ilon = 0; Ilon < Nlon; Ilon++) {
+                        index      = Index(Itime, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon);
+                        area_index = Index(0,     0,      Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon);
+                        #if DEBUG >= 1
+                        is_water = mask.at(index);
+                        area     = dAreas.at(area_index);
+                        #else
+                        is_water = mask[index];
+                        area     = dAreas[area_index];
+                        #endif
+                        if (weight != NULL) { area *= weight->at(index); }
+
+                        for (int II = 0; II < 2; II++) {
+                            Ichan = 2 * Ipair + II;
+                            vals[II] = 0.;
+                            if (Ichan < Nfields) {
+                                if (is_water) {
+                                    loc_val = fields[Ichan]->at(index);
+                                    if ( (field_factors.size() > 0) and (field_factors[Ichan] != NULL) ) {
+                                        loc_val *= field_factors[Ichan]->at(index);
+                                    }
+                                    vals[II] = loc_val * area;
+                                }
+                            } else if (Ichan == Iden) {
+                                vals[II] = ( not(constants::DEFORM_AROUND_LAND) or is_water ) ? area : 0.;
+                            }
+                        }
+                        row[Ilon] = std::complex<double>( vals[0], vals[1] );
+                    }
+                    fft_in_longitude( row, work, twiddles, false );
+                    std::copy( row.begin(), row.end(), spectra.begin() + SPEC_INDEX(Ilev, Ipair, Ilat) );
+                }
+            }
+        }
+    }
+
+    //
+    //// Now build the output one target latitude at a time
+    //
+    const int Nkernels = 1 + (do_dl ? 1 : 0) + (do_dll ? 1 : 0);
+
+    std::vector<double> local_kernel( Nlat * Nlon, 0. ),
+                        local_dl_kernel(  do_dl  ? Nlat * Nlon : 0, 0. ),
+                        local_dll_kernel( do_dll ? Nlat * Nlon : 0, 0. );
+
+    #pragma omp parallel default(none) \
+    shared( spectra, twiddles, latitude, source_data, coarse_fields, dl_coarse_fields, dll_coarse_fields, \
+            dl_kernel_vals, dll_kernel_vals ) \
+    firstprivate( local_kernel, local_dl_kernel, local_dll_kernel, Nlevels, Nlat, Nlon, Ntime, Ndepth, \
+                  Nfields, Nchannels, Npairs, Iden, Nkernels, do_dl, do_dll, scale, Ilat_start, Ilat_end )
+    {
+        int LAT_lb, LAT_ub, curr_lat, Itime, Idepth, Irow, Nrows, Ichan, Ikern;
+        size_t index;
+        double numer, denom;
+
+        std::vector< std::complex<double> > acc(Nlon), work;
+        std::vector< std::vector< std::complex<double> > > kernel_spectra;
+        std::vector<int> row_lats;
+
+        // filtered[ Ikern ][ Ichan ] is one output row
+        std::vector< std::vector< std::vector<double> > > filtered(
+                Nkernels, std::vector< std::vector<double> >( Nchannels, std::vector<double>(Nlon, 0.) ) );
+
+        #pragma omp for schedule(dynamic)
+        for (int Ilat = Ilat_start; Ilat < Ilat_end; Ilat++) {
+
+            get_lat_bounds(LAT_lb, LAT_ub, latitude, Ilat, scale);
+            Nrows = LAT_ub - LAT_lb;
+
+            // Kernel at the reference longitude (Ilon = 0), stored as offsets from the centre
+            for (int LAT = LAT_lb; LAT < LAT_ub; LAT++) {
+                curr_lat = constants::PERIODIC_Y ? ( LAT % Nlat + Nlat ) % Nlat : LAT;
+                std::fill( local_kernel.begin() + curr_lat * Nlon, local_kernel.begin() + (curr_lat + 1) * Nlon, 0. );
+                if (do_dl)  { std::fill( local_dl_kernel.begin()  + curr_lat * Nlon, local_dl_kernel.begin()  + (curr_lat + 1) * Nlon, 0. ); }
+                if (do_dll) { std::fill( local_dll_kernel.begin() + curr_lat * Nlon, local_dll_kernel.begin() + (curr_lat + 1) * Nlon, 0. ); }
+            }
+            compute_local_kernel( local_kernel, local_dl_kernel, local_dll_kernel,
+                    scale, source_data, Ilat, 0, LAT_lb, LAT_ub );
+
+            // Transform each kernel row (one per source latitude and kernel type)
+            kernel_spectra.resize( Nkernels * Nrows );
+            row_lats.resize( Nrows );
+            for (Irow = 0; Irow < Nrows; Irow++) {
+                curr_lat = constants::PERIODIC_Y ? ( (LAT_lb + Irow) % Nlat + Nlat ) % Nlat : LAT_lb + Irow;
+                row_lats[Irow] = curr_lat;
+                for (Ikern = 0; Ikern < Nkernels; Ikern++) {
+                    const std::vector<double> & kern = ( Ikern == 0 ) ? local_kernel :
+                                                       ( (Ikern == 1) and do_dl ) ? local_dl_kernel : local_dll_kernel;
+                    std::vector< std::complex<double> > & spec = kernel_spectra[ Ikern * Nrows + Irow ];
+                    spec.resize(Nlon);
+                    for (int Ilon = 0; Ilon < Nlon; Ilon++) { spec[Ilon] = kern[ curr_lat * Nlon + Ilon ]; }
+                    fft_in_longitude( spec, work, twiddles, false );
+                    // Correlation (not convolution), so conjugate the kernel spectrum
+                    for (int Ilon = 0; Ilon < Nlon; Ilon++) { spec[Ilon] = std::conj( spec[Ilon] ); }
+                }
+            }
+
+            for (int Ilev = 0; Ilev < Nlevels; Ilev++) {
+                Itime  = Ilev / Ndepth;
+                Idepth = Ilev % Ndepth;
+
+                // Sum the spectral products over source latitudes, then invert once per output row
+                for (Ikern = 0; Ikern < Nkernels; Ikern++) {
+                    for (int Ipair = 0; Ipair < Npairs; Ipair++) {
+                        std::fill( acc.begin(), acc.end(), std::complex<double>(0.,0.) );
+                        for (Irow = 0; Irow < Nrows; Irow++) {
+                            const std::complex<double> * spec_field  = &spectra[ SPEC_INDEX(Ilev, Ipair, row_lats[Irow]) ];
+                            const std::complex<double> * spec_kernel = &kernel_spectra[ Ikern * Nrows + Irow ][0];
+                            for (int Ilon = 0; Ilon < Nlon; Ilon++) { acc[Ilon] += spec_kernel[Ilon] * spec_field[Ilon]; }
+                        }
+                        fft_in_longitude( acc, work, twiddles, true );
+                        for (int II = 0; II < 2; II++) {
+                            Ichan = 2 * Ipair + II;
+                            if (Ichan >= Nchannels) { continue; }
+                            for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+                                filtered[Ikern][Ichan][Ilon] = (II == 0) ? acc[Ilon].real() : acc[Ilon].imag();
+                            }
+                        }
+                    }
+                }
+
+                // Normalize and store
+                for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+                    index = Index(Itime, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon);
+                    for (Ikern = 0; Ikern < Nkernels; Ikern++) {
+                        denom = filtered[Ikern][Iden][Ilon];
+                        for (Ichan = 0; Ichan < Nfields; Ichan++) {
+                            numer = filtered[Ikern][Ichan][Ilon];
+                            std::vector<double> * target = ( Ikern == 0 ) ? coarse_fields[Ichan] :
+                                                           ( (Ikern == 1) and do_dl ) ?
+                                                               ( dl_coarse_fields.size()  > 0 ? dl_coarse_fields[Ichan]  : NULL ) :
+                                                               ( dll_coarse_fields.size() > 0 ? dll_coarse_fields[Ichan] : NULL );
+                            if (target != NULL) { target->at(index) = (denom == 0) ? 0. : numer / denom; }
+                        }
+                    }
+                    denom = filtered[0][Iden][Ilon];
+                    if (do_dl and (dl_kernel_vals != NULL)) {
+                        dl_kernel_vals->at(index) = (denom == 0) ? 0. : filtered[1][Iden][Ilon] / denom;
+                    }
+                    if (do_dll and (dll_kernel_vals != NULL)) {
+                        dll_kernel_vals->at(index) = (denom == 0) ? 0. : filtered[Nkernels-1][Iden][Ilon] / denom;
+                    }
+                }
+            }
+        }
+    }
+    #undef SPEC_INDEX
+}
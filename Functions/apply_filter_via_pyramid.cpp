@@ -0,0 +1,125 @@
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include <cassert>
+#include <omp.h>
+#include "../functions.hpp"
+#include "../constants.hpp"
+
+/*!
+ * \brief Filter fields on a coarsened grid of the resolution pyramid, and interpolate back onto the source grid
+ *
+ * The fields (times field_factors, if given) are block-averaged onto grid Igrid of the pyramid
+ * (see resolution_pyramid::coarsen), filtered at every coarse water cell, and then interpolated
+ * back onto the water points of the source rows [Ilat_start, Ilat_end). Only the coarse rows that
+ * are needed for that interpolation are filtered.
+ *
+ * Since the coarse grid spacing is a fixed fraction of the scale, the number of cells in each
+ * kernel does not grow with the scale. The price is the variation of the kernel within each
+ * block (which is small when the spacing is a small fraction of the scale), and the interpolation
+ * error (see pyramid_filter_error for measuring both).
+ *
+ * @param[in,out]   coarse_fields           where to store the filtered fields on the source grid (NULL entries are skipped)
+ * @param[in]       fields                  fields to filter
+ * @param[in]       field_factors           optional second factor for each field (size 0 or same size as fields)
+ * @param[in]       source_data             dataset class instance containing data (Psi, Phi, etc)
+ * @param[in]       pyramid                 pre-built resolution pyramid
+ * @param[in]       Igrid                   which grid of the pyramid to filter on (must be positive)
+ * @param[in]       scale                   filtering scale
+ * @param[in]       Ilat_start              first source latitude that needs the filtered fields
+ * @param[in]       Ilat_end                one past the last source latitude that needs the filtered fields
+ * @param[in]       weight                  pointer to spatial weight (i.e. rho) (NULL indicates not provided)
+ *
+ */
+void apply_filter_via_pyramid(
+        std::vector< std::vector<double>* > & coarse_fields,
+        const std::vector<const std::vector<filter_real>*> & fields,
+        const std::vector<const std::vector<filter_real>*> & field_factors,
+        const dataset & source_data,
+        const resolution_pyramid & pyramid,
+        const int Igrid,
+        const double scale,
+        const int Ilat_start,
+        const int Ilat_end,
+        const std::vector<filter_real> * weight
+        ) {
+
+    assert( (Igrid > 0) and (Igrid < pyramid.Ngrids) );
+
+    const int Nfields = fields.size();
+    assert( (int)coarse_fields.size() == Nfields );
+    assert( (field_factors.size() == 0) or ((int)field_factors.size() == Nfields) );
+
+    const dataset & grid = pyramid.grids.at(Igrid);
+    const std::vector<bool> &coarse_mask = grid.mask;
+
+    const int   block   = pyramid.block_sizes.at(Igrid),
+                Ntime   = grid.Ntime,
+                Ndepth  = grid.Ndepth,
+                Nlat_c  = grid.Nlat,
+                Nlon_c  = grid.Nlon,
+                Nlevels = Ntime * Ndepth;
+
+    // Block-average the inputs. The coarse weight is used even if weight is NULL,
+    //   since it carries the water fraction of each block when deforming around land.
+    std::vector<filter_real> coarse_weight;
+    pyramid.coarsen_weight( coarse_weight, weight, source_data, Igrid );
+
+    std::vector< std::vector<filter_real> > coarse_inputs( Nfields );
+    std::vector< std::vector<double> > coarse_outputs( Nfields, std::vector<double>( (size_t) Nlevels * Nlat_c * Nlon_c, 0. ) );
+    std::vector<const std::vector<filter_real>*> coarse_input_ptrs, null_factors;
+    for (int Ifield = 0; Ifield < Nfields; Ifield++) {
+        pyramid.coarsen( coarse_inputs[Ifield], *fields[Ifield],
+                         ( field_factors.size() > 0 ) ? field_factors[Ifield] : NULL,
+                         weight, source_data, Igrid );
+        coarse_input_ptrs.push_back( &coarse_inputs[Ifield] );
+    }
+
+    // Coarse rows that bracket the requested source rows (every row if periodic in latitude)
+    const int   Jlat_start  = constants::PERIODIC_Y ? 0      : std::max( 0,      Ilat_start / block - 1 ),
+                Jlat_end    = constants::PERIODIC_Y ? Nlat_c : std::min( Nlat_c, (Ilat_end - 1) / block + 2 );
+
+    const bool can_roll_in_longitude = (constants::PERIODIC_X) and (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN);
+
+    #pragma omp parallel default(none) \
+    shared( grid, coarse_mask, coarse_input_ptrs, null_factors, coarse_weight, coarse_outputs ) \
+    firstprivate( Nfields, Ntime, Ndepth, Nlat_c, Nlon_c, Nlevels, Jlat_start, Jlat_end, scale, can_roll_in_longitude )
+    {
+        kernel_stencil stencil;
+        std::vector<double> level_vals, null_vector;
+        bool any_water;
+        size_t index;
+
+        #pragma omp for collapse(1) schedule(dynamic)
+        for (int Jlat = Jlat_start; Jlat < Jlat_end; Jlat++) {
+
+            if (can_roll_in_longitude) { stencil.build( grid, scale, Jlat, 0 ); }
+
+            for (int Jlon = 0; Jlon < Nlon_c; Jlon++) {
+
+                any_water = false;
+                for (int Ilev = 0; Ilev < Nlevels; Ilev++) {
+                    if ( coarse_mask[ Index(Ilev / Ndepth, Ilev % Ndepth, Jlat, Jlon, Ntime, Ndepth, Nlat_c, Nlon_c) ] ) { any_water = true; }
+                }
+                if (not(any_water)) { continue; }
+
+                if (not(can_roll_in_longitude)) { stencil.build( grid, scale, Jlat, Jlon ); }
+
+                apply_filter_at_point_all_levels( level_vals, null_vector, null_vector, null_vector, null_vector,
+                        coarse_input_ptrs, null_factors, grid, Jlat, Jlon, stencil, &coarse_weight, true );
+
+                for (int Ilev = 0; Ilev < Nlevels; Ilev++) {
+                    index = Index(Ilev / Ndepth, Ilev % Ndepth, Jlat, Jlon, Ntime, Ndepth, Nlat_c, Nlon_c);
+                    for (int Ifield = 0; Ifield < Nfields; Ifield++) {
+                        coarse_outputs[Ifield][index] = level_vals[ Ilev * Nfields + Ifield ];
+                    }
+                }
+            }
+        }
+    }
+
+    for (int Ifield = 0; Ifield < Nfields; Ifield++) {
+        if (coarse_fields[Ifield] == NULL) { continue; }
+        pyramid.interpolate_to_source( *coarse_fields[Ifield], coarse_outputs[Ifield], source_data, Igrid, Ilat_start, Ilat_end );
+    }
+}
@@ -39,7 +39,7 @@ void compute_local_kernel(
                 Nlat    = source_data.Nlat,
                 Nlon    = source_data.Nlon;
 
-    double dist, kern, dlat_m, dlon_m;
+    double dist, kern, dl_kern = 0., dll_kern = 0., dlat_m, dlon_m;
     size_t index;
     int curr_lon, curr_lat, LON_lb, LON_ub;
 
@@ -50,6 +50,14 @@ void compute_local_kernel(
     const bool do_dl  = (local_dl_kernel.size() > 0),
                do_dll = (local_dll_kernel.size() > 0);
 
+    // Use the cached grid geometry for distances, if it's available
+    const bool use_geometry = source_data.geometry.is_built() 
+                              and (source_data.geometry.Nlat == Nlat) and (source_data.geometry.Nlon == Nlon);
+    std::vector<double> row_dists;
+
+    // Periodic length in y, so that get_lon_bounds can wrap the latitude separation
+    const double Llat = ( constants::CARTESIAN and constants::PERIODIC_Y ) ? (latitude.at(1) - latitude.at(0)) * Nlat : 0.;
+
     for (int LAT = LAT_lb; LAT < LAT_ub; LAT++) {
 
         // Handle periodicity
@@ -58,7 +66,13 @@ void compute_local_kernel(
         lat_at_curr = latitude.at(curr_lat);
 
         // Get lon bounds at the latitude
-        get_lon_bounds(LON_lb, LON_ub, longitude, Ilon, lat_at_ilat, lat_at_curr, scale);
+        get_lon_bounds(LON_lb, LON_ub, longitude, Ilon, lat_at_ilat, lat_at_curr, scale, Llat);
+
+        // Distances to the whole row at once
+        if (use_geometry) {
+            row_dists.resize(LON_ub - LON_lb);
+            source_data.geometry.distances_row( row_dists.data(), Ilat, Ilon, curr_lat, LON_lb, LON_ub - LON_lb );
+        }
 
         for (int LON = LON_lb; LON < LON_ub; LON++) {
 
@@ -68,7 +82,9 @@ void compute_local_kernel(
 
             index = Index(0, 0, curr_lat, curr_lon, Ntime, Ndepth, Nlat, Nlon);
 
-            if (constants::CARTESIAN) {
+            if (use_geometry) {
+                dist = row_dists[LON - LON_lb];
+            } else if (constants::CARTESIAN) {
                 dlat_m = latitude.at( 1) - latitude.at( 0);
                 dlon_m = longitude.at(1) - longitude.at(0);
                 dist = distance(lon_at_ilon,     lat_at_ilat,
@@ -78,12 +94,11 @@ void compute_local_kernel(
                 dist = distance(lon_at_ilon,            lat_at_ilat,
                                 longitude.at(curr_lon), lat_at_curr);
             }
-            kern = kernel(dist, scale);
+            // Also get the first and second ell-derivatives of the kernel (from the same table lookup)
+            kernel_tabulated( kern, dl_kern, dll_kern, dist, scale, do_dll ? 2 : do_dl ? 1 : 0 );
             local_kernel.at(index) = kern;
-
-            // Also get the first and second ell-derivatives of the kernel
-            if (do_dl) { local_dl_kernel.at(index)  = kernel(dist, scale, 1); }
-            if (do_dll) { local_dll_kernel.at(index) = kernel(dist, scale, 2); }
+            if (do_dl) { local_dl_kernel.at(index)  = dl_kern; }
+            if (do_dll) { local_dll_kernel.at(index) = dll_kern; }
 
         }
     }
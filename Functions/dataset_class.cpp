@@ -65,6 +65,9 @@ void dataset::compute_cell_areas() {
 
     areas.resize( Nlat * Nlon );
     compute_areas( areas, longitude, latitude );
+
+    // Also cache the grid geometry, which is used to compute distances when building kernels
+    geometry.build( longitude, latitude );
 }
 
 void dataset::load_variable( 
@@ -89,7 +92,9 @@ void dataset::load_variable(
                         load_counts ? &myStarts : NULL, 
                         Nprocs_in_time, Nprocs_in_depth,
                         do_splits, force_split_dim, land_fill_value, 
-                        (Nprocs_in_quadrature == 1) ? MPI_COMM_WORLD : MPI_subcomm_samequadrature );
+                        (Nprocs_in_quadrature == 1) ? MPI_Comm_Global : MPI_subcomm_samequadrature,
+                        &time_split_starts, &depth_split_starts,
+                        Itime_window, Ntime_windows );
 };
 
 void dataset::check_processor_divisions(    const int Nprocs_in_time_input, 
@@ -173,6 +178,165 @@ void dataset::check_processor_divisions(    const int Nprocs_in_time_input,
 }
 
 
+/*!
+ * \brief Choose time / depth divisions so that the filtering work is balanced across processors
+ *
+ * The variable is read once with the (even) default divisions, just to get the mask. Since the 
+ * filtering cost at each water point is the stencil walk (denominator) plus the water part of the 
+ * stencil (numerators), the work for each (time, depth) is estimated as W * (1 + W / (Nlat * Nlon)),
+ * where W is the number of water points. The time and depth ranges are then chosen (independently,
+ * since the processors form a time x depth grid) to balance the summed work, and stored in 
+ * time_split_starts and depth_split_starts, which are used by all subsequent load_variable calls.
+ *
+ * Must be called after check_processor_divisions and before any variables are loaded.
+ *
+ * @param[in]   var_name_in_file    name of a variable whose fill values define the mask
+ * @param[in]   filename            name of the file containing the variable
+ *
+ */
+void dataset::balance_processor_divisions(  const std::string var_name_in_file,
+                                            const std::string filename ) {
+
+    assert( (full_Ntime > 0) and (full_Ndepth > 0) and (Nlon > 0) and (Nlat > 0) ); // Must read in dimensions before balancing processor divisions.
+
+    int wRank=-1;
+    MPI_Comm_rank( MPI_COMM_WORLD, &wRank );
+
+    const MPI_Comm comm = (Nprocs_in_quadrature == 1) ? MPI_COMM_WORLD : MPI_subcomm_samequadrature;
+
+    // Read with the default divisions to get the mask
+    time_split_starts.clear();
+    depth_split_starts.clear();
+
+    std::vector<double> var;
+    std::vector<bool> var_mask;
+    std::vector<int> counts, starts;
+    read_var_from_file( var, var_name_in_file, filename, &var_mask, &counts, &starts,
+                        Nprocs_in_time, Nprocs_in_depth, true, -1, 0., comm );
+    var.clear();
+
+    // Nothing to balance unless the variable is split in time / depth
+    if ( (counts.size() != 4) or (Nprocs_in_time * Nprocs_in_depth == 1) ) { return; }
+
+    // Count the water points for each (time, depth), then share across the processors
+    const size_t Nhoriz = (size_t) Nlat * Nlon;
+    std::vector<double> water_counts( full_Ntime * full_Ndepth, 0. );
+    for (int Itime = 0; Itime < counts[0]; Itime++) {
+        for (int Idepth = 0; Idepth < counts[1]; Idepth++) {
+            const size_t offset = ( (size_t) Itime * counts[1] + Idepth ) * Nhoriz;
+            water_counts.at( ( starts[0] + Itime ) * full_Ndepth + starts[1] + Idepth ) = 
+                std::count( var_mask.begin() + offset, var_mask.begin() + offset + Nhoriz, true );
+        }
+    }
+    MPI_Allreduce( MPI_IN_PLACE, &water_counts[0], full_Ntime * full_Ndepth, MPI_DOUBLE, MPI_SUM, comm );
+
+    // Estimated work for each (time, depth), and summed over each dimension
+    std::vector<double> level_costs( full_Ntime * full_Ndepth ),
+                        time_costs( full_Ntime, 0. ), depth_costs( full_Ndepth, 0. );
+    for (int Itime = 0; Itime < full_Ntime; Itime++) {
+        for (int Idepth = 0; Idepth < full_Ndepth; Idepth++) {
+            const int    Ilev = Itime * full_Ndepth + Idepth;
+            const double W    = water_counts[Ilev];
+            level_costs[Ilev]    = W * ( 1. + W / Nhoriz );
+            time_costs[Itime]   += level_costs[Ilev];
+            depth_costs[Idepth] += level_costs[Ilev];
+        }
+    }
+
+    partition_by_cost( time_split_starts,  time_costs,  Nprocs_in_time  );
+    partition_by_cost( depth_split_starts, depth_costs, Nprocs_in_depth );
+
+    #if DEBUG >= 0
+    // Predicted imbalance (max / mean over the time x depth processor grid) for a set of divisions
+    auto predicted_imbalance = [&]( const std::vector<int> & t_starts, const std::vector<int> & d_starts ) {
+        double max_work = 0., sum_work = 0.;
+        for (int Ip_time = 0; Ip_time < Nprocs_in_time; Ip_time++) {
+            for (int Ip_depth = 0; Ip_depth < Nprocs_in_depth; Ip_depth++) {
+                double work = 0.;
+                for (int Itime = t_starts[Ip_time]; Itime < t_starts[Ip_time+1]; Itime++) {
+                    for (int Idepth = d_starts[Ip_depth]; Idepth < d_starts[Ip_depth+1]; Idepth++) {
+                        work += level_costs[ Itime * full_Ndepth + Idepth ];
+                    }
+                }
+                max_work  = std::max( max_work, work );
+                sum_work += work;
+            }
+        }
+        return (sum_work > 0) ? max_work * Nprocs_in_time * Nprocs_in_depth / sum_work : 1.;
+    };
+
+    // The default (even) divisions, as in read_var_from_file
+    auto even_splits = []( const int N, const int Nprocs ) {
+        std::vector<int> split_starts( Nprocs + 1 );
+        for (int Iproc = 0; Iproc <= Nprocs; Iproc++) {
+            split_starts[Iproc] = Iproc * ( N / Nprocs ) + std::min( Iproc, N % Nprocs );
+        }
+        return split_starts;
+    };
+
+    if (wRank == 0) {
+        fprintf( stdout, " Predicted filtering load imbalance (max / mean): %.3g with even divisions, %.3g with balanced divisions\n",
+                predicted_imbalance( even_splits( full_Ntime, Nprocs_in_time ), even_splits( full_Ndepth, Nprocs_in_depth ) ),
+                predicted_imbalance( time_split_starts, depth_split_starts ) );
+        #if DEBUG >= 1
+        fprintf( stdout, "   time divisions start at:  " );
+        for (int Iproc = 0; Iproc < Nprocs_in_time;  Iproc++) { fprintf( stdout, "%d ", time_split_starts[Iproc] ); }
+        fprintf( stdout, "\n   depth divisions start at: " );
+        for (int Iproc = 0; Iproc < Nprocs_in_depth; Iproc++) { fprintf( stdout, "%d ", depth_split_starts[Iproc] ); }
+        fprintf( stdout, "\n" );
+        #endif
+        fprintf( stdout, "\n" );
+    }
+    #endif
+}
+
+/*!
+ * \brief Divide the times on each processor into windows, so that the variables can be loaded (and filtered) one window at a time
+ *
+ * Every processor uses the same number of windows (since loading is collective), chosen so that the 
+ * processor with the most times has at most max_window_size times per window. The number of windows
+ * is capped by the fewest times on any processor, so that no window is empty (in which case some
+ * windows will be larger than requested).
+ *
+ * Must be called after the processor divisions are set (see check_processor_divisions and 
+ * balance_processor_divisions). Afterwards, set Itime_window before loading the variables.
+ *
+ * @param[in]   max_window_size     largest number of times to hold at once (0 or less means all of them)
+ *
+ */
+void dataset::set_time_windows( const int max_window_size ) {
+
+    assert( (full_Ntime > 0) and (Nprocs_in_time > 0) ); // Must set the processor divisions before the time windows.
+
+    Itime_window  = 0;
+    Ntime_windows = 1;
+    if ( (max_window_size <= 0) or (full_Ntime == 1) ) { return; }
+
+    // Number of times on each processor (in time)
+    int min_local_Ntime = full_Ntime, max_local_Ntime = 0, local_Ntime;
+    for (int Iproc = 0; Iproc < Nprocs_in_time; Iproc++) {
+        if ( (int)time_split_starts.size() == Nprocs_in_time + 1 ) {
+            local_Ntime = time_split_starts[Iproc + 1] - time_split_starts[Iproc];
+        } else {
+            local_Ntime = full_Ntime / Nprocs_in_time + ( ( Iproc < full_Ntime % Nprocs_in_time ) ? 1 : 0 );
+        }
+        min_local_Ntime = std::min( min_local_Ntime, local_Ntime );
+        max_local_Ntime = std::max( max_local_Ntime, local_Ntime );
+    }
+
+    Ntime_windows = ( max_local_Ntime + max_window_size - 1 ) / max_window_size;
+    Ntime_windows = std::max( 1, std::min( Ntime_windows, min_local_Ntime ) );
+
+    #if DEBUG >= 0
+    int wRank=-1;
+    MPI_Comm_rank( MPI_COMM_WORLD, &wRank );
+    if (wRank == 0) { 
+        fprintf(stdout, " Streaming through time in %'d windows (of up to %'d times each)\n\n", 
+                Ntime_windows, ( max_local_Ntime + Ntime_windows - 1 ) / Ntime_windows);
+    }
+    #endif
+}
+
 void dataset::compute_region_areas() {
 
     #if DEBUG >= 2
@@ -258,6 +422,95 @@ void dataset::prepare_for_coarsened_grids(
     compute_areas( coarse_map_areas, coarse_map_lat, coarse_map_lon );
 }
 
+/*!
+ * \brief Set this dataset to be a subsampled (every lat_stride / lon_stride points) copy of the source grid
+ *
+ * The dimensions, processor divisions, communicators, mask, and regions are copied / subsampled
+ * (and the cell and region areas recomputed), so that the result can be used for derivatives,
+ * output, and post-processing on the reduced grid. The variables are not copied.
+ *
+ * Point (Jlat, Jlon) of the subsampled grid is point (Jlat * lat_stride, Jlon * lon_stride) of the source grid.
+ *
+ * @param[in]   source_data             dataset to subsample
+ * @param[in]   lat_stride,lon_stride   subsampling strides (in grid points)
+ *
+ */
+void dataset::subsample_from(
+        const dataset & source_data,
+        const int lat_stride,
+        const int lon_stride
+        ) {
+
+    assert( (lat_stride >= 1) and (lon_stride >= 1) );
+
+    const int   Nlat_src = source_data.Nlat,
+                Nlon_src = source_data.Nlon;
+
+    Nprocs_in_time          = source_data.Nprocs_in_time;
+    Nprocs_in_depth         = source_data.Nprocs_in_depth;
+    Nprocs_in_quadrature    = source_data.Nprocs_in_quadrature;
+
+    MPI_Comm_Global             = source_data.MPI_Comm_Global;
+    MPI_subcomm_sametimes       = source_data.MPI_subcomm_sametimes;
+    MPI_subcomm_samedepths      = source_data.MPI_subcomm_samedepths;
+    MPI_subcomm_sametimedepths  = source_data.MPI_subcomm_sametimedepths;
+    MPI_subcomm_samequadrature  = source_data.MPI_subcomm_samequadrature;
+
+    time        = source_data.time;
+    depth       = source_data.depth;
+    Ntime       = source_data.Ntime;
+    Ndepth      = source_data.Ndepth;
+    full_Ntime  = source_data.full_Ntime;
+    full_Ndepth = source_data.full_Ndepth;
+
+    compute_radial_vel      = source_data.compute_radial_vel;
+    use_depth_derivatives   = source_data.use_depth_derivatives;
+    depth_is_elevation      = source_data.depth_is_elevation;
+    depth_is_increasing     = source_data.depth_is_increasing;
+
+    coarse_map_lat      = source_data.coarse_map_lat;
+    coarse_map_lon      = source_data.coarse_map_lon;
+    coarse_map_areas    = source_data.coarse_map_areas;
+
+    latitude.clear();
+    longitude.clear();
+    for (int Ilat = 0; Ilat < Nlat_src; Ilat += lat_stride) { latitude.push_back(  source_data.latitude.at(Ilat)  ); }
+    for (int Ilon = 0; Ilon < Nlon_src; Ilon += lon_stride) { longitude.push_back( source_data.longitude.at(Ilon) ); }
+    Nlat = latitude.size();
+    Nlon = longitude.size();
+
+    myStarts = source_data.myStarts;
+    myCounts = source_data.myCounts;
+    if (myCounts.size() == 4) { myCounts.at(2) = Nlat; myCounts.at(3) = Nlon; }
+
+    // Subsample (Nlevels, Nlat, Nlon) masks / regions
+    auto subsample = [&]( std::vector<bool> & sub, const std::vector<bool> & src ) {
+        const size_t Nlevels = src.size() / ( (size_t) Nlat_src * Nlon_src );
+        sub.resize( Nlevels * Nlat * Nlon );
+        for (size_t Ilev = 0; Ilev < Nlevels; Ilev++) {
+            for (int Jlat = 0; Jlat < Nlat; Jlat++) {
+                for (int Jlon = 0; Jlon < Nlon; Jlon++) {
+                    sub.at( ( Ilev * Nlat + Jlat ) * Nlon + Jlon ) 
+                        = src.at( ( Ilev * Nlat_src + Jlat * lat_stride ) * Nlon_src + Jlon * lon_stride );
+                }
+            }
+        }
+    };
+    subsample( mask,            source_data.mask );
+    subsample( reference_mask,  source_data.reference_mask );
+    subsample( mask_DEPTH,      source_data.mask_DEPTH );
+
+    region_names = source_data.region_names;
+    regions.clear();
+    for (const auto & region : source_data.regions) {
+        regions.insert( std::pair< std::string, std::vector<bool> >( region.first, std::vector<bool>() ) );
+        subsample( regions.at( region.first ), region.second );
+    }
+
+    compute_cell_areas();
+    if (region_names.size() > 0) { compute_region_areas(); }
+}
+
 
 void dataset::gather_variable_across_depth( const std::vector<double> & var,
                                             std::vector<double> & gathered_var
@@ -0,0 +1,90 @@
+#include <math.h>
+#include <complex>
+#include <vector>
+#include <cassert>
+#include "../functions.hpp"
+#include "../constants.hpp"
+
+// Recursive mixed-radix (decimation-in-time) step.
+//   x is read with stride x_stride, X is written contiguously, and
+//   tmp is scratch space of the same length as X.
+//   twiddles[ j * tw_stride ] = exp( -2 pi i j / n )
+static void fft_mixed_radix(
+        const std::complex<double> * x,
+        const int x_stride,
+        std::complex<double> * X,
+        std::complex<double> * tmp,
+        const int n,
+        const std::complex<double> * twiddles,
+        const int tw_stride
+        ) {
+
+    if (n == 1) { X[0] = x[0]; return; }
+
+    // Smallest prime factor of n (falls back to a direct DFT if n is prime)
+    int p = n;
+    if      (n % 2 == 0) { p = 2; }
+    else if (n % 3 == 0) { p = 3; }
+    else {
+        for (int f = 5; f * f <= n; f += 2) {
+            if (n % f == 0) { p = f; break; }
+        }
+    }
+    const int m = n / p;
+
+    // Sub-transforms of the p interleaved sub-sequences. Each sub-transform
+    //   writes into its own block of X and uses the matching block of tmp as scratch.
+    for (int r = 0; r < p; r++) {
+        fft_mixed_radix( x + r * x_stride, x_stride * p, X + r * m, tmp + r * m,
+                         m, twiddles, tw_stride * p );
+    }
+
+    // Combine the sub-transforms
+    for (int k = 0; k < m; k++) {
+        for (int q = 0; q < p; q++) {
+            const int kk = k + q * m;
+            std::complex<double> sum = X[k];
+            for (int r = 1; r < p; r++) {
+                sum += twiddles[ ( ( (size_t) r * kk ) % n ) * tw_stride ] * X[r * m + k];
+            }
+            tmp[kk] = sum;
+        }
+    }
+    for (int k = 0; k < n; k++) { X[k] = tmp[k]; }
+}
+
+/*!
+ * \brief Discrete Fourier transform of a single (periodic) longitude row
+ *
+ * Uses a self-contained mixed-radix Cooley-Tukey scheme, so that any Nlon
+ * can be used (rows whose length has large prime factors will fall back to
+ * a direct DFT for that factor). This avoids adding an FFTW dependency to
+ * the core filtering executables.
+ *
+ * The inverse transform includes the 1/N normalization.
+ *
+ * @param[in,out]   data        row to transform (length N), overwritten with the transform
+ * @param[in,out]   work        scratch space (resized to 2N if needed)
+ * @param[in]       twiddles    exp( -2 pi i j / N ) for j = 0 ... N-1
+ * @param[in]       inverse     if true, compute the (normalized) inverse transform
+ *
+ */
+void fft_in_longitude(
+        std::vector< std::complex<double> > & data,
+        std::vector< std::complex<double> > & work,
+        const std::vector< std::complex<double> > & twiddles,
+        const bool inverse
+        ) {
+
+    const int N = data.size();
+    assert( (int)twiddles.size() == N );
+    if ( (int)work.size() < 2 * N ) { work.resize( 2 * N ); }
+
+    // The inverse transform is the conjugate of the forward transform of the conjugate
+    if (inverse) { for (int II = 0; II < N; II++) { data[II] = std::conj( data[II] ); } }
+
+    fft_mixed_radix( &data[0], 1, &work[0], &work[N], N, &twiddles[0], 1 );
+
+    if (inverse) { for (int II = 0; II < N; II++) { data[II] = std::conj( work[II] ) / (double)N; } }
+    else         { for (int II = 0; II < N; II++) { data[II] = work[II]; } }
+}
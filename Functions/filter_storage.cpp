@@ -0,0 +1,82 @@
+#include <vector>
+#include "../functions.hpp"
+
+/*!
+ * \brief Move a field into the storage type used by the filter kernels (see FLOAT_FIELD_STORAGE)
+ *
+ * If the storage type is double, then the data is just swapped in (no copy). Otherwise it is
+ * converted, and the memory for the double-precision field is released. Either way, field is
+ * empty on return.
+ *
+ * @param[in,out]   stored      where to store the field
+ * @param[in,out]   field       field to move (emptied)
+ *
+ */
+void move_to_filter_storage(
+        std::vector<double> & stored,
+        std::vector<double> & field
+        ) {
+    stored.clear();
+    stored.swap( field );
+    std::vector<double>().swap( field );
+}
+
+void move_to_filter_storage(
+        std::vector<float> & stored,
+        std::vector<double> & field
+        ) {
+    stored.assign( field.begin(), field.end() );
+    std::vector<double>().swap( field );
+}
+
+/*!
+ * \brief Get a read-only view of a field in the storage type used by the filter kernels (see FLOAT_FIELD_STORAGE)
+ *
+ * If the storage type is double, then this is just field itself (and copy is not used).
+ * Otherwise, the field is converted into copy, and copy is returned.
+ * The field (or copy) must outlive the returned reference.
+ *
+ * @param[in,out]   copy        where to store the converted field (if needed)
+ * @param[in]       field       field to view
+ *
+ */
+const std::vector<double> & filter_storage_view(
+        std::vector<double> & copy,
+        const std::vector<double> & field
+        ) {
+    return field;
+}
+
+const std::vector<float> & filter_storage_view(
+        std::vector<float> & copy,
+        const std::vector<double> & field
+        ) {
+    copy.assign( field.begin(), field.end() );
+    return copy;
+}
+
+/*!
+ * \brief Get a field in the storage type used by the filter kernels, without keeping two copies of it (see FLOAT_FIELD_STORAGE)
+ *
+ * If the storage type is double, then this is just field itself (and stored is not used).
+ * Otherwise, the field is moved into stored (see move_to_filter_storage), so that field
+ * is empty on return, and stored is returned.
+ *
+ * @param[in,out]   stored      where to store the converted field (if needed)
+ * @param[in,out]   field       field to get (emptied if converted)
+ *
+ */
+const std::vector<double> & release_to_filter_storage(
+        std::vector<double> & stored,
+        std::vector<double> & field
+        ) {
+    return field;
+}
+
+const std::vector<float> & release_to_filter_storage(
+        std::vector<float> & stored,
+        std::vector<double> & field
+        ) {
+    move_to_filter_storage( stored, field );
+    return stored;
+}
@@ -0,0 +1,55 @@
+#include <vector>
+#include <string>
+#include <map>
+#include "../functions.hpp"
+
+// Class constructor
+filtering_workspace::filtering_workspace() {
+};
+
+/*!
+ * \brief Get the working array with the given name, as Npts zeros
+ *
+ * The array keeps its storage from the previous call (if any), so this only allocates
+ * when Npts is larger than it has been before. Use Npts = 0 for an array that is
+ * only resized later (if needed), which then also re-uses the storage.
+ *
+ * @param[in]   name    name of the array
+ * @param[in]   Npts    number of points to give the array
+ *
+ * @returns the array, holding Npts zeros
+ *
+ */
+std::vector<double> & filtering_workspace::array(
+        const std::string & name,
+        const size_t Npts
+        ) {
+
+    std::vector<double> & arr = arrays[ name ];
+    arr.assign( Npts, 0. );
+    return arr;
+}
+
+/*!
+ * \brief Get the set of working arrays with the given name, as Narrays arrays of Npts zeros
+ *
+ * As for array, the arrays in the set keep their storage between calls.
+ *
+ * @param[in]   name        name of the set of arrays
+ * @param[in]   Narrays     number of arrays in the set
+ * @param[in]   Npts        number of points to give each array
+ *
+ * @returns the set of arrays, each holding Npts zeros
+ *
+ */
+std::vector< std::vector<double> > & filtering_workspace::array_set(
+        const std::string & name,
+        const size_t Narrays,
+        const size_t Npts
+        ) {
+
+    std::vector< std::vector<double> > & set = array_sets[ name ];
+    set.resize( Narrays );
+    for ( std::vector<double> & arr : set ) { arr.assign( Npts, 0. ); }
+    return set;
+}
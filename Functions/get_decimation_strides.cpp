@@ -0,0 +1,56 @@
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include "../constants.hpp"
+#include "../functions.hpp"
+
+/*!
+ * \brief Get the subsampling strides for decimated outputs at a given filter scale
+ *
+ * The output spacing is filter_scale / DECIMATE_OUTPUT_PTS_PER_SCALE, and the strides are the
+ * (largest) number of grid points that fit in that spacing, using the mean grid spacing
+ * (at the equator, on a sphere). If the grid is periodic in a direction, the stride is
+ * reduced to a divisor of the number of points, so that the subsampled grid is still periodic.
+ * The strides are also capped so that the subsampled grid keeps enough points for the 
+ * finite-difference stencils.
+ *
+ * If DECIMATE_OUTPUT_PTS_PER_SCALE is not positive, both strides are one.
+ *
+ * @param[in,out]   lat_stride,lon_stride   where to store the strides
+ * @param[in]       source_data             dataset class instance containing the grid
+ * @param[in]       filter_scale            filtering scale
+ *
+ */
+void get_decimation_strides(
+        int & lat_stride,
+        int & lon_stride,
+        const dataset & source_data,
+        const double filter_scale
+        ) {
+
+    lat_stride = 1;
+    lon_stride = 1;
+    if ( constants::DECIMATE_OUTPUT_PTS_PER_SCALE <= 0 ) { return; }
+
+    const std::vector<double>   &latitude   = source_data.latitude,
+                                &longitude  = source_data.longitude;
+
+    const int   Nlat    = source_data.Nlat,
+                Nlon    = source_data.Nlon;
+
+    const double    output_spacing  = filter_scale / constants::DECIMATE_OUTPUT_PTS_PER_SCALE,
+                    metres_per_unit = constants::CARTESIAN ? 1. : constants::R_earth;
+
+    // Strides from the mean grid spacing, keeping at least a few points per finite-difference stencil
+    const int min_points = 2 * constants::DiffOrd + 1;
+    auto stride_from = [&]( const std::vector<double> & grid, const int Npts, const bool periodic ) {
+        if (Npts < 2 * min_points) { return 1; }
+        const double spacing = fabs( grid.back() - grid.front() ) / ( Npts - 1 ) * metres_per_unit;
+        int stride = std::max( 1, std::min( (int) floor( output_spacing / spacing ), Npts / min_points ) );
+        if (periodic) { while ( Npts % stride != 0 ) { stride--; } }
+        return stride;
+    };
+
+    lat_stride = stride_from( latitude,  Nlat, constants::PERIODIC_Y );
+    lon_stride = stride_from( longitude, Nlon, (constants::PERIODIC_X) and (constants::FULL_LON_SPAN) );
+}
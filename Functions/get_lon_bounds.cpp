@@ -17,6 +17,8 @@
  *  @param[in]      centre_lat          latitude for the centre of the filtering kernel
  *  @param[in]      curr_lat            current latitude
  *  @param[in]      scale               filtering scale (metres)
+ *  @param[in]      Llat                physical length of the latitude dimension, used to wrap the
+ *                                          latitude separation on periodic (PERIODIC_Y) Cartesian grids
  *
  */
 void get_lon_bounds(
@@ -26,10 +28,11 @@ void get_lon_bounds(
         const int Ilon,
         const double centre_lat,
         const double curr_lat,
-        const double scale) {
+        const double scale,
+        const double Llat) {
 
     const double dlon    = longitude.at( 1) - longitude.at( 0);
-    const double KernPad = constants::KernPad;
+    const double KernPad = kernel_pad();
     const int    Nlon    = (int) longitude.size();
 
     // assumes uniform lon grid
@@ -60,7 +63,9 @@ void get_lon_bounds(
         double local_scale;
         if (constants::CARTESIAN) { 
             // Simply use Cartesian pythagorean
-            const double delta_lat = fabs( centre_lat - curr_lat ); 
+            //   (rows across a periodic y boundary are still close to the centre)
+            double delta_lat = fabs( centre_lat - curr_lat ); 
+            if ( constants::PERIODIC_Y and (Llat > 0) ) { delta_lat = fmin( delta_lat, Llat - delta_lat ); }
             const double square_diff = pow(padded_scale, 2.) - pow(delta_lat, 2.);
             local_scale = sqrt( fmax( square_diff, 0. ) );
 
@@ -75,12 +80,12 @@ void get_lon_bounds(
             // This is the distance between the centre point (centre_lat, centre_lon)
             // and the point at this latitude on the other side (curr_lat, centre_lon + pi)
             // dist( ( lambda0, phi0 ), ( lambda0 + pi, phi1 ) )
-            const double dist_on_other_side = distance( longitude.at(Ilon), centre_lat,
-                                                        longitude.at(Ilon) + M_PI, curr_lat );
+            //   the shortest path goes over the nearer pole, so this is R * ( pi - | phi0 + phi1 | )
+            const double dist_on_other_side = constants::R_earth * ( M_PI - fabs( centre_lat + curr_lat ) );
 
             // dist( ( lambda0, phi0 ), ( lambda0, phi1 ) )
-            const double dist_to_lat1 = distance( longitude.at(Ilon), centre_lat,
-                                                  longitude.at(Ilon), curr_lat );
+            //   along a meridian, so this is just R * | phi0 - phi1 |
+            const double dist_to_lat1 = constants::R_earth * fabs( centre_lat - curr_lat );
 
             if ( dist_on_other_side <= padded_scale / 2. ) {
                 // Use all points on line of latitude phi1
@@ -0,0 +1,114 @@
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include <cassert>
+#include "../constants.hpp"
+#include "../functions.hpp"
+
+// Class constructor
+grid_geometry::grid_geometry() {
+};
+
+/*!
+ * \brief Cache the trig values of the grid coordinates
+ *
+ * @param[in]   longitude_in    1D longitude vector
+ * @param[in]   latitude_in     1D latitude vector
+ *
+ */
+void grid_geometry::build(
+        const std::vector<double> & longitude_in,
+        const std::vector<double> & latitude_in
+        ) {
+
+    longitude = longitude_in;
+    latitude  = latitude_in;
+
+    Nlon = longitude.size();
+    Nlat = latitude.size();
+
+    cos_lon.resize(Nlon);
+    sin_lon.resize(Nlon);
+    for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+        cos_lon[Ilon] = cos( longitude[Ilon] );
+        sin_lon[Ilon] = sin( longitude[Ilon] );
+    }
+
+    cos_lat.resize(Nlat);
+    sin_lat.resize(Nlat);
+    for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+        cos_lat[Ilat] = cos( latitude[Ilat] );
+        sin_lat[Ilat] = sin( latitude[Ilat] );
+    }
+
+    // Same convention as is used when calling distance() for periodic Cartesian grids
+    Llon = (Nlon > 1) ? ( longitude[1] - longitude[0] ) * Nlon : 0.;
+    Llat = (Nlat > 1) ? ( latitude[1]  - latitude[0]  ) * Nlat : 0.;
+};
+
+/*!
+ * \brief Compute the distances from a reference grid point to a run of points along a line of latitude
+ *
+ * The distances are those from distance(), but computed from the cached trig values.
+ * In spherical coordinates, with unit vectors p1 and p2 for the two points, the 
+ * great-circle distance is 2 R atan2( |p1 - p2|, |p1 + p2| ). This is well-conditioned 
+ * for both short and nearly-antipodal distances, so it is as accurate as the high-precision 
+ * option of distance(), but the inner loop has no trig calls on the coordinates.
+ *
+ * @param[in,out]   distances       where to store the distances (length Ncells)
+ * @param[in]       ref_Ilat        latitude index of the reference point
+ * @param[in]       ref_Ilon        longitude index of the reference point
+ * @param[in]       Ilat            latitude index of the row
+ * @param[in]       LON_lb          first longitude index of the run (can be outside [0, Nlon) if periodic)
+ * @param[in]       Ncells          number of points in the run
+ *
+ */
+void grid_geometry::distances_row(
+        double * distances,
+        const int ref_Ilat,
+        const int ref_Ilon,
+        const int Ilat,
+        const int LON_lb,
+        const int Ncells
+        ) const {
+
+    assert( is_built() );
+
+    // Split the run into contiguous segments of (in-range) longitude indices
+    int done = 0;
+    while (done < Ncells) {
+        const int LON0 = constants::PERIODIC_X ? ( (LON_lb + done) % Nlon + Nlon ) % Nlon : LON_lb + done,
+                  NN   = constants::PERIODIC_X ? std::min( Ncells - done, Nlon - LON0 ) : Ncells - done;
+        double * out = distances + done;
+
+        if (constants::CARTESIAN) {
+            const double ref_lon = longitude[ref_Ilon],
+                         del_y_raw = fabs( latitude[Ilat] - latitude[ref_Ilat] ),
+                         del_y = constants::PERIODIC_Y ? fmin( del_y_raw, Llat - del_y_raw ) : del_y_raw;
+            for (int II = 0; II < NN; II++) {
+                double del_x = fabs( longitude[LON0 + II] - ref_lon );
+                if (constants::PERIODIC_X) { del_x = fmin( del_x, Llon - del_x ); }
+                out[II] = sqrt( del_x * del_x + del_y * del_y );
+            }
+        } else {
+            // Unit vectors of the reference point and the row
+            const double    x_ref = cos_lat[ref_Ilat] * cos_lon[ref_Ilon],
+                            y_ref = cos_lat[ref_Ilat] * sin_lon[ref_Ilon],
+                            z_ref = sin_lat[ref_Ilat],
+                            c_row = cos_lat[Ilat],
+                            dz    = sin_lat[Ilat] - z_ref,
+                            sz    = sin_lat[Ilat] + z_ref;
+            const double * cl = &cos_lon[LON0];
+            const double * sl = &sin_lon[LON0];
+            for (int II = 0; II < NN; II++) {
+                const double x  = c_row * cl[II],
+                             y  = c_row * sl[II],
+                             dx = x - x_ref, sx = x + x_ref,
+                             dy = y - y_ref, sy = y + y_ref;
+                out[II] = 2. * constants::R_earth * atan2( sqrt( dx * dx + dy * dy + dz * dz ), 
+                                                           sqrt( sx * sx + sy * sy + sz * sz ) );
+            }
+        }
+        done += NN;
+    }
+};
@@ -0,0 +1,60 @@
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include "../functions.hpp"
+#include "../constants.hpp"
+
+// Integration resolution (points per unit of D = dist / (scale/2)) for the kernel tails
+static const int PAD_POINTS_PER_UNIT = 2000;
+
+// Smallest D such that the kernel mass (and that of its ell-derivatives) outside of the 
+//   circle of radius D is at most tolerance times the total. Absolute values are integrated,
+//   so negative lobes (e.g. HighOrder) count towards the neglected mass.
+static double compute_kernel_pad( const double tolerance ) {
+
+    // Don't search further than the kernel table (see kernel_tabulated)
+    const double    D_max   = 2 * fmax( constants::KernPad, 1. ),
+                    dD      = 1. / PAD_POINTS_PER_UNIT;
+    const int       Npts    = (int) ceil( D_max * PAD_POINTS_PER_UNIT );
+
+    double pad = 0.;
+    for (int order = 0; order <= 2; order++) {
+
+        // tails[II] is the mass outside of D = II * dD (2D, so weighted by D)
+        std::vector<double> tails( Npts + 1, 0. );
+        for (int II = Npts - 1; II >= 0; II--) {
+            const double D = ( II + 0.5 ) * dD;
+            tails[II] = tails[II + 1] + fabs( kernel( D / 2., 1., order ) ) * D * dD;
+        }
+
+        // Some kernels don't define every derivative
+        if (tails[0] == 0) { continue; }
+
+        int II = Npts;
+        while ( (II > 0) and (tails[II - 1] <= tolerance * tails[0]) ) { II--; }
+        pad = std::max( pad, II * dD );
+    }
+    return pad;
+}
+
+/*!
+ * \brief Get the kernel truncation radius, in units of scale / 2
+ *
+ * If KERNEL_TRUNCATION_TOLERANCE is positive (and the kernel is bounded, i.e. KernPad > 0), this is the
+ * smallest radius outside of which the neglected (absolute) kernel mass, and that of its
+ * ell-derivatives, is at most KERNEL_TRUNCATION_TOLERANCE times the total, which includes 
+ * the negative tail of the HighOrder kernel. Since the kernels only depend on dist / (scale/2), 
+ * the radius in metres is kernel_pad() * scale / 2 for every scale.
+ * 
+ * Otherwise, this is KernPad.
+ *
+ * The radius is only computed once.
+ *
+ * @returns The radius factor that sizes the filtering stencils (in place of KernPad)
+ *
+ */
+double kernel_pad(void) {
+    static const double pad = ( (constants::KERNEL_TRUNCATION_TOLERANCE > 0) and (constants::KernPad > 0) ) ?
+                                compute_kernel_pad( constants::KERNEL_TRUNCATION_TOLERANCE ) : constants::KernPad;
+    return pad;
+}
@@ -0,0 +1,256 @@
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include <cassert>
+#include "../constants.hpp"
+#include "../functions.hpp"
+
+// Class constructor
+kernel_stencil::kernel_stencil() {
+};
+
+/*!
+ * \brief Build the compressed stencil for the kernel centred at (Ilat, Ilon)
+ *
+ * For each source latitude within the latitude bounds, the longitude bounds are
+ * found (get_lon_bounds) and the kernel * area weights are stored contiguously.
+ * Leading / trailing cells where the kernel (and derivatives) vanish are trimmed,
+ * so that only cells inside the kernel disc are stored.
+ *
+ * If the kernel can be rolled in longitude (uniform, periodic, full-span longitude grid),
+ * then a stencil built at any Ilon can be applied at any other longitude (see source_lon).
+ *
+ * @param[in]   source_data     dataset class instance containing data (Psi, Phi, etc)
+ * @param[in]   filter_scale    filtering scale
+ * @param[in]   Ilat,Ilon       reference coordinate (kernel centre)
+ * @param[in]   with_dl         also store ell-derivative of kernel * area
+ * @param[in]   with_dll        also store 2nd ell-derivative of kernel * area
+ *
+ */
+void kernel_stencil::build(
+        const dataset & source_data,
+        const double filter_scale,
+        const int Ilat,
+        const int Ilon,
+        const bool with_dl,
+        const bool with_dll
+        ) {
+    build( source_data, std::vector<double>(1, filter_scale), Ilat, Ilon, with_dl, with_dll );
+};
+
+/*!
+ * \brief Build a compressed stencil that holds the kernels for several scales at once
+ *
+ * The stencil covers the support of the largest scale, and each cell stores one weight
+ * per scale (as kA[ Icell * Nscales + Iscale ]). Since the integration region for a
+ * smaller scale is a subset of the region for a larger one, the weight for each scale
+ * is zero outside of its own lat/lon bounds, so that filtering with weight Iscale gives
+ * exactly the same result as a stencil built for that scale alone.
+ *
+ * @param[in]   source_data     dataset class instance containing data (Psi, Phi, etc)
+ * @param[in]   filter_scales   filtering scales
+ * @param[in]   Ilat,Ilon       reference coordinate (kernel centre)
+ * @param[in]   with_dl         also store ell-derivative of kernel * area
+ * @param[in]   with_dll        also store 2nd ell-derivative of kernel * area
+ *
+ */
+void kernel_stencil::build(
+        const dataset & source_data,
+        const std::vector<double> & filter_scales,
+        const int Ilat,
+        const int Ilon,
+        const bool with_dl,
+        const bool with_dll
+        ) {
+
+    const std::vector<double>   &latitude   = source_data.latitude,
+                                &longitude  = source_data.longitude,
+                                &dAreas     = source_data.areas;
+
+    const int   Nlat    = source_data.Nlat,
+                Nlon    = source_data.Nlon;
+
+    assert( filter_scales.size() > 0 );
+
+    ref_Ilat = Ilat;
+    ref_Ilon = Ilon;
+    scales   = filter_scales;
+    Nscales  = filter_scales.size();
+    scale    = *std::max_element( filter_scales.begin(), filter_scales.end() );
+    do_dl    = with_dl;
+    do_dll   = with_dll;
+
+    row_lat.clear();
+    row_lon_start.clear();
+    row_Ncells.clear();
+    row_offset.clear();
+    kA.clear();
+    kpA.clear();
+    kppA.clear();
+
+    int LAT_lb, LAT_ub, LON_lb, LON_ub, curr_lat, curr_lon, first, last;
+    double dist, area, lat_at_curr, kern, dl_kern = 0., dll_kern = 0.;
+    size_t area_index;
+
+    const double    lat_at_ilat = latitude.at(Ilat),
+                    lon_at_ilon = longitude.at(Ilon);
+
+    // Integration bounds for each scale (the largest scale gives the stencil extent)
+    std::vector<int> LAT_lb_s(Nscales), LAT_ub_s(Nscales), LON_lb_s(Nscales), LON_ub_s(Nscales);
+    for (int Is = 0; Is < Nscales; Is++) {
+        get_lat_bounds(LAT_lb_s[Is], LAT_ub_s[Is], latitude, Ilat, scales[Is]);
+    }
+
+    std::vector<double> tmp_kA, tmp_kpA, tmp_kppA, row_dists;
+
+    // Use the cached grid geometry for distances, if it's available
+    const bool use_geometry = source_data.geometry.is_built() 
+                              and (source_data.geometry.Nlat == Nlat) and (source_data.geometry.Nlon == Nlon);
+
+    get_lat_bounds(LAT_lb, LAT_ub, latitude, Ilat, scale);
+
+    // Periodic length in y, so that get_lon_bounds can wrap the latitude separation
+    const double Llat = ( constants::CARTESIAN and constants::PERIODIC_Y ) ? (latitude.at(1) - latitude.at(0)) * Nlat : 0.;
+
+    for (int LAT = LAT_lb; LAT < LAT_ub; LAT++) {
+
+        // Handle periodicity
+        if (constants::PERIODIC_Y) { curr_lat = ( LAT % Nlat + Nlat ) % Nlat; }
+        else                       { curr_lat = LAT; }
+        lat_at_curr = latitude.at(curr_lat);
+
+        get_lon_bounds(LON_lb, LON_ub, longitude, Ilon, lat_at_ilat, lat_at_curr, scale, Llat);
+        if (Nscales > 1) {
+            for (int Is = 0; Is < Nscales; Is++) {
+                get_lon_bounds(LON_lb_s[Is], LON_ub_s[Is], longitude, Ilon, lat_at_ilat, lat_at_curr, scales[Is], Llat);
+            }
+        }
+
+        const int Ncells = LON_ub - LON_lb;
+        tmp_kA.assign(  Ncells * Nscales, 0.);
+        tmp_kpA.assign( do_dl  ? Ncells * Nscales : 0, 0.);
+        tmp_kppA.assign(do_dll ? Ncells * Nscales : 0, 0.);
+
+        // Distances to the whole row at once
+        row_dists.resize(Ncells);
+        if (use_geometry) {
+            source_data.geometry.distances_row( row_dists.data(), Ilat, Ilon, curr_lat, LON_lb, Ncells );
+        }
+
+        first = Ncells;
+        last  = -1;
+        for (int LON = LON_lb; LON < LON_ub; LON++) {
+
+            // Handle periodicity
+            if (constants::PERIODIC_X) { curr_lon = ( LON % Nlon + Nlon ) % Nlon; }
+            else                       { curr_lon = LON; }
+
+            if (use_geometry) {
+                dist = row_dists[LON - LON_lb];
+            } else if (constants::CARTESIAN) {
+                dist = distance(lon_at_ilon,            lat_at_ilat,
+                                longitude.at(curr_lon), lat_at_curr,
+                                (longitude.at(1) - longitude.at(0)) * Nlon,
+                                (latitude.at(1)  - latitude.at(0))  * Nlat);
+            } else {
+                dist = distance(lon_at_ilon,            lat_at_ilat,
+                                longitude.at(curr_lon), lat_at_curr);
+            }
+
+            area_index = Index(0, 0, curr_lat, curr_lon, 1, 1, Nlat, Nlon);
+            area = dAreas.at(area_index);
+
+            const int II = LON - LON_lb;
+            for (int Is = 0; Is < Nscales; Is++) {
+
+                // Only include the cell if it is inside the integration region for this scale
+                if (Nscales > 1) {
+                    if ( (LAT < LAT_lb_s[Is]) or (LAT >= LAT_ub_s[Is]) ) { continue; }
+                    const int lon_span = LON_ub_s[Is] - LON_lb_s[Is];
+                    const int lon_off  = constants::PERIODIC_X ? ( (LON - LON_lb_s[Is]) % Nlon + Nlon ) % Nlon
+                                                               : LON - LON_lb_s[Is];
+                    if ( (lon_off < 0) or (lon_off >= lon_span) ) { continue; }
+                }
+
+                const size_t JJ = II * Nscales + Is;
+                kernel_tabulated( kern, dl_kern, dll_kern, dist, scales[Is], do_dll ? 2 : do_dl ? 1 : 0 );
+                tmp_kA.at(JJ) = kern * area;
+                if (do_dl)  { tmp_kpA.at(JJ)  = dl_kern  * area; }
+                if (do_dll) { tmp_kppA.at(JJ) = dll_kern * area; }
+
+                if (    ( tmp_kA.at(JJ) != 0 )
+                     or ( do_dl  and ( tmp_kpA.at(JJ)  != 0 ) )
+                     or ( do_dll and ( tmp_kppA.at(JJ) != 0 ) ) ) {
+                    first = std::min(first, II);
+                    last  = std::max(last,  II);
+                }
+            }
+        }
+
+        // Row is entirely outside of the kernel
+        if (last < first) { continue; }
+
+        row_lat.push_back( curr_lat );
+        row_lon_start.push_back( LON_lb + first - Ilon );
+        row_Ncells.push_back( last - first + 1 );
+        row_offset.push_back( kA.size() / Nscales );
+
+        kA.insert( kA.end(), tmp_kA.begin() + first * Nscales, tmp_kA.begin() + (last + 1) * Nscales );
+        if (do_dl)  { kpA.insert(  kpA.end(),  tmp_kpA.begin()  + first * Nscales, tmp_kpA.begin()  + (last + 1) * Nscales ); }
+        if (do_dll) { kppA.insert( kppA.end(), tmp_kppA.begin() + first * Nscales, tmp_kppA.begin() + (last + 1) * Nscales ); }
+    }
+};
+
+/*!
+ * \brief Get the first source longitude index for a stencil row, when the kernel is centred at Ilon
+ *
+ * Subsequent cells in the row are at increasing longitude indices (modulo Nlon if PERIODIC_X).
+ * If the kernel cannot be rolled in longitude, Ilon must be the reference longitude.
+ *
+ * @param[in]   Irow    row of the stencil
+ * @param[in]   Ilon    longitude index of the kernel centre
+ * @param[in]   Nlon    number of longitude points
+ *
+ */
+int kernel_stencil::source_lon( const int Irow, const int Ilon, const int Nlon ) const {
+    const int LON = row_lon_start[Irow] + Ilon;
+    return constants::PERIODIC_X ? ( LON % Nlon + Nlon ) % Nlon : LON;
+};
+
+/*!
+ * \brief Split a stencil row into contiguous segments of source longitudes, when the kernel is centred at Ilon
+ *
+ * A row that wraps around the periodic boundary is split into two segments (the second starting
+ * at longitude 0), and otherwise the row is a single segment.
+ *
+ * @param[in,out]   segments    where to store the segments
+ * @param[in]       Irow        row of the stencil
+ * @param[in]       Ilon        longitude index of the kernel centre
+ * @param[in]       Nlon        number of longitude points
+ *
+ * @returns the number of segments (1 or 2)
+ *
+ */
+int kernel_stencil::row_segments(
+        stencil_segment segments[2],
+        const size_t Irow,
+        const int Ilon,
+        const int Nlon
+        ) const {
+
+    const int lon_start = source_lon( Irow, Ilon, Nlon ),
+              Ncells    = row_Ncells[Irow];
+
+    segments[0].lon_start   = lon_start;
+    segments[0].cell_offset = row_offset[Irow];
+    if (lon_start + Ncells > Nlon) {
+        segments[0].Ncells      = Nlon - lon_start;
+        segments[1].lon_start   = 0;
+        segments[1].Ncells      = Ncells - segments[0].Ncells;
+        segments[1].cell_offset = segments[0].cell_offset + segments[0].Ncells;
+        return 2;
+    } else {
+        segments[0].Ncells = Ncells;
+        return 1;
+    }
+};
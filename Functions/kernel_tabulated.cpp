@@ -0,0 +1,93 @@
+#include <math.h>
+#include <vector>
+#include "../functions.hpp"
+#include "../constants.hpp"
+
+// Table resolution (nodes per unit of D = dist / (scale/2)) and extent (in D).
+//   Beyond the extent of the table, the exact kernel is used.
+static const int    TABLE_NODES_PER_UNIT = 1024;
+static const double TABLE_MAX_D          = 2 * fmax( constants::KernPad, 1. );
+
+// The TopHat kernel is discontinuous, and the Sinc kernel has no 2nd derivative,
+//   so neither can be tabulated
+static const bool   CAN_TABULATE = (constants::KERNEL_OPT != constants::KernelType::TopHat) 
+                                   and (constants::KERNEL_OPT != constants::KernelType::Sinc);
+
+// Build the kernel table. For every kernel, 
+//      kernel(dist, scale, 0) =           G(D)
+//      kernel(dist, scale, 1) = T1(D) / scale
+//      kernel(dist, scale, 2) = T2(D) / scale^2
+//   where D = dist / (scale/2), so tabulating with scale = 1 gives the values for any scale.
+//   Values are interleaved as table[ 3 * (Inode + 1) + deriv_order ], with one node of 
+//   padding on either end for the cubic interpolation.
+static std::vector<double> build_kernel_table() {
+    const int Nnodes = (int) ceil( TABLE_MAX_D * TABLE_NODES_PER_UNIT ) + 1;
+    std::vector<double> table( 3 * (Nnodes + 3) );
+    for (int Inode = -1; Inode < Nnodes + 2; Inode++) {
+        const double D = (double) Inode / TABLE_NODES_PER_UNIT;
+        table[ 3 * (Inode + 1) + 0 ] = kernel( D / 2., 1., 0 );
+        table[ 3 * (Inode + 1) + 1 ] = kernel( D / 2., 1., 1 );
+        table[ 3 * (Inode + 1) + 2 ] = kernel( D / 2., 1., 2 );
+    }
+    return table;
+}
+
+/*!
+ * \brief Evaluate the kernel, and optionally its ell-derivatives, from a pre-computed table
+ *
+ * The kernel (and ell-derivatives) are tabulated once as functions of D = dist / (scale/2),
+ * at a resolution of 1/1024 in D, and evaluated with 4-point (cubic) Lagrange interpolation.
+ * All requested orders come from a single table lookup.
+ *
+ * The interpolation error is bounded by (3/128) h^4 max| f'''' |, with h = 1/1024.
+ * Tests/kernel_benchmark.cpp checks that the errors (relative to the peak magnitude) are at most 1e-9 
+ * for the kernel and 1e-7 for the ell-derivatives; the measured maxima are about 4e-10 and 1.5e-8.
+ *
+ * Falls back to kernel() if the table is not in use (see constants::USE_KERNEL_TABLE),
+ * if the kernel can not be tabulated (TopHat, Sinc), or if D is beyond the table.
+ *
+ * @param[in,out]   kern            where to store the kernel value
+ * @param[in,out]   dl_kern         where to store the ell-derivative (if max_deriv_order >= 1)
+ * @param[in,out]   dll_kern        where to store the 2nd ell-derivative (if max_deriv_order >= 2)
+ * @param[in]       dist            distance for evaluating the kernel
+ * @param[in]       scale           filter scale (in metres)
+ * @param[in]       max_deriv_order highest ell-derivative to compute (0, 1, or 2)
+ *
+ */
+void kernel_tabulated(
+        double & kern,
+        double & dl_kern,
+        double & dll_kern,
+        const double dist,
+        const double scale,
+        const int max_deriv_order
+        ) {
+
+    const double D = ( scale > 0 ) ? ( dist / ( scale / 2. ) ) : TABLE_MAX_D + 1;
+
+    if ( not(constants::USE_KERNEL_TABLE) or not(CAN_TABULATE) or (D < 0) or (D >= TABLE_MAX_D) ) {
+        kern = kernel(dist, scale, 0);
+        if (max_deriv_order >= 1) { dl_kern  = kernel(dist, scale, 1); }
+        if (max_deriv_order >= 2) { dll_kern = kernel(dist, scale, 2); }
+        return;
+    }
+
+    // Built once (thread-safe initialization of function-local statics)
+    static const std::vector<double> table = build_kernel_table();
+
+    const double    x   = D * TABLE_NODES_PER_UNIT;
+    const int       Ix  = (int) x;
+    const double    t   = x - Ix;
+
+    // Cubic Lagrange weights on the nodes Ix-1, Ix, Ix+1, Ix+2
+    const double    w0  = -t * (t - 1) * (t - 2) / 6.,
+                    w1  =  (t + 1) * (t - 1) * (t - 2) / 2.,
+                    w2  = -(t + 1) * t * (t - 2) / 2.,
+                    w3  =  (t + 1) * t * (t - 1) / 6.;
+
+    const double * T = &table[ 3 * Ix ];  // node Ix - 1
+
+    kern = w0 * T[0] + w1 * T[3] + w2 * T[6] + w3 * T[9];
+    if (max_deriv_order >= 1) { dl_kern  = ( w0 * T[1] + w1 * T[4] + w2 * T[7] + w3 * T[10] ) / scale; }
+    if (max_deriv_order >= 2) { dll_kern = ( w0 * T[2] + w1 * T[5] + w2 * T[8] + w3 * T[11] ) / ( scale * scale ); }
+}
@@ -0,0 +1,206 @@
+#include <math.h>
+#include <stdio.h>
+#include <limits.h>
+#include <algorithm>
+#include <vector>
+#include <mpi.h>
+#include <cassert>
+#include "../constants.hpp"
+#include "../functions.hpp"
+
+// Class constructor
+latitude_bands::latitude_bands() {
+};
+
+// MPI message counts and offsets are ints, so make sure that they don't overflow
+static int checked_count(
+        const size_t count,
+        const MPI_Comm comm
+        ) {
+    if ( count > (size_t) INT_MAX ) {
+        fprintf(stderr, "latitude_bands: a message of %zu values is too large for an MPI count (at most %d). "
+                        "Use more processors in time / depth, or fewer levels per processor.\n", count, INT_MAX);
+        MPI_Abort( comm, 1 );
+    }
+    return (int) count;
+}
+
+/*!
+ * \brief Split the target latitudes into contiguous bands of (nearly) equal filtering cost
+ *
+ * Only the filtering work is split: the source fields on every processor still cover every latitude.
+ *
+ * The cost of a latitude row is the number of water points in the row (summed over times
+ * and depths), scaled by the relative number of cells in the kernel stencil at that
+ * latitude (which grows like 1 / cos(lat) on a sphere). If water is NULL, then every
+ * point in the row is counted.
+ *
+ * This is a collective operation over band_comm.
+ *
+ * @param[in]   source_data     dataset class instance containing data (Psi, Phi, etc)
+ * @param[in]   water           pre-computed water runs for the mask (NULL indicates every point is computed)
+ * @param[in]   band_comm       MPI communicator of the processors that share the same times and depths
+ *
+ */
+void latitude_bands::build(
+        const dataset & source_data,
+        const water_runs * water,
+        const MPI_Comm band_comm
+        ) {
+
+    const std::vector<double> &latitude = source_data.latitude;
+
+    const int   Ntime   = source_data.Ntime,
+                Ndepth  = source_data.Ndepth,
+                Nlon    = source_data.Nlon;
+
+    Nlat = source_data.Nlat;
+    comm = band_comm;
+    MPI_Comm_rank( comm, &Iband );
+    MPI_Comm_size( comm, &Nbands );
+
+    #if DEBUG >= 1
+    assert( (water == NULL) or ( (water->Nrows == Ntime * Ndepth * Nlat) and (water->Nlon == Nlon) ) );
+    #endif
+
+    std::vector<double> row_costs( Nlat, 0. );
+    for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+        double Npts = 0.;
+        if (water == NULL) {
+            Npts = (double) Ntime * Ndepth * Nlon;
+        } else {
+            for (int Ilev = 0; Ilev < Ntime * Ndepth; Ilev++) {
+                const size_t Irow = (size_t) Ilev * Nlat + Ilat;
+                for (size_t Irun = water->row_start[Irow]; Irun < water->row_start[Irow+1]; Irun++) {
+                    Npts += water->run_end[Irun] - water->run_begin[Irun];
+                }
+            }
+        }
+        const double stencil_width = constants::CARTESIAN ? 1.
+                                        : 1. / std::max( cos( latitude.at(Ilat) ), 1. / Nlon );
+        row_costs[Ilat] = Npts * stencil_width;
+    }
+
+    partition_by_cost( band_starts, row_costs, Nbands );
+};
+
+// Rows outside of band J (with at least one row) that are within Nhalo rows of it, in increasing order
+static std::vector<int> rows_near_band(
+        const std::vector<int> & band_starts,
+        const int J,
+        const int Nlat,
+        const int Nhalo
+        ) {
+
+    std::vector<int> rows;
+    if ( band_starts[J+1] <= band_starts[J] ) { return rows; }
+
+    for (int offset = 1; offset <= Nhalo; offset++) {
+        for ( int LAT : { band_starts[J] - offset, band_starts[J+1] - 1 + offset } ) {
+            if (constants::PERIODIC_Y) { LAT = ( LAT % Nlat + Nlat ) % Nlat; }
+            else if ( (LAT < 0) or (LAT >= Nlat) ) { continue; }
+
+            if ( (LAT < band_starts[J]) or (LAT >= band_starts[J+1]) ) { rows.push_back( LAT ); }
+        }
+    }
+    std::sort( rows.begin(), rows.end() );
+    rows.erase( std::unique( rows.begin(), rows.end() ), rows.end() );
+    return rows;
+}
+
+/*!
+ * \brief Copy the rows just outside of this processor's band from the processors that computed them
+ *
+ * On input, field only needs to be correct within this processor's band (for every time and depth).
+ * On return, it is also correct within Nhalo rows of the band, which is enough for derivatives
+ * (or chains of derivatives) that reach Nhalo rows to be correct within the band. Rows further
+ * away are left as they were. Fields that are not full-sized (e.g. empty or length-one placeholders
+ * for unused outputs) are skipped.
+ *
+ * This is a collective operation over the band communicator.
+ *
+ * @param[in,out]   field       field to update, with dimensions (Nlevels, Nlat, Nlon)
+ * @param[in]       Nlevels     number of times * depths
+ * @param[in]       Nlon        number of longitudes
+ * @param[in]       Nhalo       number of rows needed on each side of the band
+ *
+ */
+void latitude_bands::exchange_halo(
+        std::vector<double> & field,
+        const int Nlevels,
+        const int Nlon,
+        const int Nhalo
+        ) const {
+
+    if ( (Nbands == 1) or (Nhalo <= 0) or ( field.size() != (size_t) Nlevels * Nlat * Nlon ) ) { return; }
+
+    // Send every band the rows of ours that it needs, and receive the rows that we need from each band,
+    //   packed row-by-row (in increasing latitude) and then level-by-level
+    const std::vector<int> my_halo = rows_near_band( band_starts, Iband, Nlat, Nhalo );
+
+    std::vector< std::vector<int> > send_rows( Nbands ), recv_rows( Nbands );
+    std::vector<int> send_counts( Nbands ), send_offsets( Nbands ), recv_counts( Nbands ), recv_offsets( Nbands );
+    size_t send_total = 0, recv_total = 0;
+    for (int II = 0; II < Nbands; II++) {
+        if (II != Iband) {
+            for ( const int LAT : rows_near_band( band_starts, II, Nlat, Nhalo ) ) {
+                if ( (LAT >= first_row()) and (LAT < end_row()) ) { send_rows[II].push_back( LAT ); }
+            }
+            for ( const int LAT : my_halo ) {
+                if ( (LAT >= band_starts[II]) and (LAT < band_starts[II+1]) ) { recv_rows[II].push_back( LAT ); }
+            }
+        }
+
+        send_counts[II]  = checked_count( (size_t) Nlevels * send_rows[II].size() * Nlon, comm );
+        send_offsets[II] = checked_count( send_total, comm );
+        send_total += send_counts[II];
+
+        recv_counts[II]  = checked_count( (size_t) Nlevels * recv_rows[II].size() * Nlon, comm );
+        recv_offsets[II] = checked_count( recv_total, comm );
+        recv_total += recv_counts[II];
+    }
+
+    std::vector<double> send_buff( send_total ), recv_buff( recv_total );
+
+    for (int II = 0; II < Nbands; II++) {
+        size_t Ibuff = send_offsets[II];
+        for ( const int LAT : send_rows[II] ) {
+            for (int Ilev = 0; Ilev < Nlevels; Ilev++) {
+                const size_t row_start = ( (size_t) Ilev * Nlat + LAT ) * Nlon;
+                std::copy( field.begin() + row_start, field.begin() + row_start + Nlon, send_buff.begin() + Ibuff );
+                Ibuff += Nlon;
+            }
+        }
+    }
+
+    MPI_Alltoallv(  send_buff.data(), send_counts.data(), send_offsets.data(), MPI_DOUBLE,
+                    recv_buff.data(), recv_counts.data(), recv_offsets.data(), MPI_DOUBLE, comm );
+
+    for (int II = 0; II < Nbands; II++) {
+        size_t Ibuff = recv_offsets[II];
+        for ( const int LAT : recv_rows[II] ) {
+            for (int Ilev = 0; Ilev < Nlevels; Ilev++) {
+                const size_t row_start = ( (size_t) Ilev * Nlat + LAT ) * Nlon;
+                std::copy( recv_buff.begin() + Ibuff, recv_buff.begin() + Ibuff + Nlon, field.begin() + row_start );
+                Ibuff += Nlon;
+            }
+        }
+    }
+};
+
+/*!
+ * \brief Add up partial sums (e.g. area integrals over this processor's band) across the bands
+ *
+ * This is a collective operation over the band communicator.
+ *
+ * @param[in,out]   vals        values to sum (in place)
+ *
+ */
+void latitude_bands::sum_across_bands(
+        std::vector<double> & vals
+        ) const {
+
+    if ( (Nbands == 1) or ( vals.size() == 0 ) ) { return; }
+
+    MPI_Allreduce( MPI_IN_PLACE, vals.data(), checked_count( vals.size(), comm ), MPI_DOUBLE, MPI_SUM, comm );
+};
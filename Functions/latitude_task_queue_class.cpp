@@ -0,0 +1,131 @@
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include <mutex>
+#include <cassert>
+#include "../constants.hpp"
+#include "../functions.hpp"
+
+// Class constructor
+latitude_task_queue::latitude_task_queue() {
+};
+
+/*!
+ * \brief Split the latitudes [Ilat_start, Ilat_end) into tasks, and deal them out to the threads
+ *
+ * Each latitude is split into the same number of longitude blocks, chosen so that there are
+ * at least (about) eight tasks per thread, which leaves enough tasks to steal when the
+ * latitudes are not enough to go around. Each thread is then given a contiguous share of
+ * the tasks.
+ *
+ * Nthreads_in should be the largest number of threads that will call next_task.
+ *
+ * @param[in]   Ilat_start      first latitude to filter
+ * @param[in]   Ilat_end        one past the last latitude to filter
+ * @param[in]   Nlon            number of longitudes
+ * @param[in]   Nthreads_in     number of threads
+ *
+ */
+void latitude_task_queue::build(
+        const int Ilat_start,
+        const int Ilat_end,
+        const int Nlon,
+        const int Nthreads_in
+        ) {
+
+    Nthreads = std::max( Nthreads_in, 1 );
+    const int Nrows = std::max( Ilat_end - Ilat_start, 0 );
+
+    const int tasks_per_thread = 8;
+    const int Nblocks = (Nrows == 0) ? 1
+                            : std::max( 1, std::min( Nlon, (tasks_per_thread * Nthreads + Nrows - 1) / Nrows ) );
+
+    task_lat.clear();
+    task_lon_start.clear();
+    task_lon_end.clear();
+    for (int Ilat = Ilat_start; Ilat < Ilat_end; Ilat++) {
+        for (int Iblock = 0; Iblock < Nblocks; Iblock++) {
+            task_lat.push_back( Ilat );
+            task_lon_start.push_back( (int)( ( (long) Iblock      * Nlon ) / Nblocks ) );
+            task_lon_end.push_back(   (int)( ( (long)(Iblock + 1) * Nlon ) / Nblocks ) );
+        }
+    }
+    Ntasks = task_lat.size();
+
+    head.resize( Nthreads );
+    tail.resize( Nthreads );
+    for (int Ithread = 0; Ithread < Nthreads; Ithread++) {
+        head[Ithread] = (int)( ( (long) Ithread      * Ntasks ) / Nthreads );
+        tail[Ithread] = (int)( ( (long)(Ithread + 1) * Ntasks ) / Nthreads );
+    }
+    locks = std::vector<std::mutex>( Nthreads );
+    Nissued = 0;
+};
+
+/*!
+ * \brief Get the next task for a thread
+ *
+ * The thread takes the first task of its own share. If its share is empty, it steals the
+ * back half of the largest remaining share and carries on from there.
+ *
+ * @param[in]   thread_id       thread number (less than Nthreads)
+ * @param[out]  Ilat            latitude of the task
+ * @param[out]  Ilon_start      first longitude of the task
+ * @param[out]  Ilon_end        one past the last longitude of the task
+ *
+ * @returns Returns false once there are no tasks left.
+ *
+ */
+bool latitude_task_queue::next_task(
+        const int thread_id,
+        int & Ilat,
+        int & Ilon_start,
+        int & Ilon_end
+        ) {
+
+    assert( (thread_id >= 0) and (thread_id < Nthreads) );
+
+    int Itask = -1;
+
+    {
+        std::lock_guard<std::mutex> lock( locks[thread_id] );
+        if ( head[thread_id] < tail[thread_id] ) { Itask = head[thread_id]++; }
+    }
+
+    while (Itask < 0) {
+        // Find the largest remaining share
+        int victim = -1, Nleft = 0;
+        for (int Ithread = 0; Ithread < Nthreads; Ithread++) {
+            if (Ithread == thread_id) { continue; }
+            std::lock_guard<std::mutex> lock( locks[Ithread] );
+            if ( tail[Ithread] - head[Ithread] > Nleft ) {
+                Nleft = tail[Ithread] - head[Ithread];
+                victim = Ithread;
+            }
+        }
+        if (victim < 0) { return false; }
+
+        // Take the back half of it (it may have shrunk in the meantime)
+        int steal_start, steal_end;
+        {
+            std::lock_guard<std::mutex> lock( locks[victim] );
+            Nleft = tail[victim] - head[victim];
+            if (Nleft <= 0) { continue; }
+            steal_end   = tail[victim];
+            steal_start = steal_end - (Nleft + 1) / 2;
+            tail[victim] = steal_start;
+        }
+
+        std::lock_guard<std::mutex> lock( locks[thread_id] );
+        head[thread_id] = steal_start + 1;
+        tail[thread_id] = steal_end;
+        Itask = steal_start;
+    }
+
+    Nissued++;
+
+    Ilat       = task_lat[Itask];
+    Ilon_start = task_lon_start[Itask];
+    Ilon_end   = task_lon_end[Itask];
+    return true;
+};
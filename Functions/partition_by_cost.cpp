@@ -0,0 +1,76 @@
+#include <math.h>
+#include <algorithm>
+#include <numeric>
+#include <vector>
+#include <cassert>
+#include "../functions.hpp"
+
+/*!
+ * \brief Split a list of costs into contiguous chunks with (nearly) equal total cost
+ *
+ * The largest chunk cost is minimized by bisection on the chunk threshold, with each
+ * candidate threshold tested by greedily packing the costs in order. Every chunk
+ * gets at least one entry (if there are enough entries).
+ *
+ * On return, chunk II is [ split_starts[II], split_starts[II+1] ), so split_starts
+ * has Nchunks + 1 entries, the last of which is costs.size().
+ *
+ * @param[in,out]   split_starts    where to store the first index of each chunk (plus the total)
+ * @param[in]       costs           cost of each entry (non-negative)
+ * @param[in]       Nchunks         number of chunks
+ *
+ */
+void partition_by_cost(
+        std::vector<int> & split_starts,
+        const std::vector<double> & costs,
+        const int Nchunks
+        ) {
+
+    const int N = costs.size();
+    assert( Nchunks > 0 );
+
+    split_starts.resize( Nchunks + 1 );
+
+    // Not enough entries to go around, so some chunks have to be empty
+    if ( N <= Nchunks ) {
+        for (int II = 0; II <= Nchunks; II++) { split_starts[II] = std::min(II, N); }
+        return;
+    }
+
+    // Number of chunks needed so that no chunk is larger than thresh
+    auto chunks_needed = [&costs, N]( const double thresh ) {
+        int Nneeded = 1;
+        double acc = 0.;
+        for (int II = 0; II < N; II++) {
+            if ( (acc + costs[II] > thresh) and (acc > 0) ) { Nneeded++; acc = 0.; }
+            acc += costs[II];
+        }
+        return Nneeded;
+    };
+
+    double  lower = *std::max_element( costs.begin(), costs.end() ),
+            upper = std::accumulate( costs.begin(), costs.end(), 0. );
+    for (int Iter = 0; Iter < 100; Iter++) {
+        if ( upper - lower <= 1e-12 * upper ) { break; }
+        const double mid = 0.5 * ( lower + upper );
+        if ( chunks_needed(mid) <= Nchunks ) { upper = mid; }
+        else                                 { lower = mid; }
+    }
+
+    // Pack greedily with the final threshold, but start a new chunk whenever
+    //   there are only just enough entries left for the remaining chunks
+    int Ichunk = 0;
+    double acc = 0.;
+    split_starts[0] = 0;
+    for (int II = 0; II < N; II++) {
+        const int remaining_chunks = Nchunks - Ichunk - 1;
+        if (    ( remaining_chunks > 0 ) and ( II > split_starts[Ichunk] )
+            and ( ( acc + costs[II] > upper ) or ( N - II == remaining_chunks ) ) ) {
+            Ichunk++;
+            split_starts[Ichunk] = II;
+            acc = 0.;
+        }
+        acc += costs[II];
+    }
+    for (int II = Ichunk + 1; II <= Nchunks; II++) { split_starts[II] = N; }
+}
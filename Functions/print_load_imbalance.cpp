@@ -0,0 +1,37 @@
+#include <stdio.h>
+#include <mpi.h>
+#include "../functions.hpp"
+
+/*!
+ * \brief Print the load imbalance (max / mean) of some per-rank work across a communicator
+ *
+ * This is a collective operation (over comm), and only the root prints.
+ *
+ * @param[in]   local_work  work (e.g. seconds) on this rank
+ * @param[in]   label       label to print with the imbalance
+ * @param[in]   comm        MPI communicator over which to compare the work
+ *
+ */
+void print_load_imbalance(
+        const double local_work,
+        const char * label,
+        const MPI_Comm comm
+        ) {
+
+    int wRank, wSize;
+    MPI_Comm_rank( comm, &wRank );
+    MPI_Comm_size( comm, &wSize );
+
+    double max_work, sum_work, min_work;
+    MPI_Allreduce( &local_work, &max_work, 1, MPI_DOUBLE, MPI_MAX, comm );
+    MPI_Allreduce( &local_work, &min_work, 1, MPI_DOUBLE, MPI_MIN, comm );
+    MPI_Allreduce( &local_work, &sum_work, 1, MPI_DOUBLE, MPI_SUM, comm );
+
+    const double mean_work = sum_work / wSize;
+
+    if (wRank == 0) {
+        fprintf( stdout, "  %s load imbalance (max / mean) = %.3g  (min %.4g, mean %.4g, max %.4g)\n",
+                label, (mean_work > 0) ? max_work / mean_work : 1., min_work, mean_work, max_work );
+        fflush(stdout);
+    }
+}
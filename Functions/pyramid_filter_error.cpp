@@ -0,0 +1,106 @@
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include <mpi.h>
+#include <omp.h>
+#include "../functions.hpp"
+#include "../constants.hpp"
+
+/*!
+ * \brief Measure the error of filtering on a coarsened grid, by comparing to the full-resolution filter at a sample of points
+ *
+ * This also applies to the other approximate filters (e.g. apply_filter_iir).
+ *
+ * Nsamples (lat,lon) points are spread evenly over the source rows [Ilat_start, Ilat_end), and
+ * the fields are filtered there with the full-resolution stencil. The error for each field is
+ * sqrt( sum( (coarse - exact)^2 ) / sum( exact^2 ) ), summed over the sampled water points
+ * of every processor in comm, and the largest error over the fields is returned.
+ *
+ * This is a collective operation over comm.
+ *
+ * @param[in]   coarse_fields   filtered fields to check (e.g. from apply_filter_via_pyramid or apply_filter_iir)
+ * @param[in]   fields          fields that were filtered
+ * @param[in]   source_data     dataset class instance containing data (Psi, Phi, etc)
+ * @param[in]   scale           filtering scale
+ * @param[in]   Ilat_start      first source latitude to sample
+ * @param[in]   Ilat_end        one past the last source latitude to sample
+ * @param[in]   Nsamples        number of (lat,lon) points to sample on this processor
+ * @param[in]   water           pre-computed water runs for the mask (NULL indicates not provided)
+ * @param[in]   comm            MPI communicator over which to combine the errors
+ *
+ */
+double pyramid_filter_error(
+        const std::vector< std::vector<double>* > & coarse_fields,
+        const std::vector<const std::vector<filter_real>*> & fields,
+        const dataset & source_data,
+        const double scale,
+        const int Ilat_start,
+        const int Ilat_end,
+        const int Nsamples,
+        const water_runs * water,
+        const MPI_Comm comm
+        ) {
+
+    const int Nfields = fields.size();
+
+    const int   Ntime   = source_data.Ntime,
+                Ndepth  = source_data.Ndepth,
+                Nlat    = source_data.Nlat,
+                Nlon    = source_data.Nlon,
+                Nlevels = Ntime * Ndepth;
+
+    const size_t    Npts    = (size_t) std::max( 0, Ilat_end - Ilat_start ) * Nlon,
+                    stride  = std::max( (size_t) 1, Npts / std::max( 1, Nsamples ) );
+
+    const bool can_roll_in_longitude = (constants::PERIODIC_X) and (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN);
+
+    // Squared errors (first Nfields) and squared exact values (last Nfields)
+    std::vector<double> sums( 2 * Nfields, 0. ), global_sums( 2 * Nfields, 0. );
+    std::vector<const std::vector<filter_real>*> null_factors;
+
+    #pragma omp parallel default(none) \
+    shared( coarse_fields, fields, null_factors, source_data, water, sums ) \
+    firstprivate( Nfields, Ntime, Ndepth, Nlat, Nlon, Nlevels, Npts, stride, Ilat_start, scale, can_roll_in_longitude )
+    {
+        kernel_stencil stencil;
+        std::vector<double> level_vals, null_vector, local_sums( 2 * Nfields, 0. );
+        int Ilat, Ilon;
+        size_t index;
+        double exact;
+
+        #pragma omp for schedule(dynamic)
+        for (size_t Ipt = stride / 2; Ipt < Npts; Ipt += stride) {
+            Ilat = Ilat_start + Ipt / Nlon;
+            Ilon = Ipt % Nlon;
+
+            stencil.build( source_data, scale, Ilat, can_roll_in_longitude ? 0 : Ilon );
+            apply_filter_at_point_all_levels( level_vals, null_vector, null_vector, null_vector, null_vector,
+                    fields, null_factors, source_data, Ilat, Ilon, stencil, NULL, true, water );
+
+            for (int Ilev = 0; Ilev < Nlevels; Ilev++) {
+                index = Index(Ilev / Ndepth, Ilev % Ndepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon);
+                if ( not(source_data.mask[index]) ) { continue; }
+                for (int Ifield = 0; Ifield < Nfields; Ifield++) {
+                    exact = level_vals[ Ilev * Nfields + Ifield ];
+                    local_sums[ Ifield ]           += pow( coarse_fields[Ifield]->at(index) - exact, 2 );
+                    local_sums[ Nfields + Ifield ] += pow( exact, 2 );
+                }
+            }
+        }
+
+        #pragma omp critical
+        {
+            for (int II = 0; II < 2 * Nfields; II++) { sums[II] += local_sums[II]; }
+        }
+    }
+
+    MPI_Allreduce( sums.data(), global_sums.data(), 2 * Nfields, MPI_DOUBLE, MPI_SUM, comm );
+
+    double max_error = 0.;
+    for (int Ifield = 0; Ifield < Nfields; Ifield++) {
+        if ( global_sums[ Nfields + Ifield ] > 0 ) {
+            max_error = std::max( max_error, sqrt( global_sums[Ifield] / global_sums[ Nfields + Ifield ] ) );
+        }
+    }
+    return max_error;
+}
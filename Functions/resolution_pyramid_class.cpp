@@ -0,0 +1,351 @@
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include <cassert>
+#include <omp.h>
+#include "../constants.hpp"
+#include "../functions.hpp"
+
+// Class constructor
+resolution_pyramid::resolution_pyramid() {
+};
+
+/*!
+ * \brief Build the block-averaged grids that are needed for scales up to max_scale
+ *
+ * Each grid doubles the block size of the previous one, and grids are added while their
+ * spacing is at most PYRAMID_MAX_SPACING_FRACTION * max_scale. A coarse cell is water if
+ * any of the cells in its block are water, its area is the sum of the areas in the block,
+ * and its coordinates are the mean of the coordinates in the block. Periodic dimensions
+ * need the block size to divide the number of points (so that the coarse grid is uniform
+ * and periodic), and every grid keeps a few points in each direction for the interpolation.
+ *
+ * @param[in]   source_data     dataset class instance containing the grid and mask
+ * @param[in]   max_scale       largest filter scale that will be used
+ *
+ */
+void resolution_pyramid::build(
+        const dataset & source_data,
+        const double max_scale
+        ) {
+
+    const std::vector<double>   &latitude   = source_data.latitude,
+                                &longitude  = source_data.longitude,
+                                &dAreas     = source_data.areas;
+
+    const std::vector<bool> &mask = source_data.mask;
+
+    const int   Ntime   = source_data.Ntime,
+                Ndepth  = source_data.Ndepth,
+                Nlat    = source_data.Nlat,
+                Nlon    = source_data.Nlon,
+                Nlevels = Ntime * Ndepth;
+
+    const double    metres_per_unit = constants::CARTESIAN ? 1. : constants::R_earth,
+                    dlat_m  = (Nlat > 1) ? fabs( latitude.back()  - latitude.front()  ) / ( Nlat - 1 ) * metres_per_unit : 0.,
+                    dlon_m  = (Nlon > 1) ? fabs( longitude.back() - longitude.front() ) / ( Nlon - 1 ) * metres_per_unit : 0.,
+                    max_spacing = constants::PYRAMID_MAX_SPACING_FRACTION * max_scale;
+
+    const bool periodic_lon = (constants::PERIODIC_X) and (constants::FULL_LON_SPAN);
+    const int min_points = 4;
+
+    block_sizes.assign( 1, 1 );
+    spacings.assign( 1, std::max( dlat_m, dlon_m ) );
+    grids.resize( 1 );
+
+    while ( constants::PYRAMID_MAX_SPACING_FRACTION > 0 ) {
+
+        const int       block   = 2 * block_sizes.back();
+        const double    spacing = block * std::max( dlat_m, dlon_m );
+
+        if ( spacing > max_spacing ) { break; }
+        if ( (Nlat / block < min_points) or (Nlon / block < min_points) ) { break; }
+        if ( (constants::PERIODIC_Y) and (Nlat % block != 0) ) { break; }
+        if ( periodic_lon and (Nlon % block != 0) ) { break; }
+
+        block_sizes.push_back( block );
+        spacings.push_back( spacing );
+        grids.push_back( dataset() );
+
+        dataset & grid = grids.back();
+        const int   Nlat_c  = ( Nlat + block - 1 ) / block,
+                    Nlon_c  = ( Nlon + block - 1 ) / block;
+
+        grid.Ntime  = Ntime;
+        grid.Ndepth = Ndepth;
+        grid.Nlat   = Nlat_c;
+        grid.Nlon   = Nlon_c;
+        grid.full_Ntime  = source_data.full_Ntime;
+        grid.full_Ndepth = source_data.full_Ndepth;
+
+        // Mean coordinates over each block (the last block may be partial)
+        auto block_means = [&]( std::vector<double> & coarse, const std::vector<double> & fine, const int Ncoarse ) {
+            const int Nfine = fine.size();
+            coarse.resize( Ncoarse );
+            for (int J = 0; J < Ncoarse; J++) {
+                const int I_lo = J * block, I_hi = std::min( (J + 1) * block, Nfine );
+                double sum = 0.;
+                for (int I = I_lo; I < I_hi; I++) { sum += fine[I]; }
+                coarse[J] = sum / ( I_hi - I_lo );
+            }
+        };
+        block_means( grid.latitude,  latitude,  Nlat_c );
+        block_means( grid.longitude, longitude, Nlon_c );
+
+        grid.areas.assign( (size_t) Nlat_c * Nlon_c, 0. );
+        grid.mask.assign( (size_t) Nlevels * Nlat_c * Nlon_c, false );
+        for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+            for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+                grid.areas[ (Ilat / block) * Nlon_c + Ilon / block ] += dAreas[ Ilat * Nlon + Ilon ];
+            }
+        }
+        for (int Ilev = 0; Ilev < Nlevels; Ilev++) {
+            for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+                for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+                    if ( mask[ ( (size_t) Ilev * Nlat + Ilat ) * Nlon + Ilon ] ) {
+                        grid.mask[ ( (size_t) Ilev * Nlat_c + Ilat / block ) * Nlon_c + Ilon / block ] = true;
+                    }
+                }
+            }
+        }
+
+        grid.geometry.build( grid.longitude, grid.latitude );
+    }
+
+    Ngrids = block_sizes.size();
+};
+
+/*!
+ * \brief Index of the coarsest grid whose spacing is at most PYRAMID_MAX_SPACING_FRACTION * filter_scale
+ *
+ * Returns zero (i.e. the source grid) if no coarsened grid is fine enough.
+ *
+ * @param[in]   filter_scale    filtering scale
+ *
+ */
+int resolution_pyramid::grid_for_scale(
+        const double filter_scale
+        ) const {
+
+    int Igrid = 0;
+    for (int II = 1; II < Ngrids; II++) {
+        if ( spacings[II] <= constants::PYRAMID_MAX_SPACING_FRACTION * filter_scale ) { Igrid = II; }
+    }
+    return Igrid;
+};
+
+/*!
+ * \brief Coarsen a spatial weight (e.g. rho) onto a grid of the pyramid
+ *
+ * The coarse weight is sum( area * mask' * weight ) / (coarse area) over each block, where
+ * mask' is the mask if deforming around land, and one otherwise. It is used as the weight
+ * when filtering on the coarse grid (even if weight is NULL), so that the coarse kernel
+ * denominators match the fine ones.
+ *
+ * @param[in,out]   coarse_weight   where to store the coarse weight (resized)
+ * @param[in]       weight          pointer to spatial weight on the source grid (NULL indicates not provided)
+ * @param[in]       source_data     dataset class instance containing the grid and mask
+ * @param[in]       Igrid           which grid of the pyramid
+ *
+ */
+void resolution_pyramid::coarsen_weight(
+        std::vector<filter_real> & coarse_weight,
+        const std::vector<filter_real> * weight,
+        const dataset & source_data,
+        const int Igrid
+        ) const {
+
+    const dataset & grid = grids.at(Igrid);
+    const int   block   = block_sizes.at(Igrid),
+                Nlat    = source_data.Nlat,
+                Nlon    = source_data.Nlon,
+                Nlat_c  = grid.Nlat,
+                Nlon_c  = grid.Nlon,
+                Nlevels = source_data.Ntime * source_data.Ndepth;
+
+    const std::vector<bool> &mask = source_data.mask;
+    const std::vector<double> &dAreas = source_data.areas;
+
+    coarse_weight.assign( (size_t) Nlevels * Nlat_c * Nlon_c, 0. );
+
+    #pragma omp parallel for collapse(2) schedule(static) default(none) \
+    shared( coarse_weight, weight, mask, dAreas, grid ) \
+    firstprivate( block, Nlat, Nlon, Nlat_c, Nlon_c, Nlevels )
+    for (int Ilev = 0; Ilev < Nlevels; Ilev++) {
+        for (int Jlat = 0; Jlat < Nlat_c; Jlat++) {
+            for (int Jlon = 0; Jlon < Nlon_c; Jlon++) {
+                double sum = 0.;
+                for (int Ilat = Jlat * block; Ilat < std::min( (Jlat + 1) * block, Nlat ); Ilat++) {
+                    for (int Ilon = Jlon * block; Ilon < std::min( (Jlon + 1) * block, Nlon ); Ilon++) {
+                        const size_t index = ( (size_t) Ilev * Nlat + Ilat ) * Nlon + Ilon;
+                        if ( (constants::DEFORM_AROUND_LAND) and not(mask[index]) ) { continue; }
+                        sum += dAreas[ Ilat * Nlon + Ilon ] * ( (weight == NULL) ? 1. : (*weight)[index] );
+                    }
+                }
+                coarse_weight[ ( (size_t) Ilev * Nlat_c + Jlat ) * Nlon_c + Jlon ] = sum / grid.areas[ Jlat * Nlon_c + Jlon ];
+            }
+        }
+    }
+};
+
+/*!
+ * \brief Coarsen field * factor onto a grid of the pyramid
+ *
+ * The coarse value is sum( area * mask * weight * field * factor ) / sum( area * mask' * weight )
+ * over each block, where mask' is as in coarsen_weight. Land cells contribute nothing to the
+ * numerator (as in the filter itself), so that filtering the coarse field with the coarse
+ * weight gives the same kernel sums as on the source grid, up to the variation of the kernel
+ * within each block.
+ *
+ * @param[in,out]   coarse_field    where to store the coarse field (resized)
+ * @param[in]       field           field on the source grid
+ * @param[in]       factor          pointer to optional second factor (NULL indicates a linear field)
+ * @param[in]       weight          pointer to spatial weight (i.e. rho) (NULL indicates not provided)
+ * @param[in]       source_data     dataset class instance containing the grid and mask
+ * @param[in]       Igrid           which grid of the pyramid
+ *
+ */
+void resolution_pyramid::coarsen(
+        std::vector<filter_real> & coarse_field,
+        const std::vector<filter_real> & field,
+        const std::vector<filter_real> * factor,
+        const std::vector<filter_real> * weight,
+        const dataset & source_data,
+        const int Igrid
+        ) const {
+
+    const dataset & grid = grids.at(Igrid);
+    const int   block   = block_sizes.at(Igrid),
+                Nlat    = source_data.Nlat,
+                Nlon    = source_data.Nlon,
+                Nlat_c  = grid.Nlat,
+                Nlon_c  = grid.Nlon,
+                Nlevels = source_data.Ntime * source_data.Ndepth;
+
+    const std::vector<bool> &mask = source_data.mask;
+    const std::vector<double> &dAreas = source_data.areas;
+
+    coarse_field.assign( (size_t) Nlevels * Nlat_c * Nlon_c, 0. );
+
+    #pragma omp parallel for collapse(2) schedule(static) default(none) \
+    shared( coarse_field, field, factor, weight, mask, dAreas ) \
+    firstprivate( block, Nlat, Nlon, Nlat_c, Nlon_c, Nlevels )
+    for (int Ilev = 0; Ilev < Nlevels; Ilev++) {
+        for (int Jlat = 0; Jlat < Nlat_c; Jlat++) {
+            for (int Jlon = 0; Jlon < Nlon_c; Jlon++) {
+                double numer = 0., denom = 0.;
+                for (int Ilat = Jlat * block; Ilat < std::min( (Jlat + 1) * block, Nlat ); Ilat++) {
+                    for (int Ilon = Jlon * block; Ilon < std::min( (Jlon + 1) * block, Nlon ); Ilon++) {
+                        const size_t index = ( (size_t) Ilev * Nlat + Ilat ) * Nlon + Ilon;
+                        const double area = dAreas[ Ilat * Nlon + Ilon ] * ( (weight == NULL) ? 1. : (*weight)[index] );
+                        if ( mask[index] ) {
+                            numer += area * field[index] * ( (factor == NULL) ? 1. : (*factor)[index] );
+                        }
+                        if ( not(constants::DEFORM_AROUND_LAND) or mask[index] ) { denom += area; }
+                    }
+                }
+                coarse_field[ ( (size_t) Ilev * Nlat_c + Jlat ) * Nlon_c + Jlon ] = (denom == 0) ? 0. : numer / denom;
+            }
+        }
+    }
+};
+
+/*!
+ * \brief Interpolate a field from a grid of the pyramid back onto the source grid
+ *
+ * Bilinear interpolation between the four surrounding coarse cells, using only the coarse
+ * water cells (with the weights re-normalized). Only the water points of the source rows
+ * [Ilat_start, Ilat_end) are set; everything else in field is left untouched.
+ *
+ * @param[in,out]   field           field on the source grid
+ * @param[in]       coarse_field    field on the coarse grid
+ * @param[in]       source_data     dataset class instance containing the grid and mask
+ * @param[in]       Igrid           which grid of the pyramid
+ * @param[in]       Ilat_start      first source latitude to set
+ * @param[in]       Ilat_end        one past the last source latitude to set
+ *
+ */
+void resolution_pyramid::interpolate_to_source(
+        std::vector<double> & field,
+        const std::vector<double> & coarse_field,
+        const dataset & source_data,
+        const int Igrid,
+        const int Ilat_start,
+        const int Ilat_end
+        ) const {
+
+    const dataset & grid = grids.at(Igrid);
+    const int   block   = block_sizes.at(Igrid),
+                Nlat    = source_data.Nlat,
+                Nlon    = source_data.Nlon,
+                Nlat_c  = grid.Nlat,
+                Nlon_c  = grid.Nlon,
+                Nlevels = source_data.Ntime * source_data.Ndepth;
+
+    const std::vector<bool> &mask = source_data.mask,
+                            &coarse_mask = grid.mask;
+
+    const bool periodic_lon = (constants::PERIODIC_X) and (constants::FULL_LON_SPAN);
+
+    // The two coarse cells on either side of source point Ifine, and the fractional
+    //   distance t from the first to the second. Beyond the outermost coarse cell centres
+    //   of a non-periodic dimension, the nearest coarse cell is used.
+    auto bracket = [block]( int & J0, int & J1, double & t, const int Ifine,
+                            const std::vector<double> & fine, const std::vector<double> & coarse, const bool periodic ) {
+        const int   Nfine   = fine.size(),
+                    Ncoarse = coarse.size(),
+                    J       = Ifine / block;
+        const double centre = 0.5 * ( J * block + std::min( (J + 1) * block, Nfine ) - 1 );
+        J0 = ( Ifine < centre ) ? J - 1 : J;
+        J1 = J0 + 1;
+        if (periodic) {
+            t  = ( Ifine - ( J0 * block + 0.5 * (block - 1) ) ) / block;
+            J0 = ( J0 + Ncoarse ) % Ncoarse;
+            J1 = J1 % Ncoarse;
+        } else if ( (J0 < 0) or (J1 >= Ncoarse) ) {
+            J0 = J;
+            J1 = J;
+            t  = 0.;
+        } else {
+            t = ( fine[Ifine] - coarse[J0] ) / ( coarse[J1] - coarse[J0] );
+        }
+    };
+
+    #pragma omp parallel default(none) \
+    shared( field, coarse_field, mask, coarse_mask, source_data, grid, bracket ) \
+    firstprivate( block, Nlat, Nlon, Nlat_c, Nlon_c, Nlevels, Ilat_start, Ilat_end, periodic_lon )
+    {
+        int Jlat[2], Jlon[2];
+        double t_lat, t_lon, wght, val_sum, wght_sum;
+        size_t index, coarse_index;
+
+        #pragma omp for collapse(2) schedule(static)
+        for (int Ilev = 0; Ilev < Nlevels; Ilev++) {
+            for (int Ilat = Ilat_start; Ilat < Ilat_end; Ilat++) {
+                bracket( Jlat[0], Jlat[1], t_lat, Ilat, source_data.latitude, grid.latitude, constants::PERIODIC_Y );
+                for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+                    index = ( (size_t) Ilev * Nlat + Ilat ) * Nlon + Ilon;
+                    if ( not(mask[index]) ) { continue; }
+
+                    bracket( Jlon[0], Jlon[1], t_lon, Ilon, source_data.longitude, grid.longitude, periodic_lon );
+
+                    val_sum  = 0.;
+                    wght_sum = 0.;
+                    for (int II = 0; II < 2; II++) {
+                        for (int JJ = 0; JJ < 2; JJ++) {
+                            coarse_index = ( (size_t) Ilev * Nlat_c + Jlat[II] ) * Nlon_c + Jlon[JJ];
+                            if ( not(coarse_mask[coarse_index]) ) { continue; }
+                            wght = ( II == 0 ? 1. - t_lat : t_lat ) * ( JJ == 0 ? 1. - t_lon : t_lon );
+                            val_sum  += wght * coarse_field[coarse_index];
+                            wght_sum += wght;
+                        }
+                    }
+                    // The block containing the point is always water, so fall back to it
+                    //   if the interpolation weights all landed on coarse land cells
+                    coarse_index = ( (size_t) Ilev * Nlat_c + Ilat / block ) * Nlon_c + Ilon / block;
+                    field[index] = (wght_sum == 0) ? coarse_field[coarse_index] : val_sum / wght_sum;
+                }
+            }
+        }
+    }
+};
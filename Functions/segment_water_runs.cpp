@@ -0,0 +1,39 @@
+#include <vector>
+#include "../functions.hpp"
+
+/*!
+ * \brief Get the water intervals within one segment of a kernel stencil row, at one time / depth
+ *
+ * On return, wet_lo[II] <= Ilon < wet_hi[II] are the water cells of the segment, given as offsets
+ *    relative to segment.lon_start. If water is NULL, then the intervals are found from the mask.
+ *
+ * @param[in,out]   wet_lo,wet_hi   where to store the intervals (cleared first)
+ * @param[in]       segment         stencil segment (see kernel_stencil::row_segments)
+ * @param[in]       level_offset    index of the first longitude of the source row (at this time / depth)
+ * @param[in]       mask            land / water mask
+ * @param[in]       water           pre-computed water runs for the mask (NULL to use the mask)
+ *
+ */
+void segment_water_runs(
+        std::vector<int> & wet_lo,
+        std::vector<int> & wet_hi,
+        const stencil_segment & segment,
+        const size_t level_offset,
+        const std::vector<bool> & mask,
+        const water_runs * water
+        ) {
+
+    if (water != NULL) {
+        water->runs_in_range( wet_lo, wet_hi, level_offset / water->Nlon, segment.lon_start, segment.Ncells );
+        return;
+    }
+
+    wet_lo.clear();
+    wet_hi.clear();
+    const size_t off = level_offset + segment.lon_start;
+    for (int II = 0; II < segment.Ncells; II++) {
+        if ( not(mask[ off + II ]) ) { continue; }
+        if ( (wet_hi.size() > 0) and (wet_hi.back() == II) ) { wet_hi.back()++; }
+        else { wet_lo.push_back(II); wet_hi.push_back(II + 1); }
+    }
+}
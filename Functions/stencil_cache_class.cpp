@@ -0,0 +1,89 @@
+#include <vector>
+#include <memory>
+#include <future>
+#include <mutex>
+#include <algorithm>
+#include "../constants.hpp"
+#include "../functions.hpp"
+
+// Class constructor
+stencil_cache::stencil_cache() {
+};
+
+/*!
+ * \brief Get the (shared, read-only) stencil for latitude Ilat, building it if it is not cached
+ *
+ * The stencil is built at the reference longitude (index 0), and so can only be used
+ * when the kernel can be rolled in longitude. The build itself is done outside of the
+ * lock, so that other threads can keep using the cache, and any thread that asks for the
+ * same stencil while it is being built waits for it instead of building its own copy.
+ *
+ * If the cache is full, the least recently used stencil is dropped. Threads that still
+ * hold that stencil keep it alive until they are done with it.
+ *
+ * @param[in]   source_data     dataset class instance containing data (Psi, Phi, etc)
+ * @param[in]   filter_scale    filtering scale
+ * @param[in]   Ilat            latitude index of the kernel centre
+ * @param[in]   with_dl         also store ell-derivative of kernel * area
+ * @param[in]   with_dll        also store 2nd ell-derivative of kernel * area
+ * @param[out]  was_built       true if this call built the stencil
+ *
+ */
+std::shared_ptr<const kernel_stencil> stencil_cache::get(
+        const dataset & source_data,
+        const double filter_scale,
+        const int Ilat,
+        const bool with_dl,
+        const bool with_dll,
+        bool & was_built
+        ) {
+
+    std::promise< std::shared_ptr<const kernel_stencil> > promise;
+    std::shared_future< std::shared_ptr<const kernel_stencil> > stencil;
+
+    {
+        std::lock_guard<std::mutex> lock( cache_mutex );
+        use_count++;
+
+        for (size_t II = 0; II < entries.size(); II++) {
+            entry & ent = entries[II];
+            if (    (ent.Ilat == Ilat) and (ent.scale == filter_scale)
+                and (ent.do_dl == with_dl) and (ent.do_dll == with_dll) ) {
+                ent.last_use = use_count;
+                stencil = ent.stencil;
+                break;
+            }
+        }
+
+        was_built = not( stencil.valid() );
+        if (was_built) {
+            // Drop the least recently used entry to make room
+            if ( (int)entries.size() >= std::max( capacity, 1 ) ) {
+                size_t Ioldest = 0;
+                for (size_t II = 1; II < entries.size(); II++) {
+                    if (entries[II].last_use < entries[Ioldest].last_use) { Ioldest = II; }
+                }
+                entries.erase( entries.begin() + Ioldest );
+            }
+
+            stencil = promise.get_future().share();
+            entries.push_back( entry{ Ilat, filter_scale, with_dl, with_dll, use_count, stencil } );
+        }
+    }
+
+    if (was_built) {
+        std::shared_ptr<kernel_stencil> new_stencil = std::make_shared<kernel_stencil>();
+        new_stencil->build( source_data, filter_scale, Ilat, 0, with_dl, with_dll );
+        promise.set_value( new_stencil );
+    }
+
+    return stencil.get();
+};
+
+/*!
+ * \brief Drop all of the cached stencils
+ */
+void stencil_cache::clear() {
+    std::lock_guard<std::mutex> lock( cache_mutex );
+    entries.clear();
+};
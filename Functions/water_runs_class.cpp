@@ -0,0 +1,96 @@
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include <cassert>
+#include "../constants.hpp"
+#include "../functions.hpp"
+
+// Class constructor
+water_runs::water_runs() {
+};
+
+/*!
+ * \brief Compress the mask into runs of water cells along each line of latitude
+ *
+ * @param[in]   mask                        mask (true = water) to compress
+ * @param[in]   Ntime,Ndepth,Nlat,Nlon_in   dimension sizes
+ *
+ */
+void water_runs::build(
+        const std::vector<bool> & mask,
+        const int Ntime,
+        const int Ndepth,
+        const int Nlat,
+        const int Nlon_in
+        ) {
+
+    Nlon  = Nlon_in;
+    Nrows = Ntime * Ndepth * Nlat;
+
+    row_start.resize( Nrows + 1 );
+    run_begin.clear();
+    run_end.clear();
+
+    for (int Irow = 0; Irow < Nrows; Irow++) {
+        row_start[Irow] = run_begin.size();
+
+        const size_t row_offset = (size_t) Irow * Nlon;
+        int Ilon = 0;
+        while (Ilon < Nlon) {
+            // Skip over land
+            while ( (Ilon < Nlon) and not(mask[row_offset + Ilon]) ) { Ilon++; }
+            if (Ilon == Nlon) { break; }
+
+            // And then find the end of the water run
+            run_begin.push_back( Ilon );
+            while ( (Ilon < Nlon) and mask[row_offset + Ilon] ) { Ilon++; }
+            run_end.push_back( Ilon );
+        }
+    }
+    row_start[Nrows] = run_begin.size();
+};
+
+/*!
+ * \brief Get the water intervals within a contiguous range of longitudes of one row
+ *
+ * On return, lo[II] <= Ilon < hi[II] are the water cells within [LON_start, LON_start + Ncells),
+ *    given as offsets relative to LON_start.
+ *
+ * @param[in,out]   lo,hi       where to store the intervals (cleared first)
+ * @param[in]       Irow        row index ( (Itime * Ndepth + Idepth) * Nlat + Ilat )
+ * @param[in]       LON_start   first longitude of the range (must be in [0, Nlon) )
+ * @param[in]       Ncells      number of cells in the range (must not pass Nlon)
+ *
+ */
+void water_runs::runs_in_range(
+        std::vector<int> & lo,
+        std::vector<int> & hi,
+        const size_t Irow,
+        const int LON_start,
+        const int Ncells
+        ) const {
+
+    lo.clear();
+    hi.clear();
+
+    const int LON_end = LON_start + Ncells;
+
+    // First run that ends after the start of the range
+    const int * ends  = run_end.data();
+    size_t Irun = std::upper_bound( ends + row_start[Irow], ends + row_start[Irow+1], LON_start ) - ends;
+
+    for ( ; (Irun < row_start[Irow+1]) and (run_begin[Irun] < LON_end); Irun++) {
+        lo.push_back( std::max( run_begin[Irun], LON_start ) - LON_start );
+        hi.push_back( std::min( run_end[Irun],   LON_end   ) - LON_start );
+    }
+};
+
+/*!
+ * \brief Fraction of the cells that are water
+ */
+double water_runs::water_fraction() const {
+    if (Nrows == 0) { return 0.; }
+    size_t Nwater = 0;
+    for (size_t Irun = 0; Irun < run_begin.size(); Irun++) { Nwater += run_end[Irun] - run_begin[Irun]; }
+    return (double) Nwater / ( (double) Nrows * Nlon );
+};
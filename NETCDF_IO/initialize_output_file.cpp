@@ -178,6 +178,7 @@ void initialize_output_file(
     if (constants::COMP_BC_TRANSFERS) {
         add_attr_to_file("KernPad",                             (double) constants::KernPad,    filename);
     }
+    add_attr_to_file("KERNEL_TRUNCATION_TOLERANCE",             constants::KERNEL_TRUNCATION_TOLERANCE, filename);
 
     #if DEBUG >= 2
     if (wRank == 0) { fprintf(stdout, "\n"); }
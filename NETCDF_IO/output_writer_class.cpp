@@ -0,0 +1,267 @@
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <mpi.h>
+#include "../netcdf_io.hpp"
+#include "../constants.hpp"
+
+/*!
+ * \brief Class constructor (collective over comm_in)
+ *
+ * If use_io_thread is true (and MPI provides MPI_THREAD_MULTIPLE), then
+ * the IO thread is started with a duplicate of comm_in.
+ *
+ * @param[in]   comm_in         MPI communicator used for the output files
+ * @param[in]   use_io_thread   boolean indicating if the operations should run on a background thread (default ASYNC_OUTPUT)
+ *
+ */
+output_writer::output_writer( const MPI_Comm comm_in, const bool use_io_thread ) {
+
+    comm    = comm_in;
+    io_comm = comm_in;
+
+    if (use_io_thread) {
+        int thread_safety_provided;
+        MPI_Query_thread( &thread_safety_provided );
+
+        if ( thread_safety_provided == MPI_THREAD_MULTIPLE ) {
+            MPI_Comm_dup( comm, &io_comm );
+            use_thread = true;
+            io_thread = std::thread( &output_writer::io_loop, this );
+        } else {
+            #if DEBUG >= 0
+            int wRank;
+            MPI_Comm_rank( comm, &wRank );
+            if (wRank == 0) { fprintf(stdout, " WARNING!! Background IO needs MPI_THREAD_MULTIPLE, running synchronously instead.\n"); }
+            #endif
+        }
+    }
+};
+
+// Class destructor: finish the queued operations, and then stop the IO thread
+output_writer::~output_writer() {
+    if (use_thread) {
+        flush();
+        {
+            std::lock_guard<std::mutex> lock( queue_mutex );
+            stop_requested = true;
+        }
+        queue_cv.notify_all();
+        io_thread.join();
+        MPI_Comm_free( &io_comm );
+    }
+};
+
+/*!
+ * \brief Queue an operation for the IO thread (or run it now if not using a thread)
+ *
+ * If the queued fields would pass constants::ASYNC_OUTPUT_MAX_GB, then wait until the IO
+ * thread has written enough of them (a lone field is always accepted).
+ *
+ * @param[in]   task        operation to run
+ * @param[in]   Nbytes      size of the field data held by the operation
+ *
+ */
+void output_writer::submit( std::function<void()> task, const size_t Nbytes ) {
+
+    if (not(use_thread)) {
+        task();
+        return;
+    }
+
+    const double max_bytes = constants::ASYNC_OUTPUT_MAX_GB * 1024. * 1024. * 1024.;
+
+    std::unique_lock<std::mutex> lock( queue_mutex );
+    queue_cv.wait( lock, [&]{ return (queued_bytes == 0) or ( (double)(queued_bytes + Nbytes) <= max_bytes ); } );
+
+    tasks.push_back( std::move(task) );
+    task_bytes.push_back( Nbytes );
+    queued_bytes += Nbytes;
+
+    lock.unlock();
+    queue_cv.notify_all();
+};
+
+// Main loop of the IO thread: run the queued operations in order until asked to stop
+void output_writer::io_loop() {
+
+    std::unique_lock<std::mutex> lock( queue_mutex );
+    while (true) {
+        queue_cv.wait( lock, [&]{ return stop_requested or (tasks.size() > 0); } );
+        if ( tasks.size() == 0 ) { break; }
+
+        std::function<void()> task = std::move( tasks.front() );
+        const size_t Nbytes = task_bytes.front();
+        tasks.pop_front();
+        task_bytes.pop_front();
+        is_busy = true;
+
+        lock.unlock();
+        task();
+        task = nullptr; // release the field copy before reporting the bytes as freed
+        lock.lock();
+
+        queued_bytes -= Nbytes;
+        is_busy = false;
+        queue_cv.notify_all();
+    }
+};
+
+/*!
+ * \brief Queue some other operation (e.g. prefetching inputs) to run, in order, with the output operations
+ *
+ * Any netcdf calls in task that are collective must be over a communicator that is only used by the
+ * queued operations (since they run on the IO thread), and must be queued in the same order on every processor.
+ *
+ * @param[in]   task        operation to run
+ *
+ */
+void output_writer::enqueue( std::function<void()> task ) {
+    submit( std::move(task), 0 );
+};
+
+/*!
+ * \brief Only write the rows [ first_row, end_row ) of the four-dimensional fields with Nlat latitudes
+ *
+ * This is for when each processor only has valid values in its own band of latitudes (see latitude_bands),
+ * and so each processor writes a different part of the file. Use first_row = 0 and end_row = Nlat to go
+ * back to writing every row.
+ *
+ * @param[in]   first_row   first latitude row to write
+ * @param[in]   end_row     one past the last latitude row to write
+ * @param[in]   Nlat        number of latitudes in the fields
+ *
+ */
+void output_writer::set_latitude_band(
+        const int first_row,
+        const int end_row,
+        const int Nlat
+        ) {
+
+    band_start  = first_row;
+    band_end    = end_row;
+    band_Nlat   = ( (first_row == 0) and (end_row == Nlat) ) ? -1 : Nlat;
+};
+
+/*!
+ * \brief Wait until every queued operation has finished
+ */
+void output_writer::flush() {
+    if (not(use_thread)) { return; }
+
+    std::unique_lock<std::mutex> lock( queue_mutex );
+    queue_cv.wait( lock, [&]{ return (tasks.size() == 0) and not(is_busy); } );
+};
+
+/*!
+ * \brief Queue the creation of an output file (see initialize_output_file)
+ *
+ * source_data must not be modified until the operation has finished.
+ *
+ * @param[in]   source_data     dataset class storing dimension information
+ * @param[in]   vars            name of variables to write
+ * @param[in]   filename        name for the output file
+ * @param[in]   filter_scale    lengthscale used in the filter
+ *
+ */
+void output_writer::initialize_file(
+        const dataset & source_data,
+        const std::vector<std::string> & vars,
+        const char * filename,
+        const double filter_scale
+        ) {
+
+    const dataset * data_ptr = &source_data;
+    const std::string fname( filename );
+    submit( [this, data_ptr, vars, fname, filter_scale]{
+                initialize_output_file( *data_ptr, vars, fname.c_str(), filter_scale, io_comm );
+            }, 0 );
+};
+
+/*!
+ * \brief Queue adding a (double) attribute to a file (see add_attr_to_file)
+ *
+ * @param[in]   varname     name of the attribute
+ * @param[in]   value       value of the attribute
+ * @param[in]   filename    name of the file to modify
+ *
+ */
+void output_writer::add_attr(
+        const char * varname,
+        const double value,
+        const char * filename
+        ) {
+
+    const std::string vname( varname ), fname( filename );
+    submit( [this, vname, value, fname]{
+                add_attr_to_file( vname.c_str(), value, fname.c_str(), io_comm );
+            }, 0 );
+};
+
+/*!
+ * \brief Queue writing a field (see write_field_to_output)
+ *
+ * The field, start, and count are copied, so they can be changed as soon as this returns.
+ * The mask is not copied, and so must not be modified until the operation has finished
+ * (unless only a latitude band is written, in which case those rows of the mask are copied).
+ *
+ * @param[in]   field           data to be written to the file
+ * @param[in]   field_name      name of the variable in the netcdf file
+ * @param[in]   start           starting indices for the write
+ * @param[in]   count           size of the write in each dimension
+ * @param[in]   filename        name of the netcdf file
+ * @param[in]   mask            (pointer to) mask that distinguishes land/water cells (default is NULL)
+ * @param[in]   ndims           number of entries in start and count (default 4)
+ *
+ */
+void output_writer::write(
+        const std::vector<double> & field,
+        const std::string & field_name,
+        const size_t * start,
+        const size_t * count,
+        const std::string & filename,
+        const std::vector<bool> * mask,
+        const int ndims
+        ) {
+
+    std::vector<size_t> start_copy( start, start + ndims ),
+                        count_copy( count, count + ndims );
+
+    // If only a band of latitudes is valid, then pull out (and write) just those rows
+    const bool write_band =     ( band_Nlat >= 0 ) and ( ndims == 4 ) and ( count[2] == (size_t) band_Nlat )
+                            and ( field.size() == count[0] * count[1] * count[2] * count[3] )
+                            and ( (mask == NULL) or ( mask->size() == field.size() ) );
+    std::vector<double> band_field;
+    std::vector<bool> band_mask;
+    if (write_band) {
+        const size_t Nlevels = count[0] * count[1],
+                     Nlon    = count[3],
+                     Nrows   = band_end - band_start;
+        band_field.resize( Nlevels * Nrows * Nlon );
+        if (mask != NULL) { band_mask.resize( band_field.size() ); }
+        for (size_t Ilev = 0; Ilev < Nlevels; Ilev++) {
+            const size_t src = ( Ilev * band_Nlat + band_start ) * Nlon,
+                         dst = Ilev * Nrows * Nlon;
+            std::copy( field.begin() + src, field.begin() + src + Nrows * Nlon, band_field.begin() + dst );
+            if (mask != NULL) { std::copy( mask->begin() + src, mask->begin() + src + Nrows * Nlon, band_mask.begin() + dst ); }
+        }
+        start_copy[2] += band_start;
+        count_copy[2]  = Nrows;
+    }
+    const bool use_band_mask = write_band and (mask != NULL);
+
+    if (not(use_thread)) {
+        write_field_to_output( write_band ? band_field : field, field_name, start_copy.data(), count_copy.data(), 
+                               filename, use_band_mask ? &band_mask : mask, io_comm );
+        return;
+    }
+
+    std::vector<double> field_copy = write_band ? std::move( band_field ) : field;
+    const size_t Nbytes = field_copy.size() * sizeof(double);
+
+    submit( [this, field_copy = std::move(field_copy), band_mask = std::move(band_mask), use_band_mask,
+             field_name, start_copy, count_copy, filename, mask]{
+                write_field_to_output( field_copy, field_name, start_copy.data(), count_copy.data(), filename, 
+                                       use_band_mask ? &band_mask : mask, io_comm );
+            }, Nbytes );
+};
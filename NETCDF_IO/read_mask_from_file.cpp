@@ -21,6 +21,10 @@
  *  @param[in]      force_split_dim     Dimension along which data splitting should be force
  *  @param[in]      land_fill_value     Value to place at 'land' areas, if needed
  *  @param[in]      comm                the MPI communicator world
+ *  @param[in]      time_split_starts   first time index for each processor in time, plus the total (NULL or empty for even divisions)
+ *  @param[in]      depth_split_starts  first depth index for each processor in depth, plus the total (NULL or empty for even divisions)
+ *  @param[in]      Itime_window        which window of this processor's times to read (see Ntime_windows)
+ *  @param[in]      Ntime_windows       number of windows that this processor's times are divided into (1 reads all of them)
  *
  */
 
@@ -33,7 +37,11 @@ void read_mask_from_file(
         const bool do_splits,
         const int force_split_dim,
         const double land_fill_value,
-        const MPI_Comm comm
+        const MPI_Comm comm,
+        const std::vector<int> * time_split_starts,
+        const std::vector<int> * depth_split_starts,
+        const int Itime_window,
+        const int Ntime_windows
         ) {
 
     assert( check_file_existence( filename.c_str() ) );
@@ -99,6 +107,7 @@ void read_mask_from_file(
     size_t num_pts = 1;
     int my_count, overflow,
         Itime_proc, Idepth_proc, Ilat_proc, Ilon_proc;
+    const std::vector<int> * split_starts;
     for (int II = 0; II < num_dims; II++) {
         start[II] = 0;
         retval = nc_inq_dim(ncid, dim_ids[II] , NULL, &count[II]);
@@ -127,25 +136,45 @@ void read_mask_from_file(
                 else if ( II == 1 ) { Nprocs_in_dim = Nprocs_in_depth;  }
                 else                { Nprocs_in_dim = 0; assert(false); }  // II <= 1 so won't happen
 
-                my_count = ( (int)count[II] ) / Nprocs_in_dim;
-                overflow = (int)( count[II] - my_count * Nprocs_in_dim );
-
                 Index1to4( wRank, Itime_proc,      Idepth_proc,     Ilat_proc, Ilon_proc,
                                   Nprocs_in_time,  Nprocs_in_depth, 1,         1          );
                 if      ( II == 0 ) { Iproc_in_dim = Itime_proc;        }
                 else if ( II == 1 ) { Iproc_in_dim = Idepth_proc;       }
                 else                { Iproc_in_dim = -1; assert(false); }  // II <= 1 so won't happen
 
-                start[II] = (size_t) (   
-                          std::min(Iproc_in_dim,            overflow) * (my_count + 1)
-                        + std::max(Iproc_in_dim - overflow, 0       ) *  my_count
-                        );
-
-                // Distribute the remainder over the first chunk of processors
-                if (wRank < overflow) { my_count++; }
+                split_starts = ( II == 0 ) ? time_split_starts : depth_split_starts;
+                if ( (split_starts != NULL) and ( (int)split_starts->size() == Nprocs_in_dim + 1 ) ) {
+                    // Use the provided (possibly irregular) divisions
+                    assert( split_starts->back() == (int)count[II] );
+                    start[II] = (size_t) split_starts->at(Iproc_in_dim);
+                    my_count  = split_starts->at(Iproc_in_dim + 1) - split_starts->at(Iproc_in_dim);
+                } else {
+                    my_count = ( (int)count[II] ) / Nprocs_in_dim;
+                    overflow = (int)( count[II] - my_count * Nprocs_in_dim );
+
+                    start[II] = (size_t) (   
+                              std::min(Iproc_in_dim,            overflow) * (my_count + 1)
+                            + std::max(Iproc_in_dim - overflow, 0       ) *  my_count
+                            );
+
+                    // Distribute the remainder over the first chunk of processors
+                    if (Iproc_in_dim < overflow) { my_count++; }
+                }
                 count[II] = (size_t) my_count;
             }
         }
+
+        // Optionally, only read one window of this processor's times (see dataset::set_time_windows)
+        if ( (II == 0) and (num_dims > 2) and (Ntime_windows > 1) ) {
+            my_count = ( (int)count[II] ) / Ntime_windows;
+            overflow = (int)( count[II] - my_count * Ntime_windows );
+            start[II] += (size_t) (
+                      std::min(Itime_window,            overflow) * (my_count + 1)
+                    + std::max(Itime_window - overflow, 0       ) *  my_count
+                    );
+            if (Itime_window < overflow) { my_count++; }
+            count[II] = (size_t) my_count;
+        }
         num_pts *= count[II];
 
     }
@@ -64,7 +64,7 @@ void write_field_to_output(
         if (wRank == 0) { fprintf(stdout, "    Preparing to package the field.\n"); }
         fflush(stdout);
         #endif
-        package_field(reduced_field, scale_factor, add_offset, field, mask);
+        package_field(reduced_field, scale_factor, add_offset, field, mask, comm);
 
         // We need to record the scale and translation used to encode in signed shorts
         retval = nc_put_att_double( ncid, field_varid, "scale_factor", NC_DOUBLE, 1, &scale_factor );
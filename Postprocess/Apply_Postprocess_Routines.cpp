@@ -17,7 +17,8 @@ void Apply_Postprocess_Routines(
         const double filter_scale,
         Timing_Records & timing_records,
         const std::string filename_base,
-        const MPI_Comm comm
+        const MPI_Comm comm,
+        const latitude_bands * bands
         ) {
 
     // Create some tidy names for variables
@@ -30,6 +31,11 @@ void Apply_Postprocess_Routines(
                 Nlat   = source_data.Nlat,
                 Nlon   = source_data.Nlon;
 
+    // With latitude bands, the fields are only valid within this processor's band,
+    //   and so each processor only processes those rows (and then they are combined)
+    const int   Ilat_start  = (bands == NULL) ? 0    : bands->first_row(),
+                Ilat_end    = (bands == NULL) ? Nlat : bands->end_row();
+
     // Timer clock variable
     double clock_on;
 
@@ -81,16 +87,27 @@ void Apply_Postprocess_Routines(
     } else {
         snprintf(filename, 50, (filename_base + ".nc").c_str());
     }
-    initialize_postprocess_file(
-            source_data, OkuboWeiss_dim_vals, vars_to_process,
-            filename, filter_scale, do_OkuboWeiss
-            );
+    //   (when streaming through time, it already exists after the first window)
+    if (source_data.Itime_window == 0) {
+        initialize_postprocess_file(
+                source_data, OkuboWeiss_dim_vals, vars_to_process,
+                filename, filter_scale, do_OkuboWeiss
+                );
 
-    // Add some attributes to the file
-    const double kern_alpha = kernel_alpha();
-    add_attr_to_file("kernel_alpha", 
-            kern_alpha * pow(filter_scale, 2), 
-            filename);
+        // Add some attributes to the file
+        const double kern_alpha = kernel_alpha();
+        add_attr_to_file("kernel_alpha", 
+                kern_alpha * pow(filter_scale, 2), 
+                filename);
+    } else {
+        // The region areas depend on time (through the mask), so add them for this window
+        size_t start_r[] = { (size_t) Stime, (size_t) Sdepth, 0 },
+               count_r[] = { (size_t) Ntime, (size_t) Ndepth, (size_t) num_regions };
+        write_field_to_output( source_data.region_areas, "region_areas", start_r, count_r, filename, NULL);
+        if (constants::FILTER_OVER_LAND) {
+            write_field_to_output( source_data.region_areas_water_only, "region_areas_water_only", start_r, count_r, filename, NULL);
+        }
+    }
 
     //
     //// Region averages and standard deviations
@@ -106,7 +123,7 @@ void Apply_Postprocess_Routines(
         field_std_devs(num_fields, std::vector<double>(Ntime * Ndepth * num_regions, 0.));
 
     if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
-    compute_region_avg_and_std( field_averages, field_std_devs, source_data, postprocess_fields );
+    compute_region_avg_and_std( field_averages, field_std_devs, source_data, postprocess_fields, comm, bands );
     if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "postprocess_area_means");  }
 
     #if DEBUG >= 1
@@ -137,8 +154,8 @@ void Apply_Postprocess_Routines(
             zonal_medians(num_fields, std::vector<double>(Ntime * Ndepth * Nlat, 0.));
 
         if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
-        compute_zonal_avg_and_std( zonal_averages, zonal_std_devs, source_data, postprocess_fields );
-        compute_zonal_median( zonal_medians, source_data, postprocess_fields );
+        compute_zonal_avg_and_std( zonal_averages, zonal_std_devs, source_data, postprocess_fields, comm, bands );
+        compute_zonal_median( zonal_medians, source_data, postprocess_fields, comm, bands );
         if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "postprocess_zonal_means");  }
 
         #if DEBUG >= 1
@@ -175,7 +192,7 @@ void Apply_Postprocess_Routines(
         if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
         compute_region_avg_and_std_OkuboWeiss(
                 field_averages_OW, field_std_devs_OW, OkuboWeiss_areas, 
-                source_data, postprocess_fields, OkuboWeiss, OkuboWeiss_dim_vals, N_Okubo
+                source_data, postprocess_fields, OkuboWeiss, OkuboWeiss_dim_vals, N_Okubo, comm, bands
                 );
         if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "postprocess_OkuboWeiss_histogrames");  }
 
@@ -206,7 +223,7 @@ void Apply_Postprocess_Routines(
             coarsened_maps(num_fields, std::vector<double>(Ntime * Ndepth * source_data.coarse_map_lat.size() * source_data.coarse_map_lon.size(), 0.));
 
         if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
-        compute_coarsened_map( coarsened_maps, source_data, postprocess_fields );
+        compute_coarsened_map( coarsened_maps, source_data, postprocess_fields, comm, bands );
         if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "postprocess_coarse_maps");  }
 
         #if DEBUG >= 1
@@ -238,7 +255,7 @@ void Apply_Postprocess_Routines(
         #pragma omp parallel default(none) \
         private( index, area_index, Itime, Idepth, Ilat, Ilon ) \
         shared( mask_count_loc, mask ) \
-        firstprivate( Nlon, Nlat, Ndepth, Ntime )
+        firstprivate( Nlon, Nlat, Ndepth, Ntime, Ilat_start, Ilat_end )
         { 
             #pragma omp for collapse(1) schedule(static)
             for (index = 0; index < mask.size(); ++index) {
@@ -249,7 +266,8 @@ void Apply_Postprocess_Routines(
                         1, Ndepth, Nlat, Nlon);
 
                 // Add up the number of times a cell is water (not masked)
-                if ( mask.at(index) ) { mask_count_loc.at(area_index) = mask_count_loc.at(area_index) + 1; }
+                //   (rows outside of this band are counted by the other bands in the reduction)
+                if ( mask.at(index) and (Ilat >= Ilat_start) and (Ilat < Ilat_end) ) { mask_count_loc.at(area_index) = mask_count_loc.at(area_index) + 1; }
             }
         }
         MPI_Allreduce( &(mask_count_loc[0]), &(mask_count[0]), Ndepth * Nlat * Nlon, MPI_INT, MPI_SUM, source_data.MPI_subcomm_samedepths );
@@ -278,7 +296,7 @@ void Apply_Postprocess_Routines(
             time_std_dev.at( Ifield ).resize( Ndepth * Nlat * Nlon, 0. );
         }
 
-        compute_time_avg_std( time_average, time_std_dev, source_data, postprocess_fields, mask_count, always_masked, full_Ntime );
+        compute_time_avg_std( time_average, time_std_dev, source_data, postprocess_fields, mask_count, always_masked, full_Ntime, bands );
         if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "postprocess_time_means");  }
 
         #if DEBUG >= 1
@@ -13,7 +13,8 @@ void compute_coarsened_map(
         std::vector< std::vector< double > > & coarsened_maps,
         const dataset & source_data,
         const std::vector<const std::vector<double>*> & postprocess_fields,
-        const MPI_Comm comm
+        const MPI_Comm comm,
+        const latitude_bands * bands
         ) {
 
     const int   Ntime   = source_data.Ntime,
@@ -21,6 +22,11 @@ void compute_coarsened_map(
                 Nlat    = source_data.Nlat,
                 Nlon    = source_data.Nlon;
 
+    // With latitude bands, each processor only adds up the rows in its own band (but the
+    //   areas of the coarse cells still include every row)
+    const int   Ilat_start  = (bands == NULL) ? 0    : bands->first_row(),
+                Ilat_end    = (bands == NULL) ? Nlat : bands->end_row();
+
     const std::vector<double>   &latitude   = source_data.latitude,
                                 &longitude  = source_data.longitude,
                                 &coarse_latitude = source_data.coarse_map_lat,
@@ -108,7 +114,7 @@ void compute_coarsened_map(
                 Idepth, Itime, lat_LB, lat_UB, lon_LB, lon_UB )\
         shared( source_data, Ifield, coarsened_maps, postprocess_fields, latitude, longitude, \
                 coarse_latitude, coarse_longitude, coarsened_areas ) \
-        firstprivate( Nlon, Nlat, Ndepth, Ntime, Nlat_coarse, Nlon_coarse )
+        firstprivate( Nlon, Nlat, Ndepth, Ntime, Nlat_coarse, Nlon_coarse, Ilat_start, Ilat_end )
         { 
             #pragma omp for collapse(4) schedule(static)
             for (Itime = 0; Itime < Ntime; ++Itime) {
@@ -135,7 +141,7 @@ void compute_coarsened_map(
                             coarse_index = Index(Itime, Idepth, Ilat_coarse, Ilon_coarse, Ntime, Ndepth, Nlat_coarse, Nlon_coarse);
                             dA_coarse = coarsened_areas.at(coarse_index);
 
-                            for ( Ilat = lat_LB; Ilat < lat_UB; Ilat++ ) {
+                            for ( Ilat = std::max( lat_LB, Ilat_start ); Ilat < std::min( lat_UB, Ilat_end ); Ilat++ ) {
                                 for ( Ilon = lon_LB; Ilon < lon_UB; Ilon++ ) {
                                     index = Index(Itime, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon);
                                     is_water = source_data.mask.at(index);
@@ -157,6 +163,7 @@ void compute_coarsened_map(
                 }
             }
         }
+        if (bands != NULL) { bands->sum_across_bands( coarsened_maps.at(Ifield) ); }
     }
 
 }
@@ -21,7 +21,8 @@ void compute_region_avg_and_std(
         std::vector< std::vector< double > > & field_std_devs,
         const dataset & source_data,
         const std::vector<const std::vector<double>*> & postprocess_fields,
-        const MPI_Comm comm
+        const MPI_Comm comm,
+        const latitude_bands * bands
         ) {
 
     const int   Ntime   = source_data.Ntime,
@@ -29,6 +30,10 @@ void compute_region_avg_and_std(
                 Nlat    = source_data.Nlat,
                 Nlon    = source_data.Nlon;
 
+    // With latitude bands, each processor only integrates over the rows in its own band
+    const int   Ilat_start  = (bands == NULL) ? 0    : bands->first_row(),
+                Ilat_end    = (bands == NULL) ? Nlat : bands->end_row();
+
     const int   num_regions   = source_data.region_names.size(),
                 num_fields    = postprocess_fields.size();
 
@@ -56,14 +61,14 @@ void compute_region_avg_and_std(
         private(Ilat, Ilon, index, dA, area_index, increment, int_index, \
                 Idepth, Itime, Iregion )\
         shared( source_data, Ifield, postprocess_fields, stderr) \
-        firstprivate( Nlon, Nlat, Ndepth, Ntime, num_regions ) \
+        firstprivate( Nlon, Nlat, Ndepth, Ntime, num_regions, Ilat_start, Ilat_end ) \
         reduction(vec_double_plus : field_integrals)
         { 
             #pragma omp for collapse(5) schedule(static)
             for (Iregion = 0; Iregion < num_regions; ++Iregion) {
                 for (Itime = 0; Itime < Ntime; ++Itime) {
                     for (Idepth = 0; Idepth < Ndepth; ++Idepth) {
-                        for (Ilat = 0; Ilat < Nlat; ++Ilat) {
+                        for (Ilat = Ilat_start; Ilat < Ilat_end; ++Ilat) {
                             for (Ilon = 0; Ilon < Nlon; ++Ilon) {
                                 int_index = Index(0, Itime, Idepth, Iregion, 1, Ntime, Ndepth, num_regions);
                                 index = Index(Itime, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon);
@@ -89,6 +94,8 @@ void compute_region_avg_and_std(
                 }
             }
         }
+        if (bands != NULL) { bands->sum_across_bands( field_integrals ); }
+
         #pragma omp parallel default(none) \
         private( int_index, reg_area ) \
         shared( field_integrals, field_averages, source_data ) \
@@ -121,14 +128,14 @@ void compute_region_avg_and_std(
         private(Ilat, Ilon, index, dA, area_index, increment, int_index, \
                 Idepth, Itime, Iregion )\
         shared( source_data, Ifield, postprocess_fields, field_averages ) \
-        firstprivate( Nlon, Nlat, Ndepth, Ntime, num_regions ) \
+        firstprivate( Nlon, Nlat, Ndepth, Ntime, num_regions, Ilat_start, Ilat_end ) \
         reduction(vec_double_plus : field_integrals)
         { 
             #pragma omp for collapse(5) schedule(static)
             for (Iregion = 0; Iregion < num_regions; ++Iregion) {
                 for (Itime = 0; Itime < Ntime; ++Itime) {
                     for (Idepth = 0; Idepth < Ndepth; ++Idepth) {
-                        for (Ilat = 0; Ilat < Nlat; ++Ilat) {
+                        for (Ilat = Ilat_start; Ilat < Ilat_end; ++Ilat) {
                             for (Ilon = 0; Ilon < Nlon; ++Ilon) {
                                 int_index = Index(0, Itime, Idepth, Iregion, 1, Ntime, Ndepth, num_regions);
                                 index = Index(Itime, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon);
@@ -152,6 +159,8 @@ void compute_region_avg_and_std(
                 }
             }
         }
+        if (bands != NULL) { bands->sum_across_bands( field_integrals ); }
+
         for (int_index = 0; int_index < field_integrals.size(); int_index++) {
             reg_area = source_data.region_areas.at(int_index);
             field_std_devs.at(Ifield).at(int_index) = (reg_area == 0) ? 0. : sqrt( field_integrals.at(int_index) / reg_area );
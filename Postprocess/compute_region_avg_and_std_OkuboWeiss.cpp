@@ -23,7 +23,8 @@ void compute_region_avg_and_std_OkuboWeiss(
         const std::vector<double> & OkuboWeiss,
         const std::vector<double> & OkuboWeiss_bounds,
         const int NOkubo,
-        const MPI_Comm comm
+        const MPI_Comm comm,
+        const latitude_bands * bands
         ) {
 
     //fprintf( stdout, " %zu, %zu, %g, %g, %zu\n ", OkuboWeiss.size(), 
@@ -35,6 +36,10 @@ void compute_region_avg_and_std_OkuboWeiss(
                 Nlat    = source_data.Nlat,
                 Nlon    = source_data.Nlon;
 
+    // With latitude bands, each processor only integrates over the rows in its own band
+    const int   Ilat_start  = (bands == NULL) ? 0    : bands->first_row(),
+                Ilat_end    = (bands == NULL) ? Nlat : bands->end_row();
+
     const int   num_regions   = source_data.region_names.size(),
                 num_fields    = postprocess_fields.size();
 
@@ -60,14 +65,14 @@ void compute_region_avg_and_std_OkuboWeiss(
     #pragma omp parallel default(none)\
     private( Iregion, Itime, Idepth, Ilat, Ilon, IOkubo, index, area_index, int_index, dA )\
     shared( source_data, OkuboWeiss, OkuboWeiss_bounds ) \
-    firstprivate( Nlon, Nlat, Ndepth, Ntime, NOkubo, num_regions ) \
+    firstprivate( Nlon, Nlat, Ndepth, Ntime, NOkubo, num_regions, Ilat_start, Ilat_end ) \
     reduction(vec_double_plus : area_sums)
     { 
         #pragma omp for collapse(5) schedule(static)
         for (Iregion = 0; Iregion < num_regions; ++Iregion) {
             for (Itime = 0; Itime < Ntime; ++Itime) {
                 for (Idepth = 0; Idepth < Ndepth; ++Idepth) {
-                    for (Ilat = 0; Ilat < Nlat; ++Ilat) {
+                    for (Ilat = Ilat_start; Ilat < Ilat_end; ++Ilat) {
                         for (Ilon = 0; Ilon < Nlon; ++Ilon) {
 
                             index = Index(Itime, Idepth, Ilat, Ilon,
@@ -94,6 +99,7 @@ void compute_region_avg_and_std_OkuboWeiss(
             }
         }
     }
+    if (bands != NULL) { bands->sum_across_bands( area_sums ); }
 
     #pragma omp parallel default(none) \
     private( int_index ) \
@@ -125,14 +131,14 @@ void compute_region_avg_and_std_OkuboWeiss(
         private( Iregion, Itime, Idepth, Ilat, Ilon, IOkubo,\
                 index, area_index, int_index, dA )\
         shared( source_data, postprocess_fields, OkuboWeiss, OkuboWeiss_bounds ) \
-        firstprivate( Ifield, Nlon, Nlat, Ndepth, Ntime, NOkubo, num_regions ) \
+        firstprivate( Ifield, Nlon, Nlat, Ndepth, Ntime, NOkubo, num_regions, Ilat_start, Ilat_end ) \
         reduction(vec_double_plus : field_integrals)
         { 
             #pragma omp for collapse(5) schedule(static)
             for (Iregion = 0; Iregion < num_regions; ++Iregion) {
                 for (Itime = 0; Itime < Ntime; ++Itime) {
                     for (Idepth = 0; Idepth < Ndepth; ++Idepth) {
-                        for (Ilat = 0; Ilat < Nlat; ++Ilat) {
+                        for (Ilat = Ilat_start; Ilat < Ilat_end; ++Ilat) {
                             for (Ilon = 0; Ilon < Nlon; ++Ilon) {
 
                                 index = Index(Itime, Idepth, Ilat, Ilon,
@@ -159,6 +165,8 @@ void compute_region_avg_and_std_OkuboWeiss(
                 }
             }
         }
+        if (bands != NULL) { bands->sum_across_bands( field_integrals ); }
+
         #if DEBUG >= 2
         if (wRank == 0) { fprintf(stdout, "    copying results for field %d of %d to outputs\n", Ifield + 1, num_fields); }
         #endif
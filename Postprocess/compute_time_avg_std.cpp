@@ -15,7 +15,8 @@ void compute_time_avg_std(
         const std::vector<const std::vector<double>*> & postprocess_fields,
         const std::vector<int> & mask_count,
         const std::vector<bool> & always_masked,
-        const int full_Ntime
+        const int full_Ntime,
+        const latitude_bands * bands
         ){
 
     //MPI_Comm &comm = source_data.MPI_Comm_Global;
@@ -30,6 +31,11 @@ void compute_time_avg_std(
                 Nlat   = source_data.Nlat,
                 Nlon   = source_data.Nlon;
 
+    // With latitude bands, each processor only adds up the rows in its own band, and the
+    //   reduction below (which includes every band) fills in the rest
+    const int   Ilat_start  = (bands == NULL) ? 0    : bands->first_row(),
+                Ilat_end    = (bands == NULL) ? Nlat : bands->end_row();
+
     const int num_fields = postprocess_fields.size();
 
     int Ifield, Itime, Idepth, Ilat, Ilon;
@@ -45,10 +51,10 @@ void compute_time_avg_std(
     #pragma omp parallel default(none)\
     private(Ifield, Ilat, Ilon, Itime, Idepth, index, space_index )\
     shared(postprocess_fields, source_data, always_masked, mask_count, time_average_loc) \
-    firstprivate( Nlon, Nlat, Ndepth, Ntime, num_fields )
+    firstprivate( Nlon, Nlat, Ndepth, Ntime, num_fields, Ilat_start, Ilat_end )
     { 
         #pragma omp for collapse(3) schedule(guided)
-        for (Ilat = 0; Ilat < Nlat; ++Ilat){
+        for (Ilat = Ilat_start; Ilat < Ilat_end; ++Ilat){
             for (Ilon = 0; Ilon < Nlon; ++Ilon){
                 for (Idepth = 0; Idepth < Ndepth; ++Idepth){
 
@@ -13,7 +13,8 @@ void compute_zonal_median(
         std::vector<std::vector<double>> & zonal_median,
         const dataset & source_data,
         const std::vector<const std::vector<double>*> & postprocess_fields,
-        const MPI_Comm comm
+        const MPI_Comm comm,
+        const latitude_bands * bands
         ){
 
     int wRank=-1, wSize=-1;
@@ -25,6 +26,10 @@ void compute_zonal_median(
                 Nlat   = source_data.Nlat,
                 Nlon   = source_data.Nlon;
 
+    // With latitude bands, each processor only computes the rows in its own band
+    const int   Ilat_start  = (bands == NULL) ? 0    : bands->first_row(),
+                Ilat_end    = (bands == NULL) ? Nlat : bands->end_row();
+
     const int num_fields = postprocess_fields.size();
 
     int Ifield, Itime, Idepth, Ilat, Ilon;
@@ -40,14 +45,14 @@ void compute_zonal_median(
     #pragma omp parallel default(none)\
     private( Ifield, Ilat, Ilon, Itime, Idepth, index, int_index, Ipt, lon_slice )\
     shared( postprocess_fields, source_data, zonal_median ) \
-    firstprivate( Nlon, Nlat, Ndepth, Ntime, num_fields )
+    firstprivate( Nlon, Nlat, Ndepth, Ntime, num_fields, Ilat_start, Ilat_end )
     { 
         lon_slice.resize(Nlon);
 
         #pragma omp for collapse(4) schedule(dynamic)
         for (Ifield = 0; Ifield < num_fields; ++Ifield) {
             for (Itime = 0; Itime < Ntime; ++Itime){
-                for (Ilat = 0; Ilat < Nlat; ++Ilat){
+                for (Ilat = Ilat_start; Ilat < Ilat_end; ++Ilat){
                     for (Idepth = 0; Idepth < Ndepth; ++Idepth){
 
                         std::fill( lon_slice.begin(), lon_slice.end(), 0.);
@@ -71,4 +76,9 @@ void compute_zonal_median(
             }
         }
     }
+
+    // The other rows come from the other bands
+    if (bands != NULL) {
+        for (Ifield = 0; Ifield < num_fields; ++Ifield) { bands->sum_across_bands( zonal_median.at(Ifield) ); }
+    }
 }
@@ -7,12 +7,13 @@
 #include <vector>
 #include <omp.h>
 #include <math.h>
+#include <cassert>
 #include "../ALGLIB/stdafx.h"
 #include "../ALGLIB/linalg.h"
 #include "../ALGLIB/solvers.h"
 
 void sparse_vel_from_PsiPhi_vortdiv(
-        alglib::sparsematrix & LHS_matr,
+        crs_matrix & LHS_matr,
         const dataset & source_data,
         const int Itime,
         const int Idepth,
@@ -34,285 +35,346 @@ void sparse_vel_from_PsiPhi_vortdiv(
                 Nlat    = myCounts.at(2),
                 Nlon    = myCounts.at(3);
 
-    int Ilat, Ilon, IDIFF, Idiff, Ndiff, LB;
-    size_t index_sub, diff_index;
     const size_t Npts = Nlat * Nlon;
-    double tmp_val, tan_lat;
-    std::vector<double> diff_vec;
-    bool is_pole;
 
     const double R_inv  = 1. / constants::R_earth,
                  R2_inv = pow( R_inv, 2 );
 
 
-    //
-    ////
-    ////// Add terms for velocity matching
-    ////
-    //
     #if DEBUG >= 1
-    if (wRank == 0) { fprintf( stdout, "  Adding terms to force velocity matching.\n" ); }
+    if (wRank == 0) { fprintf( stdout, "  Assembling the velocity matching and vorticity / divergence terms.\n" ); }
     #endif
 
-    for ( Ilat = 0; Ilat < Nlat; Ilat++ ) {
-        for ( Ilon = 0; Ilon < Nlon; Ilon++ ) {
-            
-            // If we're too close to the pole (less than 0.01 degrees), bad things happen
-            is_pole = std::fabs( std::fabs( latitude.at(Ilat) * 180.0 / M_PI ) - 90 ) < 0.01;
+    // Each grid point produces the entries for its own four rows (index_sub + {0,1,2,3} * Npts)
+    auto point_entries = [&]( std::vector<int> & rows, std::vector<int> & cols, std::vector<double> & vals, const int Iblock ) {
+
+        const int Ilat = Iblock / Nlon,
+                  Ilon = Iblock % Nlon;
 
-            index_sub = Index(0, 0, Ilat, Ilon, 1, 1, Nlat, Nlon);
-            
-            double weight_val = weight_err ? dAreas.at(index_sub) : 1.;
+        int IDIFF, Idiff, Ndiff, LB;
+        size_t diff_index;
+        double tmp_val, tan_lat;
+        std::vector<double> diff_vec;
 
-            double cos_lat_inv = 1. / cos(latitude.at(Ilat));
+        auto add_entry = [&]( const size_t Irow, const size_t Icol, const double val ) {
+            rows.push_back( Irow );
+            cols.push_back( Icol );
+            vals.push_back( val );
+        };
 
-            if ( not(is_pole) ) { // Skip poles
+        //
+        ////
+        ////// Add terms for velocity matching
+        ////
+        //
 
-                //
-                //// LON first derivative part
-                //
+        // If we're too close to the pole (less than 0.01 degrees), bad things happen
+        const bool is_pole = std::fabs( std::fabs( latitude.at(Ilat) * 180.0 / M_PI ) - 90 ) < 0.01;
 
-                LB = - 2 * Nlon;
-                get_diff_vector(diff_vec, LB, longitude, "lon", Itime, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon, mask, 1, constants::DiffOrd);
+        const size_t index_sub = Index(0, 0, Ilat, Ilon, 1, 1, Nlat, Nlon);
 
-                Ndiff = diff_vec.size();
+        const double weight_val = weight_err ? dAreas.at(index_sub) : 1.;
 
-                // If LB is unchanged, then we failed to build a stencil
-                if (LB != - 2 * Nlon) {
-                    for ( IDIFF = LB; IDIFF < LB + Ndiff; IDIFF++ ) {
+        const double cos_lat_inv = 1. / cos(latitude.at(Ilat));
 
-                        if (constants::PERIODIC_X) { Idiff = ( IDIFF % Nlon + Nlon ) % Nlon; }
-                        else                       { Idiff = IDIFF;                          }
+        if ( not(is_pole) ) { // Skip poles
 
-                        diff_index = Index(0, 0, Ilat, Idiff, 1, 1, Nlat, Nlon);
+            //
+            //// LON first derivative part
+            //
 
-                        tmp_val     = diff_vec.at(IDIFF-LB) * cos_lat_inv * R_inv;
-                        tmp_val    *= weight_val;
-                        if (isnan(tmp_val)) { fprintf( stdout, "  Rank %d encountered a NaN at lat/lon %d,%d (codeline %d)\n", wRank, Ilat, Ilon, __LINE__ ); }
+            LB = - 2 * Nlon;
+            get_diff_vector(diff_vec, LB, longitude, "lon", Itime, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon, mask, 1, constants::DiffOrd);
 
-                        // Psi part
-                        size_t  column_skip = 0 * Npts,
-                                row_skip    = 1 * Npts;
-                        alglib::sparseadd(  LHS_matr, row_skip + index_sub, column_skip + diff_index, tmp_val );
+            Ndiff = diff_vec.size();
 
-                        // Phi part
-                        column_skip = 1 * Npts;
-                        row_skip    = 0 * Npts;
-                        alglib::sparseadd(  LHS_matr, row_skip + index_sub, column_skip + diff_index, tmp_val );
-                    }
+            // If LB is unchanged, then we failed to build a stencil
+            if (LB != - 2 * Nlon) {
+                for ( IDIFF = LB; IDIFF < LB + Ndiff; IDIFF++ ) {
+
+                    if (constants::PERIODIC_X) { Idiff = ( IDIFF % Nlon + Nlon ) % Nlon; }
+                    else                       { Idiff = IDIFF;                          }
+
+                    diff_index = Index(0, 0, Ilat, Idiff, 1, 1, Nlat, Nlon);
+
+                    tmp_val     = diff_vec.at(IDIFF-LB) * cos_lat_inv * R_inv;
+                    tmp_val    *= weight_val;
+                    if (isnan(tmp_val)) { fprintf( stdout, "  Rank %d encountered a NaN at lat/lon %d,%d (codeline %d)\n", wRank, Ilat, Ilon, __LINE__ ); }
+
+                    // Psi part
+                    size_t  column_skip = 0 * Npts,
+                            row_skip    = 1 * Npts;
+                    add_entry( row_skip + index_sub, column_skip + diff_index, tmp_val );
+
+                    // Phi part
+                    column_skip = 1 * Npts;
+                    row_skip    = 0 * Npts;
+                    add_entry( row_skip + index_sub, column_skip + diff_index, tmp_val );
                 }
+            }
 
 
-                //
-                //// LAT first derivative part
-                //
+            //
+            //// LAT first derivative part
+            //
 
-                LB = - 2 * Nlat;
-                get_diff_vector(diff_vec, LB, latitude, "lat", Itime, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon, mask, 1, constants::DiffOrd);
+            LB = - 2 * Nlat;
+            get_diff_vector(diff_vec, LB, latitude, "lat", Itime, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon, mask, 1, constants::DiffOrd);
 
-                Ndiff = diff_vec.size();
+            Ndiff = diff_vec.size();
 
-                // If LB is unchanged, then we failed to build a stencil
-                if (LB != - 2 * Nlat) {
-                    for ( IDIFF = LB; IDIFF < LB + Ndiff; IDIFF++ ) {
+            // If LB is unchanged, then we failed to build a stencil
+            if (LB != - 2 * Nlat) {
+                for ( IDIFF = LB; IDIFF < LB + Ndiff; IDIFF++ ) {
 
-                        if (constants::PERIODIC_Y) { Idiff = ( IDIFF % Nlat + Nlat ) % Nlat; }
-                        else                       { Idiff = IDIFF;                          }
+                    if (constants::PERIODIC_Y) { Idiff = ( IDIFF % Nlat + Nlat ) % Nlat; }
+                    else                       { Idiff = IDIFF;                          }
 
-                        diff_index = Index(0, 0, Idiff, Ilon, 1, 1, Nlat,  Nlon);
+                    diff_index = Index(0, 0, Idiff, Ilon, 1, 1, Nlat,  Nlon);
 
-                        tmp_val     = diff_vec.at(IDIFF-LB) * R_inv;
-                        tmp_val    *= weight_val;
-                        if (isnan(tmp_val)) { fprintf( stdout, "  Rank %d encountered a NaN at lat/lon %d,%d (codeline %d)\n", wRank, Ilat, Ilon, __LINE__ ); }
+                    tmp_val     = diff_vec.at(IDIFF-LB) * R_inv;
+                    tmp_val    *= weight_val;
+                    if (isnan(tmp_val)) { fprintf( stdout, "  Rank %d encountered a NaN at lat/lon %d,%d (codeline %d)\n", wRank, Ilat, Ilon, __LINE__ ); }
 
-                        // Psi part
-                        size_t  column_skip = 0 * Npts,
-                                row_skip    = 0 * Npts;
-                        alglib::sparseadd(  LHS_matr, row_skip + index_sub, column_skip + diff_index, -tmp_val );
+                    // Psi part
+                    size_t  column_skip = 0 * Npts,
+                            row_skip    = 0 * Npts;
+                    add_entry( row_skip + index_sub, column_skip + diff_index, -tmp_val );
 
-                        // Phi part
-                        column_skip = 1 * Npts;
-                        row_skip    = 1 * Npts;
-                        alglib::sparseadd(  LHS_matr, row_skip + index_sub, column_skip + diff_index,  tmp_val );
-                    }
+                    // Phi part
+                    column_skip = 1 * Npts;
+                    row_skip    = 1 * Npts;
+                    add_entry( row_skip + index_sub, column_skip + diff_index, tmp_val );
                 }
             }
         }
-    }
 
 
+        //
+        ////
+        ////// Add in Laplace terms to force Phi / Psi to match vorticity and divergence of flow
+        ////
+        //
 
-    //
-    ////
-    ////// Add in Laplace terms to force Phi / Psi to match vorticity and divergence of flow
-    ////
-    //
-    #if DEBUG >= 1
-    if (wRank == 0) { fprintf( stdout, "  Adding Laplace terms to force velocity / divergence matching.\n" ); }
-    #endif
+        const double cos2_lat_inv = pow( cos_lat_inv, 2. );
+        tan_lat = tan( latitude.at(Ilat) );
 
+        if ( ( Ilat == 0 ) and (Tikhov_Laplace == 0) ) {
+            // At the pole-most point, force to be zonally constant. This is to try and remove the null(Laplacian) component
+            //      i.e. force neighbouring points to sum to zero
 
-    for ( Ilat = 0; Ilat < Nlat; Ilat++ ) {
-        for ( Ilon = 0; Ilon < Nlon; Ilon++ ) {
-            
-            // If we're too close to the pole (less than 0.01 degrees), bad things happen
-            is_pole = std::fabs( std::fabs( latitude.at(Ilat) * 180.0 / M_PI ) - 90 ) < 0.01;
+            // i.e. force zero zonal derivative
+            LB = - 2 * Nlon;
+            get_diff_vector(diff_vec, LB, longitude, "lon", Itime, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon, mask, 1, constants::DiffOrd);
 
-            index_sub = Index(0, 0, Ilat, Ilon, 1, 1, Nlat, Nlon);
+            Ndiff = diff_vec.size();
 
-            double weight_val = weight_err ? dAreas.at(index_sub) : 1.;
+            // If LB is unchanged, then we failed to build a stencil
+            if (LB != - 2 * Nlon) {
+                for ( IDIFF = LB; IDIFF < LB + Ndiff; IDIFF++ ) {
 
-            double cos_lat_inv = 1. / cos(latitude.at(Ilat)),
-                   cos2_lat_inv = pow( cos_lat_inv, 2. );
-            tan_lat = tan( latitude.at(Ilat) );
+                    if (constants::PERIODIC_X) { Idiff = ( IDIFF % Nlon + Nlon ) % Nlon; }
+                    else                       { Idiff = IDIFF;                          }
 
-            if ( ( Ilat == 0 ) and (Tikhov_Laplace == 0) ) {
-                // At the pole-most point, force to be zonally constant. This is to try and remove the null(Laplacian) component
-                //      i.e. force neighbouring points to sum to zero
+                    diff_index = Index(0, 0, Ilat, Idiff, 1, 1, Nlat, Nlon);
 
-                // i.e. force zero zonal derivative
-                LB = - 2 * Nlon;
-                get_diff_vector(diff_vec, LB, longitude, "lon", Itime, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon, mask, 1, constants::DiffOrd);
+                    //tmp_val     = diff_vec.at(IDIFF-LB);
+                    tmp_val     = diff_vec.at(IDIFF-LB) * cos_lat_inv * R_inv;
+                    tmp_val    *= weight_val;
+                    if (isnan(tmp_val)) { fprintf( stdout, "  Rank %d encountered a NaN at lat/lon %d,%d (codeline %d)\n", wRank, Ilat, Ilon, __LINE__ ); }
 
-                Ndiff = diff_vec.size();
+                    // Psi part
+                    size_t  column_skip = 1 * Npts,
+                            row_skip    = 2 * Npts;
+                    add_entry( row_skip + index_sub, column_skip + diff_index, tmp_val );
 
-                // If LB is unchanged, then we failed to build a stencil
-                if (LB != - 2 * Nlon) {
-                    for ( IDIFF = LB; IDIFF < LB + Ndiff; IDIFF++ ) {
+                    // Phi part
+                    column_skip = 0 * Npts;
+                    row_skip    = 3 * Npts;
+                    add_entry( row_skip + index_sub, column_skip + diff_index, tmp_val );
+                }
+            }
 
-                        if (constants::PERIODIC_X) { Idiff = ( IDIFF % Nlon + Nlon ) % Nlon; }
-                        else                       { Idiff = IDIFF;                          }
+        } else if ( (not(is_pole)) and (Tikhov_Laplace > 0) ) {
 
-                        diff_index = Index(0, 0, Ilat, Idiff, 1, 1, Nlat, Nlon);
 
-                        //tmp_val     = diff_vec.at(IDIFF-LB);
-                        tmp_val     = diff_vec.at(IDIFF-LB) * cos_lat_inv * R_inv;
-                        tmp_val    *= weight_val;
-                        if (isnan(tmp_val)) { fprintf( stdout, "  Rank %d encountered a NaN at lat/lon %d,%d (codeline %d)\n", wRank, Ilat, Ilon, __LINE__ ); }
+            //
+            //// LON second derivative part
+            //
 
-                        // Psi part
-                        size_t  column_skip = 1 * Npts,
-                                row_skip    = 2 * Npts;
-                        alglib::sparseadd(  LHS_matr, row_skip + index_sub, column_skip + diff_index, tmp_val );
+            LB = - 2 * Nlon;
+            get_diff_vector(diff_vec, LB, longitude, "lon", Itime, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon, mask, 2, constants::DiffOrd);
 
-                        // Phi part
-                        column_skip = 0 * Npts;
-                        row_skip    = 3 * Npts;
-                        alglib::sparseadd(  LHS_matr, row_skip + index_sub, column_skip + diff_index, tmp_val );
-                    }
-                }
+            Ndiff = diff_vec.size();
 
-            } else if ( (not(is_pole)) and (Tikhov_Laplace > 0) ) {
+            // If LB is unchanged, then we failed to build a stencil
+            if (LB != - 2 * Nlon) {
+                for ( IDIFF = LB; IDIFF < LB + Ndiff; IDIFF++ ) {
 
+                    if (constants::PERIODIC_X) { Idiff = ( IDIFF % Nlon + Nlon ) % Nlon; }
+                    else                       { Idiff = IDIFF;                          }
 
-                //
-                //// LON second derivative part
-                //
+                    diff_index = Index(0, 0, Ilat, Idiff, 1, 1, Nlat, Nlon);
 
-                LB = - 2 * Nlon;
-                get_diff_vector(diff_vec, LB, longitude, "lon", Itime, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon, mask, 2, constants::DiffOrd);
+                    tmp_val     = diff_vec.at(IDIFF-LB) * cos2_lat_inv * R2_inv;
+                    tmp_val    *= weight_val * Tikhov_Laplace / deriv_scale_factor;
+                    if (isnan(tmp_val)) { fprintf( stdout, "  Rank %d encountered a NaN at lat/lon %d,%d (codeline %d)\n", wRank, Ilat, Ilon, __LINE__ ); }
 
-                Ndiff = diff_vec.size();
+                    // (2,0) entry
+                    size_t  row_skip    = 2 * Npts,
+                            column_skip = 0 * Npts;
+                    add_entry( row_skip + index_sub, column_skip + diff_index, tmp_val );
 
-                // If LB is unchanged, then we failed to build a stencil
-                if (LB != - 2 * Nlon) {
-                    for ( IDIFF = LB; IDIFF < LB + Ndiff; IDIFF++ ) {
+                    // (3,1) entry
+                    row_skip    = 3 * Npts;
+                    column_skip = 1 * Npts;
+                    add_entry( row_skip + index_sub, column_skip + diff_index, tmp_val );
+                }
+            }
 
-                        if (constants::PERIODIC_X) { Idiff = ( IDIFF % Nlon + Nlon ) % Nlon; }
-                        else                       { Idiff = IDIFF;                          }
 
-                        diff_index = Index(0, 0, Ilat, Idiff, 1, 1, Nlat, Nlon);
+            //
+            //// LAT second derivative part
+            //
 
-                        tmp_val     = diff_vec.at(IDIFF-LB) * cos2_lat_inv * R2_inv;
-                        tmp_val    *= weight_val * Tikhov_Laplace / deriv_scale_factor;
-                        if (isnan(tmp_val)) { fprintf( stdout, "  Rank %d encountered a NaN at lat/lon %d,%d (codeline %d)\n", wRank, Ilat, Ilon, __LINE__ ); }
+            LB = -2 * Nlat;
+            get_diff_vector(diff_vec, LB, latitude, "lat", Itime, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon, mask, 2, constants::DiffOrd);
 
-                        // (2,0) entry
-                        size_t  row_skip    = 2 * Npts,
-                                column_skip = 0 * Npts;
-                        alglib::sparseadd(  LHS_matr, row_skip + index_sub, column_skip + diff_index, tmp_val );
+            Ndiff = diff_vec.size();
 
-                        // (3,1) entry
-                        row_skip    = 3 * Npts;
-                        column_skip = 1 * Npts;
-                        alglib::sparseadd(  LHS_matr, row_skip + index_sub, column_skip + diff_index, tmp_val );
-                    }
+            // If LB is unchanged, then we failed to build a stencil
+            if (LB != - 2 * Nlat) {
+                for ( IDIFF = LB; IDIFF < LB + Ndiff; IDIFF++ ) {
+
+                    if (constants::PERIODIC_Y) { Idiff = ( IDIFF % Nlat + Nlat ) % Nlat; }
+                    else                       { Idiff = IDIFF;                          }
+
+                    diff_index = Index(0, 0, Idiff, Ilon, 1, 1, Nlat,  Nlon);
+
+                    tmp_val     = diff_vec.at(IDIFF-LB) * R2_inv;
+                    tmp_val    *= weight_val * Tikhov_Laplace / deriv_scale_factor;
+                    if (isnan(tmp_val)) { fprintf( stdout, "  Rank %d encountered a NaN at lat/lon %d,%d (codeline %d)\n", wRank, Ilat, Ilon, __LINE__ ); }
+
+                    // (2,0) entry
+                    size_t  row_skip    = 2 * Npts,
+                            column_skip = 0 * Npts;
+                    add_entry( row_skip + index_sub, column_skip + diff_index, tmp_val );
+
+                    // (3,1) entry
+                    row_skip    = 3 * Npts;
+                    column_skip = 1 * Npts;
+                    add_entry( row_skip + index_sub, column_skip + diff_index, tmp_val );
                 }
+            }
 
 
-                //
-                //// LAT second derivative part
-                //
+            //
+            //// LAT first derivative part
+            //
 
-                LB = -2 * Nlat;
-                get_diff_vector(diff_vec, LB, latitude, "lat", Itime, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon, mask, 2, constants::DiffOrd);
+            LB = - 2 * Nlat;
+            get_diff_vector(diff_vec, LB, latitude, "lat", Itime, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon, mask, 1, constants::DiffOrd);
 
-                Ndiff = diff_vec.size();
+            Ndiff = diff_vec.size();
+            //tan_lat = tan( latitude.at(Ilat) );
 
-                // If LB is unchanged, then we failed to build a stencil
-                if (LB != - 2 * Nlat) {
-                    for ( IDIFF = LB; IDIFF < LB + Ndiff; IDIFF++ ) {
+            // If LB is unchanged, then we failed to build a stencil
+            if (LB != - 2 * Nlat) {
+                for ( IDIFF = LB; IDIFF < LB + Ndiff; IDIFF++ ) {
 
-                        if (constants::PERIODIC_Y) { Idiff = ( IDIFF % Nlat + Nlat ) % Nlat; }
-                        else                       { Idiff = IDIFF;                          }
+                    if (constants::PERIODIC_Y) { Idiff = ( IDIFF % Nlat + Nlat ) % Nlat; }
+                    else                       { Idiff = IDIFF;                          }
 
-                        diff_index = Index(0, 0, Idiff, Ilon, 1, 1, Nlat,  Nlon);
+                    diff_index = Index(0, 0, Idiff, Ilon, 1, 1, Nlat,  Nlon);
 
-                        tmp_val     = diff_vec.at(IDIFF-LB) * R2_inv;
-                        tmp_val    *= weight_val * Tikhov_Laplace / deriv_scale_factor;
-                        if (isnan(tmp_val)) { fprintf( stdout, "  Rank %d encountered a NaN at lat/lon %d,%d (codeline %d)\n", wRank, Ilat, Ilon, __LINE__ ); }
+                    tmp_val     = - diff_vec.at(IDIFF-LB) * tan_lat * R2_inv;
+                    tmp_val    *= weight_val * Tikhov_Laplace / deriv_scale_factor;
+                    if (isnan(tmp_val)) { fprintf( stdout, "  Rank %d encountered a NaN at lat/lon %d,%d (codeline %d)\n", wRank, Ilat, Ilon, __LINE__ ); }
 
-                        // (2,0) entry
-                        size_t  row_skip    = 2 * Npts,
-                                column_skip = 0 * Npts;
-                        alglib::sparseadd(  LHS_matr, row_skip + index_sub, column_skip + diff_index, tmp_val );
+                    // (2,0) entry
+                    size_t  row_skip    = 2 * Npts,
+                            column_skip = 0 * Npts;
+                    add_entry( row_skip + index_sub, column_skip + diff_index, tmp_val );
 
-                        // (3,1) entry
-                        row_skip    = 3 * Npts;
-                        column_skip = 1 * Npts;
-                        alglib::sparseadd(  LHS_matr, row_skip + index_sub, column_skip + diff_index, tmp_val );
-                    }
+                    // (3,1) entry
+                    row_skip    = 3 * Npts;
+                    column_skip = 1 * Npts;
+                    add_entry( row_skip + index_sub, column_skip + diff_index, tmp_val );
                 }
+            }
+        }
+    };
 
+    LHS_matr.assemble( 4 * Npts, 2 * Npts, Npts, point_entries );
+}
 
-                //
-                //// LAT first derivative part
-                //
-
-                LB = - 2 * Nlat;
-                get_diff_vector(diff_vec, LB, latitude, "lat", Itime, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon, mask, 1, constants::DiffOrd);
 
-                Ndiff = diff_vec.size();
-                //tan_lat = tan( latitude.at(Ilat) );
+// Build the RHS of the least-squares problem (velocity, vorticity, and divergence rows) from a velocity field
+static void Helmholtz_RHS(
+        std::vector<double> & RHS_vector,
+        std::vector<double> & div_term,
+        std::vector<double> & vort_term,
+        const std::vector<double> & u_lon_rem,
+        const std::vector<double> & u_lat_rem,
+        const dataset & source_data,
+        const std::vector<bool> & mask,
+        const bool weight_err,
+        const double Tikhov_Laplace,
+        const double deriv_scale_factor
+        ) {
 
-                // If LB is unchanged, then we failed to build a stencil
-                if (LB != - 2 * Nlat) {
-                    for ( IDIFF = LB; IDIFF < LB + Ndiff; IDIFF++ ) {
+    const std::vector<double>   &latitude   = source_data.latitude,
+                                &longitude  = source_data.longitude,
+                                &dAreas     = source_data.areas;
 
-                        if (constants::PERIODIC_Y) { Idiff = ( IDIFF % Nlat + Nlat ) % Nlat; }
-                        else                       { Idiff = IDIFF;                          }
+    const int   Nlat    = source_data.myCounts.at(2),
+                Nlon    = source_data.myCounts.at(3);
 
-                        diff_index = Index(0, 0, Idiff, Ilon, 1, 1, Nlat,  Nlon);
+    const size_t Npts = Nlat * Nlon;
 
-                        tmp_val     = - diff_vec.at(IDIFF-LB) * tan_lat * R2_inv;
-                        tmp_val    *= weight_val * Tikhov_Laplace / deriv_scale_factor;
-                        if (isnan(tmp_val)) { fprintf( stdout, "  Rank %d encountered a NaN at lat/lon %d,%d (codeline %d)\n", wRank, Ilat, Ilon, __LINE__ ); }
+    int Ilat, Ilon;
+    size_t index_sub;
 
-                        // (2,0) entry
-                        size_t  row_skip    = 2 * Npts,
-                                column_skip = 0 * Npts;
-                        alglib::sparseadd(  LHS_matr, row_skip + index_sub, column_skip + diff_index, tmp_val );
+    #if DEBUG >= 3
+    fprintf( stdout, "Getting divergence and vorticity from remaining velocity.\n" );
+    fflush(stdout);
+    #endif
+    toroidal_vel_div(        div_term, u_lon_rem, u_lat_rem, longitude, latitude,       1, 1, Nlat, Nlon, mask );
+    toroidal_curl_u_dot_er( vort_term, u_lon_rem, u_lat_rem, longitude, latitude, 0, 0, 1, 1, Nlat, Nlon, mask );
+
+    double is_pole;
+    #pragma omp parallel default(none) \
+    shared( dAreas, latitude, RHS_vector, div_term, vort_term, u_lon_rem, u_lat_rem ) \
+    private( Ilat, Ilon, index_sub, is_pole ) \
+    firstprivate( Nlon, Nlat, Npts, Tikhov_Laplace, weight_err, deriv_scale_factor )
+    {
+        #pragma omp for collapse(2) schedule(static)
+        for (Ilat = 0; Ilat < Nlat; ++Ilat) {
+            for (Ilon = 0; Ilon < Nlon; ++Ilon) {
+                index_sub = Index( 0,     0,      Ilat, Ilon, 1,     1,      Nlat, Nlon);
+
+                is_pole = std::fabs( std::fabs( latitude.at(Ilat) * 180.0 / M_PI ) - 90 ) < 0.01;
+
+                RHS_vector.at( 0*Npts + index_sub) = u_lon_rem.at(index_sub);
+                RHS_vector.at( 1*Npts + index_sub) = u_lat_rem.at(index_sub);
+
+                if ( ( Ilat == 0 ) or ( is_pole ) ) {
+                    RHS_vector.at( 2*Npts + index_sub) = 0.;
+                    RHS_vector.at( 3*Npts + index_sub) = 0.;
+                } else {
+                    RHS_vector.at( 2*Npts + index_sub) = vort_term.at(index_sub) * Tikhov_Laplace / deriv_scale_factor;
+                    RHS_vector.at( 3*Npts + index_sub) = div_term.at( index_sub) * Tikhov_Laplace / deriv_scale_factor;
+                }
 
-                        // (3,1) entry
-                        row_skip    = 3 * Npts;
-                        column_skip = 1 * Npts;
-                        alglib::sparseadd(  LHS_matr, row_skip + index_sub, column_skip + diff_index, tmp_val );
-                    }
+                if ( weight_err ) {
+                    RHS_vector.at( 0*Npts + index_sub) *= dAreas.at(index_sub);
+                    RHS_vector.at( 1*Npts + index_sub) *= dAreas.at(index_sub);
+                    RHS_vector.at( 2*Npts + index_sub) *= dAreas.at(index_sub);
+                    RHS_vector.at( 3*Npts + index_sub) *= dAreas.at(index_sub);
                 }
             }
         }
     }
-        
 }
 
 
@@ -327,6 +389,7 @@ void Apply_Helmholtz_Projection(
         const bool weight_err,
         const bool use_mask,
         const double Tikhov_Laplace,
+        const std::string time_seed,
         const MPI_Comm comm
         ) {
 
@@ -394,8 +457,7 @@ void Apply_Helmholtz_Projection(
         u_lon_pot_seed(  Npts, 0. ),
         u_lat_pot_seed(  Npts, 0. );
 
-    // alglib variables
-    alglib::real_1d_array rhs;
+    // least-squares variables
     std::vector<double> 
         RHS_vector( 4 * Npts, 0. ),
         Psi_seed(       Npts, 0. ),
@@ -426,14 +488,9 @@ void Apply_Helmholtz_Projection(
         }
     }
 
-    rhs.attach_to_ptr( 4 * Npts, &RHS_vector[0] );
-
-    alglib::linlsqrstate state;
-    alglib::linlsqrreport report;
-
-    alglib::real_1d_array F_alglib;
-
-    double *F_array;
+    // Least-squares solver (ALGLIB or native, see NATIVE_LSQR_SOLVER)
+    least_squares_solver solver;
+    std::vector<double> F_vector;
 
     //
     //// Build the LHS part of the problem
@@ -452,8 +509,7 @@ void Apply_Helmholtz_Projection(
     }
     #endif
 
-    alglib::sparsematrix LHS_matr;
-    alglib::sparsecreate(4*Npts, 2*Npts, LHS_matr);
+    crs_matrix LHS_matr;
 
     // Get a magnitude for the derivatives, to help normalize the rows of the 
     //  Laplace entries to have similar magnitude to the others.
@@ -471,16 +527,30 @@ void Apply_Helmholtz_Projection(
     //      this assumes that we can use the same operator for all times / depths
     sparse_vel_from_PsiPhi_vortdiv( LHS_matr, source_data, 0, 0, use_mask ? mask : unmask, weight_err, Tikhov_Laplace, deriv_scale_factor, wRank );
 
-    alglib::sparseconverttocrs(LHS_matr);
-
     #if DEBUG >= 1
     if (wRank == 0) {
         fprintf(stdout, "Declaring the least squares problem.\n");
         fflush(stdout);
     }
     #endif
-    alglib::linlsqrcreate(4*Npts, 2*Npts, state);
-    alglib::linlsqrsetcond(state, rel_tol, rel_tol, max_iters);
+    solver.build( LHS_matr, rel_tol, rel_tol, max_iters );
+
+    // The solver keeps its own copy of the matrix
+    LHS_matr = crs_matrix();
+
+    // Warm starts across time: seed each time with the solution(s) at the same depth from the previous time(s) on this rank
+    //      "none"          use the provided seed (or, with a single seed, the last solved slice)
+    //      "previous"      use the solution from the previous time
+    //      "extrapolate"   linearly extrapolate from the previous two times (falls back to "previous" for the second time)
+    const bool  seed_from_previous_time = (time_seed == "previous") or (time_seed == "extrapolate"),
+                seed_from_extrapolation = (time_seed == "extrapolate");
+    assert( seed_from_previous_time or (time_seed == "none") );
+
+    // Iterations and solve time for the first time at each depth (which doesn't get a warm start), to estimate the savings
+    std::vector<size_t> reference_iters( Ndepth, 0 );
+    std::vector<double> reference_solve_time( Ndepth, 0. );
+    long long total_iters_used = 0, total_iters_saved = 0;
+    double total_time_saved = 0.;
 
     // Counters to track termination types
     int terminate_count_abs_tol = 0,
@@ -517,6 +587,34 @@ void Apply_Helmholtz_Projection(
                 }
             }
 
+            // Seed from the previous time(s), if requested
+            const int Nprev = seed_from_previous_time ? std::min( Itime, seed_from_extrapolation ? 2 : 1 ) : 0;
+            if (Nprev > 0) {
+                #pragma omp parallel \
+                default(none) \
+                shared( Psi_seed, Phi_seed, full_Psi, full_Phi, Itime, Idepth ) \
+                private( Ilat, Ilon, index, index_sub ) \
+                firstprivate( Nlon, Nlat, Ndepth, Ntime, Nprev )
+                {
+                    size_t index_prev2;
+                    #pragma omp for collapse(2) schedule(static)
+                    for (Ilat = 0; Ilat < Nlat; ++Ilat) {
+                        for (Ilon = 0; Ilon < Nlon; ++Ilon) {
+                            index     = Index(Itime - 1, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon);
+                            index_sub = Index(0,         0,      Ilat, Ilon, 1,     1,      Nlat, Nlon);
+                            if (Nprev == 2) {
+                                index_prev2 = Index(Itime - 2, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon);
+                                Psi_seed.at(index_sub) = 2 * full_Psi.at(index) - full_Psi.at(index_prev2);
+                                Phi_seed.at(index_sub) = 2 * full_Phi.at(index) - full_Phi.at(index_prev2);
+                            } else {
+                                Psi_seed.at(index_sub) = full_Psi.at(index);
+                                Phi_seed.at(index_sub) = full_Phi.at(index);
+                            }
+                        }
+                    }
+                }
+            }
+
             // Get velocity from seed
             #if DEBUG >= 3
             fprintf( stdout, "Getting velocities from seed.\n" );
@@ -525,6 +623,30 @@ void Apply_Helmholtz_Projection(
             toroidal_vel_from_F(  u_lon_tor_seed, u_lat_tor_seed, Psi_seed, longitude, latitude, Ntime, Ndepth, Nlat, Nlon, use_mask ? mask : unmask);
             potential_vel_from_F( u_lon_pot_seed, u_lat_pot_seed, Phi_seed, longitude, latitude, Ntime, Ndepth, Nlat, Nlon, use_mask ? mask : unmask);
 
+            // Norm of the RHS without the seed (for the warm-start tolerance)
+            double full_RHS_norm = 0.;
+            if (Nprev > 0) {
+                #pragma omp parallel default(none) \
+                shared( Itime, Idepth, u_lon, u_lat, u_lon_rem, u_lat_rem ) \
+                private( Ilat, Ilon, index, index_sub ) \
+                firstprivate( Nlon, Nlat, Ndepth, Ntime )
+                {
+                    #pragma omp for collapse(2) schedule(static)
+                    for (Ilat = 0; Ilat < Nlat; ++Ilat) {
+                        for (Ilon = 0; Ilon < Nlon; ++Ilon) {
+                            index_sub = Index( 0,     0,      Ilat, Ilon, 1,     1,      Nlat, Nlon);
+                            index     = Index( Itime, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon);
+                            u_lon_rem.at( index_sub ) = u_lon.at(index);
+                            u_lat_rem.at( index_sub ) = u_lat.at(index);
+                        }
+                    }
+                }
+                Helmholtz_RHS( RHS_vector, div_term, vort_term, u_lon_rem, u_lat_rem, source_data,
+                               use_mask ? mask : unmask, weight_err, Tikhov_Laplace, deriv_scale_factor );
+                for (size_t II = 0; II < RHS_vector.size(); II++) { full_RHS_norm += RHS_vector[II] * RHS_vector[II]; }
+                full_RHS_norm = sqrt( full_RHS_norm );
+            }
+
             #if DEBUG >= 3
             fprintf( stdout, "Subtracting seed velocity to get remaining.\n" );
             fflush(stdout);
@@ -547,57 +669,26 @@ void Apply_Helmholtz_Projection(
                     }
                 }
             }
-            #if DEBUG >= 3
-            fprintf( stdout, "Getting divergence and vorticity from remaining velocity.\n" );
-            fflush(stdout);
-            #endif
-            toroidal_vel_div(        div_term, u_lon_rem, u_lat_rem, longitude, latitude,       1, 1, Nlat, Nlon, use_mask ? mask : unmask );
-            toroidal_curl_u_dot_er( vort_term, u_lon_rem, u_lat_rem, longitude, latitude, 0, 0, 1, 1, Nlat, Nlon, use_mask ? mask : unmask );
-
             #if DEBUG >= 2
             if ( wRank == 0 ) {
                 fprintf(stdout, "Building the RHS of the least squares problem.\n");
                 fflush(stdout);
             }
             #endif
-
-            //
-            //// Set up the RHS_vector
-            //
-            
-            double is_pole;
-            #pragma omp parallel default(none) \
-            shared( dAreas, latitude, Itime, Idepth, RHS_vector, div_term, vort_term, u_lon_rem, u_lat_rem, deriv_scale_factor ) \
-            private( Ilat, Ilon, index, index_sub, is_pole ) \
-            firstprivate( Nlon, Nlat, Ndepth, Ntime, Npts, Tikhov_Laplace, weight_err )
-            {
-                #pragma omp for collapse(2) schedule(static)
-                for (Ilat = 0; Ilat < Nlat; ++Ilat) {
-                    for (Ilon = 0; Ilon < Nlon; ++Ilon) {
-                        index_sub = Index( 0,     0,      Ilat, Ilon, 1,     1,      Nlat, Nlon);
-                        index     = Index( Itime, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon);
-
-                        is_pole = std::fabs( std::fabs( latitude.at(Ilat) * 180.0 / M_PI ) - 90 ) < 0.01;
-
-                        RHS_vector.at( 0*Npts + index_sub) = u_lon_rem.at(index_sub);
-                        RHS_vector.at( 1*Npts + index_sub) = u_lat_rem.at(index_sub);
-
-                        if ( ( Ilat == 0 ) or ( is_pole ) ) {
-                            RHS_vector.at( 2*Npts + index_sub) = 0.;
-                            RHS_vector.at( 3*Npts + index_sub) = 0.;
-                        } else {
-                            RHS_vector.at( 2*Npts + index_sub) = vort_term.at(index_sub) * Tikhov_Laplace / deriv_scale_factor;
-                            RHS_vector.at( 3*Npts + index_sub) = div_term.at( index_sub) * Tikhov_Laplace / deriv_scale_factor;
-                        }
-
-                        if ( weight_err ) {
-                            RHS_vector.at( 0*Npts + index_sub) *= dAreas.at(index_sub);
-                            RHS_vector.at( 1*Npts + index_sub) *= dAreas.at(index_sub);
-                            RHS_vector.at( 2*Npts + index_sub) *= dAreas.at(index_sub);
-                            RHS_vector.at( 3*Npts + index_sub) *= dAreas.at(index_sub);
-                        }
-                    }
+            Helmholtz_RHS( RHS_vector, div_term, vort_term, u_lon_rem, u_lat_rem, source_data,
+                           use_mask ? mask : unmask, weight_err, Tikhov_Laplace, deriv_scale_factor );
+
+            // With a warm start, the residual tolerance is relative to the full (unseeded) RHS rather than to
+            //   the remainder, so that a better seed means fewer iterations (instead of a tighter tolerance)
+            if (seed_from_previous_time) {
+                double eps_b = rel_tol;
+                if (Nprev > 0) {
+                    double rem_RHS_norm = 0.;
+                    for (size_t II = 0; II < RHS_vector.size(); II++) { rem_RHS_norm += RHS_vector[II] * RHS_vector[II]; }
+                    rem_RHS_norm = sqrt( rem_RHS_norm );
+                    if (rem_RHS_norm > 0) { eps_b = std::min( 1., rel_tol * full_RHS_norm / rem_RHS_norm ); }
                 }
+                solver.set_tolerances( rel_tol, eps_b );
             }
 
             //
@@ -609,11 +700,12 @@ void Apply_Helmholtz_Projection(
                 fflush(stdout);
             }
             #endif
-            alglib::linlsqrsolvesparse(state, LHS_matr, rhs);
-            alglib::linlsqrresults(state, F_alglib, report);
+            const double solve_clock_on = MPI_Wtime();
+            solver.solve( F_vector, RHS_vector );
+            const double solve_time = MPI_Wtime() - solve_clock_on;
 
-            /*    Rep     -   optimization report:
-                * Rep.TerminationType completetion code:
+            /*    Termination codes (the same for the ALGLIB and native solvers):
+                * solver.terminationtype completetion code:
                     *  1    ||Rk||<=EpsB*||B||
                     *  4    ||A^T*Rk||/(||A||*||Rk||)<=EpsA
                     *  5    MaxIts steps was taken
@@ -622,26 +714,49 @@ void Apply_Helmholtz_Projection(
                             (sometimes returned on singular systems)
                     *  8    user requested termination via calling
                             linlsqrrequesttermination()
-                * Rep.IterationsCount contains iterations count
-                * NMV countains number of matrix-vector calculations
+                * solver.iterationscount contains iterations count
             */
 
             #if DEBUG >= 1
-            if      (report.terminationtype == 1) { fprintf(stdout, "Termination type: absolulte tolerance reached.\n"); }
-            else if (report.terminationtype == 4) { fprintf(stdout, "Termination type: relative tolerance reached.\n"); }
-            else if (report.terminationtype == 5) { fprintf(stdout, "Termination type: maximum number of iterations reached.\n"); }
-            else if (report.terminationtype == 7) { fprintf(stdout, "Termination type: round-off errors prevent further progress.\n"); }
-            else if (report.terminationtype == 8) { fprintf(stdout, "Termination type: user requested (?)\n"); }
+            if      (solver.terminationtype == 1) { fprintf(stdout, "Termination type: absolulte tolerance reached.\n"); }
+            else if (solver.terminationtype == 4) { fprintf(stdout, "Termination type: relative tolerance reached.\n"); }
+            else if (solver.terminationtype == 5) { fprintf(stdout, "Termination type: maximum number of iterations reached.\n"); }
+            else if (solver.terminationtype == 7) { fprintf(stdout, "Termination type: round-off errors prevent further progress.\n"); }
+            else if (solver.terminationtype == 8) { fprintf(stdout, "Termination type: user requested (?)\n"); }
             else                                  { fprintf(stdout, "Termination type: unknown\n"); }
             #endif
-            if      (report.terminationtype == 1) { terminate_count_abs_tol++; }
-            else if (report.terminationtype == 4) { terminate_count_rel_tol++; }
-            else if (report.terminationtype == 5) { terminate_count_max_iter++; }
-            else if (report.terminationtype == 7) { terminate_count_rounding++; }
-            else if (report.terminationtype == 8) { terminate_count_other++; }
+            if      (solver.terminationtype == 1) { terminate_count_abs_tol++; }
+            else if (solver.terminationtype == 4) { terminate_count_rel_tol++; }
+            else if (solver.terminationtype == 5) { terminate_count_max_iter++; }
+            else if (solver.terminationtype == 7) { terminate_count_rounding++; }
+            else if (solver.terminationtype == 8) { terminate_count_other++; }
             else                                  { terminate_count_other++; }
 
-            iters_used = linlsqrpeekiterationscount( state );
+            iters_used = solver.iterationscount;
+            total_iters_used += iters_used;
+
+            // Log the savings from the warm start, relative to the first time at this depth
+            if (Itime == 0) {
+                reference_iters.at(Idepth)      = iters_used;
+                reference_solve_time.at(Idepth) = solve_time;
+            }
+            if (seed_from_previous_time) {
+                const long   iters_saved = (long) reference_iters.at(Idepth) - (long) iters_used;
+                const double time_saved  = reference_solve_time.at(Idepth) - solve_time;
+                if (Itime > 0) {
+                    total_iters_saved += iters_saved;
+                    total_time_saved  += time_saved;
+                }
+                #if DEBUG >= 0
+                fprintf( stdout, "  --  Rank %d time %d depth %d: seeded from %s, %'zu iterations, solve time %.3g s",
+                        wRank, Itime + myStarts.at(0), Idepth + myStarts.at(1),
+                        (Nprev == 2) ? "extrapolation" : ( (Nprev == 1) ? "previous time" : "input seed" ),
+                        iters_used, solve_time );
+                if (Itime > 0) { fprintf( stdout, " (%'ld iterations and %.3g s saved)", iters_saved, time_saved ); }
+                fprintf( stdout, "\n" );
+                fflush(stdout);
+                #endif
+            }
 
             #if DEBUG >= 2
             if ( wRank == 0 ) {
@@ -651,9 +766,8 @@ void Apply_Helmholtz_Projection(
             #endif
 
             // Extract the solution and add the seed back in
-            F_array = F_alglib.getcontent();
-            std::vector<double> Psi_vector(F_array,        F_array +     Npts),
-                                Phi_vector(F_array + Npts, F_array + 2 * Npts);
+            std::vector<double> Psi_vector(F_vector.begin(),        F_vector.begin() +     Npts),
+                                Phi_vector(F_vector.begin() + Npts, F_vector.begin() + 2 * Npts);
             for (size_t ii = 0; ii < Npts; ++ii) {
                 Psi_vector.at(ii) += Psi_seed.at(ii);
                 Phi_vector.at(ii) += Phi_seed.at(ii);
@@ -744,6 +858,21 @@ void Apply_Helmholtz_Projection(
     MPI_Reduce( &terminate_count_rounding, &total_count_rounding, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD );
     MPI_Reduce( &terminate_count_other,    &total_count_other,    1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD );
 
+    if (seed_from_previous_time) {
+        long long local_iters[2] = { total_iters_used, total_iters_saved },
+                  global_iters[2];
+        double global_time_saved;
+        MPI_Reduce( local_iters,       global_iters,       2, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD );
+        MPI_Reduce( &total_time_saved, &global_time_saved, 1, MPI_DOUBLE,    MPI_SUM, 0, MPI_COMM_WORLD );
+        #if DEBUG >= 0
+        if (wRank == 0) {
+            fprintf( stdout, "\n" );
+            fprintf( stdout, "Warm starts (%s): %'lld iterations used, about %'lld iterations and %.3g s of solves saved\n",
+                    time_seed.c_str(), global_iters[0], global_iters[1], global_time_saved );
+        }
+        #endif
+    }
+
     #if DEBUG >= 0
     if (wRank == 0) {
         fprintf( stdout, "\n" );
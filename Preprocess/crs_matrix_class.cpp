@@ -0,0 +1,269 @@
+#include "../constants.hpp"
+#include "../functions.hpp"
+#include "../preprocess.hpp"
+#include <algorithm>
+#include <vector>
+#include <omp.h>
+#include "../ALGLIB/stdafx.h"
+#include "../ALGLIB/linalg.h"
+
+// Sort one block of (row, col, val) entries by row and then column, summing repeated entries
+//   (in the order that they were generated) and dropping entries that sum to zero, as
+//   alglib::sparseadd would
+static void merge_block_entries(
+        std::vector<int> & rows,
+        std::vector<int> & cols,
+        std::vector<double> & vals,
+        std::vector<size_t> & order
+        ) {
+
+    const size_t Nentries = rows.size();
+    order.resize( Nentries );
+    for (size_t II = 0; II < Nentries; II++) { order[II] = II; }
+    std::stable_sort( order.begin(), order.end(),
+            [&rows, &cols]( const size_t a, const size_t b ) {
+                return ( rows[a] < rows[b] ) or ( ( rows[a] == rows[b] ) and ( cols[a] < cols[b] ) );
+            } );
+
+    std::vector<int> merged_rows, merged_cols;
+    std::vector<double> merged_vals;
+    merged_rows.reserve( Nentries );
+    merged_cols.reserve( Nentries );
+    merged_vals.reserve( Nentries );
+    size_t II = 0;
+    while (II < Nentries) {
+        const int Irow = rows[ order[II] ], Icol = cols[ order[II] ];
+        double sum = 0.;
+        for ( ; (II < Nentries) and ( rows[ order[II] ] == Irow ) and ( cols[ order[II] ] == Icol ); II++) {
+            sum += vals[ order[II] ];
+        }
+        if (sum != 0) {
+            merged_rows.push_back( Irow );
+            merged_cols.push_back( Icol );
+            merged_vals.push_back( sum );
+        }
+    }
+    rows.swap( merged_rows );
+    cols.swap( merged_cols );
+    vals.swap( merged_vals );
+}
+
+// Class constructor
+crs_matrix::crs_matrix() {
+};
+
+/*!
+ * \brief Copy an ALGLIB sparse matrix (in any storage format) into compressed row storage
+ *
+ * The non-zero entries are enumerated twice: once to count the entries in each row, and
+ * once to fill them in. Within each row, the entries keep the order that ALGLIB enumerates
+ * them in (which is sorted by column if the ALGLIB matrix is already CRS).
+ *
+ * @param[in]   matr        ALGLIB sparse matrix
+ *
+ */
+void crs_matrix::build(
+        const alglib::sparsematrix & matr
+        ) {
+
+    Nrows = alglib::sparsegetnrows( matr );
+    Ncols = alglib::sparsegetncols( matr );
+
+    alglib::ae_int_t t0, t1, Irow, Icol;
+    double val;
+
+    // Count the entries in each row
+    row_start.assign( Nrows + 1, 0 );
+    t0 = 0;
+    t1 = 0;
+    while ( alglib::sparseenumerate( matr, t0, t1, Irow, Icol, val ) ) { row_start[Irow + 1]++; }
+    for (int II = 0; II < Nrows; II++) { row_start[II + 1] += row_start[II]; }
+
+    // And then fill them in
+    col_index.resize( row_start[Nrows] );
+    values.resize( row_start[Nrows] );
+    std::vector<size_t> next( row_start.begin(), row_start.end() - 1 );
+    t0 = 0;
+    t1 = 0;
+    while ( alglib::sparseenumerate( matr, t0, t1, Irow, Icol, val ) ) {
+        col_index[ next[Irow] ] = Icol;
+        values[    next[Irow] ] = val;
+        next[Irow]++;
+    }
+};
+
+/*!
+ * \brief Assemble the matrix directly in compressed row storage, from generators for blocks of rows
+ *
+ * block_entries( rows, cols, vals, Iblock ) should append the (row, column, value) entries for
+ * block Iblock (for Iblock = 0, ..., Nblocks - 1). Each row must only receive entries from one
+ * block, and a block must produce the same entries every time that it is called, since it will
+ * be called from multiple threads, and twice per block.
+ *
+ * The first pass counts the (merged) entries in each row, which gives the row starts after a
+ * prefix sum, and the second pass fills in the columns and values. Within each row, entries are
+ * sorted by column, repeated entries are summed in the order that they were generated, and
+ * entries that sum to zero are dropped (i.e. the same as alglib::sparseadd followed by
+ * alglib::sparseconverttocrs, but without the hash table).
+ *
+ * @param[in]   Nrows_in        number of rows in the matrix
+ * @param[in]   Ncols_in        number of columns in the matrix
+ * @param[in]   Nblocks         number of blocks of rows
+ * @param[in]   block_entries   generator for the entries in each block
+ *
+ */
+void crs_matrix::assemble(
+        const int Nrows_in,
+        const int Ncols_in,
+        const int Nblocks,
+        const std::function< void( std::vector<int> & rows,
+                                   std::vector<int> & cols,
+                                   std::vector<double> & vals,
+                                   const int Iblock ) > & block_entries
+        ) {
+
+    Nrows = Nrows_in;
+    Ncols = Ncols_in;
+
+    row_start.assign( Nrows + 1, 0 );
+    size_t *starts = row_start.data();
+
+    // First pass: count the entries in each row
+    #pragma omp parallel default(none) shared( block_entries, starts ) firstprivate( Nblocks )
+    {
+        std::vector<int> rows, cols;
+        std::vector<double> vals;
+        std::vector<size_t> order;
+
+        #pragma omp for schedule(dynamic, 64)
+        for (int Iblock = 0; Iblock < Nblocks; Iblock++) {
+            rows.clear();
+            cols.clear();
+            vals.clear();
+            block_entries( rows, cols, vals, Iblock );
+            merge_block_entries( rows, cols, vals, order );
+            for (size_t II = 0; II < rows.size(); II++) { starts[ rows[II] + 1 ]++; }
+        }
+    }
+
+    for (int II = 0; II < Nrows; II++) { row_start[II + 1] += row_start[II]; }
+
+    col_index.resize( row_start[Nrows] );
+    values.resize( row_start[Nrows] );
+    int *col_ptr = col_index.data();
+    double *val_ptr = values.data();
+
+    // Second pass: fill in the columns and values
+    #pragma omp parallel default(none) shared( block_entries, starts, col_ptr, val_ptr ) firstprivate( Nblocks )
+    {
+        std::vector<int> rows, cols;
+        std::vector<double> vals;
+        std::vector<size_t> order;
+
+        #pragma omp for schedule(dynamic, 64)
+        for (int Iblock = 0; Iblock < Nblocks; Iblock++) {
+            rows.clear();
+            cols.clear();
+            vals.clear();
+            block_entries( rows, cols, vals, Iblock );
+            merge_block_entries( rows, cols, vals, order );
+
+            // Entries are sorted by row, and the rows belong to this block alone
+            size_t Iout = 0;
+            for (size_t II = 0; II < rows.size(); II++) {
+                if ( (II == 0) or (rows[II] != rows[II - 1]) ) { Iout = starts[ rows[II] ]; }
+                col_ptr[Iout] = cols[II];
+                val_ptr[Iout] = vals[II];
+                Iout++;
+            }
+        }
+    }
+};
+
+/*!
+ * \brief Copy the matrix into an ALGLIB sparse matrix (in CRS format)
+ *
+ * The columns must be sorted within each row (as they are after assemble, or after
+ * build from an ALGLIB CRS matrix). Any existing contents of matr are replaced.
+ *
+ * @param[in,out]   matr        where to store the ALGLIB matrix
+ *
+ */
+void crs_matrix::to_alglib(
+        alglib::sparsematrix & matr
+        ) const {
+
+    alglib::integer_1d_array row_counts;
+    row_counts.setlength( Nrows );
+    for (int Irow = 0; Irow < Nrows; Irow++) { row_counts[Irow] = row_start[Irow + 1] - row_start[Irow]; }
+
+    alglib::sparsecreatecrs( Nrows, Ncols, row_counts, matr );
+    for (int Irow = 0; Irow < Nrows; Irow++) {
+        for (size_t II = row_start[Irow]; II < row_start[Irow + 1]; II++) {
+            alglib::sparseset( matr, Irow, col_index[II], values[II] );
+        }
+    }
+};
+
+/*!
+ * \brief Build the transpose of the matrix (also in compressed row storage)
+ *
+ * Storing the transpose means that products with A^T are also row-parallel,
+ * without needing atomics or per-thread copies of the output.
+ *
+ * @param[in,out]   transposed      where to store the transpose
+ *
+ */
+void crs_matrix::transpose(
+        crs_matrix & transposed
+        ) const {
+
+    transposed.Nrows = Ncols;
+    transposed.Ncols = Nrows;
+
+    transposed.row_start.assign( Ncols + 1, 0 );
+    for (size_t II = 0; II < col_index.size(); II++) { transposed.row_start[ col_index[II] + 1 ]++; }
+    for (int II = 0; II < Ncols; II++) { transposed.row_start[II + 1] += transposed.row_start[II]; }
+
+    transposed.col_index.resize( values.size() );
+    transposed.values.resize( values.size() );
+    std::vector<size_t> next( transposed.row_start.begin(), transposed.row_start.end() - 1 );
+    for (int Irow = 0; Irow < Nrows; Irow++) {
+        for (size_t II = row_start[Irow]; II < row_start[Irow + 1]; II++) {
+            const size_t Iout = next[ col_index[II] ]++;
+            transposed.col_index[Iout] = Irow;
+            transposed.values[Iout]    = values[II];
+        }
+    }
+};
+
+/*!
+ * \brief Compute y = A * x (threaded over rows)
+ *
+ * @param[in,out]   y       where to store the product (resized if needed)
+ * @param[in]       x       vector to multiply (length Ncols)
+ *
+ */
+void crs_matrix::multiply(
+        std::vector<double> & y,
+        const std::vector<double> & x
+        ) const {
+
+    y.resize( Nrows );
+
+    const int Nrows_loc = Nrows;
+    const size_t *starts = row_start.data();
+    const int *cols = col_index.data();
+    const double *vals = values.data(), *xx = x.data();
+    double *yy = y.data();
+
+    #pragma omp parallel for default(none) schedule(static) \
+    shared( starts, cols, vals, xx, yy ) firstprivate( Nrows_loc )
+    for (int Irow = 0; Irow < Nrows_loc; Irow++) {
+        double sum = 0.;
+        for (size_t II = starts[Irow]; II < starts[Irow + 1]; II++) {
+            sum += vals[II] * xx[ cols[II] ];
+        }
+        yy[Irow] = sum;
+    }
+};
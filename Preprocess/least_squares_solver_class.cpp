@@ -0,0 +1,305 @@
+#include "../constants.hpp"
+#include "../functions.hpp"
+#include "../preprocess.hpp"
+#include <algorithm>
+#include <vector>
+#include <omp.h>
+#include <math.h>
+#include <float.h>
+#include <cassert>
+#include "../ALGLIB/stdafx.h"
+#include "../ALGLIB/linalg.h"
+#include "../ALGLIB/solvers.h"
+
+// Two-norm of a vector (threaded)
+static double vector_norm( const std::vector<double> & x ) {
+    const size_t N = x.size();
+    const double * xx = x.data();
+    double sum = 0.;
+    #pragma omp parallel for default(none) schedule(static) shared( xx ) firstprivate( N ) reduction(+:sum)
+    for (size_t II = 0; II < N; II++) { sum += xx[II] * xx[II]; }
+    return sqrt(sum);
+}
+
+// Class constructor
+least_squares_solver::least_squares_solver() {
+};
+
+/*!
+ * \brief Set up the solver for the matrix LHS_matr
+ *
+ * For the ALGLIB backend, LHS_matr must be in CRS format, and must not be changed
+ * or freed while the solver is in use. The native backend keeps its own copy of the
+ * matrix (and of its transpose), so LHS_matr can be freed after the build.
+ *
+ * For the native backend, the columns are scaled by the inverse of their norms (the default
+ * ALGLIB preconditioner), and ||A|| (which enters the stopping criteria) is estimated with a few
+ * power iterations on the scaled matrix, in place of the ALGLIB norm estimator.
+ *
+ * @param[in]   LHS_matr        matrix of the least-squares problem
+ * @param[in]   epsa            stop if ||A^T*Rk|| / (||A||*||Rk||) <= epsa
+ * @param[in]   epsb            stop if ||Rk|| <= epsb*||B||
+ * @param[in]   max_iters       stop after max_iters iterations (0 for no limit)
+ * @param[in]   native          use the native solver instead of ALGLIB (see NATIVE_LSQR_SOLVER)
+ *
+ */
+void least_squares_solver::build(
+        const alglib::sparsematrix & LHS_matr,
+        const double epsa,
+        const double epsb,
+        const int max_iters,
+        const bool native
+        ) {
+
+    use_native = native;
+    Nrows = alglib::sparsegetnrows( LHS_matr );
+    Ncols = alglib::sparsegetncols( LHS_matr );
+    terminationtype = 0;
+    iterationscount = 0;
+
+    maxits = max_iters;
+
+    if (not(use_native)) {
+        alglib_matr = &LHS_matr;
+        alglib::linlsqrcreate( Nrows, Ncols, state );
+        alglib::linlsqrsetcond( state, epsa, epsb, max_iters );
+        return;
+    }
+
+    A.build( LHS_matr );
+    prepare_native( epsa, epsb, max_iters );
+};
+
+/*!
+ * \brief Set up the solver for the matrix LHS_matr (already in compressed row storage)
+ *
+ * This avoids the ALGLIB hash-table matrix when the matrix is assembled directly (see crs_matrix::assemble).
+ * The native backend copies LHS_matr, and the ALGLIB backend copies it into an ALGLIB CRS matrix,
+ * so in either case LHS_matr can be freed after the build.
+ *
+ * @param[in]   LHS_matr        matrix of the least-squares problem
+ * @param[in]   epsa            stop if ||A^T*Rk|| / (||A||*||Rk||) <= epsa
+ * @param[in]   epsb            stop if ||Rk|| <= epsb*||B||
+ * @param[in]   max_iters       stop after max_iters iterations (0 for no limit)
+ * @param[in]   native          use the native solver instead of ALGLIB (see NATIVE_LSQR_SOLVER)
+ *
+ */
+void least_squares_solver::build(
+        const crs_matrix & LHS_matr,
+        const double epsa,
+        const double epsb,
+        const int max_iters,
+        const bool native
+        ) {
+
+    use_native = native;
+    Nrows = LHS_matr.Nrows;
+    Ncols = LHS_matr.Ncols;
+    terminationtype = 0;
+    iterationscount = 0;
+
+    maxits = max_iters;
+
+    if (not(use_native)) {
+        LHS_matr.to_alglib( alglib_copy );
+        alglib_matr = &alglib_copy;
+        alglib::linlsqrcreate( Nrows, Ncols, state );
+        alglib::linlsqrsetcond( state, epsa, epsb, max_iters );
+        return;
+    }
+
+    A = LHS_matr;
+    prepare_native( epsa, epsb, max_iters );
+};
+
+/*!
+ * \brief Set up the native backend, once A has been filled in
+ *
+ * @param[in]   epsa,epsb,max_iters     stopping criteria (see build)
+ *
+ */
+void least_squares_solver::prepare_native(
+        const double epsa,
+        const double epsb,
+        const int max_iters
+        ) {
+
+    eps_a  = epsa;
+    eps_b  = epsb;
+    maxits = max_iters;
+
+    A.transpose( A_transpose );
+
+    // Preconditioner: inverse of the column norms (i.e. the row norms of the transpose)
+    column_scale.resize( Ncols );
+    for (int Icol = 0; Icol < Ncols; Icol++) {
+        double sum = 0.;
+        for (size_t II = A_transpose.row_start[Icol]; II < A_transpose.row_start[Icol + 1]; II++) {
+            sum += A_transpose.values[II] * A_transpose.values[II];
+        }
+        column_scale[Icol] = (sum > 0) ? 1. / sqrt(sum) : 1.;
+    }
+
+    // Estimate ||A * D|| with power iterations on (A * D)^T (A * D), from a fixed pseudo-random start
+    std::vector<double> x( Ncols ), Ax( Nrows ), AtAx( Ncols );
+    unsigned int seed = 12345;
+    for (int Icol = 0; Icol < Ncols; Icol++) {
+        seed = 1103515245u * seed + 12345u;
+        x[Icol] = 0.5 + (double)( seed >> 16 ) / 65536.;
+    }
+    const int Npower = 4;
+    Anorm = 0.;
+    for (int Iter = 0; Iter < Npower; Iter++) {
+        const double x_norm = vector_norm( x );
+        if (x_norm == 0) { break; }
+        for (int Icol = 0; Icol < Ncols; Icol++) { x[Icol] *= column_scale[Icol] / x_norm; }
+        A.multiply( Ax, x );
+        Anorm = vector_norm( Ax );
+        A_transpose.multiply( AtAx, Ax );
+        for (int Icol = 0; Icol < Ncols; Icol++) { x[Icol] = column_scale[Icol] * AtAx[Icol]; }
+    }
+    if (Anorm == 0) { Anorm = 1.; }
+};
+
+/*!
+ * \brief Change the tolerances for the following solves (the iteration limit is unchanged)
+ *
+ * @param[in]   epsa            stop if ||A^T*Rk|| / (||A||*||Rk||) <= epsa
+ * @param[in]   epsb            stop if ||Rk|| <= epsb*||B||
+ *
+ */
+void least_squares_solver::set_tolerances(
+        const double epsa,
+        const double epsb
+        ) {
+
+    if (not(use_native)) {
+        alglib::linlsqrsetcond( state, epsa, epsb, maxits );
+        return;
+    }
+
+    eps_a = epsa;
+    eps_b = epsb;
+};
+
+/*!
+ * \brief Solve the least-squares problem min || A * solution - rhs ||
+ *
+ * The termination code and number of iterations are stored in terminationtype and iterationscount.
+ *
+ * The native solver follows the LSQR outline of Paige and Saunders (1982), as in ALGLIB: the
+ * preconditioned system (A*D)*(inv(D)*x) = b is solved, with the products by A*D and (A*D)^T
+ * done on the CRS copies of A and A^T.
+ *
+ * @param[in,out]   solution    where to store the solution (length Ncols)
+ * @param[in]       rhs         right-hand side (length Nrows)
+ *
+ */
+void least_squares_solver::solve(
+        std::vector<double> & solution,
+        const std::vector<double> & rhs
+        ) {
+
+    assert( (int)rhs.size() == Nrows );
+
+    if (not(use_native)) {
+        alglib::real_1d_array rhs_alglib, F_alglib;
+        rhs_alglib.attach_to_ptr( Nrows, const_cast<double*>( rhs.data() ) );
+
+        alglib::linlsqrsolvesparse( state, *alglib_matr, rhs_alglib );
+        alglib::linlsqrresults( state, F_alglib, report );
+
+        const double * F_array = F_alglib.getcontent();
+        solution.assign( F_array, F_array + Ncols );
+        terminationtype = report.terminationtype;
+        iterationscount = alglib::linlsqrpeekiterationscount( state );
+        return;
+    }
+
+    const int m = Nrows, n = Ncols;
+    const double *D = column_scale.data();
+    const double eps_c = 1. / sqrt( DBL_EPSILON );
+
+    std::vector<double> u( rhs ), v( n ), v_next( n ), w( n ), d( n, 0. ), z( n, 0. ), Dv( n ), Au( m ), Atu( n );
+    double alpha, alpha_next, beta, rho, rho_bar, phi, phi_bar, c, s, theta, d_norm2 = 0.;
+
+    solution.assign( n, 0. );
+    iterationscount = 0;
+
+    // Step 0: beta * u = b,  alpha * v = (A*D)^T u,  w = v
+    const double b_norm = vector_norm( u );
+    if (b_norm == 0) { terminationtype = 1; return; }
+    beta = b_norm;
+    for (int II = 0; II < m; II++) { u[II] /= beta; }
+
+    A_transpose.multiply( Atu, u );
+    for (int II = 0; II < n; II++) { v[II] = D[II] * Atu[II]; }
+    alpha = vector_norm( v );
+    if (alpha == 0) { terminationtype = 4; return; }
+    for (int II = 0; II < n; II++) { v[II] /= alpha; w[II] = v[II]; }
+
+    phi_bar = beta;
+    rho_bar = alpha;
+
+    while (true) {
+        iterationscount++;
+
+        // Bidiagonalization: beta * u = (A*D) v - alpha * u
+        #pragma omp parallel for default(none) schedule(static) shared( Dv, v ) firstprivate( n, D )
+        for (int II = 0; II < n; II++) { Dv[II] = D[II] * v[II]; }
+        A.multiply( Au, Dv );
+        #pragma omp parallel for default(none) schedule(static) shared( u, Au ) firstprivate( m, alpha )
+        for (int II = 0; II < m; II++) { u[II] = Au[II] - alpha * u[II]; }
+        beta = vector_norm( u );
+        if (beta != 0) {
+            #pragma omp parallel for default(none) schedule(static) shared( u ) firstprivate( m, beta )
+            for (int II = 0; II < m; II++) { u[II] /= beta; }
+        }
+
+        //   and alpha_next * v_next = (A*D)^T u - beta * v
+        A_transpose.multiply( Atu, u );
+        #pragma omp parallel for default(none) schedule(static) shared( v_next, v, Atu ) firstprivate( n, D, beta )
+        for (int II = 0; II < n; II++) { v_next[II] = D[II] * Atu[II] - beta * v[II]; }
+        alpha_next = vector_norm( v_next );
+        if (alpha_next != 0) {
+            #pragma omp parallel for default(none) schedule(static) shared( v_next ) firstprivate( n, alpha_next )
+            for (int II = 0; II < n; II++) { v_next[II] /= alpha_next; }
+        }
+
+        // Next orthogonal transformation
+        rho     = hypot( rho_bar, beta );
+        c       = rho_bar / rho;
+        s       = beta / rho;
+        theta   = s * alpha_next;
+        rho_bar = - c * alpha_next;
+        phi     = c * phi_bar;
+        phi_bar = s * phi_bar;
+
+        // Condition estimate: stop if ||D_k|| * ||A|| is too large
+        double d_sum = 0.;
+        #pragma omp parallel for default(none) schedule(static) shared( d, v ) firstprivate( n, theta, rho ) reduction(+:d_sum)
+        for (int II = 0; II < n; II++) {
+            d[II] = ( v[II] - theta * d[II] ) / rho;
+            d_sum += d[II] * d[II];
+        }
+        d_norm2 += d_sum;
+        if ( sqrt(d_norm2) * Anorm >= eps_c ) { terminationtype = 7; break; }
+
+        // Update the (scaled) solution and the search direction
+        #pragma omp parallel for default(none) schedule(static) shared( z, w, v_next ) firstprivate( n, phi, theta, rho )
+        for (int II = 0; II < n; II++) {
+            z[II] += ( phi / rho ) * w[II];
+            w[II]  = v_next[II] - ( theta / rho ) * w[II];
+        }
+        v.swap( v_next );
+        alpha = alpha_next;
+
+        // Stopping criteria (same order as ALGLIB)
+        if ( (maxits > 0) and (iterationscount >= maxits) ) { terminationtype = 5; break; }
+        if ( phi_bar <= eps_b * b_norm )                     { terminationtype = 1; break; }
+        if ( alpha * fabs(c) / Anorm <= eps_a )              { terminationtype = 4; break; }
+    }
+
+    // Undo the preconditioning
+    for (int II = 0; II < n; II++) { solution[II] = D[II] * z[II]; }
+};
@@ -19,11 +19,16 @@
  *
  * Currently only handles spherical coordinates.
  *
+ * The matrix is assembled in parallel directly in compressed row storage (see crs_matrix::assemble),
+ * and Lap is then replaced by the CRS matrix, with the dimensions that Lap was created with.
+ * Only rows row_skip ... row_skip + Nlat*Nlon - 1 have entries.
+ *
  * @param[in,out]   Lap                     Where to store the (sparse) differentiation matrix
  * @param[in]       source_data             dataset class storing various fields (longitude, latitude, etc)
  * @param[in]       Itime,Idepth            Current time-depth iteration
  * @param[in]       mask                    Array to distinguish land/water
  * @param[in]       area_weight             Bool indicating if the Laplacian should be weighted by cell-size (i.e. weight error by cell size). Default is false.
+ * @param[in]       row_skip,column_skip    Offsets of the Laplacian block within Lap. Default is zero.
  *
  */
 void toroidal_sparse_Lap(
@@ -48,122 +53,131 @@ void toroidal_sparse_Lap(
                 Nlat    = myCounts.at(2),
                 Nlon    = myCounts.at(3);
 
-    int Ilat, Ilon, IDIFF, Idiff, Ndiff, LB;
-    size_t index, index_sub, diff_index;
-    double old_val, tmp, cos2_lat_inv, tan_lat;
-    std::vector<double> diff_vec;
-    bool is_pole;
-
     const double R2_inv = 1. / pow(constants::R_earth, 2);
 
-    for ( Ilat = 0; Ilat < Nlat; Ilat++ ) {
-        for ( Ilon = 0; Ilon < Nlon; Ilon++ ) {
-            
-            // If we're too close to the pole (less than 0.01 degrees), bad things happen
-            is_pole = std::fabs( std::fabs( latitude.at(Ilat) * 180.0 / M_PI ) - 90 ) < 0.01;
+    // Each grid point produces the entries for its own row (row_skip + index_sub)
+    auto point_entries = [&]( std::vector<int> & rows, std::vector<int> & cols, std::vector<double> & vals, const int Iblock ) {
+
+        const int Ilat = Iblock / Nlon,
+                  Ilon = Iblock % Nlon;
+
+        int IDIFF, Idiff, Ndiff, LB;
+        size_t index, index_sub, diff_index;
+        double tmp, cos2_lat_inv, tan_lat;
+        std::vector<double> diff_vec;
+        bool is_pole;
+
+        auto add_entry = [&]( const size_t Irow, const size_t Icol, const double val ) {
+            rows.push_back( Irow );
+            cols.push_back( Icol );
+            vals.push_back( val );
+        };
 
-            cos2_lat_inv = 1. / pow( cos(latitude.at(Ilat)), 2 );
-            tan_lat = tan(latitude.at(Ilat));
+        // If we're too close to the pole (less than 0.01 degrees), bad things happen
+        is_pole = std::fabs( std::fabs( latitude.at(Ilat) * 180.0 / M_PI ) - 90 ) < 0.01;
 
-            index = Index(Itime, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon);
-            index_sub = Index(0, 0, Ilat, Ilon, 1, 1, Nlat, Nlon);
+        cos2_lat_inv = 1. / pow( cos(latitude.at(Ilat)), 2 );
+        tan_lat = tan(latitude.at(Ilat));
 
-            if ( (mask.at(index)) and not(is_pole) ) { // Skip land areas and poles
+        index = Index(Itime, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon);
+        index_sub = Index(0, 0, Ilat, Ilon, 1, 1, Nlat, Nlon);
 
-                //
-                //// LON second derivative part
-                //
+        if ( (mask.at(index)) and not(is_pole) ) { // Skip land areas and poles
 
-                LB = - 2 * Nlon;
-                get_diff_vector(diff_vec, LB, longitude, "lon",
-                                Itime, Idepth, Ilat, Ilon,
-                                Ntime, Ndepth, Nlat, Nlon,
-                                mask, 2, constants::DiffOrd);
+            //
+            //// LON second derivative part
+            //
 
-                Ndiff = diff_vec.size();
+            LB = - 2 * Nlon;
+            get_diff_vector(diff_vec, LB, longitude, "lon",
+                            Itime, Idepth, Ilat, Ilon,
+                            Ntime, Ndepth, Nlat, Nlon,
+                            mask, 2, constants::DiffOrd);
 
-                // If LB is unchanged, then we failed to build a stencil
-                if (LB != - 2 * Nlon) {
-                    for ( IDIFF = LB; IDIFF < LB + Ndiff; IDIFF++ ) {
+            Ndiff = diff_vec.size();
 
-                        if (constants::PERIODIC_X) { Idiff = ( IDIFF % Nlon + Nlon ) % Nlon; }
-                        else                       { Idiff = IDIFF;                          }
+            // If LB is unchanged, then we failed to build a stencil
+            if (LB != - 2 * Nlon) {
+                for ( IDIFF = LB; IDIFF < LB + Ndiff; IDIFF++ ) {
 
-                        diff_index = Index(0, 0, Ilat, Idiff, 1, 1, Nlat, Nlon);
+                    if (constants::PERIODIC_X) { Idiff = ( IDIFF % Nlon + Nlon ) % Nlon; }
+                    else                       { Idiff = IDIFF;                          }
 
-                        tmp = diff_vec.at(IDIFF-LB) * cos2_lat_inv * R2_inv;
-                        if (area_weight) { tmp *= areas.at(index_sub); }
+                    diff_index = Index(0, 0, Ilat, Idiff, 1, 1, Nlat, Nlon);
 
-                        old_val = sparseget(Lap, row_skip + index_sub, column_skip + diff_index);
-                        alglib::sparseset(  Lap, row_skip + index_sub, column_skip + diff_index, old_val + tmp);
-                    }
+                    tmp = diff_vec.at(IDIFF-LB) * cos2_lat_inv * R2_inv;
+                    if (area_weight) { tmp *= areas.at(index_sub); }
+
+                    add_entry( row_skip + index_sub, column_skip + diff_index, tmp );
                 }
+            }
 
 
-                //
-                //// LAT second derivative part
-                //
+            //
+            //// LAT second derivative part
+            //
 
-                LB = -2 * Nlat;
-                get_diff_vector(diff_vec, LB, latitude, "lat",
-                                Itime, Idepth, Ilat, Ilon,
-                                Ntime, Ndepth, Nlat, Nlon,
-                                mask, 2, constants::DiffOrd);
+            LB = -2 * Nlat;
+            get_diff_vector(diff_vec, LB, latitude, "lat",
+                            Itime, Idepth, Ilat, Ilon,
+                            Ntime, Ndepth, Nlat, Nlon,
+                            mask, 2, constants::DiffOrd);
 
-                Ndiff = diff_vec.size();
+            Ndiff = diff_vec.size();
 
-                // If LB is unchanged, then we failed to build a stencil
-                if (LB != - 2 * Nlat) {
-                    for ( IDIFF = LB; IDIFF < LB + Ndiff; IDIFF++ ) {
+            // If LB is unchanged, then we failed to build a stencil
+            if (LB != - 2 * Nlat) {
+                for ( IDIFF = LB; IDIFF < LB + Ndiff; IDIFF++ ) {
 
-                        if (constants::PERIODIC_Y) { Idiff = ( IDIFF % Nlat + Nlat ) % Nlat; }
-                        else                       { Idiff = IDIFF;                          }
+                    if (constants::PERIODIC_Y) { Idiff = ( IDIFF % Nlat + Nlat ) % Nlat; }
+                    else                       { Idiff = IDIFF;                          }
 
-                        diff_index = Index(0, 0, Idiff, Ilon, 1, 1, Nlat,  Nlon);
+                    diff_index = Index(0, 0, Idiff, Ilon, 1, 1, Nlat,  Nlon);
 
-                        tmp = diff_vec.at(IDIFF-LB) * R2_inv;
-                        if (area_weight) { tmp *= areas.at(index_sub); }
+                    tmp = diff_vec.at(IDIFF-LB) * R2_inv;
+                    if (area_weight) { tmp *= areas.at(index_sub); }
 
-                        old_val = sparseget(Lap, row_skip + index_sub, column_skip + diff_index);
-                        alglib::sparseset(  Lap, row_skip + index_sub, column_skip + diff_index, old_val + tmp);
-                    }
+                    add_entry( row_skip + index_sub, column_skip + diff_index, tmp );
                 }
+            }
 
 
-                //
-                //// LAT first derivative part
-                //
+            //
+            //// LAT first derivative part
+            //
 
-                LB = - 2 * Nlat;
-                get_diff_vector(diff_vec, LB, latitude, "lat",
-                                Itime, Idepth, Ilat, Ilon,
-                                Ntime, Ndepth, Nlat, Nlon,
-                                mask, 1, constants::DiffOrd);
+            LB = - 2 * Nlat;
+            get_diff_vector(diff_vec, LB, latitude, "lat",
+                            Itime, Idepth, Ilat, Ilon,
+                            Ntime, Ndepth, Nlat, Nlon,
+                            mask, 1, constants::DiffOrd);
 
-                Ndiff = diff_vec.size();
+            Ndiff = diff_vec.size();
 
-                // If LB is unchanged, then we failed to build a stencil
-                if (LB != - 2 * Nlat) {
-                    for ( IDIFF = LB; IDIFF < LB + Ndiff; IDIFF++ ) {
+            // If LB is unchanged, then we failed to build a stencil
+            if (LB != - 2 * Nlat) {
+                for ( IDIFF = LB; IDIFF < LB + Ndiff; IDIFF++ ) {
 
-                        if (constants::PERIODIC_Y) { Idiff = ( IDIFF % Nlat + Nlat ) % Nlat; }
-                        else                       { Idiff = IDIFF;                          }
+                    if (constants::PERIODIC_Y) { Idiff = ( IDIFF % Nlat + Nlat ) % Nlat; }
+                    else                       { Idiff = IDIFF;                          }
 
-                        diff_index = Index(0, 0, Idiff, Ilon, 1, 1, Nlat,  Nlon);
+                    diff_index = Index(0, 0, Idiff, Ilon, 1, 1, Nlat,  Nlon);
 
-                        tmp = - diff_vec.at(IDIFF-LB) * tan_lat * R2_inv;
-                        if (area_weight) { tmp *= areas.at(index_sub); }
+                    tmp = - diff_vec.at(IDIFF-LB) * tan_lat * R2_inv;
+                    if (area_weight) { tmp *= areas.at(index_sub); }
 
-                        old_val = sparseget(Lap, row_skip + index_sub, column_skip + diff_index);
-                        alglib::sparseset(  Lap, row_skip + index_sub, column_skip + diff_index, old_val + tmp);
-                    }
+                    add_entry( row_skip + index_sub, column_skip + diff_index, tmp );
                 }
-            } else { // end mask if
-                // If this spot is masked, then set the value to 1
-                //   if we correspondingly set the RHS value to 0,
-                //   then this should force a zero value over land
-                alglib::sparseset(Lap, row_skip + index_sub, column_skip + index_sub, 1.);
             }
+        } else { // end mask if
+            // If this spot is masked, then set the value to 1
+            //   if we correspondingly set the RHS value to 0,
+            //   then this should force a zero value over land
+            add_entry( row_skip + index_sub, column_skip + index_sub, 1. );
         }
-    }
+    };
+
+    crs_matrix Lap_crs;
+    Lap_crs.assemble( alglib::sparsegetnrows( Lap ), alglib::sparsegetncols( Lap ), Nlat * Nlon, point_entries );
+    Lap_crs.to_alglib( Lap );
 }
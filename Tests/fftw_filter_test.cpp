@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <math.h>
+#include <vector>
+#include <omp.h>
+#include <fftw3.h>
+#include "../functions.hpp"
+#include "../fft_based.hpp"
+#include "../constants.hpp"
+
+// Compare the FFTW-based filter (fft_forward / fft_transfer_function / fft_filter, as used by
+//   filtering_fftw) against the direct stencil sums (apply_filter_at_point_all_levels) on a
+//   periodic Cartesian domain without land. The grid is not square, and has two depths, so that
+//   the batched (howmany) plans are used as in the driver. With FFT_TRANSFER_FROM_KERNEL, the only
+//   difference should come from the direct stencils being cut off at KernPad, which is negligible
+//   for the Gaussian kernels.
+//
+// Usage: ./fftw_filter_test.x [Nlat (default 48)] [Nlon (default 64)]
+
+const double tolerance = 1e-8;
+
+double u_func(const double y, const double x) {
+    return sin( 2 * M_PI * x ) * cos( 4 * M_PI * y ) + 0.3 * cos( 2 * M_PI * ( 5 * x + 3 * y ) );
+}
+
+double v_func(const double y, const double x) {
+    return cos( 6 * M_PI * x ) + 0.5 * sin( 2 * M_PI * ( 7 * y - 2 * x ) );
+}
+
+int main(int argc, char *argv[]) {
+
+    fprintf(stdout, "Beginning FFTW filter tests.\n");
+
+    static_assert( constants::CARTESIAN and constants::PERIODIC_X and constants::PERIODIC_Y,
+            "The FFTW filter requires a periodic Cartesian grid" );
+    static_assert( constants::UNIFORM_LON_GRID and constants::UNIFORM_LAT_GRID, "The FFTW filter requires a uniform grid" );
+    static_assert( constants::FFT_TRANSFER_FROM_KERNEL, "The comparison needs the transfer function of the kernel" );
+    static_assert( (constants::KERNEL_OPT == constants::KernelType::Gaussian) or
+                   (constants::KERNEL_OPT == constants::KernelType::JohnsonGaussian),
+                   "The direct stencils are only negligibly truncated for Gaussian kernels" );
+
+    int thread_safety_provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &thread_safety_provided);
+
+    const int       Nlat    = (argc > 1) ? atoi(argv[1]) : 48,
+                    Nlon    = (argc > 2) ? atoi(argv[2]) : 64,
+                    Ntime   = 1,
+                    Ndepth  = 2,
+                    Nlevels = Ntime * Ndepth;
+    const size_t    Npts    = (size_t) Nlevels * Nlat * Nlon,
+                    Nk      = (size_t) Nlevels * Nlat * (Nlon/2 + 1);
+
+    const double    Lx  = 1000e3,
+                    Ly  = 750e3,
+                    dx  = Lx / Nlon,
+                    dy  = Ly / Nlat;
+
+    const std::vector<double> scales = { 30e3, 60e3, 120e3 };
+
+    dataset source_data;
+    source_data.time  = { 0. };
+    source_data.depth = { 0., 1. };
+    source_data.latitude.resize(  Nlat );
+    source_data.longitude.resize( Nlon );
+    for (int II = 0; II < Nlat; II++) { source_data.latitude.at( II) = - Ly / 2 + (II+0.5) * dy; }
+    for (int II = 0; II < Nlon; II++) { source_data.longitude.at(II) = - Lx / 2 + (II+0.5) * dx; }
+
+    source_data.Ntime   = Ntime;
+    source_data.Ndepth  = Ndepth;
+    source_data.Nlat    = Nlat;
+    source_data.Nlon    = Nlon;
+
+    source_data.compute_cell_areas();
+
+    // No land, and different fields at each depth
+    source_data.mask.assign( Npts, true );
+    std::vector<double> u( Npts ), v( Npts );
+    for (int Idepth = 0; Idepth < Ndepth; Idepth++) {
+        for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+            for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+                const size_t index = Index(0, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon);
+                const double y = source_data.latitude.at(Ilat) / Ly, x = source_data.longitude.at(Ilon) / Lx;
+                u.at(index) = u_func( y, x ) * ( 1 + Idepth );
+                v.at(index) = v_func( y, x ) - Idepth;
+            }
+        }
+    }
+
+    const std::vector<const std::vector<double>*>
+        fields  = { &u,   &v,   &u },
+        factors = { NULL, NULL, &v };
+    const char * field_names[] = { "u", "v", "u*v" };
+    const int Nfields = fields.size();
+
+    // Plans, laid out as in filtering_fftw
+    const int n[] = { Nlat, Nlon };
+    double * fft_inp = fftw_alloc_real( Npts );
+    fftw_complex * fft_out = fftw_alloc_complex( Nk );
+    fftw_plan fft  = fftw_plan_many_dft_r2c( 2, n, Nlevels, fft_inp, NULL, 1, Nlat * Nlon,
+                                             fft_out, NULL, 1, Nlat * (Nlon/2 + 1), FFTW_ESTIMATE );
+    fftw_plan ifft = fftw_plan_many_dft_c2r( 2, n, Nlevels, fft_out, NULL, 1, Nlat * (Nlon/2 + 1),
+                                             fft_inp, NULL, 1, Nlat * Nlon, FFTW_ESTIMATE );
+
+    // Each field is transformed once, and then filtered at every scale
+    std::vector<fftw_complex*> spectra( Nfields );
+    for (int Ifield = 0; Ifield < Nfields; Ifield++) {
+        spectra[Ifield] = fftw_alloc_complex( Nk );
+        fft_forward( spectra[Ifield], *fields[Ifield], factors[Ifield], source_data.mask, fft, fft_inp );
+    }
+
+    std::vector< std::vector<double> > fft_storage( Nfields ), direct_storage( Nfields, std::vector<double>( Npts, 0. ) );
+    std::vector<double> transfer;
+    bool passed = true;
+
+    fprintf(stdout, "\nRelative errors (FFTW - direct), Nlat = %d, Nlon = %d:\n", Nlat, Nlon);
+    fprintf(stdout, "%10s  %-8s  %12s  %12s\n", "scale(km)", "field", "max", "RMS");
+
+    for (size_t Iscale = 0; Iscale < scales.size(); Iscale++) {
+        const double scale = scales[Iscale];
+
+        fft_transfer_function( transfer, scale, source_data );
+        for (int Ifield = 0; Ifield < Nfields; Ifield++) {
+            fft_filter( fft_storage[Ifield], spectra[Ifield], transfer, ifft, fft_inp, fft_out, Nlevels, Nlat, Nlon );
+        }
+
+        #pragma omp parallel default(none) \
+        shared( direct_storage, fields, factors, source_data ) \
+        firstprivate( Nlat, Nlon, Ntime, Ndepth, Nlevels, Nfields, scale )
+        {
+            kernel_stencil stencil;
+            std::vector<double> level_vals, null_vector;
+
+            #pragma omp for schedule(dynamic)
+            for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+                stencil.build( source_data, scale, Ilat, 0 );
+                for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+                    apply_filter_at_point_all_levels( level_vals, null_vector, null_vector, null_vector, null_vector,
+                            fields, factors, source_data, Ilat, Ilon, stencil, NULL, false, NULL );
+                    for (int Ilev = 0; Ilev < Nlevels; Ilev++) {
+                        const size_t index = Index(Ilev / Ndepth, Ilev % Ndepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon);
+                        for (int Ifield = 0; Ifield < Nfields; Ifield++) {
+                            direct_storage[Ifield].at(index) = level_vals[ Ilev * Nfields + Ifield ];
+                        }
+                    }
+                }
+            }
+        }
+
+        for (int Ifield = 0; Ifield < Nfields; Ifield++) {
+            double max_diff = 0, max_ref = 0, sum_sq_diff = 0, sum_sq_ref = 0;
+            for (size_t index = 0; index < Npts; index++) {
+                const double    ref  = direct_storage[Ifield][index],
+                                diff = fabs( fft_storage[Ifield][index] - ref );
+                max_diff = std::max( max_diff, diff );
+                max_ref  = std::max( max_ref,  fabs( ref ) );
+                sum_sq_diff += diff * diff;
+                sum_sq_ref  += ref * ref;
+            }
+            const double rel_max = (max_ref > 0) ? max_diff / max_ref : 0.;
+            if (rel_max > tolerance) { passed = false; }
+            fprintf(stdout, "%10.5g  %-8s  %12.4e  %12.4e\n", scale / 1e3, field_names[Ifield],
+                    rel_max, (sum_sq_ref > 0) ? sqrt( sum_sq_diff / sum_sq_ref ) : 0.);
+        }
+    }
+
+    for (int Ifield = 0; Ifield < Nfields; Ifield++) { fftw_free( spectra[Ifield] ); }
+    fftw_destroy_plan( fft );
+    fftw_destroy_plan( ifft );
+    fftw_free( fft_inp );
+    fftw_free( fft_out );
+
+    fprintf(stdout, "\n%s (tolerance %g)\n", passed ? "Passed" : "FAILED", tolerance);
+
+    MPI_Finalize();
+    return passed ? 0 : 1;
+}
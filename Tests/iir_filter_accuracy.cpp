@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <math.h>
+#include <vector>
+#include <omp.h>
+#include "../functions.hpp"
+#include "../constants.hpp"
+
+// Report the accuracy of the recursive (IIR) Gaussian filter (see IIR_GAUSSIAN_FILTER) against
+//   the direct stencil sums (apply_filter_at_point_all_levels), over a range of scales, on a 
+//   sphere with continents. The direct filter is only evaluated at a sample of points (every 
+//   Nth water point), since it is prohibitively expensive at the largest scales.
+//
+// Usage: ./iir_filter_accuracy.x [sample stride (default 17)]
+
+const double D2R = M_PI / 180;
+
+double u_lon_func(const double lat, const double lon) {
+    return 0.5 * cos(lat) * sin(3 * lon) + 0.2 * sin( 16 * lon + 12 * lat) * cos( 10 * lon - 8 * lat );
+}
+
+double u_lat_func(const double lat, const double lon) {
+    return 0.3 * cos( 2 * lat ) * cos( 2 * lon ) + 0.1 * cos( 25 * lon + 17 * lat );
+}
+
+bool mask_func(const double lat, const double lon) {
+    // Rectangular continent, and land over the south pole
+    if ( (lat > 10 * D2R) and (lat < 40 * D2R) and (lon > 20 * D2R) and (lon < 80 * D2R) ) { return false; }
+    if ( lat < -75 * D2R ) { return false; }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+
+    fprintf(stdout, "Beginning recursive filter accuracy tests.\n");
+
+    static_assert( (constants::KERNEL_OPT == constants::KernelType::Gaussian) or 
+                   (constants::KERNEL_OPT == constants::KernelType::JohnsonGaussian),
+                   "The recursive filter approximates a Gaussian kernel" );
+    static_assert( not(constants::CARTESIAN), "The accuracy test uses a spherical grid" );
+    static_assert( constants::PERIODIC_X and constants::UNIFORM_LON_GRID and constants::FULL_LON_SPAN,
+            "The direct reference rolls the kernel in longitude" );
+
+    int thread_safety_provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &thread_safety_provided);
+
+    const int       Nlat   = 180,
+                    Nlon   = 360,
+                    stride = (argc > 1) ? atoi(argv[1]) : 17;
+    const size_t    Npts   = Nlat * Nlon;
+
+    const double    dlat  = M_PI / Nlat,
+                    dlon  = 2 * M_PI / Nlon;
+
+    const std::vector<double> scales = { 100e3, 250e3, 500e3, 1000e3, 2000e3, 4000e3 };
+
+    dataset source_data;
+    source_data.time  = { 0. };
+    source_data.depth = { 0. };
+    source_data.latitude.resize(  Nlat );
+    source_data.longitude.resize( Nlon );
+    for (int II = 0; II < Nlat; II++) { source_data.latitude.at( II) = - M_PI / 2 + (II+0.5) * dlat; }
+    for (int II = 0; II < Nlon; II++) { source_data.longitude.at(II) = - M_PI     + (II+0.5) * dlon; }
+
+    source_data.Ntime   = 1;
+    source_data.Ndepth  = 1;
+    source_data.Nlat    = Nlat;
+    source_data.Nlon    = Nlon;
+
+    source_data.compute_cell_areas();
+
+    // Initialize the fields (zero on land)
+    std::vector<filter_real> u_lon( Npts, 0. ), u_lat( Npts, 0. );
+    source_data.mask.resize( Npts );
+    for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+        for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+            const size_t index = Index(0, 0, Ilat, Ilon, 1, 1, Nlat, Nlon);
+            const double lat = source_data.latitude.at(Ilat), lon = source_data.longitude.at(Ilon);
+            source_data.mask.at(index) = mask_func( lat, lon );
+            if ( source_data.mask.at(index) ) {
+                u_lon.at(index) = u_lon_func( lat, lon );
+                u_lat.at(index) = u_lat_func( lat, lon );
+            }
+        }
+    }
+
+    water_runs water;
+    water.build( source_data.mask, 1, 1, Nlat, Nlon );
+
+    const std::vector<const std::vector<filter_real>*> 
+        fields  = { &u_lon, &u_lat, &u_lon },
+        factors = { NULL,   NULL,   &u_lat };
+    const char * field_names[] = { "u_lon", "u_lat", "u_lon*u_lat" };
+    const int Nfields = fields.size();
+
+    std::vector< std::vector<double> > iir_storage( Nfields, std::vector<double>( Npts, 0. ) );
+    std::vector< std::vector<double>* > iir_outputs;
+    for (int Ifield = 0; Ifield < Nfields; Ifield++) { iir_outputs.push_back( &iir_storage[Ifield] ); }
+
+    // Sampled water points
+    std::vector<int> sample_lat, sample_lon;
+    for (size_t II = stride / 2; II < Npts; II += stride) {
+        if ( not(source_data.mask.at(II)) ) { continue; }
+        sample_lat.push_back( II / Nlon );
+        sample_lon.push_back( II % Nlon );
+    }
+    const int Nsamples = sample_lat.size();
+
+    fprintf(stdout, "\nRelative errors (recursive - direct) at %d sampled water points:\n", Nsamples);
+    fprintf(stdout, "%10s  %-12s  %12s  %12s  %10s  %10s\n", "scale(km)", "field", "max", "RMS", "direct(s)", "iir(s)");
+
+    for (size_t Iscale = 0; Iscale < scales.size(); Iscale++) {
+        const double scale = scales[Iscale];
+
+        double clock_on = MPI_Wtime();
+        apply_filter_iir( iir_outputs, fields, factors, source_data, scale, 0, Nlat );
+        const double iir_time = MPI_Wtime() - clock_on;
+
+        std::vector<double> direct( Nsamples * Nfields );
+        clock_on = MPI_Wtime();
+        #pragma omp parallel default(none) \
+        shared( direct, fields, factors, source_data, water, sample_lat, sample_lon ) \
+        firstprivate( Nsamples, Nfields, scale )
+        {
+            kernel_stencil stencil;
+            std::vector<double> level_vals, null_vector;
+
+            #pragma omp for schedule(dynamic)
+            for (int Isample = 0; Isample < Nsamples; Isample++) {
+                stencil.build( source_data, scale, sample_lat[Isample], 0 );
+                apply_filter_at_point_all_levels( level_vals, null_vector, null_vector, null_vector, null_vector,
+                        fields, factors, source_data, sample_lat[Isample], sample_lon[Isample], stencil, NULL, true, &water );
+                for (int Ifield = 0; Ifield < Nfields; Ifield++) { direct[ Isample * Nfields + Ifield ] = level_vals[Ifield]; }
+            }
+        }
+        const double direct_time = MPI_Wtime() - clock_on;
+
+        for (int Ifield = 0; Ifield < Nfields; Ifield++) {
+            double max_diff = 0, max_ref = 0, sum_sq_diff = 0, sum_sq_ref = 0;
+            for (int Isample = 0; Isample < Nsamples; Isample++) {
+                const double    ref  = direct[ Isample * Nfields + Ifield ],
+                                diff = fabs( iir_storage[Ifield].at( sample_lat[Isample] * Nlon + sample_lon[Isample] ) - ref );
+                max_diff = std::max( max_diff, diff );
+                max_ref  = std::max( max_ref,  fabs( ref ) );
+                sum_sq_diff += diff * diff;
+                sum_sq_ref  += ref * ref;
+            }
+            fprintf(stdout, "%10.5g  %-12s  %12.4e  %12.4e  %10.3g  %10.3g\n", scale / 1e3, field_names[Ifield],
+                    (max_ref > 0) ? max_diff / max_ref : 0., (sum_sq_ref > 0) ? sqrt( sum_sq_diff / sum_sq_ref ) : 0.,
+                    direct_time, iir_time);
+        }
+    }
+
+    MPI_Finalize();
+    return 0;
+}
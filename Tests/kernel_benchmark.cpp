@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <math.h>
+#include <vector>
+#include <random>
+#include <assert.h>
+#include "../functions.hpp"
+#include "../constants.hpp"
+
+int main(int argc, char *argv[]) {
+
+    fprintf(stdout, "Beginning benchmark for the tabulated kernel.\n");
+
+    static_assert( constants::USE_KERNEL_TABLE, "The benchmark compares the kernel table against kernel(), so needs USE_KERNEL_TABLE" );
+
+    int thread_safety_provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &thread_safety_provided);
+    MPI_Comm_set_errhandler(MPI_COMM_WORLD, MPI::ERRORS_THROW_EXCEPTIONS);
+
+    int wRank=-1, wSize=-1;
+    MPI_Comm_rank( MPI_COMM_WORLD, &wRank );
+    MPI_Comm_size( MPI_COMM_WORLD, &wSize );
+
+    assert(wSize==1);
+
+    const int Npts = 4000000;
+    const double filter_scale = 100e3;
+
+    // Random distances within the kernel search radius
+    const double max_dist = fmax( constants::KernPad, 1. ) * filter_scale / 2.;
+    std::mt19937 gen(1);
+    std::uniform_real_distribution<double> dist_gen(0., max_dist);
+    std::vector<double> dists( Npts );
+    for (int II = 0; II < Npts; II++) { dists.at(II) = dist_gen(gen); }
+
+    std::vector<double> kern_exact(Npts), dl_exact(Npts), dll_exact(Npts),
+                        kern_table(Npts), dl_table(Npts), dll_table(Npts);
+
+    // Build the table before timing
+    double tmp0, tmp1, tmp2;
+    kernel_tabulated( tmp0, tmp1, tmp2, 0., filter_scale, 2 );
+
+    const double exact_start_time = MPI_Wtime();
+    for (int II = 0; II < Npts; II++) {
+        kern_exact[II] = kernel( dists[II], filter_scale, 0 );
+        dl_exact[II]   = kernel( dists[II], filter_scale, 1 );
+        dll_exact[II]  = kernel( dists[II], filter_scale, 2 );
+    }
+    const double exact_stop_time = MPI_Wtime();
+
+    const double table_start_time = MPI_Wtime();
+    for (int II = 0; II < Npts; II++) {
+        kernel_tabulated( kern_table[II], dl_table[II], dll_table[II], dists[II], filter_scale, 2 );
+    }
+    const double table_stop_time = MPI_Wtime();
+
+    // Errors, relative to the largest magnitude of each quantity
+    double max_err[3] = {0., 0., 0.}, max_val[3] = {0., 0., 0.};
+    for (int II = 0; II < Npts; II++) {
+        max_err[0] = fmax( max_err[0], fabs( kern_table[II] - kern_exact[II] ) );
+        max_err[1] = fmax( max_err[1], fabs( dl_table[II]   - dl_exact[II]   ) );
+        max_err[2] = fmax( max_err[2], fabs( dll_table[II]  - dll_exact[II]  ) );
+        max_val[0] = fmax( max_val[0], fabs( kern_exact[II] ) );
+        max_val[1] = fmax( max_val[1], fabs( dl_exact[II]   ) );
+        max_val[2] = fmax( max_val[2], fabs( dll_exact[II]  ) );
+    }
+
+    fprintf( stdout, "Timing Results  (%'d evaluations of value + 2 derivatives)\n\n", Npts );
+    fprintf( stdout, " Exact     kernel: %.6g s\n", exact_stop_time - exact_start_time );
+    fprintf( stdout, " Tabulated kernel: %.6g s\n", table_stop_time - table_start_time );
+    fprintf( stdout, "\n" );
+    fprintf( stdout, "Relative errors (max abs error / max abs value)\n\n" );
+    fprintf( stdout, " kernel          : %.4g\n", max_val[0] > 0 ? max_err[0] / max_val[0] : 0. );
+    fprintf( stdout, " ell-derivative  : %.4g\n", max_val[1] > 0 ? max_err[1] / max_val[1] : 0. );
+    fprintf( stdout, " 2nd derivative  : %.4g\n", max_val[2] > 0 ? max_err[2] / max_val[2] : 0. );
+
+    MPI_Finalize();
+
+    // Fail if the tabulated kernel is less accurate than documented
+    const bool passed = ( max_err[0] <= 1e-9 * max_val[0] ) and ( max_err[1] <= 1e-7 * max_val[1] )
+                                                            and ( max_err[2] <= 1e-7 * max_val[2] );
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <math.h>
+#include <vector>
+#include <omp.h>
+#include "../functions.hpp"
+#include "../constants.hpp"
+
+// Compare the longitude-FFT filter (see USE_LON_FFT_FILTER) against the direct stencil
+//   sums (apply_filter_at_point_all_levels) at every point of a sphere with continents.
+//   The number of longitudes is not a power of two (so that the mixed-radix transforms
+//   are used), one of the continents straddles the periodic boundary, and the second
+//   depth has more land than the first. Both methods use the same kernel and denominator,
+//   so the differences should be at round-off level.
+//
+// Usage: ./lon_fft_filter_test.x [Nlat (default 90)] [Nlon (default 270)]
+
+const double D2R = M_PI / 180;
+
+double u_lon_func(const double lat, const double lon) {
+    return 0.5 * cos(lat) * sin(3 * lon) + 0.2 * sin( 16 * lon + 12 * lat) * cos( 10 * lon - 8 * lat );
+}
+
+double u_lat_func(const double lat, const double lon) {
+    return 0.3 * cos( 2 * lat ) * cos( 2 * lon ) + 0.1 * cos( 25 * lon + 17 * lat );
+}
+
+bool mask_func(const double lat, const double lon, const int Idepth) {
+    // Rectangular continent, and one that crosses the periodic boundary in longitude
+    if ( (lat > 10 * D2R) and (lat < 40 * D2R) and (lon > 20 * D2R) and (lon < 80 * D2R) ) { return false; }
+    if ( (lat > -50 * D2R) and (lat < 5 * D2R) and ( (lon > 165 * D2R) or (lon < -170 * D2R) ) ) { return false; }
+    // The deeper level also has land over the south pole
+    if ( (Idepth > 0) and (lat < -70 * D2R) ) { return false; }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+
+    fprintf(stdout, "Beginning longitude-FFT filter tests.\n");
+
+    static_assert( not(constants::CARTESIAN), "The lon-FFT test uses a spherical grid" );
+    static_assert( constants::PERIODIC_X and constants::UNIFORM_LON_GRID and constants::FULL_LON_SPAN,
+            "Filtering via FFTs in longitude requires a uniform, periodic, full-span longitude grid" );
+
+    int thread_safety_provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &thread_safety_provided);
+
+    const int       Nlat    = (argc > 1) ? atoi(argv[1]) : 90,
+                    Nlon    = (argc > 2) ? atoi(argv[2]) : 270,
+                    Ntime   = 1,
+                    Ndepth  = 2;
+    const size_t    Npts    = Ntime * Ndepth * Nlat * Nlon;
+
+    const double    dlat  = M_PI / Nlat,
+                    dlon  = 2 * M_PI / Nlon;
+
+    const std::vector<double> scales = { 150e3, 600e3, 2500e3 };
+
+    dataset source_data;
+    source_data.time  = { 0. };
+    source_data.depth = { 0., 1. };
+    source_data.latitude.resize(  Nlat );
+    source_data.longitude.resize( Nlon );
+    for (int II = 0; II < Nlat; II++) { source_data.latitude.at( II) = - M_PI / 2 + (II+0.5) * dlat; }
+    for (int II = 0; II < Nlon; II++) { source_data.longitude.at(II) = - M_PI     + (II+0.5) * dlon; }
+
+    source_data.Ntime   = Ntime;
+    source_data.Ndepth  = Ndepth;
+    source_data.Nlat    = Nlat;
+    source_data.Nlon    = Nlon;
+
+    source_data.compute_cell_areas();
+
+    // Initialize the fields (zero on land)
+    std::vector<filter_real> u_lon( Npts, 0. ), u_lat( Npts, 0. );
+    source_data.mask.resize( Npts );
+    for (int Idepth = 0; Idepth < Ndepth; Idepth++) {
+        for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+            for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+                const size_t index = Index(0, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon);
+                const double lat = source_data.latitude.at(Ilat), lon = source_data.longitude.at(Ilon);
+                source_data.mask.at(index) = mask_func( lat, lon, Idepth );
+                if ( source_data.mask.at(index) ) {
+                    u_lon.at(index) = u_lon_func( lat, lon ) * ( 1 + Idepth );
+                    u_lat.at(index) = u_lat_func( lat, lon ) * ( 1 - 0.5 * Idepth );
+                }
+            }
+        }
+    }
+
+    const std::vector<const std::vector<filter_real>*> 
+        fields  = { &u_lon, &u_lat, &u_lon },
+        factors = { NULL,   NULL,   &u_lat };
+    const char * field_names[] = { "u_lon", "u_lat", "u_lon*u_lat" };
+    const int Nfields = fields.size();
+
+    // Outputs: the filtered fields, the fields filtered with the ell-derivative kernel, and the dl kernel sum
+    std::vector< std::vector<double> > fft_storage( 2 * Nfields + 1, std::vector<double>( Npts, 0. ) );
+    std::vector< std::vector<double>* > fft_coarse, fft_dl_coarse, fft_dll_coarse;
+    for (int Ifield = 0; Ifield < Nfields; Ifield++) { 
+        fft_coarse.push_back(    &fft_storage[Ifield] ); 
+        fft_dl_coarse.push_back( &fft_storage[Nfields + Ifield] ); 
+    }
+    std::vector<double> & fft_dl_kernel = fft_storage[2 * Nfields];
+
+    std::vector< std::vector<double> > direct_storage( 2 * Nfields + 1, std::vector<double>( Npts, 0. ) );
+    const int Nlevels = Ntime * Ndepth;
+
+    fprintf(stdout, "\nRelative errors (lon FFT - direct) over all points, Nlat = %d, Nlon = %d:\n", Nlat, Nlon);
+    fprintf(stdout, "%10s  %-16s  %12s  %12s  %10s  %10s\n", "scale(km)", "field", "max", "RMS", "direct(s)", "fft(s)");
+
+    for (size_t Iscale = 0; Iscale < scales.size(); Iscale++) {
+        const double scale = scales[Iscale];
+
+        double clock_on = MPI_Wtime();
+        apply_filter_via_lon_fft( fft_coarse, fft_dl_coarse, fft_dll_coarse, &fft_dl_kernel, NULL,
+                fields, factors, source_data, scale, 0, Nlat );
+        const double fft_time = MPI_Wtime() - clock_on;
+
+        // Reference values at every point (including land, which the FFT filter also fills)
+        clock_on = MPI_Wtime();
+        #pragma omp parallel default(none) \
+        shared( direct_storage, fields, factors, source_data ) \
+        firstprivate( Nlat, Nlon, Ntime, Ndepth, Nlevels, Nfields, scale )
+        {
+            kernel_stencil stencil;
+            std::vector<double> level_vals, dl_level_vals(1), dl_kernel_vals, null_vector;
+
+            #pragma omp for schedule(dynamic)
+            for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+                stencil.build( source_data, scale, Ilat, 0, true );
+                for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+                    apply_filter_at_point_all_levels( level_vals, dl_level_vals, null_vector, dl_kernel_vals, null_vector,
+                            fields, factors, source_data, Ilat, Ilon, stencil, NULL, false, NULL );
+                    for (int Ilev = 0; Ilev < Nlevels; Ilev++) {
+                        const size_t index = Index(Ilev / Ndepth, Ilev % Ndepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon);
+                        for (int Ifield = 0; Ifield < Nfields; Ifield++) {
+                            direct_storage[Ifield].at(index)           = level_vals[    Ilev * Nfields + Ifield ];
+                            direct_storage[Nfields + Ifield].at(index) = dl_level_vals[ Ilev * Nfields + Ifield ];
+                        }
+                        direct_storage[2 * Nfields].at(index) = dl_kernel_vals[Ilev];
+                    }
+                }
+            }
+        }
+        const double direct_time = MPI_Wtime() - clock_on;
+
+        for (int Iout = 0; Iout < 2 * Nfields + 1; Iout++) {
+            double max_diff = 0, max_ref = 0, sum_sq_diff = 0, sum_sq_ref = 0;
+            for (size_t index = 0; index < Npts; index++) {
+                const double    ref  = direct_storage[Iout][index],
+                                diff = fabs( fft_storage[Iout][index] - ref );
+                max_diff = std::max( max_diff, diff );
+                max_ref  = std::max( max_ref,  fabs( ref ) );
+                sum_sq_diff += diff * diff;
+                sum_sq_ref  += ref * ref;
+            }
+            char name[32];
+            if      (Iout < Nfields)     { snprintf( name, sizeof(name), "%s",    field_names[Iout] ); }
+            else if (Iout < 2 * Nfields) { snprintf( name, sizeof(name), "dl(%s)", field_names[Iout - Nfields] ); }
+            else                         { snprintf( name, sizeof(name), "dl kernel" ); }
+            fprintf(stdout, "%10.5g  %-16s  %12.4e  %12.4e  %10.3g  %10.3g\n", scale / 1e3, name,
+                    (max_ref > 0) ? max_diff / max_ref : 0., (sum_sq_ref > 0) ? sqrt( sum_sq_diff / sum_sq_ref ) : 0.,
+                    direct_time, fft_time);
+        }
+
+        // Filtering only a band of latitudes (as for one processor of latitude_bands) should
+        //   reproduce those rows exactly, and leave the other rows untouched
+        const int   band_start = Nlat / 3,
+                    band_end   = 2 * Nlat / 3;
+        std::vector< std::vector<double> > band_storage( Nfields, std::vector<double>( Npts, -1. ) );
+        std::vector< std::vector<double>* > band_coarse, null_outputs;
+        for (int Ifield = 0; Ifield < Nfields; Ifield++) { band_coarse.push_back( &band_storage[Ifield] ); }
+        apply_filter_via_lon_fft( band_coarse, null_outputs, null_outputs, NULL, NULL,
+                fields, factors, source_data, scale, band_start, band_end );
+
+        double max_band_diff = 0;
+        size_t Nchanged = 0;
+        for (int Ifield = 0; Ifield < Nfields; Ifield++) {
+            for (size_t index = 0; index < Npts; index++) {
+                const int Ilat = ( index / Nlon ) % Nlat;
+                if ( (Ilat >= band_start) and (Ilat < band_end) ) {
+                    max_band_diff = std::max( max_band_diff, fabs( band_storage[Ifield][index] - fft_storage[Ifield][index] ) );
+                } else if ( band_storage[Ifield][index] != -1. ) {
+                    Nchanged++;
+                }
+            }
+        }
+        fprintf(stdout, "%10.5g  band [%d, %d): max difference from the full filter %.4e, %zu points outside the band changed\n",
+                scale / 1e3, band_start, band_end, max_band_diff, Nchanged);
+    }
+
+    MPI_Finalize();
+    return 0;
+}
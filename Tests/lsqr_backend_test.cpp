@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <math.h>
+#include <vector>
+#include <omp.h>
+#include "../functions.hpp"
+#include "../preprocess.hpp"
+#include "../constants.hpp"
+#include "../ALGLIB/stdafx.h"
+#include "../ALGLIB/linalg.h"
+#include "../ALGLIB/solvers.h"
+
+// Compare the native (OpenMP) LSQR solver against ALGLIB (see NATIVE_LSQR_SOLVER), on the
+//   least-squares problem for (Psi, Phi) from a velocity field (sparse_vel_from_PsiPhi) on a
+//   sphere with a continent. Both solvers start from zero, so they should take (nearly) the same
+//   path and stop for the same reason, with solutions that agree to about the tolerance.
+//
+// Usage: ./lsqr_backend_test.x [Nlat (default 90)] [rel_tol (default 1e-8)]
+
+const double D2R = M_PI / 180;
+
+double u_lon_func(const double lat, const double lon) {
+    return 0.5 * cos(lat) * sin(3 * lon) + 0.2 * sin( 4 * lon + 3 * lat) * cos( 2 * lon - 5 * lat );
+}
+
+double u_lat_func(const double lat, const double lon) {
+    return 0.3 * cos( 2 * lat ) * cos( 2 * lon ) + 0.1 * cos( 5 * lon + 7 * lat );
+}
+
+bool mask_func(const double lat, const double lon) {
+    // Rectangular continent
+    return not( (lat > 10 * D2R) and (lat < 40 * D2R) and (lon > 20 * D2R) and (lon < 80 * D2R) );
+}
+
+int main(int argc, char *argv[]) {
+
+    fprintf(stdout, "Beginning least-squares solver comparison.\n");
+
+    static_assert( not(constants::CARTESIAN), "The comparison uses a spherical grid" );
+
+    int thread_safety_provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &thread_safety_provided);
+
+    const int       Nlat    = (argc > 1) ? atoi(argv[1]) : 90,
+                    Nlon    = 2 * Nlat,
+                    max_its = 100000;
+    const double    rel_tol = (argc > 2) ? atof(argv[2]) : 1e-8;
+    const size_t    Npts    = Nlat * Nlon;
+
+    const double    dlat  = 170. * D2R / Nlat,
+                    dlon  = 2 * M_PI / Nlon;
+
+    dataset source_data;
+    source_data.time  = { 0. };
+    source_data.depth = { 0. };
+    source_data.latitude.resize(  Nlat );
+    source_data.longitude.resize( Nlon );
+    for (int II = 0; II < Nlat; II++) { source_data.latitude.at( II) = - 85. * D2R + (II+0.5) * dlat; }
+    for (int II = 0; II < Nlon; II++) { source_data.longitude.at(II) = (II+0.5) * dlon; }
+
+    source_data.Ntime   = 1;
+    source_data.Ndepth  = 1;
+    source_data.Nlat    = Nlat;
+    source_data.Nlon    = Nlon;
+    source_data.myCounts = { 1, 1, Nlat, Nlon };
+    source_data.myStarts = { 0, 0, 0, 0 };
+
+    source_data.compute_cell_areas();
+
+    source_data.mask.resize( Npts );
+    std::vector<double> RHS( 2 * Npts, 0. );
+    for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+        for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+            const size_t index = Index(0, 0, Ilat, Ilon, 1, 1, Nlat, Nlon);
+            const double lat = source_data.latitude.at(Ilat), lon = source_data.longitude.at(Ilon);
+            source_data.mask.at(index) = mask_func( lat, lon );
+            if (source_data.mask.at(index)) {
+                RHS.at(       index ) = u_lon_func( lat, lon ) * source_data.areas.at(index);
+                RHS.at( Npts + index ) = u_lat_func( lat, lon ) * source_data.areas.at(index);
+            }
+        }
+    }
+
+    alglib::sparsematrix LHS_matr;
+    alglib::sparsecreate( 2 * Npts, 2 * Npts, LHS_matr );
+    sparse_vel_from_PsiPhi( LHS_matr, source_data, 0, 0, source_data.mask, true );
+    alglib::sparseconverttocrs( LHS_matr );
+
+    fprintf(stdout, "  %d x %d grid, %zu unknowns, rel_tol = %g, %d threads\n",
+            Nlat, Nlon, 2 * Npts, rel_tol, omp_get_max_threads());
+
+    std::vector<double> solutions[2], residual;
+    crs_matrix A;
+    A.build( LHS_matr );
+    const char * names[] = { "ALGLIB", "native" };
+
+    for (int Isolver = 0; Isolver < 2; Isolver++) {
+        least_squares_solver solver;
+        double clock_on = MPI_Wtime();
+        solver.build( LHS_matr, rel_tol, rel_tol, max_its, Isolver == 1 );
+        const double build_time = MPI_Wtime() - clock_on;
+
+        clock_on = MPI_Wtime();
+        solver.solve( solutions[Isolver], RHS );
+        const double solve_time = MPI_Wtime() - clock_on;
+
+        A.multiply( residual, solutions[Isolver] );
+        double res2 = 0., rhs2 = 0.;
+        for (size_t II = 0; II < residual.size(); II++) {
+            res2 += pow( residual[II] - RHS[II], 2 );
+            rhs2 += pow( RHS[II], 2 );
+        }
+
+        fprintf(stdout, "  %-6s: termination type %d after %6d iterations, ||Ax - b|| / ||b|| = %.4e, "
+                        "build %.3f s, solve %.3f s\n",
+                names[Isolver], solver.terminationtype, solver.iterationscount, sqrt( res2 / rhs2 ),
+                build_time, solve_time );
+    }
+
+    // Compare the velocities from the two solutions (the solutions themselves are only defined up to the null space)
+    std::vector<double> vel_ref, vel_nat;
+    A.multiply( vel_ref, solutions[0] );
+    A.multiply( vel_nat, solutions[1] );
+    double diff2 = 0., ref2 = 0.;
+    for (size_t II = 0; II < vel_ref.size(); II++) {
+        diff2 += pow( vel_nat[II] - vel_ref[II], 2 );
+        ref2  += pow( vel_ref[II], 2 );
+    }
+    fprintf(stdout, "  Relative difference in the projected velocities: %.4e\n", sqrt( diff2 / ref2 ) );
+
+    MPI_Finalize();
+    return 0;
+}
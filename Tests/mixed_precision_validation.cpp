@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <math.h>
+#include <vector>
+#include <omp.h>
+#include "../functions.hpp"
+#include "../constants.hpp"
+
+// Compare the filtering results when the filtered fields are stored in single precision
+//   (see FLOAT_FIELD_STORAGE) against the double-precision path. The kernel sums are
+//   accumulated in double precision either way, so the differences should be at the
+//   level of float round-off in the inputs (~1e-7 relative).
+
+const double D2R = M_PI / 180;
+
+double u_lon_func(const double lat, const double lon) {
+    return 0.5 * cos(lat) * sin(3 * lon) + 0.2 * sin( 16 * lon + 12 * lat) * cos( 10 * lon - 8 * lat );
+}
+
+double u_lat_func(const double lat, const double lon) {
+    return 0.3 * cos( 2 * lat ) * cos( 2 * lon ) + 0.1 * cos( 25 * lon + 17 * lat );
+}
+
+bool mask_func(const double lat, const double lon) {
+    // Rectangular continent, and land over the south pole
+    if ( (lat > 10 * D2R) and (lat < 40 * D2R) and (lon > 20 * D2R) and (lon < 80 * D2R) ) { return false; }
+    if ( lat < -75 * D2R ) { return false; }
+    return true;
+}
+
+void filter_all_points(
+        std::vector< std::vector<double> > & coarse_fields,
+        const std::vector< const std::vector<double>* > & all_fields,
+        const std::vector< const std::vector<double>* > & all_factors,
+        const dataset & source_data,
+        const double scale,
+        const water_runs & water,
+        const bool single_precision
+        ) {
+
+    const int   Nlat    = source_data.Nlat,
+                Nlon    = source_data.Nlon,
+                Nfields = all_fields.size();
+
+    // The single precision path gets float copies of the inputs
+    std::vector< std::vector<float> > float_storage( 2 * Nfields );
+    std::vector< const std::vector<float>* > float_fields, float_factors;
+    for (int Ifield = 0; Ifield < Nfields; Ifield++) {
+        float_storage[Ifield].assign( all_fields[Ifield]->begin(), all_fields[Ifield]->end() );
+        float_fields.push_back( &float_storage[Ifield] );
+        if (all_factors[Ifield] == NULL) {
+            float_factors.push_back( NULL );
+        } else {
+            float_storage[Nfields + Ifield].assign( all_factors[Ifield]->begin(), all_factors[Ifield]->end() );
+            float_factors.push_back( &float_storage[Nfields + Ifield] );
+        }
+    }
+
+    coarse_fields.assign( Nfields, std::vector<double>( Nlat * Nlon, 0. ) );
+
+    #pragma omp parallel default(none) \
+    shared( coarse_fields, all_fields, all_factors, float_fields, float_factors, source_data, water ) \
+    firstprivate( Nlat, Nlon, Nfields, scale, single_precision )
+    {
+        kernel_stencil stencil;
+        std::vector<double> level_vals, null_vector;
+        size_t index;
+
+        #pragma omp for collapse(1) schedule(dynamic)
+        for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+            stencil.build( source_data, scale, Ilat, 0 );
+            for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+                index = Index(0, 0, Ilat, Ilon, 1, 1, Nlat, Nlon);
+                if ( not(source_data.mask.at(index)) ) { continue; }
+
+                if (single_precision) {
+                    apply_filter_at_point_all_levels( level_vals, null_vector, null_vector, null_vector, null_vector,
+                            float_fields, float_factors, source_data, Ilat, Ilon, stencil, NULL, true, &water );
+                } else {
+                    apply_filter_at_point_all_levels( level_vals, null_vector, null_vector, null_vector, null_vector,
+                            all_fields, all_factors, source_data, Ilat, Ilon, stencil, NULL, true, &water );
+                }
+
+                for (int Ifield = 0; Ifield < Nfields; Ifield++) {
+                    coarse_fields[Ifield][index] = level_vals[Ifield];
+                }
+            }
+        }
+    }
+}
+
+void compute_coarse_diagnostics(
+        std::vector<double> & coarse_u_lon,
+        std::vector<double> & coarse_u_lat,
+        std::vector<double> & Pi,
+        std::vector<double> & Z,
+        const std::vector< std::vector<double> > & coarse_fields,
+        const dataset & source_data
+        ) {
+
+    // coarse_fields are ux, uy, uz, then uxux, uxuy, uxuz, uyuy, uyuz, uzuz, then vort_ux, vort_uy, vort_uz
+    const std::vector<double> &ux = coarse_fields[0], &uy = coarse_fields[1], &uz = coarse_fields[2];
+
+    const size_t Npts = ux.size();
+    std::vector<double> coarse_u_r( Npts ), coarse_vort_r( Npts ), null_vector;
+    coarse_u_lon.resize( Npts );
+    coarse_u_lat.resize( Npts );
+    Pi.resize( Npts );
+    Z.resize( Npts );
+
+    vel_Cart_to_Spher( coarse_u_r, coarse_u_lon, coarse_u_lat, ux, uy, uz, source_data );
+    compute_vorticity( coarse_vort_r, null_vector, null_vector, null_vector, null_vector,
+            null_vector, null_vector, null_vector, source_data, coarse_u_r, coarse_u_lon, coarse_u_lat );
+
+    compute_Pi( Pi, source_data, ux, uy, uz,
+            coarse_fields[3], coarse_fields[4], coarse_fields[5], coarse_fields[6], coarse_fields[7], coarse_fields[8] );
+    compute_Z(  Z, source_data, ux, uy, uz, coarse_vort_r, coarse_fields[9], coarse_fields[10], coarse_fields[11] );
+}
+
+void print_differences( const char * name, const std::vector<double> & single_vals,
+        const std::vector<double> & double_vals, const std::vector<bool> & mask ) {
+    double max_diff = 0, max_ref = 0, sum_sq_diff = 0, sum_sq_ref = 0;
+    size_t Nwater = 0;
+    for (size_t II = 0; II < double_vals.size(); II++) {
+        if ( not(mask.at(II)) ) { continue; }
+        const double diff = fabs( single_vals.at(II) - double_vals.at(II) );
+        max_diff = std::max( max_diff, diff );
+        max_ref  = std::max( max_ref,  fabs( double_vals.at(II) ) );
+        sum_sq_diff += diff * diff;
+        sum_sq_ref  += double_vals.at(II) * double_vals.at(II);
+        Nwater++;
+    }
+    fprintf( stdout, "  %-14s: max diff = %.4e (relative %.4e),  RMS diff = %.4e (relative %.4e)\n",
+            name, max_diff, (max_ref > 0) ? max_diff / max_ref : 0.,
+            sqrt( sum_sq_diff / std::max( Nwater, (size_t) 1 ) ),
+            (sum_sq_ref > 0) ? sqrt( sum_sq_diff / sum_sq_ref ) : 0. );
+}
+
+int main(int argc, char *argv[]) {
+
+    fprintf(stdout, "Beginning mixed-precision validation.\n");
+
+    int thread_safety_provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &thread_safety_provided);
+
+    static_assert( constants::PERIODIC_X and constants::UNIFORM_LON_GRID and constants::FULL_LON_SPAN,
+            "The validation rolls the kernel in longitude" );
+    static_assert( not(constants::CARTESIAN), "The validation uses a spherical grid" );
+
+    const int       Nlat   = 180,
+                    Nlon   = 360;
+    const size_t    Npts   = Nlat * Nlon;
+
+    const double    scale = (argc > 1) ? atof(argv[1]) : 500e3,
+                    dlat  = M_PI / Nlat,
+                    dlon  = 2 * M_PI / Nlon;
+
+    dataset source_data;
+    source_data.time  = { 0. };
+    source_data.depth = { 0. };
+    source_data.latitude.resize(  Nlat );
+    source_data.longitude.resize( Nlon );
+    for (int II = 0; II < Nlat; II++) { source_data.latitude.at( II) = - M_PI / 2 + (II+0.5) * dlat; }
+    for (int II = 0; II < Nlon; II++) { source_data.longitude.at(II) = - M_PI     + (II+0.5) * dlon; }
+
+    source_data.Ntime   = 1;
+    source_data.Ndepth  = 1;
+    source_data.Nlat    = Nlat;
+    source_data.Nlon    = Nlon;
+
+    source_data.compute_cell_areas();
+
+    // Initialize the velocity (zero on land)
+    std::vector<double> u_r( Npts, 0. ), u_lon( Npts, 0. ), u_lat( Npts, 0. );
+    source_data.mask.resize( Npts );
+    for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+        for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+            const size_t index = Index(0, 0, Ilat, Ilon, 1, 1, Nlat, Nlon);
+            const double lat = source_data.latitude.at(Ilat), lon = source_data.longitude.at(Ilon);
+            source_data.mask.at(index) = mask_func( lat, lon );
+            if ( source_data.mask.at(index) ) {
+                u_lon.at(index) = u_lon_func( lat, lon );
+                u_lat.at(index) = u_lat_func( lat, lon );
+            }
+        }
+    }
+
+    water_runs water;
+    water.build( source_data.mask, 1, 1, Nlat, Nlon );
+
+    // Cartesian velocities and vorticity, as in the filtering driver
+    std::vector<double> u_x( Npts ), u_y( Npts ), u_z( Npts ), vort_r( Npts ), null_vector;
+    vel_Spher_to_Cart( u_x, u_y, u_z, u_r, u_lon, u_lat, source_data );
+    compute_vorticity( vort_r, null_vector, null_vector, null_vector, null_vector,
+            null_vector, null_vector, null_vector, source_data, u_r, u_lon, u_lat );
+
+    const std::vector< const std::vector<double>* >
+        all_fields  = { &u_x, &u_y, &u_z, &u_x, &u_x, &u_x, &u_y, &u_y, &u_z, &vort_r, &vort_r, &vort_r },
+        all_factors = { NULL, NULL, NULL, &u_x, &u_y, &u_z, &u_y, &u_z, &u_z, &u_x,    &u_y,    &u_z    };
+
+    std::vector< std::vector<double> > coarse_double, coarse_single;
+    std::vector<double> u_lon_double, u_lat_double, Pi_double, Z_double,
+                        u_lon_single, u_lat_single, Pi_single, Z_single;
+
+    fprintf(stdout, "  filtering at %g km (double)\n", scale / 1e3);
+    double clock_on = MPI_Wtime();
+    filter_all_points( coarse_double, all_fields, all_factors, source_data, scale, water, false );
+    const double double_time = MPI_Wtime() - clock_on;
+
+    fprintf(stdout, "  filtering at %g km (single)\n", scale / 1e3);
+    clock_on = MPI_Wtime();
+    filter_all_points( coarse_single, all_fields, all_factors, source_data, scale, water, true );
+    const double single_time = MPI_Wtime() - clock_on;
+
+    compute_coarse_diagnostics( u_lon_double, u_lat_double, Pi_double, Z_double, coarse_double, source_data );
+    compute_coarse_diagnostics( u_lon_single, u_lat_single, Pi_single, Z_single, coarse_single, source_data );
+
+    fprintf(stdout, "\nDifferences (single - double) over water points:\n");
+    print_differences( "coarse_u_lon", u_lon_single, u_lon_double, source_data.mask );
+    print_differences( "coarse_u_lat", u_lat_single, u_lat_double, source_data.mask );
+    print_differences( "Pi",           Pi_single,    Pi_double,    source_data.mask );
+    print_differences( "Z",            Z_single,     Z_double,     source_data.mask );
+
+    fprintf(stdout, "\nFiltering time: %.3g s (double), %.3g s (single, including the conversion to float)\n", double_time, single_time);
+
+    MPI_Finalize();
+    return 0;
+}
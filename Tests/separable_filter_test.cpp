@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <math.h>
+#include <vector>
+#include <omp.h>
+#include "../functions.hpp"
+#include "../constants.hpp"
+
+// Compare the separable (two-pass) filter (see SEPARABLE_CARTESIAN_FILTER) against the
+//   direct stencil sums, on the grid and fields of filtering_tests_Cart (constant, linear
+//   in x, linear in y), plus a wavy field with an island to exercise the mask handling.
+//   The only difference should come from the kernel being cut off on a square instead
+//   of a disc, which is negligible for the Gaussian kernels.
+
+double constant_field(const double lat, const double lon) {
+    return 100.;
+}
+
+double linear_lon_field(const double lat, const double lon) {
+    return lon;
+}
+
+double linear_lat_field(const double lat, const double lon) {
+    return lat;
+}
+
+double wavy_field(const double lat, const double lon) {
+    return sin( 3 * M_PI * lon ) * cos( 5 * M_PI * lat ) + 0.3 * cos( 17 * M_PI * ( lon + lat ) );
+}
+
+bool mask_func(const double lat, const double lon) {
+    // Square island in the middle of the domain
+    return not( (fabs(lat) < 0.2) and (fabs(lon - 0.1) < 0.25) );
+}
+
+void filter_direct(
+        std::vector<double> & filtered,
+        const std::vector<filter_real> & field,
+        const dataset & source_data,
+        const double scale
+        ) {
+
+    const int   Nlat    = source_data.Nlat,
+                Nlon    = source_data.Nlon;
+    const std::vector<const std::vector<filter_real>*> fields = { &field }, null_factors;
+
+    filtered.assign( Nlat * Nlon, 0. );
+
+    #pragma omp parallel default(none) shared( filtered, fields, null_factors, source_data ) firstprivate( Nlat, Nlon, scale )
+    {
+        kernel_stencil stencil;
+        std::vector<double> level_vals, null_vector;
+
+        #pragma omp for schedule(dynamic)
+        for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+            stencil.build( source_data, scale, Ilat, 0 );
+            for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+                const size_t index = Index(0, 0, Ilat, Ilon, 1, 1, Nlat, Nlon);
+                if ( not(source_data.mask.at(index)) ) { continue; }
+                apply_filter_at_point_all_levels( level_vals, null_vector, null_vector, null_vector, null_vector,
+                        fields, null_factors, source_data, Ilat, Ilon, stencil, NULL, true );
+                filtered.at(index) = level_vals.at(0);
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+
+    fprintf(stdout, "Beginning separable filter tests.\n");
+
+    static_assert( constants::CARTESIAN, "The separable filter is only for Cartesian grids" );
+    static_assert( (constants::KERNEL_OPT == constants::KernelType::Gaussian) or 
+                   (constants::KERNEL_OPT == constants::KernelType::JohnsonGaussian),
+                   "The separable filter requires a Gaussian kernel" );
+    static_assert( constants::PERIODIC_X and constants::UNIFORM_LON_GRID and constants::FULL_LON_SPAN,
+            "The direct reference rolls the kernel in longitude" );
+
+    int thread_safety_provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &thread_safety_provided);
+
+    // Same grid as filtering_tests_Cart
+    const int Nlat = 256;
+    const int Nlon = 256;
+    const int Npts = Nlat * Nlon;
+
+    const double scale = (argc > 1) ? atof(argv[1]) : 100e3;
+
+    const double lon_min = -500e3;
+    const double lon_max =  500e3;
+
+    const double lat_min = -500e3;
+    const double lat_max =  500e3;
+
+    const double dlat = (lat_max - lat_min) / Nlat;
+    const double dlon = (lon_max - lon_min) / Nlon;
+
+    dataset source_data;
+    source_data.time  = { 0. };
+    source_data.depth = { 0. };
+    source_data.latitude.resize(  Nlat );
+    source_data.longitude.resize( Nlon );
+    for (int II = 0; II < Nlat; II++) { source_data.latitude.at( II) = lat_min + (II+0.5) * dlat; }
+    for (int II = 0; II < Nlon; II++) { source_data.longitude.at(II) = lon_min + (II+0.5) * dlon; }
+
+    source_data.Ntime   = 1;
+    source_data.Ndepth  = 1;
+    source_data.Nlat    = Nlat;
+    source_data.Nlon    = Nlon;
+
+    source_data.compute_cell_areas();
+
+    double (*field_funcs[])(const double, const double) = { constant_field, linear_lon_field, linear_lat_field, wavy_field };
+    const char * field_names[] = { "constant", "linear_lon", "linear_lat", "wavy" };
+
+    std::vector<filter_real> field( Npts );
+    std::vector<double> direct, separable;
+    std::vector< std::vector<double>* > separable_ptrs = { &separable };
+    const std::vector<const std::vector<filter_real>*> fields = { &field }, null_factors;
+
+    for (int use_island = 0; use_island < 2; use_island++) {
+
+        source_data.mask.resize( Npts );
+        for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+            for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+                source_data.mask.at( Index(0, 0, Ilat, Ilon, 1, 1, Nlat, Nlon) ) = 
+                    (use_island == 0) or mask_func( source_data.latitude.at(Ilat) / lat_max, source_data.longitude.at(Ilon) / lon_max );
+            }
+        }
+
+        fprintf(stdout, "\n%s (scale %g km)\n", (use_island == 0) ? "No land" : "With an island", scale / 1e3);
+
+        for (int Ifield = 0; Ifield < 4; Ifield++) {
+            for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+                for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+                    const size_t index = Index(0, 0, Ilat, Ilon, 1, 1, Nlat, Nlon);
+                    field.at(index) = source_data.mask.at(index) ? 
+                        field_funcs[Ifield]( source_data.latitude.at(Ilat) / lat_max, source_data.longitude.at(Ilon) / lon_max ) : 0.;
+                }
+            }
+
+            double clock_on = MPI_Wtime();
+            filter_direct( direct, field, source_data, scale );
+            const double direct_time = MPI_Wtime() - clock_on;
+
+            separable.assign( Npts, 0. );
+            clock_on = MPI_Wtime();
+            apply_filter_separable( separable_ptrs, fields, null_factors, source_data, scale, 0, Nlat );
+            const double separable_time = MPI_Wtime() - clock_on;
+
+            double max_diff = 0, max_ref = 0;
+            for (int II = 0; II < Npts; II++) {
+                if ( not(source_data.mask.at(II)) ) { continue; }
+                max_diff = std::max( max_diff, fabs( separable.at(II) - direct.at(II) ) );
+                max_ref  = std::max( max_ref,  fabs( direct.at(II) ) );
+            }
+            fprintf(stdout, "  %-12s: max diff = %.4e (relative %.4e),  time = %.3g s (direct) vs %.3g s (separable)\n",
+                    field_names[Ifield], max_diff, (max_ref > 0) ? max_diff / max_ref : 0., direct_time, separable_time);
+        }
+    }
+
+    MPI_Finalize();
+    return 0;
+}
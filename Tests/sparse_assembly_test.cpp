@@ -0,0 +1,613 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <math.h>
+#include <vector>
+#include <omp.h>
+#include "../functions.hpp"
+#include "../preprocess.hpp"
+#include "../differentiation_tools.hpp"
+#include "../constants.hpp"
+#include "../ALGLIB/stdafx.h"
+#include "../ALGLIB/linalg.h"
+
+// Compare the two-pass CRS assembly (crs_matrix::assemble) of the Helmholtz least-squares
+//   matrix (sparse_vel_from_PsiPhi_vortdiv) and of the toroidal Laplacian (toroidal_sparse_Lap)
+//   against the previous assembly, which added the entries one at a time into an ALGLIB
+//   hash-table matrix and then converted it to CRS. The reference assemblies are copied
+//   below. The grid is small and has a continent, and is run with and without the poles,
+//   with and without area weighting / Tikhonov regularisation, and (for the Laplacian) with
+//   the block offset within a larger matrix. The row starts, column indices, and values
+//   should all be identical, and the test fails (non-zero exit code) otherwise.
+//
+// Usage: ./sparse_assembly_test.x [Nlat (default 30)]
+
+const double D2R = M_PI / 180;
+
+// Reference: the previous (sparseadd) assembly of sparse_vel_from_PsiPhi_vortdiv
+static void reference_vortdiv(
+        alglib::sparsematrix & LHS_matr,
+        const dataset & source_data,
+        const int Itime,
+        const int Idepth,
+        const std::vector<bool> & mask,
+        const bool weight_err,
+        const double Tikhov_Laplace,
+        const double deriv_scale_factor,
+        const int wRank
+        ) {
+
+    const std::vector<double>   &latitude   = source_data.latitude,
+                                &longitude  = source_data.longitude,
+                                &dAreas     = source_data.areas;
+
+    const std::vector<int>  &myCounts = source_data.myCounts;
+
+    const int   Ntime   = myCounts.at(0),
+                Ndepth  = myCounts.at(1),
+                Nlat    = myCounts.at(2),
+                Nlon    = myCounts.at(3);
+
+    int Ilat, Ilon, IDIFF, Idiff, Ndiff, LB;
+    size_t index_sub, diff_index;
+    const size_t Npts = Nlat * Nlon;
+    double tmp_val, tan_lat;
+    std::vector<double> diff_vec;
+    bool is_pole;
+
+    const double R_inv  = 1. / constants::R_earth,
+                 R2_inv = pow( R_inv, 2 );
+
+
+    //
+    ////
+    ////// Add terms for velocity matching
+    ////
+    //
+    #if DEBUG >= 1
+    if (wRank == 0) { fprintf( stdout, "  Adding terms to force velocity matching.\n" ); }
+    #endif
+
+    for ( Ilat = 0; Ilat < Nlat; Ilat++ ) {
+        for ( Ilon = 0; Ilon < Nlon; Ilon++ ) {
+            
+            // If we're too close to the pole (less than 0.01 degrees), bad things happen
+            is_pole = std::fabs( std::fabs( latitude.at(Ilat) * 180.0 / M_PI ) - 90 ) < 0.01;
+
+            index_sub = Index(0, 0, Ilat, Ilon, 1, 1, Nlat, Nlon);
+            
+            double weight_val = weight_err ? dAreas.at(index_sub) : 1.;
+
+            double cos_lat_inv = 1. / cos(latitude.at(Ilat));
+
+            if ( not(is_pole) ) { // Skip poles
+
+                //
+                //// LON first derivative part
+                //
+
+                LB = - 2 * Nlon;
+                get_diff_vector(diff_vec, LB, longitude, "lon", Itime, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon, mask, 1, constants::DiffOrd);
+
+                Ndiff = diff_vec.size();
+
+                // If LB is unchanged, then we failed to build a stencil
+                if (LB != - 2 * Nlon) {
+                    for ( IDIFF = LB; IDIFF < LB + Ndiff; IDIFF++ ) {
+
+                        if (constants::PERIODIC_X) { Idiff = ( IDIFF % Nlon + Nlon ) % Nlon; }
+                        else                       { Idiff = IDIFF;                          }
+
+                        diff_index = Index(0, 0, Ilat, Idiff, 1, 1, Nlat, Nlon);
+
+                        tmp_val     = diff_vec.at(IDIFF-LB) * cos_lat_inv * R_inv;
+                        tmp_val    *= weight_val;
+                        if (isnan(tmp_val)) { fprintf( stdout, "  Rank %d encountered a NaN at lat/lon %d,%d (codeline %d)\n", wRank, Ilat, Ilon, __LINE__ ); }
+
+                        // Psi part
+                        size_t  column_skip = 0 * Npts,
+                                row_skip    = 1 * Npts;
+                        alglib::sparseadd(  LHS_matr, row_skip + index_sub, column_skip + diff_index, tmp_val );
+
+                        // Phi part
+                        column_skip = 1 * Npts;
+                        row_skip    = 0 * Npts;
+                        alglib::sparseadd(  LHS_matr, row_skip + index_sub, column_skip + diff_index, tmp_val );
+                    }
+                }
+
+
+                //
+                //// LAT first derivative part
+                //
+
+                LB = - 2 * Nlat;
+                get_diff_vector(diff_vec, LB, latitude, "lat", Itime, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon, mask, 1, constants::DiffOrd);
+
+                Ndiff = diff_vec.size();
+
+                // If LB is unchanged, then we failed to build a stencil
+                if (LB != - 2 * Nlat) {
+                    for ( IDIFF = LB; IDIFF < LB + Ndiff; IDIFF++ ) {
+
+                        if (constants::PERIODIC_Y) { Idiff = ( IDIFF % Nlat + Nlat ) % Nlat; }
+                        else                       { Idiff = IDIFF;                          }
+
+                        diff_index = Index(0, 0, Idiff, Ilon, 1, 1, Nlat,  Nlon);
+
+                        tmp_val     = diff_vec.at(IDIFF-LB) * R_inv;
+                        tmp_val    *= weight_val;
+                        if (isnan(tmp_val)) { fprintf( stdout, "  Rank %d encountered a NaN at lat/lon %d,%d (codeline %d)\n", wRank, Ilat, Ilon, __LINE__ ); }
+
+                        // Psi part
+                        size_t  column_skip = 0 * Npts,
+                                row_skip    = 0 * Npts;
+                        alglib::sparseadd(  LHS_matr, row_skip + index_sub, column_skip + diff_index, -tmp_val );
+
+                        // Phi part
+                        column_skip = 1 * Npts;
+                        row_skip    = 1 * Npts;
+                        alglib::sparseadd(  LHS_matr, row_skip + index_sub, column_skip + diff_index,  tmp_val );
+                    }
+                }
+            }
+        }
+    }
+
+
+
+    //
+    ////
+    ////// Add in Laplace terms to force Phi / Psi to match vorticity and divergence of flow
+    ////
+    //
+    #if DEBUG >= 1
+    if (wRank == 0) { fprintf( stdout, "  Adding Laplace terms to force velocity / divergence matching.\n" ); }
+    #endif
+
+
+    for ( Ilat = 0; Ilat < Nlat; Ilat++ ) {
+        for ( Ilon = 0; Ilon < Nlon; Ilon++ ) {
+            
+            // If we're too close to the pole (less than 0.01 degrees), bad things happen
+            is_pole = std::fabs( std::fabs( latitude.at(Ilat) * 180.0 / M_PI ) - 90 ) < 0.01;
+
+            index_sub = Index(0, 0, Ilat, Ilon, 1, 1, Nlat, Nlon);
+
+            double weight_val = weight_err ? dAreas.at(index_sub) : 1.;
+
+            double cos_lat_inv = 1. / cos(latitude.at(Ilat)),
+                   cos2_lat_inv = pow( cos_lat_inv, 2. );
+            tan_lat = tan( latitude.at(Ilat) );
+
+            if ( ( Ilat == 0 ) and (Tikhov_Laplace == 0) ) {
+                // At the pole-most point, force to be zonally constant. This is to try and remove the null(Laplacian) component
+                //      i.e. force neighbouring points to sum to zero
+
+                // i.e. force zero zonal derivative
+                LB = - 2 * Nlon;
+                get_diff_vector(diff_vec, LB, longitude, "lon", Itime, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon, mask, 1, constants::DiffOrd);
+
+                Ndiff = diff_vec.size();
+
+                // If LB is unchanged, then we failed to build a stencil
+                if (LB != - 2 * Nlon) {
+                    for ( IDIFF = LB; IDIFF < LB + Ndiff; IDIFF++ ) {
+
+                        if (constants::PERIODIC_X) { Idiff = ( IDIFF % Nlon + Nlon ) % Nlon; }
+                        else                       { Idiff = IDIFF;                          }
+
+                        diff_index = Index(0, 0, Ilat, Idiff, 1, 1, Nlat, Nlon);
+
+                        //tmp_val     = diff_vec.at(IDIFF-LB);
+                        tmp_val     = diff_vec.at(IDIFF-LB) * cos_lat_inv * R_inv;
+                        tmp_val    *= weight_val;
+                        if (isnan(tmp_val)) { fprintf( stdout, "  Rank %d encountered a NaN at lat/lon %d,%d (codeline %d)\n", wRank, Ilat, Ilon, __LINE__ ); }
+
+                        // Psi part
+                        size_t  column_skip = 1 * Npts,
+                                row_skip    = 2 * Npts;
+                        alglib::sparseadd(  LHS_matr, row_skip + index_sub, column_skip + diff_index, tmp_val );
+
+                        // Phi part
+                        column_skip = 0 * Npts;
+                        row_skip    = 3 * Npts;
+                        alglib::sparseadd(  LHS_matr, row_skip + index_sub, column_skip + diff_index, tmp_val );
+                    }
+                }
+
+            } else if ( (not(is_pole)) and (Tikhov_Laplace > 0) ) {
+
+
+                //
+                //// LON second derivative part
+                //
+
+                LB = - 2 * Nlon;
+                get_diff_vector(diff_vec, LB, longitude, "lon", Itime, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon, mask, 2, constants::DiffOrd);
+
+                Ndiff = diff_vec.size();
+
+                // If LB is unchanged, then we failed to build a stencil
+                if (LB != - 2 * Nlon) {
+                    for ( IDIFF = LB; IDIFF < LB + Ndiff; IDIFF++ ) {
+
+                        if (constants::PERIODIC_X) { Idiff = ( IDIFF % Nlon + Nlon ) % Nlon; }
+                        else                       { Idiff = IDIFF;                          }
+
+                        diff_index = Index(0, 0, Ilat, Idiff, 1, 1, Nlat, Nlon);
+
+                        tmp_val     = diff_vec.at(IDIFF-LB) * cos2_lat_inv * R2_inv;
+                        tmp_val    *= weight_val * Tikhov_Laplace / deriv_scale_factor;
+                        if (isnan(tmp_val)) { fprintf( stdout, "  Rank %d encountered a NaN at lat/lon %d,%d (codeline %d)\n", wRank, Ilat, Ilon, __LINE__ ); }
+
+                        // (2,0) entry
+                        size_t  row_skip    = 2 * Npts,
+                                column_skip = 0 * Npts;
+                        alglib::sparseadd(  LHS_matr, row_skip + index_sub, column_skip + diff_index, tmp_val );
+
+                        // (3,1) entry
+                        row_skip    = 3 * Npts;
+                        column_skip = 1 * Npts;
+                        alglib::sparseadd(  LHS_matr, row_skip + index_sub, column_skip + diff_index, tmp_val );
+                    }
+                }
+
+
+                //
+                //// LAT second derivative part
+                //
+
+                LB = -2 * Nlat;
+                get_diff_vector(diff_vec, LB, latitude, "lat", Itime, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon, mask, 2, constants::DiffOrd);
+
+                Ndiff = diff_vec.size();
+
+                // If LB is unchanged, then we failed to build a stencil
+                if (LB != - 2 * Nlat) {
+                    for ( IDIFF = LB; IDIFF < LB + Ndiff; IDIFF++ ) {
+
+                        if (constants::PERIODIC_Y) { Idiff = ( IDIFF % Nlat + Nlat ) % Nlat; }
+                        else                       { Idiff = IDIFF;                          }
+
+                        diff_index = Index(0, 0, Idiff, Ilon, 1, 1, Nlat,  Nlon);
+
+                        tmp_val     = diff_vec.at(IDIFF-LB) * R2_inv;
+                        tmp_val    *= weight_val * Tikhov_Laplace / deriv_scale_factor;
+                        if (isnan(tmp_val)) { fprintf( stdout, "  Rank %d encountered a NaN at lat/lon %d,%d (codeline %d)\n", wRank, Ilat, Ilon, __LINE__ ); }
+
+                        // (2,0) entry
+                        size_t  row_skip    = 2 * Npts,
+                                column_skip = 0 * Npts;
+                        alglib::sparseadd(  LHS_matr, row_skip + index_sub, column_skip + diff_index, tmp_val );
+
+                        // (3,1) entry
+                        row_skip    = 3 * Npts;
+                        column_skip = 1 * Npts;
+                        alglib::sparseadd(  LHS_matr, row_skip + index_sub, column_skip + diff_index, tmp_val );
+                    }
+                }
+
+
+                //
+                //// LAT first derivative part
+                //
+
+                LB = - 2 * Nlat;
+                get_diff_vector(diff_vec, LB, latitude, "lat", Itime, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon, mask, 1, constants::DiffOrd);
+
+                Ndiff = diff_vec.size();
+                //tan_lat = tan( latitude.at(Ilat) );
+
+                // If LB is unchanged, then we failed to build a stencil
+                if (LB != - 2 * Nlat) {
+                    for ( IDIFF = LB; IDIFF < LB + Ndiff; IDIFF++ ) {
+
+                        if (constants::PERIODIC_Y) { Idiff = ( IDIFF % Nlat + Nlat ) % Nlat; }
+                        else                       { Idiff = IDIFF;                          }
+
+                        diff_index = Index(0, 0, Idiff, Ilon, 1, 1, Nlat,  Nlon);
+
+                        tmp_val     = - diff_vec.at(IDIFF-LB) * tan_lat * R2_inv;
+                        tmp_val    *= weight_val * Tikhov_Laplace / deriv_scale_factor;
+                        if (isnan(tmp_val)) { fprintf( stdout, "  Rank %d encountered a NaN at lat/lon %d,%d (codeline %d)\n", wRank, Ilat, Ilon, __LINE__ ); }
+
+                        // (2,0) entry
+                        size_t  row_skip    = 2 * Npts,
+                                column_skip = 0 * Npts;
+                        alglib::sparseadd(  LHS_matr, row_skip + index_sub, column_skip + diff_index, tmp_val );
+
+                        // (3,1) entry
+                        row_skip    = 3 * Npts;
+                        column_skip = 1 * Npts;
+                        alglib::sparseadd(  LHS_matr, row_skip + index_sub, column_skip + diff_index, tmp_val );
+                    }
+                }
+            }
+        }
+    }
+        
+}
+
+
+// Reference: the previous (sparseget / sparseset) assembly of toroidal_sparse_Lap
+static void reference_sparse_Lap(
+        alglib::sparsematrix & Lap,
+        const dataset & source_data,
+        const int Itime,
+        const int Idepth,
+        const std::vector<bool>   & mask,
+        const bool area_weight,
+        const size_t row_skip,
+        const size_t column_skip
+        ) {
+
+    const std::vector<double>   &latitude   = source_data.latitude,
+                                &longitude  = source_data.longitude,
+                                &areas      = source_data.areas;
+
+    const std::vector<int>  &myCounts = source_data.myCounts;
+
+    const int   Ntime   = myCounts.at(0),
+                Ndepth  = myCounts.at(1),
+                Nlat    = myCounts.at(2),
+                Nlon    = myCounts.at(3);
+
+    int Ilat, Ilon, IDIFF, Idiff, Ndiff, LB;
+    size_t index, index_sub, diff_index;
+    double old_val, tmp, cos2_lat_inv, tan_lat;
+    std::vector<double> diff_vec;
+    bool is_pole;
+
+    const double R2_inv = 1. / pow(constants::R_earth, 2);
+
+    for ( Ilat = 0; Ilat < Nlat; Ilat++ ) {
+        for ( Ilon = 0; Ilon < Nlon; Ilon++ ) {
+            
+            // If we're too close to the pole (less than 0.01 degrees), bad things happen
+            is_pole = std::fabs( std::fabs( latitude.at(Ilat) * 180.0 / M_PI ) - 90 ) < 0.01;
+
+            cos2_lat_inv = 1. / pow( cos(latitude.at(Ilat)), 2 );
+            tan_lat = tan(latitude.at(Ilat));
+
+            index = Index(Itime, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon);
+            index_sub = Index(0, 0, Ilat, Ilon, 1, 1, Nlat, Nlon);
+
+            if ( (mask.at(index)) and not(is_pole) ) { // Skip land areas and poles
+
+                //
+                //// LON second derivative part
+                //
+
+                LB = - 2 * Nlon;
+                get_diff_vector(diff_vec, LB, longitude, "lon",
+                                Itime, Idepth, Ilat, Ilon,
+                                Ntime, Ndepth, Nlat, Nlon,
+                                mask, 2, constants::DiffOrd);
+
+                Ndiff = diff_vec.size();
+
+                // If LB is unchanged, then we failed to build a stencil
+                if (LB != - 2 * Nlon) {
+                    for ( IDIFF = LB; IDIFF < LB + Ndiff; IDIFF++ ) {
+
+                        if (constants::PERIODIC_X) { Idiff = ( IDIFF % Nlon + Nlon ) % Nlon; }
+                        else                       { Idiff = IDIFF;                          }
+
+                        diff_index = Index(0, 0, Ilat, Idiff, 1, 1, Nlat, Nlon);
+
+                        tmp = diff_vec.at(IDIFF-LB) * cos2_lat_inv * R2_inv;
+                        if (area_weight) { tmp *= areas.at(index_sub); }
+
+                        old_val = sparseget(Lap, row_skip + index_sub, column_skip + diff_index);
+                        alglib::sparseset(  Lap, row_skip + index_sub, column_skip + diff_index, old_val + tmp);
+                    }
+                }
+
+
+                //
+                //// LAT second derivative part
+                //
+
+                LB = -2 * Nlat;
+                get_diff_vector(diff_vec, LB, latitude, "lat",
+                                Itime, Idepth, Ilat, Ilon,
+                                Ntime, Ndepth, Nlat, Nlon,
+                                mask, 2, constants::DiffOrd);
+
+                Ndiff = diff_vec.size();
+
+                // If LB is unchanged, then we failed to build a stencil
+                if (LB != - 2 * Nlat) {
+                    for ( IDIFF = LB; IDIFF < LB + Ndiff; IDIFF++ ) {
+
+                        if (constants::PERIODIC_Y) { Idiff = ( IDIFF % Nlat + Nlat ) % Nlat; }
+                        else                       { Idiff = IDIFF;                          }
+
+                        diff_index = Index(0, 0, Idiff, Ilon, 1, 1, Nlat,  Nlon);
+
+                        tmp = diff_vec.at(IDIFF-LB) * R2_inv;
+                        if (area_weight) { tmp *= areas.at(index_sub); }
+
+                        old_val = sparseget(Lap, row_skip + index_sub, column_skip + diff_index);
+                        alglib::sparseset(  Lap, row_skip + index_sub, column_skip + diff_index, old_val + tmp);
+                    }
+                }
+
+
+                //
+                //// LAT first derivative part
+                //
+
+                LB = - 2 * Nlat;
+                get_diff_vector(diff_vec, LB, latitude, "lat",
+                                Itime, Idepth, Ilat, Ilon,
+                                Ntime, Ndepth, Nlat, Nlon,
+                                mask, 1, constants::DiffOrd);
+
+                Ndiff = diff_vec.size();
+
+                // If LB is unchanged, then we failed to build a stencil
+                if (LB != - 2 * Nlat) {
+                    for ( IDIFF = LB; IDIFF < LB + Ndiff; IDIFF++ ) {
+
+                        if (constants::PERIODIC_Y) { Idiff = ( IDIFF % Nlat + Nlat ) % Nlat; }
+                        else                       { Idiff = IDIFF;                          }
+
+                        diff_index = Index(0, 0, Idiff, Ilon, 1, 1, Nlat,  Nlon);
+
+                        tmp = - diff_vec.at(IDIFF-LB) * tan_lat * R2_inv;
+                        if (area_weight) { tmp *= areas.at(index_sub); }
+
+                        old_val = sparseget(Lap, row_skip + index_sub, column_skip + diff_index);
+                        alglib::sparseset(  Lap, row_skip + index_sub, column_skip + diff_index, old_val + tmp);
+                    }
+                }
+            } else { // end mask if
+                // If this spot is masked, then set the value to 1
+                //   if we correspondingly set the RHS value to 0,
+                //   then this should force a zero value over land
+                alglib::sparseset(Lap, row_skip + index_sub, column_skip + index_sub, 1.);
+            }
+        }
+    }
+}
+
+
+// Returns the number of differences in the structure (row starts and column indices), and
+//   stores the largest difference in the values
+size_t compare_crs( double & max_value_diff, const crs_matrix & A, const crs_matrix & B ) {
+    max_value_diff = 0;
+    if ( (A.Nrows != B.Nrows) or (A.Ncols != B.Ncols) or (A.row_start.size() != B.row_start.size()) ) { return 1; }
+    size_t Ndiffs = 0;
+    for (size_t II = 0; II < A.row_start.size(); II++) { if (A.row_start[II] != B.row_start[II]) { Ndiffs++; } }
+    if ( A.col_index.size() != B.col_index.size() ) { return Ndiffs + 1; }
+    for (size_t II = 0; II < A.col_index.size(); II++) {
+        if (A.col_index[II] != B.col_index[II]) { Ndiffs++; }
+        max_value_diff = std::max( max_value_diff, fabs( A.values[II] - B.values[II] ) );
+    }
+    return Ndiffs;
+}
+
+int main(int argc, char *argv[]) {
+
+    fprintf(stdout, "Beginning sparse assembly tests.\n");
+
+    static_assert( not(constants::CARTESIAN), "The sparse assembly test uses a spherical grid" );
+
+    int thread_safety_provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &thread_safety_provided);
+
+    const int       Nlat    = (argc > 1) ? atoi(argv[1]) : 30,
+                    Nlon    = 2 * Nlat;
+    const size_t    Npts    = Nlat * Nlon;
+
+    // Number of comparisons with any difference
+    int Nfailed = 0;
+
+    fprintf(stdout, "\nNlat = %d, Nlon = %d, %d threads\n", Nlat, Nlon, omp_get_max_threads());
+    fprintf(stdout, "%-9s  %-12s  %-18s  %10s  %12s  %12s  %10s  %10s\n",
+            "poles", "matrix", "options", "nnz", "struct diffs", "max val diff", "ref(s)", "new(s)");
+
+    for (int include_poles = 0; include_poles < 2; include_poles++) {
+
+        dataset source_data;
+        source_data.time  = { 0. };
+        source_data.depth = { 0. };
+        source_data.latitude.resize(  Nlat );
+        source_data.longitude.resize( Nlon );
+        for (int II = 0; II < Nlat; II++) {
+            source_data.latitude.at(II) = include_poles ? ( -90. + II * 180. / (Nlat - 1) ) * D2R
+                                                        : ( -85. + (II + 0.5) * 170. / Nlat ) * D2R;
+        }
+        for (int II = 0; II < Nlon; II++) { source_data.longitude.at(II) = (II + 0.5) * 2 * M_PI / Nlon; }
+
+        source_data.Ntime   = 1;
+        source_data.Ndepth  = 1;
+        source_data.Nlat    = Nlat;
+        source_data.Nlon    = Nlon;
+        source_data.myCounts = { 1, 1, Nlat, Nlon };
+        source_data.myStarts = { 0, 0, 0, 0 };
+
+        source_data.compute_cell_areas();
+
+        // Rectangular continent
+        std::vector<bool> mask( Npts );
+        for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+            for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+                const double lat = source_data.latitude.at(Ilat), lon = source_data.longitude.at(Ilon);
+                mask.at(Ilat * Nlon + Ilon) = not( (lat > 10 * D2R) and (lat < 40 * D2R) and (lon > 20 * D2R) and (lon < 80 * D2R) );
+            }
+        }
+        source_data.mask = mask;
+
+        for (double Tikhov_Laplace : { 0., 1. }) {
+            for (int weight_err = 0; weight_err < 2; weight_err++) {
+                double clock_on = MPI_Wtime();
+                alglib::sparsematrix ref_matr;
+                alglib::sparsecreate( 4 * Npts, 2 * Npts, ref_matr );
+                reference_vortdiv( ref_matr, source_data, 0, 0, mask, weight_err, Tikhov_Laplace, 3.7, 0 );
+                alglib::sparseconverttocrs( ref_matr );
+                const double ref_time = MPI_Wtime() - clock_on;
+
+                clock_on = MPI_Wtime();
+                crs_matrix new_crs;
+                sparse_vel_from_PsiPhi_vortdiv( new_crs, source_data, 0, 0, mask, weight_err, Tikhov_Laplace, 3.7, 0 );
+                const double new_time = MPI_Wtime() - clock_on;
+
+                crs_matrix ref_crs;
+                ref_crs.build( ref_matr );
+                double max_value_diff;
+                const size_t Nstruct_diffs = compare_crs( max_value_diff, ref_crs, new_crs );
+                if ( (Nstruct_diffs > 0) or (max_value_diff > 0) ) { Nfailed++; }
+
+                char options[32];
+                snprintf( options, sizeof(options), "Tik=%g weight=%d", Tikhov_Laplace, weight_err );
+                fprintf(stdout, "%-9s  %-12s  %-18s  %10zu  %12zu  %12.4e  %10.3g  %10.3g\n",
+                        include_poles ? "included" : "excluded", "vortdiv", options,
+                        new_crs.Nnonzero(), Nstruct_diffs, max_value_diff, ref_time, new_time);
+            }
+        }
+
+        for (int weight_err = 0; weight_err < 2; weight_err++) {
+            for (int offset = 0; offset < 2; offset++) {
+                // With the offset, the Laplacian is the (1,0) block of a 2x2-block matrix
+                const size_t    Nrows       = (offset ? 2 : 1) * Npts,
+                                row_skip    = offset ? Npts : 0,
+                                column_skip = 0;
+
+                double clock_on = MPI_Wtime();
+                alglib::sparsematrix ref_matr;
+                alglib::sparsecreate( Nrows, Nrows, ref_matr );
+                reference_sparse_Lap( ref_matr, source_data, 0, 0, mask, weight_err, row_skip, column_skip );
+                alglib::sparseconverttocrs( ref_matr );
+                const double ref_time = MPI_Wtime() - clock_on;
+
+                clock_on = MPI_Wtime();
+                alglib::sparsematrix new_matr;
+                alglib::sparsecreate( Nrows, Nrows, new_matr );
+                toroidal_sparse_Lap( new_matr, source_data, 0, 0, mask, weight_err, row_skip, column_skip );
+                alglib::sparseconverttocrs( new_matr );
+                const double new_time = MPI_Wtime() - clock_on;
+
+                crs_matrix ref_crs, new_crs;
+                ref_crs.build( ref_matr );
+                new_crs.build( new_matr );
+                double max_value_diff;
+                const size_t Nstruct_diffs = compare_crs( max_value_diff, ref_crs, new_crs );
+                if ( (Nstruct_diffs > 0) or (max_value_diff > 0) ) { Nfailed++; }
+
+                char options[32];
+                snprintf( options, sizeof(options), "weight=%d offset=%d", weight_err, offset );
+                fprintf(stdout, "%-9s  %-12s  %-18s  %10zu  %12zu  %12.4e  %10.3g  %10.3g\n",
+                        include_poles ? "included" : "excluded", "Laplacian", options,
+                        new_crs.Nnonzero(), Nstruct_diffs, max_value_diff, ref_time, new_time);
+            }
+        }
+    }
+
+    fprintf(stdout, "\n%d comparison(s) with differences\n", Nfailed);
+
+    MPI_Finalize();
+    return (Nfailed > 0) ? 1 : 0;
+}
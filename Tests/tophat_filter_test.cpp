@@ -0,0 +1,265 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <math.h>
+#include <vector>
+#include <omp.h>
+#include "../functions.hpp"
+#include "../constants.hpp"
+
+// Compare the TopHat prefix-sum filter (see TOPHAT_PREFIX_SUM_FILTER) against the direct
+//   stencil sums (apply_filter_at_point_all_levels) at every point of a sphere with continents.
+//   One of the continents straddles the periodic boundary, so that the discs of nearby points
+//   wrap around in longitude, and the second depth has more land than the first. The errors
+//   are reported separately for water points whose disc wraps around the boundary, water
+//   points whose disc contains land, and the remaining (open ocean) water points, and land
+//   points must be exactly zero.
+//
+//   The last field is one on water (and zero on land), so that its filtered value is the
+//   denominator check: one everywhere if DEFORM_AROUND_LAND, and otherwise the fraction of
+//   the disc (weighted by kernel * area) that is water, which is computed here directly
+//   from the stencil.
+//
+// Usage: ./tophat_filter_test.x [Nlat (default 90)] [Nlon (default 270)]
+
+const double D2R = M_PI / 180;
+
+double u_lon_func(const double lat, const double lon) {
+    return 0.5 * cos(lat) * sin(3 * lon) + 0.2 * sin( 16 * lon + 12 * lat) * cos( 10 * lon - 8 * lat );
+}
+
+double u_lat_func(const double lat, const double lon) {
+    return 0.3 * cos( 2 * lat ) * cos( 2 * lon ) + 0.1 * cos( 25 * lon + 17 * lat );
+}
+
+double weight_func(const double lat, const double lon) {
+    return 1025. + 3. * sin( 2 * lat ) * cos( 5 * lon );
+}
+
+bool mask_func(const double lat, const double lon, const int Idepth) {
+    // Rectangular continent, and one that crosses the periodic boundary in longitude
+    if ( (lat > 10 * D2R) and (lat < 40 * D2R) and (lon > 20 * D2R) and (lon < 80 * D2R) ) { return false; }
+    if ( (lat > -50 * D2R) and (lat < 5 * D2R) and ( (lon > 165 * D2R) or (lon < -170 * D2R) ) ) { return false; }
+    // The deeper level also has land over the south pole
+    if ( (Idepth > 0) and (lat < -70 * D2R) ) { return false; }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+
+    fprintf(stdout, "Beginning TopHat prefix-sum filter tests.\n");
+
+    static_assert( not(constants::CARTESIAN), "The TopHat test uses a spherical grid" );
+    static_assert( constants::KERNEL_OPT == constants::KernelType::TopHat,
+            "The prefix-sum filter only applies to the TopHat kernel (KERNEL_OPT)" );
+    static_assert( constants::PERIODIC_X and constants::UNIFORM_LON_GRID and constants::FULL_LON_SPAN,
+            "The TopHat test uses a uniform, periodic, full-span longitude grid" );
+
+    int thread_safety_provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &thread_safety_provided);
+
+    const int       Nlat    = (argc > 1) ? atoi(argv[1]) : 90,
+                    Nlon    = (argc > 2) ? atoi(argv[2]) : 270,
+                    Ntime   = 1,
+                    Ndepth  = 2,
+                    Nlevels = Ntime * Ndepth;
+    const size_t    Npts    = Ntime * Ndepth * Nlat * Nlon;
+
+    const double    dlat  = M_PI / Nlat,
+                    dlon  = 2 * M_PI / Nlon;
+
+    const std::vector<double> scales = { 150e3, 600e3, 2500e3 };
+
+    dataset source_data;
+    source_data.time  = { 0. };
+    source_data.depth = { 0., 1. };
+    source_data.latitude.resize(  Nlat );
+    source_data.longitude.resize( Nlon );
+    for (int II = 0; II < Nlat; II++) { source_data.latitude.at( II) = - M_PI / 2 + (II+0.5) * dlat; }
+    for (int II = 0; II < Nlon; II++) { source_data.longitude.at(II) = - M_PI     + (II+0.5) * dlon; }
+
+    source_data.Ntime   = Ntime;
+    source_data.Ndepth  = Ndepth;
+    source_data.Nlat    = Nlat;
+    source_data.Nlon    = Nlon;
+
+    source_data.compute_cell_areas();
+
+    // Initialize the fields (zero on land) and the weight (non-zero everywhere)
+    std::vector<filter_real> u_lon( Npts, 0. ), u_lat( Npts, 0. ), ones( Npts, 0. ), rho( Npts, 0. );
+    source_data.mask.resize( Npts );
+    for (int Idepth = 0; Idepth < Ndepth; Idepth++) {
+        for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+            for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+                const size_t index = Index(0, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon);
+                const double lat = source_data.latitude.at(Ilat), lon = source_data.longitude.at(Ilon);
+                source_data.mask.at(index) = mask_func( lat, lon, Idepth );
+                rho.at(index) = weight_func( lat, lon );
+                if ( source_data.mask.at(index) ) {
+                    u_lon.at(index) = u_lon_func( lat, lon ) * ( 1 + Idepth );
+                    u_lat.at(index) = u_lat_func( lat, lon ) * ( 1 - 0.5 * Idepth );
+                    ones.at(index)  = 1.;
+                }
+            }
+        }
+    }
+
+    const std::vector<const std::vector<filter_real>*>
+        fields  = { &u_lon, &u_lat, &u_lon,  &ones },
+        factors = { NULL,   NULL,   &u_lat,  NULL };
+    const char * field_names[] = { "u_lon", "u_lat", "u_lon*u_lat", "water" };
+    const int Nfields = fields.size();
+
+    // Point categories, for the error tables
+    const int Ncats = 3;
+    const char * cat_names[] = { "wrapping", "coastal", "open" };
+
+    std::vector< std::vector<double> > tophat_storage( Nfields, std::vector<double>( Npts, 0. ) ),
+                                       direct_storage( Nfields, std::vector<double>( Npts, 0. ) );
+    std::vector< std::vector<double>* > tophat_coarse;
+    for (int Ifield = 0; Ifield < Nfields; Ifield++) { tophat_coarse.push_back( &tophat_storage[Ifield] ); }
+
+    // Water fraction of each disc (kernel * area weighted), and the category of each point
+    std::vector<double> water_frac( Npts, 0. );
+    std::vector<int> category( Npts, -1 );
+
+    fprintf(stdout, "\nDEFORM_AROUND_LAND = %s\n", constants::DEFORM_AROUND_LAND ? "true" : "false");
+    fprintf(stdout, "Relative errors (TopHat - direct) over water points, Nlat = %d, Nlon = %d:\n", Nlat, Nlon);
+    fprintf(stdout, "%10s  %-8s  %-16s  %-10s  %8s  %12s  %12s\n",
+            "scale(km)", "weight", "field", "points", "count", "max", "RMS");
+
+    for (size_t Iscale = 0; Iscale < scales.size(); Iscale++) {
+        const double scale = scales[Iscale];
+
+        for (int use_weight = 0; use_weight < 2; use_weight++) {
+            const std::vector<filter_real> * weight = use_weight ? &rho : NULL;
+
+            apply_filter_tophat( tophat_coarse, fields, factors, source_data, scale, 0, Nlat, weight );
+
+            // Reference values, water fractions, and categories
+            #pragma omp parallel default(none) \
+            shared( direct_storage, water_frac, category, fields, factors, source_data, weight ) \
+            firstprivate( Nlat, Nlon, Ntime, Ndepth, Nlevels, Nfields, scale )
+            {
+                kernel_stencil stencil;
+                stencil_segment segs[2];
+                std::vector<double> level_vals, null_vector;
+
+                #pragma omp for schedule(dynamic)
+                for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+                    stencil.build( source_data, scale, Ilat, 0 );
+                    for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+                        apply_filter_at_point_all_levels( level_vals, null_vector, null_vector, null_vector, null_vector,
+                                fields, factors, source_data, Ilat, Ilon, stencil, weight, false, NULL );
+
+                        // Does the disc wrap around the periodic boundary, and how much of it is water?
+                        bool wraps = false;
+                        std::vector<double> water_kA( Nlevels, 0. );
+                        double total_kA = 0.;
+                        for (size_t Irow = 0; Irow < stencil.Nrows(); Irow++) {
+                            const int Nsegs = stencil.row_segments( segs, Irow, Ilon, Nlon );
+                            if (Nsegs > 1) { wraps = true; }
+                            for (int Iseg = 0; Iseg < Nsegs; Iseg++) {
+                                for (int II = 0; II < segs[Iseg].Ncells; II++) {
+                                    const double kA = stencil.kA[ segs[Iseg].cell_offset + II ];
+                                    total_kA += kA;
+                                    for (int Ilev = 0; Ilev < Nlevels; Ilev++) {
+                                        const size_t src = Index(Ilev / Ndepth, Ilev % Ndepth, stencil.row_lat[Irow],
+                                                                 segs[Iseg].lon_start + II, Ntime, Ndepth, Nlat, Nlon);
+                                        if ( source_data.mask[src] ) { water_kA[Ilev] += kA; }
+                                    }
+                                }
+                            }
+                        }
+
+                        for (int Ilev = 0; Ilev < Nlevels; Ilev++) {
+                            const size_t index = Index(Ilev / Ndepth, Ilev % Ndepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon);
+                            for (int Ifield = 0; Ifield < Nfields; Ifield++) {
+                                direct_storage[Ifield].at(index) = level_vals[ Ilev * Nfields + Ifield ];
+                            }
+                            water_frac.at(index) = (total_kA == 0) ? 0. : water_kA[Ilev] / total_kA;
+                            if      ( not(source_data.mask[index]) ) { category.at(index) = -1; }
+                            else if ( wraps )                        { category.at(index) = 0; }
+                            else if ( water_kA[Ilev] < total_kA )    { category.at(index) = 1; }
+                            else                                     { category.at(index) = 2; }
+                        }
+                    }
+                }
+            }
+
+            for (int Ifield = 0; Ifield < Nfields; Ifield++) {
+                for (int Icat = 0; Icat < Ncats; Icat++) {
+                    double max_diff = 0, max_ref = 0, sum_sq_diff = 0, sum_sq_ref = 0;
+                    size_t Ncount = 0;
+                    for (size_t index = 0; index < Npts; index++) {
+                        if (category[index] != Icat) { continue; }
+                        const double    ref  = direct_storage[Ifield][index],
+                                        diff = fabs( tophat_storage[Ifield][index] - ref );
+                        max_diff = std::max( max_diff, diff );
+                        max_ref  = std::max( max_ref,  fabs( ref ) );
+                        sum_sq_diff += diff * diff;
+                        sum_sq_ref  += ref * ref;
+                        Ncount++;
+                    }
+                    fprintf(stdout, "%10.5g  %-8s  %-16s  %-10s  %8zu  %12.4e  %12.4e\n",
+                            scale / 1e3, use_weight ? "rho" : "none", field_names[Ifield], cat_names[Icat], Ncount,
+                            (max_ref > 0) ? max_diff / max_ref : 0., (sum_sq_ref > 0) ? sqrt( sum_sq_diff / sum_sq_ref ) : 0.);
+                }
+            }
+
+            // Land points are set to zero
+            size_t Nland = 0, Nland_nonzero = 0;
+            for (size_t index = 0; index < Npts; index++) {
+                if (category[index] != -1) { continue; }
+                Nland++;
+                for (int Ifield = 0; Ifield < Nfields; Ifield++) {
+                    if ( tophat_storage[Ifield][index] != 0 ) { Nland_nonzero++; break; }
+                }
+            }
+            fprintf(stdout, "%10.5g  %-8s  %zu of %zu land points have non-zero filtered values\n",
+                    scale / 1e3, use_weight ? "rho" : "none", Nland_nonzero, Nland);
+
+            // Denominator: the filtered water indicator (without a weight) is one if deforming around land,
+            //   and otherwise the water fraction of the disc
+            if (not(use_weight)) {
+                double max_denom_diff = 0;
+                for (size_t index = 0; index < Npts; index++) {
+                    if (category[index] == -1) { continue; }
+                    const double expected = constants::DEFORM_AROUND_LAND ? 1. : water_frac[index];
+                    max_denom_diff = std::max( max_denom_diff, fabs( tophat_storage[Nfields - 1][index] - expected ) );
+                }
+                fprintf(stdout, "%10.5g  %-8s  denominator: max |filtered water - %s| = %.4e\n",
+                        scale / 1e3, "none", constants::DEFORM_AROUND_LAND ? "1" : "water fraction", max_denom_diff);
+            }
+        }
+
+        // Filtering only a band of latitudes (as for one processor of latitude_bands) should
+        //   reproduce those rows exactly, and leave the other rows untouched
+        const int   band_start = Nlat / 3,
+                    band_end   = 2 * Nlat / 3;
+        std::vector< std::vector<double> > band_storage( Nfields, std::vector<double>( Npts, -1. ) );
+        std::vector< std::vector<double>* > band_coarse;
+        for (int Ifield = 0; Ifield < Nfields; Ifield++) { band_coarse.push_back( &band_storage[Ifield] ); }
+        apply_filter_tophat( tophat_coarse, fields, factors, source_data, scale, 0, Nlat, NULL );
+        apply_filter_tophat( band_coarse, fields, factors, source_data, scale, band_start, band_end, NULL );
+
+        double max_band_diff = 0;
+        size_t Nchanged = 0;
+        for (int Ifield = 0; Ifield < Nfields; Ifield++) {
+            for (size_t index = 0; index < Npts; index++) {
+                const int Ilat = ( index / Nlon ) % Nlat;
+                if ( (Ilat >= band_start) and (Ilat < band_end) ) {
+                    max_band_diff = std::max( max_band_diff, fabs( band_storage[Ifield][index] - tophat_storage[Ifield][index] ) );
+                } else if ( band_storage[Ifield][index] != -1. ) {
+                    Nchanged++;
+                }
+            }
+        }
+        fprintf(stdout, "%10.5g  band [%d, %d): max difference from the full filter %.4e, %zu points outside the band changed\n",
+                scale / 1e3, band_start, band_end, max_band_diff, Nchanged);
+    }
+
+    MPI_Finalize();
+    return 0;
+}
@@ -195,6 +195,177 @@ namespace constants
      */
     const bool FULL_LON_SPAN = true;
 
+    /*!
+     * \param USE_LON_FFT_FILTER
+     * \brief Boolean indicating if the filtering should be done with FFTs in longitude.
+     *
+     * Only used when the longitude grid is uniform, periodic, and spans the full domain
+     * (see FULL_LON_SPAN), since then each kernel is just a shift in longitude of the kernel
+     * at the first longitude point. Whole latitude rows are then filtered at once 
+     * (see apply_filter_via_lon_fft), which is much faster for large filter scales, but 
+     * requires roughly one extra full-sized array per filtered field.
+     *
+     * @ingroup constants
+     */
+    const bool USE_LON_FFT_FILTER = false;
+
+    /*!
+     * \param MULTISCALE_SINGLE_PASS
+     * \brief Boolean indicating if all filter scales should be computed in a single sweep.
+     *
+     * Used by the (non-Helmholtz) filtering driver. The stencil for the largest scale is walked 
+     * once per point, and the partial sums for every scale are accumulated at the same time 
+     * (see apply_filter_at_point_multiscale), so the fields are only read once instead of once per scale.
+     * This requires storing the filtered fields for every scale until they are written, i.e.
+     * roughly ( number of scales ) * ( number of filtered fields ) full-sized arrays.
+     *
+     * Ignored if USE_LON_FFT_FILTER is used.
+     *
+     * @ingroup constants
+     */
+    const bool MULTISCALE_SINGLE_PASS = false;
+
+    /*!
+     * \param FFT_TRANSFER_FROM_KERNEL
+     * \brief Boolean indicating if the FFTW-based filtering should use the transfer function of the kernel.
+     *
+     * Used by the FFTW-based driver (coarse_grain_fftw). If true, the spectral filter at each scale is 
+     * the discrete Fourier transform of the kernel (KERNEL_OPT) sampled on the grid, so that the result 
+     * matches direct filtering on a periodic Cartesian domain without land. If false, a sharp spectral 
+     * cutoff at wavenumber 2 pi / scale is used.
+     *
+     * @ingroup constants
+     */
+    const bool FFT_TRANSFER_FROM_KERNEL = false;
+
+    /*!
+     * \param SEPARABLE_CARTESIAN_FILTER
+     * \brief Boolean indicating if the filtering should be done as two one-dimensional passes.
+     *
+     * Used by the (non-Helmholtz) filtering driver, and only valid with CARTESIAN and a 
+     * Gaussian (or JohnsonGaussian) kernel, which factors as G(x) G(y). The fields are summed 
+     * along each row, and those sums are then summed along each column (see apply_filter_separable), 
+     * so the cost per point grows with the kernel width instead of its area.
+     *
+     * Takes precedence over USE_LON_FFT_FILTER, MULTISCALE_SINGLE_PASS, and the resolution pyramid.
+     * Ignored if decimating the outputs.
+     *
+     * @ingroup constants
+     */
+    const bool SEPARABLE_CARTESIAN_FILTER = false;
+
+    /*!
+     * \param TOPHAT_PREFIX_SUM_FILTER
+     * \brief Boolean indicating if TopHat filtering should use prefix sums along each row.
+     *
+     * Used by the (non-Helmholtz) filtering driver, and only valid with the TopHat kernel. 
+     * Each filtered value is then an area-weighted mean over runs of longitude, so each row 
+     * of the kernel disc costs two lookups into prefix sums of the fields (see apply_filter_tophat), 
+     * instead of a sum over its cells.
+     *
+     * Takes precedence over USE_LON_FFT_FILTER, MULTISCALE_SINGLE_PASS, and the resolution pyramid.
+     * Ignored if decimating the outputs.
+     *
+     * @ingroup constants
+     */
+    const bool TOPHAT_PREFIX_SUM_FILTER = false;
+
+    /*!
+     * \param IIR_GAUSSIAN_FILTER
+     * \brief Boolean indicating if Gaussian filtering should use a recursive (IIR) approximation.
+     *
+     * Used by the (non-Helmholtz) filtering driver, and only valid with a Gaussian (or JohnsonGaussian) 
+     * kernel. The kernel is applied as recursive one-dimensional Gaussians along longitude and then 
+     * latitude (see apply_filter_iir), so the cost per cell does not depend on the scale. This is an 
+     * approximation on the sphere (distances are not geodesic), with an error that grows with the scale. 
+     * See Tests/iir_filter_accuracy.cpp; with DEBUG >= 1 a sampled error is also printed and stored 
+     * in the outputs.
+     *
+     * Takes precedence over USE_LON_FFT_FILTER, MULTISCALE_SINGLE_PASS, and the resolution pyramid, 
+     * but not over SEPARABLE_CARTESIAN_FILTER (which is exact). Ignored if decimating the outputs.
+     *
+     * @ingroup constants
+     */
+    const bool IIR_GAUSSIAN_FILTER = false;
+
+    /*!
+     * \param BALANCE_BY_WATER
+     * \brief Boolean indicating if the MPI divisions in time / depth should be chosen from the mask.
+     *
+     * The filtering work scales with the number of water points, which can vary a lot between 
+     * depths (and, less often, times). If true, the mask is read up front and uneven time / depth
+     * ranges are assigned so that the estimated work is the same on each processor 
+     * (see dataset::balance_processor_divisions). If false, the ranges are split evenly by count.
+     *
+     * @ingroup constants
+     */
+    const bool BALANCE_BY_WATER = false;
+
+    /*!
+     * \param NATIVE_LSQR_SOLVER
+     * \brief Boolean indicating if the Helmholtz projection should use the native (OpenMP) LSQR solver instead of ALGLIB
+     *
+     * The free edition of ALGLIB is single-threaded, so the least-squares solve for each time / depth 
+     * keeps only one core busy. If true, the solve uses the native LSQR (see least_squares_solver), which
+     * has threaded matrix-vector products, the same column-norm preconditioning, and the same stopping
+     * criteria and termination codes. If false, ALGLIB is used (and can be used as a reference).
+     *
+     * @ingroup constants
+     */
+    const bool NATIVE_LSQR_SOLVER = false;
+
+    /*!
+     * \param DECIMATE_OUTPUT_PTS_PER_SCALE
+     * \brief Number of output points per filter scale when decimating outputs (zero or negative to turn off).
+     *
+     * Used by the (non-Helmholtz) filtering driver. Since the filtered fields are smooth on the
+     * filter scale, they only need to be computed on a subsampled grid. If positive, then for each scale
+     * the filter is only evaluated at every lat_stride-th latitude and lon_stride-th longitude of the
+     * source grid, where the strides give (at least) this many points per filter scale (see get_decimation_strides).
+     * The derivatives (vorticity, Pi, etc), output files, and post-processing then use the subsampled grid.
+     *
+     * Takes precedence over USE_LON_FFT_FILTER and MULTISCALE_SINGLE_PASS (which filter at every point).
+     *
+     * @ingroup constants
+     */
+    const double DECIMATE_OUTPUT_PTS_PER_SCALE = 0.;
+
+    /*!
+     * \param PYRAMID_MAX_SPACING_FRACTION
+     * \brief Largest grid spacing, as a fraction of the filter scale, for filtering on a coarsened grid (zero or negative to turn off).
+     *
+     * Used by the (non-Helmholtz) filtering driver. If positive, a pyramid of block-averaged grids
+     * (2x2, 4x4, 8x8, ... source cells per coarse cell) is built once, and each scale is filtered on the
+     * coarsest grid whose spacing is at most this fraction of the scale. The results are then interpolated
+     * back onto the source grid (see resolution_pyramid and apply_filter_via_pyramid). This keeps the number
+     * of cells in each kernel roughly independent of the scale, instead of growing like scale^2.
+     * Scales that are too small for the first coarsened grid are filtered as usual.
+     *
+     * The block averages are area-weighted and mask-aware, so the coarse kernel sums match the fine ones
+     * up to the variation of the kernel within a block (plus the interpolation error). With DEBUG >= 1,
+     * the relative error is measured at a sample of points and printed (see pyramid_filter_error).
+     *
+     * Ignored if DECIMATE_OUTPUT_PTS_PER_SCALE or MULTISCALE_SINGLE_PASS are used.
+     *
+     * @ingroup constants
+     */
+    const double PYRAMID_MAX_SPACING_FRACTION = 0.;
+
+    /*!
+     * \param FLOAT_FIELD_STORAGE
+     * \brief Boolean indicating if the fields that are read by the filter kernels are stored in single precision.
+     *
+     * The filter loops are limited by memory bandwidth (gathering the source fields), so storing the
+     * filtered inputs (velocities, KE, rho, p, vorticity, Helmholtz scalars, etc) as float halves both
+     * their memory and the bandwidth needed to read them. The kernel sums (and the normalization by
+     * the kernel area) are still accumulated in double precision, and all of the outputs and derived
+     * quantities (Pi, Z, etc) are double. See Tests/mixed_precision_validation.cpp for the size of the
+     * differences from the double-precision path.
+     *
+     * @ingroup constants
+     */
+    const bool FLOAT_FIELD_STORAGE = false;
+
     /*!
      * \param COMP_VORT
      * \brief Boolean indicating if vorticity should be computed.
@@ -277,6 +448,29 @@ namespace constants
      */
     const bool CAST_TO_INT = false;
 
+    /*!
+     * \param ASYNC_OUTPUT
+     * \brief Boolean indicating if output fields should be written by a background thread.
+     *
+     * Used by the filtering drivers. Finished fields are copied into a queue and written
+     * by a dedicated IO thread (see output_writer), so that the next scale can start while the
+     * previous one is still being written. Requires MPI_THREAD_MULTIPLE.
+     *
+     * @ingroup constants
+     */
+    const bool ASYNC_OUTPUT = false;
+
+    /*!
+     * \param ASYNC_OUTPUT_MAX_GB
+     * \brief Maximum size (in GB, per processor) of the fields waiting to be written when using ASYNC_OUTPUT.
+     *
+     * If queuing another field would pass this limit, then the compute thread waits for the
+     * IO thread to catch up. A single field larger than the limit is still queued on its own.
+     *
+     * @ingroup constants
+     */
+    const double ASYNC_OUTPUT_MAX_GB = 4.;
+
     /*!
      * \param DO_TIMING
      * \brief Boolean indicating if we want to output internal timings
@@ -338,6 +532,48 @@ namespace constants
                            ( KERNEL_OPT == KernelType::HighOrder ) ? 2.5 :
                            -1;
 
+    /*!
+     * \param KERNEL_TRUNCATION_TOLERANCE
+     * \brief Tolerance on the neglected kernel mass, used to size the filtering stencils in place of KernPad
+     *
+     * If positive, the stencil radius is the smallest radius at which the (absolute) kernel mass
+     * outside of it, and likewise for its ell-derivatives, is at most this fraction of the total 
+     * (see kernel_pad). The radius in metres is recorded as the kernel_radius attribute of each output file.
+     * If zero, KernPad is used. Has no effect on unbounded kernels (KernPad < 0).
+     *
+     * The filtering cost is proportional to the radius squared. The measured radius, relative to KernPad, is
+     *
+     *      kernel              1e-6    1e-8    1e-10
+     *      HyperGaussian       0.83    0.88    0.92
+     *      Gaussian            0.89    1.00    1.09
+     *      JohnsonGaussian     0.77    0.88    0.97
+     *      SmoothHat           0.73    0.83    0.92
+     *      HighOrder           1.20    1.31    1.42
+     *
+     * so the savings are modest (about 10-30% of the radius at 1e-6, and little or none at 1e-10), and
+     * the HighOrder stencils get *larger* than with KernPad at every tolerance, since its Gaussian lobe
+     * still holds about 1e-5 of the kernel mass at KernPad.
+     *
+     * @ingroup constants
+     */
+    const double KERNEL_TRUNCATION_TOLERANCE = 0.;
+
+    /*!
+     * \param USE_KERNEL_TABLE
+     * \brief Boolean indicating if kernel values should come from a pre-computed table (see kernel_tabulated)
+     *
+     * The kernel and its ell-derivatives are tabulated (as functions of dist / (scale/2)) once,
+     * and then evaluated with cubic interpolation, which avoids the transcendental function calls
+     * in kernel(). This changes the filtered values at round-off level, so it is off by default.
+     * Tests/kernel_benchmark.cpp checks that the error (relative to the peak magnitude) is at most 1e-9 for
+     * the kernel and 1e-7 for the ell-derivatives (the measured maxima are about 4e-10 and 1.5e-8, for the
+     * HighOrder and SmoothHat kernels).
+     * The TopHat and Sinc kernels always use the exact evaluation.
+     *
+     * @ingroup constants
+     */
+    const bool USE_KERNEL_TABLE = false;
+
     /*!
      * \param PARTICLE_RECYCLE_TYPE
      * \brief Variable indicating what recycling scheme should be used for particles
@@ -4,9 +4,11 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string>
 #include <vector>
 #include <mpi.h>
 #include <fftw3.h>
+#include "functions.hpp"
 #include "constants.hpp"
 
 //
@@ -14,51 +16,33 @@
 //
 
 void filtering_fftw(
-        const std::vector<double> & u_r, 
-        const std::vector<double> & u_lon, 
-        const std::vector<double> & u_lat,
-        const std::vector<double> & rho,
-        const std::vector<double> & p,
-        const std::vector<double> & scales, 
-        const std::vector<double> & dAreas, 
-        const std::vector<double> & time, 
-        const std::vector<double> & depth,
-        const std::vector<double> & longitude, 
-        const std::vector<double> & latitude,
-        const std::vector<bool>   & mask,
-        const std::vector<int>    & myCounts,
-        const std::vector<int>    & myStarts,
+        const dataset & source_data,
+        const std::vector<double> & scales,
+        const std::string & wisdom_filename = "",
         const MPI_Comm comm = MPI_COMM_WORLD);
 
-void fft_filter(
-        std::vector<double> & coarse_field,
+void fft_forward(
+        fftw_complex * spectrum,
         const std::vector<double> & full_field,
-        const fftw_plan  fft,
-        const fftw_plan ifft,
-        double * fft_inp,
-        fftw_complex * fft_out,
+        const std::vector<double> * full_factor,
+        const std::vector<bool> & mask,
+        const fftw_plan fft,
+        double * fft_inp);
+
+void fft_transfer_function(
+        std::vector<double> & transfer,
         const double scale,
-        const int Ntime,
-        const int Ndepth,
-        const int Ny,
-        const int Nx,
-        const double Ly,
-        const double Lx);
+        const dataset & source_data);
 
-void fft_filter_product(
+void fft_filter(
         std::vector<double> & coarse_field,
-        const std::vector<double> & full_field1,
-        const std::vector<double> & full_field2,
-        const fftw_plan  fft,
+        const fftw_complex * spectrum,
+        const std::vector<double> & transfer,
         const fftw_plan ifft,
         double * fft_inp,
         fftw_complex * fft_out,
-        const double scale,
-        const int Ntime,
-        const int Ndepth,
+        const int Nlevels,
         const int Ny,
-        const int Nx,
-        const double Ly,
-        const double Lx);
+        const int Nx);
 
 #endif
@@ -6,6 +6,13 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <complex>
+#include <type_traits>
+#include <functional>
+#include <memory>
+#include <future>
+#include <mutex>
+#include <atomic>
 #include <mpi.h>
 #include "constants.hpp"
 
@@ -14,6 +21,88 @@
  * \brief Collection of all computation-related functions.
  */
 
+/*!
+ * \brief Storage type for the working fields that are read by the filter kernels
+ *
+ * This is float if constants::FLOAT_FIELD_STORAGE is true, and double otherwise.
+ *    The kernel sums are always accumulated in double precision.
+ */
+typedef std::conditional< constants::FLOAT_FIELD_STORAGE, float, double >::type filter_real;
+
+/*!
+ * \brief Class to store cached grid geometry (trig values of the coordinates).
+ *
+ * This allows distances from a reference point to a whole row of
+ *    grid points to be computed at once (see distances_row), without
+ *    any trig calls on the grid coordinates.
+ */
+class grid_geometry {
+
+    public:
+
+        int Nlat = 0, Nlon = 0;
+
+        // Physical lengths of the dimensions (only used for periodic Cartesian grids)
+        double Llon = 0., Llat = 0.;
+
+        // Coordinates, and cached sin / cos for each latitude and longitude
+        std::vector<double> longitude, latitude, cos_lat, sin_lat, cos_lon, sin_lon;
+
+        // Constructor
+        grid_geometry();
+
+        void build( const std::vector<double> & longitude_in,
+                    const std::vector<double> & latitude_in );
+
+        bool is_built() const { return (Nlat > 0) and (Nlon > 0); }
+
+        void distances_row( double * distances,
+                            const int ref_Ilat,
+                            const int ref_Ilon,
+                            const int Ilat,
+                            const int LON_lb,
+                            const int Ncells ) const;
+};
+
+/*!
+ * \brief Class to store the mask as runs of water cells along each line of latitude.
+ *
+ * For each (time, depth, latitude) row, the water cells are stored as a list of 
+ *    [run_begin, run_end) intervals in longitude index (in CSR layout, so that the 
+ *    runs for a row are contiguous in memory). This lets the filtering loops walk
+ *    only over the water cells, without checking the mask cell-by-cell.
+ */
+class water_runs {
+
+    public:
+
+        int Nrows = 0, Nlon = 0;
+
+        // Runs for row Irow = (Itime * Ndepth + Idepth) * Nlat + Ilat are 
+        //   run_begin[ row_start[Irow] ... row_start[Irow+1] - 1 ] (and likewise for run_end)
+        std::vector<size_t> row_start;
+        std::vector<int> run_begin, run_end;
+
+        // Constructor
+        water_runs();
+
+        void build( const std::vector<bool> & mask,
+                    const int Ntime,
+                    const int Ndepth,
+                    const int Nlat,
+                    const int Nlon_in );
+
+        bool is_built() const { return Nrows > 0; }
+
+        void runs_in_range( std::vector<int> & lo,
+                            std::vector<int> & hi,
+                            const size_t Irow,
+                            const int LON_start,
+                            const int Ncells ) const;
+
+        double water_fraction() const;
+};
+
 /*!
  * \brief Class to store main variables.
  *
@@ -47,6 +136,9 @@ class dataset {
         // Store cell areas
         std::vector<double> areas;
 
+        // Cached grid geometry (trig values), for computing distances
+        grid_geometry geometry;
+
         // Boolean to indicate if we're computing u_r from incompressibility
         bool compute_radial_vel    = false,
              use_depth_derivatives = false,
@@ -72,6 +164,14 @@ class dataset {
         // that the output is in the same order as the input.
         std::vector<int> myCounts, myStarts;
 
+        // First time / depth index for each processor (plus the total), if the 
+        // divisions are not even (empty otherwise). See balance_processor_divisions
+        std::vector<int> time_split_starts, depth_split_starts;
+
+        // Window of this processor's times that the variables hold, when streaming through
+        // time in windows (see set_time_windows). All processors have the same number of windows.
+        int Itime_window = 0, Ntime_windows = 1;
+
         //
         //// Functions
         //
@@ -107,12 +207,24 @@ class dataset {
         void prepare_for_coarsened_grids(   const std::string filename,
                                             const MPI_Comm = MPI_COMM_WORLD );
 
+        // Subsampled copy of a grid (for decimated outputs)
+        void subsample_from(    const dataset & source_data,
+                                const int lat_stride,
+                                const int lon_stride );
+
         // Check the processors divions between dimensions
         void check_processor_divisions( const int Nprocs_in_time_input, 
                                         const int Nprocs_in_depth_input, 
                                         const int Nprocs_in_quad_input = 1, 
                                         const MPI_Comm = MPI_COMM_WORLD );
 
+        // Choose (uneven) time / depth divisions that balance the filtering work
+        void balance_processor_divisions(   const std::string var_name_in_file,
+                                            const std::string filename );
+
+        // Divide the times on each processor into windows (of at most max_window_size times, if possible)
+        void set_time_windows( const int max_window_size );
+
         // Function to gather a variable across all depths (i.e. reconstruct depth profile)
         //  this is necessary for things like depth derivatives
         void gather_variable_across_depth( const std::vector<double> & var,
@@ -146,6 +258,274 @@ class dataset {
 
 };
 
+/*!
+ * \brief Contiguous (in longitude) part of one row of a kernel_stencil
+ *
+ * A stencil row that wraps around the periodic boundary is split into two segments
+ *    (see kernel_stencil::row_segments), so that the filter loops don't need per-cell
+ *    index arithmetic.
+ */
+struct stencil_segment {
+    // Source longitudes [ lon_start, lon_start + Ncells ), whose weights start at cell cell_offset of the stencil
+    int lon_start = 0, Ncells = 0;
+    size_t cell_offset = 0;
+};
+
+/*!
+ * \brief Class for storing a compressed kernel stencil
+ *
+ * Rather than a dense Nlat*Nlon kernel, only the cells inside of the kernel
+ *    support are stored, as one contiguous run of longitudes per source latitude.
+ *    The kernel values are stored pre-multiplied by the cell areas.
+ *
+ * If the kernel can be rolled in longitude, then a single stencil per latitude
+ *    can be re-used at every longitude (and by every filter pass).
+ */
+class kernel_stencil {
+
+    public:
+
+        // Reference point and scale(s) the stencil was built for
+        //    (scale is the largest of the scales, which sets the stencil extent)
+        int ref_Ilat = -1, ref_Ilon = -1, Nscales = 1;
+        double scale = 0.;
+        std::vector<double> scales;
+        bool do_dl = false, do_dll = false;
+
+        // Per-row data: source latitude, first longitude (relative to the kernel centre),
+        //    number of cells in the run, and the index of the first cell of the run
+        std::vector<int> row_lat, row_lon_start, row_Ncells;
+        std::vector<size_t> row_offset;
+
+        // Packed (kernel * area) weights, and likewise for the ell-derivatives of the kernel
+        //    The weight for cell Icell and scale Iscale is kA[ Icell * Nscales + Iscale ]
+        std::vector<double> kA, kpA, kppA;
+
+        // Constructor
+        kernel_stencil();
+
+        void build( const dataset & source_data,
+                    const double filter_scale,
+                    const int Ilat,
+                    const int Ilon,
+                    const bool with_dl = false,
+                    const bool with_dll = false );
+        void build( const dataset & source_data,
+                    const std::vector<double> & filter_scales,
+                    const int Ilat,
+                    const int Ilon,
+                    const bool with_dl = false,
+                    const bool with_dll = false );
+
+        int source_lon( const int Irow, const int Ilon, const int Nlon ) const;
+
+        int row_segments( stencil_segment segments[2],
+                          const size_t Irow,
+                          const int Ilon,
+                          const int Nlon ) const;
+
+        size_t Nrows() const { return row_lat.size(); }
+        size_t size()  const { return kA.size() / Nscales; }
+};
+
+/*!
+ * \brief Class to share read-only kernel stencils between threads
+ *
+ * Holds the most recently used stencils (at most 'capacity' of them), keyed by
+ *    the latitude, scale, and derivatives that they were built for. A stencil that
+ *    is being built by one thread is waited on (rather than rebuilt) by the others.
+ *    Only meaningful when the kernel can be rolled in longitude, since the stencils
+ *    are all built at the reference longitude (index 0).
+ */
+class stencil_cache {
+
+    public:
+
+        int capacity = 16;
+
+        // Constructor
+        stencil_cache();
+
+        std::shared_ptr<const kernel_stencil> get( const dataset & source_data,
+                                                   const double filter_scale,
+                                                   const int Ilat,
+                                                   const bool with_dl,
+                                                   const bool with_dll,
+                                                   bool & was_built );
+
+        void clear();
+
+    private:
+
+        struct entry {
+            int Ilat;
+            double scale;
+            bool do_dl, do_dll;
+            size_t last_use;
+            std::shared_future< std::shared_ptr<const kernel_stencil> > stencil;
+        };
+
+        std::mutex cache_mutex;
+        std::vector<entry> entries;
+        size_t use_count = 0;
+};
+
+/*!
+ * \brief Class to balance the filtering work of the processors that share the same times / depths, by latitude bands
+ *
+ * This is load balancing of the computation only, not a domain decomposition. Each processor
+ *    in the band communicator filters only the target latitudes in its own band. The filtered
+ *    fields are only valid within the band: exchange_halo fills in the rows just outside of it
+ *    (so that derivatives are valid within the band), and sum_across_bands combines partial
+ *    integrals. The source fields are not split, so every processor still reads and holds every
+ *    latitude, and the memory per processor is the same as without bands.
+ *
+ */
+class latitude_bands {
+
+    public:
+
+        int Nbands = 1, Iband = 0, Nlat = 0;
+
+        // Band Iband is the latitudes [ band_starts[Iband], band_starts[Iband+1] )
+        std::vector<int> band_starts;
+
+        MPI_Comm comm = MPI_COMM_SELF;
+
+        // Constructor
+        latitude_bands();
+
+        void build( const dataset & source_data,
+                    const water_runs * water,
+                    const MPI_Comm band_comm );
+
+        int first_row() const { return band_starts.at(Iband); }
+        int end_row()   const { return band_starts.at(Iband + 1); }
+
+        void exchange_halo( std::vector<double> & field,
+                            const int Nlevels,
+                            const int Nlon,
+                            const int Nhalo ) const;
+
+        void sum_across_bands( std::vector<double> & vals ) const;
+};
+
+/*!
+ * \brief Class to hand out (latitude, longitude-block) filtering tasks to threads, with work stealing
+ *
+ * The tasks are ordered by latitude, and each thread starts with its own contiguous
+ *    share of them, which it works through from the front. A thread that runs out
+ *    steals the back half of the largest remaining share, so that threads mostly stay
+ *    on their own latitudes (and so re-use the same kernel stencil), while expensive
+ *    rows do not leave the other threads idle.
+ */
+class latitude_task_queue {
+
+    public:
+
+        int Nthreads = 1, Ntasks = 0;
+
+        // Task Itask is latitude task_lat[Itask] and longitudes [ task_lon_start[Itask], task_lon_end[Itask] )
+        std::vector<int> task_lat, task_lon_start, task_lon_end;
+
+        // Constructor
+        latitude_task_queue();
+
+        void build( const int Ilat_start,
+                    const int Ilat_end,
+                    const int Nlon,
+                    const int Nthreads_in );
+
+        bool next_task( const int thread_id,
+                        int & Ilat,
+                        int & Ilon_start,
+                        int & Ilon_end );
+
+        double fraction_issued() const { return (Ntasks == 0) ? 1. : (double) Nissued / Ntasks; }
+
+    private:
+
+        // Thread Ithread still owns the tasks [ head[Ithread], tail[Ithread] )
+        std::vector<int> head, tail;
+        std::vector<std::mutex> locks;
+        std::atomic<int> Nissued{0};
+};
+
+/*!
+ * \brief Class to store a pyramid of block-averaged grids, for filtering at large scales
+ *
+ * Grid Igrid merges blocks of block_sizes[Igrid] x block_sizes[Igrid] source cells into one
+ *    coarse cell (grid 0 is the source grid itself, and is not stored). Fields are coarsened
+ *    onto a grid as area-weighted, mask-aware block averages, filtered there, and then
+ *    interpolated back onto the source grid (see apply_filter_via_pyramid).
+ */
+class resolution_pyramid {
+
+    public:
+
+        int Ngrids = 1;
+
+        // Block size and (largest) grid spacing for each grid
+        std::vector<int> block_sizes;
+        std::vector<double> spacings;
+
+        // The coarse grids (dimensions, areas, and masks only). grids[0] is left empty.
+        std::vector<dataset> grids;
+
+        // Constructor
+        resolution_pyramid();
+
+        void build( const dataset & source_data,
+                    const double max_scale );
+
+        int grid_for_scale( const double filter_scale ) const;
+
+        void coarsen_weight( std::vector<filter_real> & coarse_weight,
+                             const std::vector<filter_real> * weight,
+                             const dataset & source_data,
+                             const int Igrid ) const;
+
+        void coarsen( std::vector<filter_real> & coarse_field,
+                      const std::vector<filter_real> & field,
+                      const std::vector<filter_real> * factor,
+                      const std::vector<filter_real> * weight,
+                      const dataset & source_data,
+                      const int Igrid ) const;
+
+        void interpolate_to_source( std::vector<double> & field,
+                                    const std::vector<double> & coarse_field,
+                                    const dataset & source_data,
+                                    const int Igrid,
+                                    const int Ilat_start,
+                                    const int Ilat_end ) const;
+};
+
+/*!
+ * \brief Class to hold the working arrays of the filtering driver, so that they can be re-used between calls
+ *
+ * filtering_streamed passes the same workspace to filtering for every time window, so the
+ *    coarse / fine fields, transfers, and pre-computed filtered values are only allocated for
+ *    the first window. Arrays are handed out zeroed (or empty), but keep their storage.
+ */
+class filtering_workspace {
+
+    public:
+
+        // Working arrays, and sets of working arrays, by name
+        std::map< std::string, std::vector<double> > arrays;
+        std::map< std::string, std::vector< std::vector<double> > > array_sets;
+
+        // Constructor
+        filtering_workspace();
+
+        std::vector<double> & array( const std::string & name,
+                                     const size_t Npts = 0 );
+
+        std::vector< std::vector<double> > & array_set( const std::string & name,
+                                                        const size_t Narrays,
+                                                        const size_t Npts );
+};
+
 void compute_areas(
         std::vector<double> & areas, 
         const std::vector<double> & longitude, 
@@ -224,9 +604,20 @@ void vel_Cart_to_Spher_at_point(
             const double lat 
             );
 
-void filtering(const dataset & source_data,
+class output_writer;  // see netcdf_io.hpp
+
+void filtering(dataset & source_data,
                const std::vector<double> & scales, 
-               const MPI_Comm comm = MPI_COMM_WORLD);
+               const MPI_Comm comm = MPI_COMM_WORLD,
+               output_writer * shared_writer = NULL,
+               filtering_workspace * shared_workspace = NULL);
+
+void filtering_streamed(
+        dataset & source_data,
+        const std::vector<double> & scales,
+        const std::function< void( dataset & data ) > & load_window,
+        const MPI_Comm comm = MPI_COMM_WORLD
+        );
 
 void filtering_helmholtz(
         const dataset & source_data,
@@ -234,6 +625,15 @@ void filtering_helmholtz(
         const MPI_Comm comm = MPI_COMM_WORLD
         );
 
+void segment_water_runs(
+        std::vector<int> & wet_lo,
+        std::vector<int> & wet_hi,
+        const stencil_segment & segment,
+        const size_t level_offset,
+        const std::vector<bool> & mask,
+        const water_runs * water
+        );
+
 void apply_filter_at_point(
         std::vector<double*> & coarse_vals,   
         std::vector<double*> & dl_coarse_vals,
@@ -253,10 +653,116 @@ void apply_filter_at_point(
         const std::vector<double> * weight = NULL
         );
 
+void move_to_filter_storage(
+        std::vector<double> & stored,
+        std::vector<double> & field
+        );
+void move_to_filter_storage(
+        std::vector<float> & stored,
+        std::vector<double> & field
+        );
+
+const std::vector<double> & filter_storage_view(
+        std::vector<double> & copy,
+        const std::vector<double> & field
+        );
+const std::vector<float> & filter_storage_view(
+        std::vector<float> & copy,
+        const std::vector<double> & field
+        );
+
+const std::vector<double> & release_to_filter_storage(
+        std::vector<double> & stored,
+        std::vector<double> & field
+        );
+const std::vector<float> & release_to_filter_storage(
+        std::vector<float> & stored,
+        std::vector<double> & field
+        );
+
+// Used to keep the weight (which is often NULL) out of deducing real_type from the fields
+template <class T> struct non_deduced { typedef T type; };
+
+template <class real_type>
+void apply_filter_at_point_all_levels(
+        std::vector<double> & coarse_vals,
+        std::vector<double> & dl_coarse_vals,
+        std::vector<double> & dll_coarse_vals,
+        std::vector<double> & dl_kernel_vals,
+        std::vector<double> & dll_kernel_vals,
+        const std::vector<const std::vector<real_type>*> & fields,
+        const std::vector<const std::vector<real_type>*> & field_factors,
+        const dataset & source_data,
+        const int Ilat,   const int Ilon,
+        const kernel_stencil & stencil,
+        const typename non_deduced< std::vector<real_type> >::type * weight = NULL,
+        const bool skip_land = false,
+        const water_runs * water = NULL
+        );
+
+template <class real_type>
+void apply_filter_at_point_fused(
+        std::vector<double> & linear_vals,
+        std::vector<double> & quad_vals,
+        std::vector<double> & tilde_vals,
+        const std::vector<real_type> & u_x,
+        const std::vector<real_type> & u_y,
+        const std::vector<real_type> & u_z,
+        const std::vector<real_type> & KE,
+        const typename non_deduced< std::vector<real_type> >::type * vort_r,
+        const typename non_deduced< std::vector<real_type> >::type * rho,
+        const typename non_deduced< std::vector<real_type> >::type * p,
+        const dataset & source_data,
+        const int Ilat,   const int Ilon,
+        const kernel_stencil & stencil,
+        const water_runs * water = NULL
+        );
+
+template <class real_type>
+void apply_filter_at_point_helmholtz_quadratics(
+        std::vector<double> & quad_vals,
+        const std::vector<real_type> & u_x_tor,
+        const std::vector<real_type> & u_y_tor,
+        const std::vector<real_type> & u_z_tor,
+        const std::vector<real_type> & vort_tor,
+        const std::vector<real_type> & u_x_pot,
+        const std::vector<real_type> & u_y_pot,
+        const std::vector<real_type> & u_z_pot,
+        const std::vector<real_type> & vort_pot,
+        const dataset & source_data,
+        const int Ilat,   const int Ilon,
+        const kernel_stencil & stencil,
+        const water_runs * water = NULL
+        );
+
+template <class real_type>
+void apply_filter_at_point_multiscale(
+        std::vector<double> & coarse_vals,
+        const std::vector<const std::vector<real_type>*> & fields,
+        const std::vector<const std::vector<real_type>*> & field_factors,
+        const dataset & source_data,
+        const int Ilat,   const int Ilon,
+        const kernel_stencil & stencil,
+        const typename non_deduced< std::vector<real_type> >::type * weight = NULL,
+        const bool skip_land = false,
+        const water_runs * water = NULL
+        );
+
 double kernel(const double distance, const double scale, const int deriv_order = 0);
 
+void kernel_tabulated(
+        double & kern,
+        double & dl_kern,
+        double & dll_kern,
+        const double dist,
+        const double scale,
+        const int max_deriv_order = 0
+        );
+
 double kernel_alpha(void);
 
+double kernel_pad(void);
+
 void compute_vorticity_at_point(
         double & vort_r_tmp, 
         double & vort_lon_tmp, 
@@ -301,6 +807,86 @@ void apply_filter_at_point_for_quadratics(
         const double scale,
         const std::vector<double> & local_kernel);
 
+void fft_in_longitude(
+        std::vector< std::complex<double> > & data,
+        std::vector< std::complex<double> > & work,
+        const std::vector< std::complex<double> > & twiddles,
+        const bool inverse = false
+        );
+
+void apply_filter_via_lon_fft(
+        std::vector< std::vector<double>* > & coarse_fields,
+        std::vector< std::vector<double>* > & dl_coarse_fields,
+        std::vector< std::vector<double>* > & dll_coarse_fields,
+        std::vector<double> * dl_kernel_vals,
+        std::vector<double> * dll_kernel_vals,
+        const std::vector<const std::vector<filter_real>*> & fields,
+        const std::vector<const std::vector<filter_real>*> & field_factors,
+        const dataset & source_data,
+        const double scale,
+        const int Ilat_start,
+        const int Ilat_end,
+        const std::vector<filter_real> * weight = NULL
+        );
+
+void apply_filter_separable(
+        std::vector< std::vector<double>* > & coarse_fields,
+        const std::vector<const std::vector<filter_real>*> & fields,
+        const std::vector<const std::vector<filter_real>*> & field_factors,
+        const dataset & source_data,
+        const double scale,
+        const int Ilat_start,
+        const int Ilat_end,
+        const std::vector<filter_real> * weight = NULL
+        );
+
+void apply_filter_tophat(
+        std::vector< std::vector<double>* > & coarse_fields,
+        const std::vector<const std::vector<filter_real>*> & fields,
+        const std::vector<const std::vector<filter_real>*> & field_factors,
+        const dataset & source_data,
+        const double scale,
+        const int Ilat_start,
+        const int Ilat_end,
+        const std::vector<filter_real> * weight = NULL
+        );
+
+void apply_filter_iir(
+        std::vector< std::vector<double>* > & coarse_fields,
+        const std::vector<const std::vector<filter_real>*> & fields,
+        const std::vector<const std::vector<filter_real>*> & field_factors,
+        const dataset & source_data,
+        const double scale,
+        const int Ilat_start,
+        const int Ilat_end,
+        const std::vector<filter_real> * weight = NULL
+        );
+
+void apply_filter_via_pyramid(
+        std::vector< std::vector<double>* > & coarse_fields,
+        const std::vector<const std::vector<filter_real>*> & fields,
+        const std::vector<const std::vector<filter_real>*> & field_factors,
+        const dataset & source_data,
+        const resolution_pyramid & pyramid,
+        const int Igrid,
+        const double scale,
+        const int Ilat_start,
+        const int Ilat_end,
+        const std::vector<filter_real> * weight = NULL
+        );
+
+double pyramid_filter_error(
+        const std::vector< std::vector<double>* > & coarse_fields,
+        const std::vector<const std::vector<filter_real>*> & fields,
+        const dataset & source_data,
+        const double scale,
+        const int Ilat_start,
+        const int Ilat_end,
+        const int Nsamples,
+        const water_runs * water = NULL,
+        const MPI_Comm comm = MPI_COMM_WORLD
+        );
+
 void compute_Pi(
         std::vector<double> & energy_transfer,
         const dataset & source_data,
@@ -472,13 +1058,33 @@ void get_lon_bounds(
         const int Ilon,
         const double centre_lat,
         const double curr_lat,
-        const double scale);
+        const double scale,
+        const double Llat = 0.);
 
 void print_compile_info(
         const std::vector<double> * scales = NULL);
 
 int get_omp_chunksize(const int Nlat, const int Nlon);
 
+void partition_by_cost(
+        std::vector<int> & split_starts,
+        const std::vector<double> & costs,
+        const int Nchunks
+        );
+
+void get_decimation_strides(
+        int & lat_stride,
+        int & lon_stride,
+        const dataset & source_data,
+        const double filter_scale
+        );
+
+void print_load_imbalance(
+        const double local_work,
+        const char * label,
+        const MPI_Comm comm = MPI_COMM_WORLD
+        );
+
 
 void convert_coordinates(
         std::vector<double> & longitude,
@@ -7,6 +7,11 @@
 #include <string>
 #include <mpi.h>
 #include <math.h>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #include "netcdf.h"
 #include "netcdf_par.h"
@@ -194,6 +199,87 @@ void write_field_to_output(
         MPI_Comm = MPI_COMM_WORLD
         );
 
+/*!
+ * \brief Class to write output fields in the background, so that computation can continue while writing.
+ *
+ *  Every netcdf operation on the output files (creating, adding attributes, writing fields)
+ *    goes through the same queue and is run in order by a single IO thread, since netcdf
+ *    itself is not thread-safe. Fields are copied when they are queued, so the caller is
+ *    free to overwrite them right away. The total size of the queued fields is bounded by
+ *    constants::ASYNC_OUTPUT_MAX_GB.
+ *
+ *  The IO thread uses its own (duplicated) communicator, so that its collective calls
+ *    do not interfere with those on the compute thread. Every processor must queue the
+ *    same operations in the same order.
+ *
+ *  If there is no IO thread (by default, if constants::ASYNC_OUTPUT is false), then every
+ *    operation is run immediately (on the calling thread).
+ *
+ *  Other operations (e.g. prefetching the next window of inputs, see filtering_streamed)
+ *    can be queued with enqueue(), so that they also run in order with the output.
+ *
+ *  Call flush() before any other netcdf access (e.g. post-processing), since the
+ *    queued operations may still be running.
+ *
+ *  If each processor only has valid values in a band of latitudes (see latitude_bands),
+ *    then set_latitude_band restricts the (four-dimensional) writes to those rows.
+ *
+ */
+class output_writer {
+
+    public:
+
+        // Constructor / destructor
+        output_writer( const MPI_Comm comm_in = MPI_COMM_WORLD, const bool use_io_thread = constants::ASYNC_OUTPUT );
+        ~output_writer();
+
+        void initialize_file(   const dataset & source_data,
+                                const std::vector<std::string> & vars,
+                                const char * filename,
+                                const double filter_scale = -1 );
+
+        void add_attr(  const char * varname,
+                        const double value,
+                        const char * filename );
+
+        void write( const std::vector<double> & field,
+                    const std::string & field_name,
+                    const size_t * start,
+                    const size_t * count,
+                    const std::string & filename,
+                    const std::vector<bool> * mask = NULL,
+                    const int ndims = 4 );
+
+        void set_latitude_band( const int first_row,
+                                const int end_row,
+                                const int Nlat );
+
+        void enqueue( std::function<void()> task );
+
+        void flush();
+
+    private:
+
+        // Rows [ band_start, band_end ) out of band_Nlat are written (all rows if band_Nlat < 0)
+        int band_start = 0, band_end = 0, band_Nlat = -1;
+
+        MPI_Comm comm, io_comm;
+
+        std::thread io_thread;
+        std::mutex queue_mutex;
+        std::condition_variable queue_cv;
+
+        // Queued operations and the number of bytes of field data that each holds
+        std::deque< std::function<void()> > tasks;
+        std::deque< size_t > task_bytes;
+        size_t queued_bytes = 0;
+
+        bool use_thread = false, is_busy = false, stop_requested = false;
+
+        void submit( std::function<void()> task, const size_t Nbytes );
+        void io_loop();
+};
+
 
 void write_integral_to_post(
         const std::vector<
@@ -238,7 +324,11 @@ void read_var_from_file(
         const bool do_splits = true,
         const int force_split_dim = -1,
         const double land_fill_value = 0.,
-        const MPI_Comm = MPI_COMM_WORLD 
+        const MPI_Comm = MPI_COMM_WORLD,
+        const std::vector<int> * time_split_starts = NULL,
+        const std::vector<int> * depth_split_starts = NULL,
+        const int Itime_window = 0,
+        const int Ntime_windows = 1
         );
 
 void read_mask_from_file(
@@ -250,7 +340,11 @@ void read_mask_from_file(
         const bool do_splits = true,
         const int force_split_dim = -1,
         const double land_fill_value = 0.,
-        const MPI_Comm = MPI_COMM_WORLD 
+        const MPI_Comm = MPI_COMM_WORLD,
+        const std::vector<int> * time_split_starts = NULL,
+        const std::vector<int> * depth_split_starts = NULL,
+        const int Itime_window = 0,
+        const int Ntime_windows = 1
         );
 
 
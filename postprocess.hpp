@@ -15,7 +15,8 @@ void Apply_Postprocess_Routines(
         const double filter_scale,
         Timing_Records & timing_records,
         const std::string filename_base = "postprocess",
-        const MPI_Comm comm = MPI_COMM_WORLD
+        const MPI_Comm comm = MPI_COMM_WORLD,
+        const latitude_bands * bands = NULL
         );
 
 void write_regions(
@@ -47,14 +48,16 @@ void compute_region_avg_and_std(
         std::vector< std::vector< double > > & field_std_devs,
         const dataset & source_data,
         const std::vector<const std::vector<double>*> & postprocess_fields,
-        const MPI_Comm comm = MPI_COMM_WORLD
+        const MPI_Comm comm = MPI_COMM_WORLD,
+        const latitude_bands * bands = NULL
         );
 
 void compute_coarsened_map(
         std::vector< std::vector< double > > & coarsened_maps,
         const dataset & source_data,
         const std::vector<const std::vector<double>*> & postprocess_fields,
-        const MPI_Comm comm = MPI_COMM_WORLD
+        const MPI_Comm comm = MPI_COMM_WORLD,
+        const latitude_bands * bands = NULL
         );
 
 void compute_zonal_avg_and_std(
@@ -62,14 +65,16 @@ void compute_zonal_avg_and_std(
         std::vector< std::vector< double > > & zonal_std_devs,
         const dataset & source_data,
         const std::vector<const std::vector<double>*> & postprocess_fields,
-        const MPI_Comm comm = MPI_COMM_WORLD
+        const MPI_Comm comm = MPI_COMM_WORLD,
+        const latitude_bands * bands = NULL
         );
 
 void compute_zonal_median(
         std::vector<std::vector<double>> & zonal_median,
         const dataset & source_data,
         const std::vector<const std::vector<double>*> & postprocess_fields,
-        const MPI_Comm comm = MPI_COMM_WORLD
+        const MPI_Comm comm = MPI_COMM_WORLD,
+        const latitude_bands * bands = NULL
         );
 
 void compute_region_avg_and_std_OkuboWeiss(
@@ -81,7 +86,8 @@ void compute_region_avg_and_std_OkuboWeiss(
         const std::vector<double> & OkuboWeiss,
         const std::vector<double> & OkuboWeiss_bounds,
         const int NOkubo,
-        const MPI_Comm comm = MPI_COMM_WORLD
+        const MPI_Comm comm = MPI_COMM_WORLD,
+        const latitude_bands * bands = NULL
         );
 
 void compute_time_avg_std(
@@ -91,7 +97,8 @@ void compute_time_avg_std(
         const std::vector<const std::vector<double>*> & postprocess_fields,
         const std::vector<int> & mask_count,
         const std::vector<bool> & always_masked,
-        const int full_Ntime
+        const int full_Ntime,
+        const latitude_bands * bands = NULL
         );
 
 void write_region_avg_and_std(
@@ -4,8 +4,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "ALGLIB/linalg.h"
+#include "ALGLIB/solvers.h"
 #include <mpi.h>
 #include <vector>
+#include <functional>
+#include "constants.hpp"
 
 /*!
  * \file
@@ -137,6 +140,7 @@ void Apply_Helmholtz_Projection(
         const bool weight_err,
         const bool use_mask,
         const double Tikhov_Laplace,
+        const std::string time_seed = "none",
         const MPI_Comm comm = MPI_COMM_WORLD
         );
 
@@ -280,6 +284,117 @@ void sparse_vel_from_PsiPhi(
         const bool area_weight
         );
 
+/*!
+ * \brief Class for a sparse matrix in compressed row storage, with threaded matrix-vector products
+ * @ingroup ToroidalProjection
+ *
+ * Row Irow holds the entries values[ row_start[Irow] ... row_start[Irow+1] - 1 ],
+ *    in the columns col_index[ row_start[Irow] ... row_start[Irow+1] - 1 ].
+ *
+ * Matrices built with assemble are sorted by column within each row, with no repeated columns.
+ */
+class crs_matrix {
+
+    public:
+
+        int Nrows = 0, Ncols = 0;
+
+        std::vector<size_t> row_start;
+        std::vector<int> col_index;
+        std::vector<double> values;
+
+        // Constructor
+        crs_matrix();
+
+        void build( const alglib::sparsematrix & matr );
+
+        void assemble( const int Nrows_in,
+                       const int Ncols_in,
+                       const int Nblocks,
+                       const std::function< void( std::vector<int> & rows,
+                                                  std::vector<int> & cols,
+                                                  std::vector<double> & vals,
+                                                  const int Iblock ) > & block_entries );
+
+        void to_alglib( alglib::sparsematrix & matr ) const;
+
+        void transpose( crs_matrix & transposed ) const;
+
+        void multiply( std::vector<double> & y, const std::vector<double> & x ) const;
+
+        size_t Nnonzero() const { return values.size(); }
+};
+
+void sparse_vel_from_PsiPhi_vortdiv(
+        crs_matrix & LHS_matr,
+        const dataset & source_data,
+        const int Itime,
+        const int Idepth,
+        const std::vector<bool> & mask,
+        const bool weight_err,
+        const double Tikhov_Laplace,
+        const double deriv_scale_factor,
+        const int wRank
+        );
+
+/*!
+ * \brief Class to solve sparse least-squares problems, with either ALGLIB or a native (OpenMP) LSQR
+ * @ingroup ToroidalProjection
+ *
+ * The ALGLIB backend calls alglib::linlsqrsolvesparse (single-threaded). The native backend
+ *    runs the same LSQR iteration (same column-norm preconditioning, stopping criteria, and 
+ *    termination codes) on a crs_matrix copy of the matrix and its transpose, with threaded
+ *    matrix-vector products and vector updates.
+ *
+ * Termination codes (terminationtype) follow ALGLIB:
+ *    1 ||Rk|| <= EpsB*||B||,  4 ||A^T*Rk|| / (||A||*||Rk||) <= EpsA,  5 MaxIts steps were taken,
+ *    7 rounding errors prevent further progress.
+ */
+class least_squares_solver {
+
+    public:
+
+        bool use_native = false;
+        int Nrows = 0, Ncols = 0, terminationtype = 0, iterationscount = 0;
+
+        // Constructor
+        least_squares_solver();
+
+        void build( const alglib::sparsematrix & LHS_matr,
+                    const double epsa,
+                    const double epsb,
+                    const int max_iters,
+                    const bool native = constants::NATIVE_LSQR_SOLVER );
+
+        void build( const crs_matrix & LHS_matr,
+                    const double epsa,
+                    const double epsb,
+                    const int max_iters,
+                    const bool native = constants::NATIVE_LSQR_SOLVER );
+
+        void set_tolerances( const double epsa, const double epsb );
+
+        void solve( std::vector<double> & solution,
+                    const std::vector<double> & rhs );
+
+    private:
+
+        int maxits = 0;
+
+        // ALGLIB backend
+        const alglib::sparsematrix * alglib_matr = NULL;
+        alglib::linlsqrstate state;
+        alglib::linlsqrreport report;
+        alglib::sparsematrix alglib_copy;
+
+        // Native backend
+        crs_matrix A, A_transpose;
+        std::vector<double> column_scale;
+        double Anorm = 0., eps_a = 0., eps_b = 0.;
+
+        void prepare_native( const double epsa, const double epsb, const int max_iters );
+};
+
 
 /*!
  * \brief This is just a helper to compute Lap(F). It's provided as an output for diagnostic purposes.